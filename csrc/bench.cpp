@@ -0,0 +1,527 @@
+// shmem_bench: one-way latency and throughput of SMQueue across message sizes, queue depths, producer and
+// consumer counts, synchronization modes, wait strategies and thread pinning. Every case prints one machine-readable
+// row (CSV or JSON lines) so results can be compared across releases.
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "futex.h"
+#include "histogram.h"
+#include "shmem.h"
+
+namespace {
+
+const std::string kQueueName = "/shmem_bench";
+
+struct Config {
+    std::vector<std::size_t> sizes = {8, 64, 512, 4 << 10, 32 << 10, 256 << 10, 2 << 20, 16 << 20, 64 << 20};
+    std::vector<std::size_t> depths = {8, 256};
+    std::vector<std::string> modes = {"locked", "spsc", "mpmc"};
+    std::vector<std::string> waits = {"adaptive"};
+    std::vector<std::size_t> producers = {1};
+    std::vector<std::size_t> consumers = {1};
+    std::vector<std::string> pinnings;                  // Default: list if CPUs were given, else none
+    std::vector<int> cpus;                              // CPUs of the list pinning, round-robin, producers first
+    std::uint64_t messages = 100000;                    // Messages per case, before the byte budget applies
+    std::uint64_t case_bytes = std::uint64_t(4) << 30;  // Payload bytes moved per case at most
+    std::size_t max_queue_bytes = std::size_t(1) << 30; // Cases whose ring would be larger are skipped
+    std::uint64_t rate = 0;                             // Messages per second per producer; 0 pushes flat out
+    shmem::CopyPolicy copy = shmem::CopyPolicy::Memcpy;
+    bool json = false;
+};
+
+struct Case {
+    std::string mode;
+    std::string wait;
+    std::string pinning;
+    std::size_t size;
+    std::size_t depth;
+    std::size_t producers;
+    std::size_t consumers;
+};
+
+struct Result {
+    std::uint64_t messages = 0; // Sent, over all producers
+    std::uint64_t received = 0; // Over all consumers (each Broadcast reader receives every message)
+    std::uint64_t retries = 0;  // Pushes refused by a full queue
+    std::uint64_t overruns = 0; // Messages Broadcast readers missed
+    double seconds = 0;
+    shmem::LatencyStats latency;
+};
+
+void usage() {
+    std::cerr << "Usage: shmem_bench [options]\n"
+                 "  --sizes LIST        Message sizes, e.g. 8,4K,64M (default 8B to 64MB in steps of 8x)\n"
+                 "  --depths LIST       Queue depths (max_elements) (default 8,256)\n"
+                 "  --modes LIST        locked (semaphores), or lock-free spsc, mpmc, broadcast\n"
+                 "                      (default locked,spsc,mpmc)\n"
+                 "  --waits LIST        How consumers wait: adaptive (spin, yield, then park), spin (never park),\n"
+                 "                      futex (park at once) (default adaptive)\n"
+                 "  --producers LIST    Producer thread counts (default 1; spsc and broadcast always use 1)\n"
+                 "  --consumers LIST    Consumer thread counts (default 1; spsc always uses 1)\n"
+                 "  --pinning LIST      none (threads float), or list (pinned round-robin to the --pin CPUs,\n"
+                 "                      producers first) (default list if --pin is given, else none)\n"
+                 "  --pin LIST          CPUs of the list pinning\n"
+                 "  --messages N        Messages per case (default 100000)\n"
+                 "  --case-bytes N      Payload bytes per case at most; large sizes send fewer messages (default 4G)\n"
+                 "  --max-queue-bytes N Skip cases whose ring is larger (default 1G)\n"
+                 "  --rate N            Messages per second per producer; 0 pushes flat out (default 0)\n"
+                 "  --copy POLICY       memcpy, streaming or parallel (default memcpy)\n"
+                 "  --format FORMAT     csv or json (one object per line) (default csv)\n";
+}
+
+// Parse a byte count with an optional K, M or G suffix
+std::uint64_t parse_bytes(const std::string& text) {
+    char* end = nullptr;
+    std::uint64_t value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        throw std::runtime_error("Invalid number: " + text);
+    }
+    switch (*end) {
+    case 'K':
+    case 'k':
+        value <<= 10;
+        break;
+    case 'M':
+    case 'm':
+        value <<= 20;
+        break;
+    case 'G':
+    case 'g':
+        value <<= 30;
+        break;
+    case '\0':
+        break;
+    default:
+        throw std::runtime_error("Invalid number: " + text);
+    }
+    return value;
+}
+
+std::vector<std::string> split(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::vector<std::size_t> parse_sizes(const std::string& text) {
+    std::vector<std::size_t> values;
+    for (const std::string& item : split(text)) {
+        values.push_back(static_cast<std::size_t>(parse_bytes(item)));
+    }
+    return values;
+}
+
+// Check a pinning name; list needs the CPUs to pin to
+void check_pinning(const Config& config, const std::string& pinning) {
+    if (pinning == "list" and config.cpus.empty()) {
+        throw std::runtime_error("The list pinning needs CPUs: pass --pin");
+    }
+    if (pinning != "list" and pinning != "none") {
+        throw std::runtime_error("Unknown pinning: " + pinning);
+    }
+}
+
+Config parse_args(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--help" or arg == "-h") {
+            usage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + arg);
+        }
+        const std::string value = argv[++i];
+        if (arg == "--sizes") {
+            config.sizes = parse_sizes(value);
+        } else if (arg == "--depths") {
+            config.depths = parse_sizes(value);
+        } else if (arg == "--modes") {
+            config.modes = split(value);
+        } else if (arg == "--waits") {
+            config.waits = split(value);
+        } else if (arg == "--producers") {
+            config.producers = parse_sizes(value);
+        } else if (arg == "--consumers") {
+            config.consumers = parse_sizes(value);
+        } else if (arg == "--pinning") {
+            config.pinnings = split(value);
+        } else if (arg == "--pin") {
+            for (const std::string& cpu : split(value)) {
+                config.cpus.push_back(std::stoi(cpu));
+            }
+        } else if (arg == "--messages") {
+            config.messages = parse_bytes(value);
+        } else if (arg == "--case-bytes") {
+            config.case_bytes = parse_bytes(value);
+        } else if (arg == "--max-queue-bytes") {
+            config.max_queue_bytes = static_cast<std::size_t>(parse_bytes(value));
+        } else if (arg == "--rate") {
+            config.rate = parse_bytes(value);
+        } else if (arg == "--copy") {
+            if (value == "memcpy") {
+                config.copy = shmem::CopyPolicy::Memcpy;
+            } else if (value == "streaming") {
+                config.copy = shmem::CopyPolicy::Streaming;
+            } else if (value == "parallel") {
+                config.copy = shmem::CopyPolicy::Parallel;
+            } else {
+                throw std::runtime_error("Unknown copy policy: " + value);
+            }
+        } else if (arg == "--format") {
+            if (value != "csv" and value != "json") {
+                throw std::runtime_error("Unknown format: " + value);
+            }
+            config.json = value == "json";
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+    if (config.pinnings.empty()) {
+        config.pinnings = {config.cpus.empty() ? "none" : "list"};
+    }
+    for (const std::string& pinning : config.pinnings) {
+        check_pinning(config, pinning);
+    }
+    return config;
+}
+
+shmem::QueueMode parse_mode(const std::string& mode) {
+    if (mode == "locked") {
+        return shmem::QueueMode::Locked;
+    }
+    if (mode == "spsc") {
+        return shmem::QueueMode::SPSC;
+    }
+    if (mode == "mpmc") {
+        return shmem::QueueMode::MPMC;
+    }
+    if (mode == "broadcast") {
+        return shmem::QueueMode::Broadcast;
+    }
+    throw std::runtime_error("Unknown mode: " + mode);
+}
+
+shmem::WaitStrategy parse_wait(const std::string& wait) {
+    shmem::WaitStrategy strategy;
+    if (wait == "spin") {
+        strategy.spin_iterations = 1u << 31;
+        strategy.yield_iterations = 0;
+    } else if (wait == "futex") {
+        strategy.spin_iterations = 0;
+        strategy.yield_iterations = 0;
+    } else if (wait != "adaptive") {
+        throw std::runtime_error("Unknown wait strategy: " + wait);
+    }
+    return strategy;
+}
+
+// Pin the calling thread to the index-th CPU of the list, if any
+void pin_thread(const std::vector<int>& cpus, std::size_t index) {
+    if (cpus.empty()) {
+        return;
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[index % cpus.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)index;
+#endif
+}
+
+Result run_case(const Config& config, const Case& c) {
+    const shmem::QueueMode mode = parse_mode(c.mode);
+    const bool broadcast = mode == shmem::QueueMode::Broadcast;
+
+    shmem::QueueOptions options;
+    options.mode = mode;
+    options.overflow = shmem::OverflowPolicy::DropNewest; // A full queue pushes back instead of losing messages
+    options.max_readers = c.consumers;
+
+    shmem::CopyStrategy copy;
+    copy.policy = config.copy;
+    const std::vector<int> cpus = c.pinning == "list" ? config.cpus : std::vector<int>();
+
+    // Large messages send fewer of them so every case finishes in reasonable time
+    const std::uint64_t budget = std::max<std::uint64_t>(16, config.case_bytes / c.size);
+    const std::uint64_t per_producer = std::max<std::uint64_t>(1, std::min(config.messages, budget) / c.producers);
+
+    shmem::SMQueue::destroy(kQueueName);
+    shmem::SMQueue writer = shmem::SMQueue::create(kQueueName, c.depth, c.size, options);
+
+    // Every thread gets its own handle; Broadcast readers must be registered before the writer starts
+    std::vector<shmem::SMQueue> producer_queues;
+    std::vector<shmem::SMQueue> consumer_queues;
+    for (std::size_t i = 0; i < c.consumers; ++i) {
+        consumer_queues.push_back(shmem::SMQueue::open(kQueueName));
+        consumer_queues.back().set_wait_strategy(parse_wait(c.wait));
+        consumer_queues.back().set_copy_strategy(copy);
+    }
+    producer_queues.push_back(std::move(writer));
+    for (std::size_t i = 1; i < c.producers; ++i) {
+        producer_queues.push_back(shmem::SMQueue::open(kQueueName));
+    }
+    for (auto& queue : producer_queues) {
+        queue.set_copy_strategy(copy);
+    }
+
+    Result result;
+    result.messages = per_producer * c.producers;
+
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<std::size_t> producers_left{c.producers};
+    std::atomic<std::uint64_t> remaining{result.messages}; // Messages not yet received (not Broadcast)
+    std::atomic<std::uint64_t> retries{0};
+    std::atomic<std::uint64_t> last_receive_ns{0};
+
+    auto histogram = std::make_unique<shmem::detail::LatencyHistogram>();
+    shmem::detail::reset_latency(*histogram);
+
+    auto wait_for_start = [&] {
+        ready.fetch_add(1);
+        while (!go.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t p = 0; p < c.producers; ++p) {
+        threads.emplace_back([&, p] {
+            pin_thread(cpus, p);
+            shmem::SMQueue& queue = producer_queues[p];
+            std::vector<std::byte> message(c.size, std::byte(p));
+            const auto interval = config.rate != 0 ? std::chrono::nanoseconds(1000000000 / config.rate)
+                                                   : std::chrono::nanoseconds::zero();
+            std::uint64_t refused = 0;
+
+            wait_for_start();
+            auto next = std::chrono::steady_clock::now();
+            for (std::uint64_t i = 0; i < per_producer; ++i) {
+                if (config.rate != 0) {
+                    while (std::chrono::steady_clock::now() < next) {
+                        shmem::detail::cpu_relax();
+                    }
+                    next += interval;
+                }
+
+                // The send time travels in the first 8 bytes of the message
+                const std::uint64_t now = shmem::detail::now_ns();
+                std::memcpy(message.data(), &now, sizeof(now));
+                while (!queue.push(message.data())) {
+                    refused++;
+                    std::this_thread::yield();
+                }
+            }
+            retries.fetch_add(refused);
+            producers_left.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    std::vector<std::unique_ptr<shmem::detail::LatencyHistogram>> histograms(c.consumers);
+    std::vector<std::uint64_t> received(c.consumers, 0);
+    for (std::size_t k = 0; k < c.consumers; ++k) {
+        histograms[k] = std::make_unique<shmem::detail::LatencyHistogram>();
+        shmem::detail::reset_latency(*histograms[k]);
+        threads.emplace_back([&, k] {
+            pin_thread(cpus, c.producers + k);
+            shmem::SMQueue& queue = consumer_queues[k];
+            std::vector<std::byte> buffer(c.size);
+            std::uint64_t count = 0;
+            std::uint64_t last = 0;
+
+            wait_for_start();
+            for (;;) {
+                if (queue.pop_for(buffer.data(), std::chrono::milliseconds(10))) {
+                    last = shmem::detail::now_ns();
+                    std::uint64_t sent;
+                    std::memcpy(&sent, buffer.data(), sizeof(sent));
+                    shmem::detail::record_latency(*histograms[k], last > sent ? last - sent : 0);
+                    count++;
+                    if (!broadcast and remaining.fetch_sub(1) == 1) {
+                        break;
+                    }
+                    continue;
+                }
+
+                // Broadcast readers cannot tell missed messages from late ones: stop once the writer is done
+                const bool finished = broadcast ? producers_left.load(std::memory_order_acquire) == 0
+                                                : remaining.load() == 0;
+                if (finished) {
+                    break;
+                }
+            }
+
+            received[k] = count;
+            std::uint64_t seen = last_receive_ns.load();
+            while (last > seen and !last_receive_ns.compare_exchange_weak(seen, last)) {
+            }
+        });
+    }
+
+    while (ready.load() != threads.size()) {
+        std::this_thread::yield();
+    }
+    const std::uint64_t start = shmem::detail::now_ns();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (std::size_t k = 0; k < c.consumers; ++k) {
+        shmem::detail::merge_latency(*histogram, *histograms[k]);
+        result.received += received[k];
+        result.overruns += consumer_queues[k].overruns();
+    }
+    result.retries = retries.load();
+    result.seconds = static_cast<double>(last_receive_ns.load() - std::min(start, last_receive_ns.load())) / 1e9;
+    result.latency = shmem::detail::summarize_latency(*histogram);
+
+    consumer_queues.clear();
+    producer_queues.clear();
+    shmem::SMQueue::destroy(kQueueName);
+    return result;
+}
+
+const char* copy_name(shmem::CopyPolicy policy) {
+    switch (policy) {
+    case shmem::CopyPolicy::Streaming:
+        return "streaming";
+    case shmem::CopyPolicy::Parallel:
+        return "parallel";
+    default:
+        return "memcpy";
+    }
+}
+
+struct Field {
+    const char* name;
+    std::string value;
+    bool quoted; // Strings are quoted in JSON
+};
+
+// Print one row; CSV output starts with a header row
+void print_result(const Config& config, const Case& c, const Result& r, bool first) {
+    const double rate = r.seconds > 0 ? static_cast<double>(r.messages) / r.seconds : 0;
+    const double bandwidth = rate * static_cast<double>(c.size) / double(1 << 20);
+    const Field fields[] = {
+        {"mode", c.mode, true},
+        {"wait", c.wait, true},
+        {"size", std::to_string(c.size), false},
+        {"depth", std::to_string(c.depth), false},
+        {"producers", std::to_string(c.producers), false},
+        {"consumers", std::to_string(c.consumers), false},
+        {"pinning", c.pinning, true},
+        {"copy", copy_name(config.copy), true},
+        {"messages", std::to_string(r.messages), false},
+        {"received", std::to_string(r.received), false},
+        {"retries", std::to_string(r.retries), false},
+        {"overruns", std::to_string(r.overruns), false},
+        {"seconds", std::to_string(r.seconds), false},
+        {"msgs_per_sec", std::to_string(rate), false},
+        {"mib_per_sec", std::to_string(bandwidth), false},
+        {"p50_ns", std::to_string(r.latency.p50_ns), false},
+        {"p90_ns", std::to_string(r.latency.p90_ns), false},
+        {"p99_ns", std::to_string(r.latency.p99_ns), false},
+        {"p999_ns", std::to_string(r.latency.p999_ns), false},
+        {"max_ns", std::to_string(r.latency.max_ns), false},
+        {"mean_ns", std::to_string(r.latency.mean_ns), false},
+    };
+
+    if (config.json) {
+        std::cout << "{";
+        for (const Field& field : fields) {
+            const char* quote = field.quoted ? "\"" : "";
+            std::cout << (&field != fields ? ", " : "") << "\"" << field.name << "\": " << quote << field.value
+                      << quote;
+        }
+        std::cout << "}" << std::endl;
+        return;
+    }
+
+    if (first) {
+        for (const Field& field : fields) {
+            std::cout << (&field != fields ? "," : "") << field.name;
+        }
+        std::cout << std::endl;
+    }
+    for (const Field& field : fields) {
+        std::cout << (&field != fields ? "," : "") << field.value;
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        const Config config = parse_args(argc, argv);
+        bool first = true;
+
+        for (const std::string& mode : config.modes) {
+            const shmem::QueueMode queue_mode = parse_mode(mode);
+            for (const std::string& wait : config.waits) {
+                parse_wait(wait);
+                for (std::size_t size : config.sizes) {
+                    for (std::size_t depth : config.depths) {
+                        if (size < sizeof(std::uint64_t) or depth == 0) {
+                            std::cerr << "Skipping size " << size << ", depth " << depth
+                                      << ": messages carry an 8-byte timestamp" << std::endl;
+                            continue;
+                        }
+                        if (depth > config.max_queue_bytes / size) {
+                            std::cerr << "Skipping " << mode << " size " << size << ", depth " << depth
+                                      << ": ring exceeds --max-queue-bytes" << std::endl;
+                            continue;
+                        }
+                        for (std::size_t producers : config.producers) {
+                            for (std::size_t consumers : config.consumers) {
+                                // SPSC has one of each side, Broadcast a single writer
+                                const bool single_producer =
+                                    queue_mode == shmem::QueueMode::SPSC or queue_mode == shmem::QueueMode::Broadcast;
+                                if ((single_producer and producers != 1) or
+                                    (queue_mode == shmem::QueueMode::SPSC and consumers != 1) or producers == 0 or
+                                    consumers == 0) {
+                                    continue;
+                                }
+                                for (const std::string& pinning : config.pinnings) {
+                                    const Case c{mode, wait, pinning, size, depth, producers, consumers};
+                                    print_result(config, c, run_case(config, c), first);
+                                    first = false;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        shmem::SMQueue::destroy(kQueueName);
+        return 1;
+    }
+}
@@ -1,11 +1,23 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
 #include <nanobind/nanobind.h>
 #include <nanobind/ndarray.h>
 #include <nanobind/stl/optional.h>
+#include <nanobind/stl/pair.h>
 #include <nanobind/stl/string.h>
 #include <nanobind/stl/vector.h>
 
+#include "copy.h"
+#include "mailbox.h"
+#include "queue_set.h"
 #include "shmem.h"
 
 namespace nb = nanobind;
@@ -16,44 +28,479 @@ inline double get_time_ms() {
     return duration_cast<microseconds>(high_resolution_clock::now().time_since_epoch()).count() / 1000.0;
 }
 
+// Timeout in seconds, as Python APIs take it
+inline std::chrono::nanoseconds to_timeout(double seconds) {
+    if (!(seconds < 1e9)) {
+        return std::chrono::nanoseconds::max();
+    }
+    return std::chrono::nanoseconds(static_cast<std::int64_t>(std::max(seconds, 0.0) * 1e9));
+}
+
+// Reusable page-aligned message buffers for pop_pooled(). Every buffer starts with a header pointing back
+// at its pool, so the capsule owning a popped array can return the buffer to the freelist without any
+// per-message allocation. Pools are shared by all queues with the same element size and live until exit.
+class BufferPool {
+  public:
+    static constexpr std::size_t kAlignment = 4096;
+    static constexpr std::size_t kMaxFree = 16; // Buffers kept for reuse; any beyond this are freed
+
+    // Pool for buffers of size bytes
+    static BufferPool& for_size(std::size_t size) {
+        static std::mutex mutex;
+        static auto* pools = new std::unordered_map<std::size_t, BufferPool*>(); // Never freed: see above
+        std::lock_guard<std::mutex> lock(mutex);
+        BufferPool*& pool = (*pools)[size];
+        if (pool == nullptr) {
+            pool = new BufferPool(size);
+        }
+        return *pool;
+    }
+
+    // Take a buffer from the freelist, or allocate one. Returns the buffer's base; its data starts at
+    // data(base).
+    void* acquire() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_free.empty()) {
+                void* base = m_free.back();
+                m_free.pop_back();
+                return base;
+            }
+        }
+        void* base = std::aligned_alloc(kAlignment, kAlignment + (m_size + kAlignment - 1) / kAlignment * kAlignment);
+        if (base == nullptr) {
+            throw std::bad_alloc();
+        }
+        *static_cast<BufferPool**>(base) = this;
+        return base;
+    }
+
+    // Give a buffer back to the pool it came from
+    static void release(void* base) noexcept {
+        BufferPool* pool = *static_cast<BufferPool**>(base);
+        {
+            std::lock_guard<std::mutex> lock(pool->m_mutex);
+            if (pool->m_free.size() < kMaxFree) {
+                pool->m_free.push_back(base);
+                return;
+            }
+        }
+        std::free(base);
+    }
+
+    static uint8_t* data(void* base) { return static_cast<uint8_t*>(base) + kAlignment; }
+
+  private:
+    explicit BufferPool(std::size_t size) : m_size(size) {}
+
+    std::size_t m_size;
+    std::mutex m_mutex;
+    std::vector<void*> m_free;
+};
+
+// Describe a numpy array layout as a MessageType. strides are in bytes, as numpy reports them.
+inline void set_message_type(shmem::QueueOptions& options, nb::handle dtype, const std::vector<int64_t>& shape,
+                             const std::optional<std::vector<int64_t>>& strides) {
+    nb::object dt = nb::module_::import_("numpy").attr("dtype")(dtype);
+    const auto kind = nb::cast<std::string>(dt.attr("kind"));
+    const auto itemsize = nb::cast<int64_t>(dt.attr("itemsize"));
+    if (!nb::cast<bool>(dt.attr("isnative"))) {
+        throw std::runtime_error("Message dtypes must use native byte order");
+    }
+
+    shmem::MessageType type;
+    if (kind == "i") {
+        type.code = shmem::DTypeCode::Int;
+    } else if (kind == "u") {
+        type.code = shmem::DTypeCode::UInt;
+    } else if (kind == "f") {
+        type.code = shmem::DTypeCode::Float;
+    } else if (kind == "c") {
+        type.code = shmem::DTypeCode::Complex;
+    } else if (kind == "b") {
+        type.code = shmem::DTypeCode::Bool;
+    } else {
+        throw std::runtime_error("Unsupported message dtype kind: " + kind);
+    }
+    if (itemsize <= 0 or itemsize > 16) {
+        throw std::runtime_error("Unsupported message dtype size");
+    }
+    type.bits = static_cast<std::uint8_t>(itemsize * 8);
+
+    if (shape.empty() or shape.size() > shmem::MessageType::kMaxDims or (strides and strides->size() != shape.size())) {
+        throw std::runtime_error("Message shape must have 1 to 8 dimensions, and strides one entry per dimension");
+    }
+    type.ndim = static_cast<std::uint32_t>(shape.size());
+    for (std::size_t i = 0; i < shape.size(); ++i) {
+        type.shape[i] = shape[i];
+        if (strides) {
+            if ((*strides)[i] % itemsize != 0) {
+                throw std::runtime_error("Message strides must be multiples of the dtype size");
+            }
+            type.strides[i] = (*strides)[i] / itemsize;
+        }
+    }
+    options.message_type = type;
+}
+
+// numpy dtype of a queue's messages, or None for untyped queues
+inline nb::object message_dtype(const shmem::SMQueue& q) {
+    const shmem::MessageType& type = q.message_type();
+    if (type.ndim == 0) {
+        return nb::none();
+    }
+    const nb::object dtype = nb::module_::import_("numpy").attr("dtype");
+    if (type.code == shmem::DTypeCode::Bool) {
+        return dtype("?"); // "b1" would be int8
+    }
+    static const char kinds[] = {'i', 'u', 'f', 0, 0, 'c'};
+    const auto code = static_cast<std::size_t>(type.code);
+    if (code >= sizeof(kinds) or kinds[code] == 0) {
+        throw std::runtime_error("Message dtype has no numpy equivalent");
+    }
+    return dtype(std::string(1, kinds[code]) + std::to_string(type.bits / 8));
+}
+
+// NumPy array over queue messages. Its dtype and shape come from the queue's message type.
+using MessageArray = nb::ndarray<nb::numpy>;
+
+// Leading dimension of a batch of messages: count rows, stride bytes apart
+struct MessageRows {
+    std::size_t count;
+    std::size_t stride;
+};
+
+// Array over the message(s) at data. Queues created with a message type give typed N-d arrays (with a
+// leading row dimension for batches); other queues, and messages shorter than element_size, give flat
+// uint8 arrays of length bytes.
+inline MessageArray message_array(const shmem::SMQueue& q, const void* data, std::size_t length, nb::handle owner,
+                                  std::optional<MessageRows> rows = std::nullopt) {
+    const shmem::MessageType& type = q.message_type();
+    const std::size_t itemsize = type.bits / 8;
+    const bool typed = type.ndim != 0 and length == q.element_size() and (!rows or rows->stride % itemsize == 0);
+
+    std::vector<std::size_t> shape;
+    std::vector<int64_t> strides;
+    if (rows) {
+        shape.push_back(rows->count);
+        strides.push_back(static_cast<int64_t>(typed ? rows->stride / itemsize : rows->stride));
+    }
+
+    nb::dlpack::dtype dtype = nb::dtype<uint8_t>();
+    if (typed) {
+        dtype = nb::dlpack::dtype{static_cast<uint8_t>(type.code), type.bits, 1};
+
+        // All-zero strides mean C-contiguous
+        std::vector<int64_t> inner(type.ndim, 0);
+        bool contiguous = true;
+        for (std::uint32_t i = 0; i < type.ndim; ++i) {
+            contiguous = contiguous and type.strides[i] == 0;
+        }
+        int64_t step = 1;
+        for (std::uint32_t i = type.ndim; i-- > 0;) {
+            inner[i] = contiguous ? step : type.strides[i];
+            step *= type.shape[i];
+        }
+        for (std::uint32_t i = 0; i < type.ndim; ++i) {
+            shape.push_back(static_cast<std::size_t>(type.shape[i]));
+            strides.push_back(inner[i]);
+        }
+    } else {
+        shape.push_back(length);
+        strides.push_back(1);
+    }
+
+    return MessageArray(const_cast<void*>(data), shape.size(), shape.data(), owner, strides.data(), dtype,
+                        nb::device::cpu::value);
+}
+
+// Zero-copy view of a borrowed message. The capsule returns the slot to the queue when the ndarray is
+// garbage-collected.
+inline MessageArray borrowed_array(shmem::SMQueue& self, const std::byte* data_ptr, std::size_t index,
+                                   std::size_t length) {
+    // Create a small helper object that will release the slot on destruction
+    struct BorrowHandle {
+        shmem::SMQueue* q;
+        std::size_t idx;
+    };
+
+    auto* handle = new BorrowHandle{&self, index};
+
+    // Capsule deleter releases the slot and deletes the handle
+    nb::capsule cap(handle, [](void* p) noexcept {
+        auto* h = static_cast<BorrowHandle*>(p);
+        if (h && h->q) {
+            h->q->commit_pop(h->idx);
+        }
+        delete h;
+    });
+
+    return message_array(self, data_ptr, length, cap);
+}
+
 NB_MODULE(cyshmem, m) {
     // Module docstring
     m.doc() = "Python bindings for shmem library - a shared memory queue implementation";
 
+    nb::enum_<shmem::QueueMode>(m, "QueueMode", "Synchronization scheme of a queue")
+        .value("Locked", shmem::QueueMode::Locked, "Named semaphores, any number of producers/consumers")
+        .value("SPSC", shmem::QueueMode::SPSC, "Lock-free single-producer/single-consumer ring")
+        .value("MPMC", shmem::QueueMode::MPMC, "Lock-free multi-producer/multi-consumer ring")
+        .value("Broadcast", shmem::QueueMode::Broadcast, "Single writer fanning out to independent readers");
+
+    nb::enum_<shmem::OverflowPolicy>(m, "OverflowPolicy", "What push does when the queue is full")
+        .value("DropOldest", shmem::OverflowPolicy::DropOldest, "Discard the oldest unread message")
+        .value("DropNewest", shmem::OverflowPolicy::DropNewest, "Discard the message being pushed")
+        .value("Block", shmem::OverflowPolicy::Block, "Wait for room; nothing is ever dropped");
+
+    nb::enum_<shmem::SyncPrimitives>(m, "SyncPrimitives", "Where the semaphores of a Locked queue live")
+        .value("Named", shmem::SyncPrimitives::Named, "sem_open semaphores named after the queue")
+        .value("InSegment", shmem::SyncPrimitives::InSegment,
+               "Process-shared semaphores inside the shared memory segment (Linux)");
+
+    nb::enum_<shmem::SlotLayout>(m, "SlotLayout", "How fixed-size message slots are laid out")
+        .value("Packed", shmem::SlotLayout::Packed, "Slots are element_size bytes apart")
+        .value("CacheLine", shmem::SlotLayout::CacheLine, "Stride padded to a multiple of 64 bytes")
+        .value("Page", shmem::SlotLayout::Page, "Stride padded to the page size, page-aligned data")
+        .value("HugePage", shmem::SlotLayout::HugePage, "Stride padded to 2MB, 2MB-aligned data");
+
+    nb::enum_<shmem::NumaPolicy>(m, "NumaPolicy", "NUMA memory policy for the pages of a queue")
+        .value("Default", shmem::NumaPolicy::Default, "First-touch placement")
+        .value("Bind", shmem::NumaPolicy::Bind, "Allocate only on the nodes in the mask")
+        .value("Interleave", shmem::NumaPolicy::Interleave, "Spread pages round-robin over the nodes in the mask")
+        .value("Preferred", shmem::NumaPolicy::Preferred, "Prefer the lowest node in the mask");
+
+    nb::enum_<shmem::CopyPolicy>(m, "CopyPolicy", "How a handle copies message payloads")
+        .value("Memcpy", shmem::CopyPolicy::Memcpy, "std::memcpy")
+        .value("Streaming", shmem::CopyPolicy::Streaming, "Non-temporal stores that bypass the cache")
+        .value("Parallel", shmem::CopyPolicy::Parallel, "Streaming stores split across worker threads");
+
+    nb::class_<shmem::NumaResidency>(m, "NumaResidency", "Where the pages of a queue's data buffer reside")
+        .def_ro("pages_per_node", &shmem::NumaResidency::pages_per_node, "Resident pages, indexed by node id")
+        .def_ro("not_present", &shmem::NumaResidency::not_present, "Pages not faulted in yet")
+        .def_ro("page_size", &shmem::NumaResidency::page_size, "Size of the pages counted");
+
+    nb::class_<shmem::QueueStats>(m, "QueueStats", "Snapshot of a queue's shared counters")
+        .def_ro("enabled", &shmem::QueueStats::enabled, "Whether the queue maintains counters")
+        .def_ro("pushes", &shmem::QueueStats::pushes, "Messages published")
+        .def_ro("pops", &shmem::QueueStats::pops, "Messages popped or borrowed")
+        .def_ro("drops", &shmem::QueueStats::drops, "Messages discarded by the overflow policy")
+        .def_ro("depth", &shmem::QueueStats::depth, "Messages published but not yet popped")
+        .def_ro("max_depth", &shmem::QueueStats::max_depth, "Largest depth seen after a publish")
+        .def_ro("producer_wait_ns", &shmem::QueueStats::producer_wait_ns, "Time producers spent blocked")
+        .def_ro("consumer_wait_ns", &shmem::QueueStats::consumer_wait_ns, "Time consumers spent waiting");
+
+    nb::class_<shmem::LatencyStats>(m, "LatencyStats", "Queue residency times, from publish until pop or borrow")
+        .def_ro("enabled", &shmem::LatencyStats::enabled, "Whether the queue records latencies")
+        .def_ro("count", &shmem::LatencyStats::count, "Messages measured")
+        .def_ro("min_ns", &shmem::LatencyStats::min_ns)
+        .def_ro("mean_ns", &shmem::LatencyStats::mean_ns)
+        .def_ro("p50_ns", &shmem::LatencyStats::p50_ns)
+        .def_ro("p90_ns", &shmem::LatencyStats::p90_ns)
+        .def_ro("p99_ns", &shmem::LatencyStats::p99_ns)
+        .def_ro("p999_ns", &shmem::LatencyStats::p999_ns)
+        .def_ro("max_ns", &shmem::LatencyStats::max_ns);
+
+    nb::class_<shmem::Participant>(m, "Participant", "A handle that has the queue open")
+        .def_ro("pid", &shmem::Participant::pid, "Process that opened the handle")
+        .def_ro("producer", &shmem::Participant::producer, "Whether the handle has pushed")
+        .def_ro("consumer", &shmem::Participant::consumer, "Whether the handle has popped or borrowed")
+        .def_ro("alive", &shmem::Participant::alive, "Whether the process still exists")
+        .def_ro("heartbeat_ns", &shmem::Participant::heartbeat_ns, "Last sign of life, steady clock nanoseconds")
+        .def_ro("cpu", &shmem::Participant::cpu, "CPU the handle's thread was pinned to, -1 if none");
+
+    nb::class_<shmem::ThreadPlacement>(m, "ThreadPlacement", "Where SMQueue.place_thread puts the calling thread")
+        .def(nb::init<>())
+        .def_rw("pin", &shmem::ThreadPlacement::pin, "Pin the thread to a single CPU (Linux only)")
+        .def_rw("cpu", &shmem::ThreadPlacement::cpu,
+                "CPU to pin to, or -1 to pick one on the queue's NUMA node sharing a cache with the other handles")
+        .def_rw("realtime", &shmem::ThreadPlacement::realtime,
+                "Run the thread under SCHED_FIFO (needs CAP_SYS_NICE or RLIMIT_RTPRIO)")
+        .def_rw("priority", &shmem::ThreadPlacement::priority, "SCHED_FIFO priority, 1 to 99");
+
+    nb::class_<shmem::QueueOptions>(m, "QueueOptions", "Options accepted by SMQueue.create")
+        .def(nb::init<>())
+        .def_rw("mode", &shmem::QueueOptions::mode, "Synchronization mode")
+        .def_rw("overflow", &shmem::QueueOptions::overflow, "Behaviour of push on a full queue")
+        .def_rw("variable_size", &shmem::QueueOptions::variable_size,
+                "Store length-prefixed records; element_size becomes the maximum message length")
+        .def_rw("max_readers", &shmem::QueueOptions::max_readers,
+                "Broadcast queues: maximum number of concurrently open readers")
+        .def_rw("layout", &shmem::QueueOptions::layout, "Slot stride and data buffer alignment")
+        .def_rw("huge_pages", &shmem::QueueOptions::huge_pages, "Back the queue with a hugetlbfs file")
+        .def_rw("populate", &shmem::QueueOptions::populate, "Pre-fault the whole mapping")
+        .def_rw("lock_memory", &shmem::QueueOptions::lock_memory, "mlock the mapping")
+        .def_rw("numa_policy", &shmem::QueueOptions::numa_policy, "NUMA placement of the queue's pages")
+        .def_rw("numa_nodes", &shmem::QueueOptions::numa_nodes, "NUMA node mask: bit n selects node n")
+        .def("set_message_type", &set_message_type,
+             "Store each message as an array of this dtype and shape (strides in bytes; C order if omitted)",
+             nb::arg("dtype"), nb::arg("shape"), nb::arg("strides") = nb::none())
+        .def_rw("stats", &shmem::QueueOptions::stats, "Maintain shared counters readable with SMQueue.stats")
+        .def_rw("latency", &shmem::QueueOptions::latency,
+                "Timestamp messages and keep a shared histogram of their queue residency time")
+        .def_rw("robust", &shmem::QueueOptions::robust,
+                "Locked queues: use a robust mutex that survives a process dying while holding it (Linux only)")
+        .def_rw("sync", &shmem::QueueOptions::sync, "Locked queues: named or in-segment semaphores")
+        .def_rw("max_participants", &shmem::QueueOptions::max_participants, "Maximum number of open handles")
+        .def_rw("flush_interval_ms", &shmem::QueueOptions::flush_interval_ms,
+                "File-backed queues: producers write the mapping back to the file this often (0: never)");
+
+    nb::class_<shmem::OpenOptions>(m, "OpenOptions", "Options accepted by SMQueue.open")
+        .def(nb::init<>())
+        .def_rw("populate", &shmem::OpenOptions::populate, "Pre-fault the whole mapping")
+        .def_rw("lock_memory", &shmem::OpenOptions::lock_memory, "mlock the mapping")
+        .def_rw("recover", &shmem::OpenOptions::recover,
+                "Repair the queue after a crash, re-queueing messages borrowed by dead consumers")
+        .def_rw("rewind", &shmem::OpenOptions::rewind,
+                "Broadcast queues: start reading at the oldest message still in the ring")
+        .def_rw("placement", &shmem::OpenOptions::placement, "Place the opening thread once the queue is open");
+
+    nb::class_<shmem::CopyStrategy>(m, "CopyStrategy", "Per-handle copy settings")
+        .def(nb::init<>())
+        .def_rw("policy", &shmem::CopyStrategy::policy, "Copy kernel for large messages")
+        .def_rw("streaming_threshold", &shmem::CopyStrategy::streaming_threshold,
+                "Smallest message copied with streaming stores")
+        .def_rw("parallel_threshold", &shmem::CopyStrategy::parallel_threshold,
+                "Smallest message split across threads")
+        .def_rw("threads", &shmem::CopyStrategy::threads, "Threads per parallel copy, the caller included");
+
     // Define the SMQueue class
     nb::class_<shmem::SMQueue>(m, "SMQueue")
         .def_static("create", &shmem::SMQueue::create, "Create a new shared memory queue", nb::arg("name"),
-                    nb::arg("max_elements"), nb::arg("element_size"))
-        .def_static("open", &shmem::SMQueue::open, "Open an existing shared memory queue", nb::arg("name"))
+                    nb::arg("max_elements"), nb::arg("element_size"), nb::arg("options") = shmem::QueueOptions())
+        .def_static("open", &shmem::SMQueue::open, "Open an existing shared memory queue", nb::arg("name"),
+                    nb::arg("options") = shmem::OpenOptions())
         .def_static("destroy", &shmem::SMQueue::destroy, "Destroy a shared memory queue", nb::arg("name"))
+        .def_static("read_stats", &shmem::SMQueue::read_stats,
+                    "Read a queue's counters through a read-only mapping, without opening it", nb::arg("name"))
+        .def_static("read_latency", &shmem::SMQueue::read_latency,
+                    "Read a queue's latency histogram through a read-only mapping, without opening it", nb::arg("name"))
+        .def_static("list_queues", &shmem::SMQueue::list_queues, "Names of all queues on this host (Linux only)")
         .def("close", &shmem::SMQueue::close, "Close the queue")
         .def("max_elements", &shmem::SMQueue::max_elements, "Get maximum number of elements")
         .def("element_size", &shmem::SMQueue::element_size, "Get element size in bytes")
+        .def("slot_stride", &shmem::SMQueue::slot_stride, "Distance in bytes between consecutive slots")
+        .def("variable_size", &shmem::SMQueue::variable_size, "Whether the queue stores variable-size records")
         .def("name", &shmem::SMQueue::name, "Get queue name")
+        .def("mode", &shmem::SMQueue::mode, "Get synchronization mode")
+        .def("message_dtype", &message_dtype, "numpy dtype of each message, or None for untyped queues")
+        .def(
+            "message_shape",
+            [](const shmem::SMQueue& self) {
+                const shmem::MessageType& type = self.message_type();
+                return std::vector<int64_t>(type.shape, type.shape + type.ndim);
+            },
+            "Shape of each message's array (empty for untyped queues)")
+        .def("bind_numa", &shmem::SMQueue::bind_numa,
+             "Apply a NUMA policy to the data buffer and migrate the pages this process mapped", nb::arg("policy"),
+             nb::arg("nodes"))
+        .def("numa_residency", &shmem::SMQueue::numa_residency, "Report the NUMA node of every data buffer page")
+        .def("overruns", &shmem::SMQueue::overruns,
+             "Broadcast readers: number of messages missed because the writer overwrote them")
+        .def("stats", &shmem::SMQueue::stats, "Snapshot of the queue's shared counters")
+        .def("latency", &shmem::SMQueue::latency, "Queue residency time percentiles measured so far")
+        .def("reset_latency", &shmem::SMQueue::reset_latency, "Empty the latency histogram")
+        .def("participants", &shmem::SMQueue::participants, "Every handle that has the queue open")
+        .def("heartbeat", &shmem::SMQueue::heartbeat, "Record a sign of life for this handle")
+        .def("place_thread", &shmem::SMQueue::place_thread,
+             "Pin the calling thread and/or make it SCHED_FIFO, recording its CPU in the queue; returns the CPU",
+             nb::arg("placement"))
+        .def(
+            "flush",
+            [](shmem::SMQueue& self) {
+                nb::gil_scoped_release release;
+                self.flush();
+            },
+            "Write a file-backed queue back to its file and wait for the disk")
+        .def("grow", &shmem::SMQueue::grow,
+             "Move the queue to a larger ring; other handles switch to it lazily", nb::arg("max_elements"),
+             nb::arg("element_size"))
+        .def("generation", &shmem::SMQueue::generation, "Generation of the ring this handle uses (0 until grown)")
+        .def("set_copy_strategy", &shmem::SMQueue::set_copy_strategy,
+             "Set how push and pop on this handle copy payloads", nb::arg("strategy"))
+        .def("notify_fd", &shmem::SMQueue::notify_fd,
+             "Descriptor that becomes readable when a message is published (for event loops)")
+        .def("clear_notify", &shmem::SMQueue::clear_notify, "Consume pending notifications on notify_fd()")
+        .def("readable", &shmem::SMQueue::readable, "Whether a message looks ready for this handle (a hint)")
         // Custom implementation for push that accepts generic arrays
         .def(
             "push",
             [](shmem::SMQueue& self, nb::ndarray<> array) {
-                if (array.size() != self.element_size()) {
+                std::size_t nbytes = array.nbytes();
+                if (self.variable_size() ? nbytes > self.element_size() : nbytes != self.element_size()) {
                     throw std::runtime_error("Array size does not match element size");
                 }
 
                 // Directly use the data from the NumPy array
-                bool result = self.push(reinterpret_cast<const std::byte*>(array.data()));
+                nb::gil_scoped_release release;
+                bool result = self.push(reinterpret_cast<const std::byte*>(array.data()), nbytes);
 
                 return result;
             },
             "Push a message to the queue as an array", nb::arg("array"))
+        .def(
+            "try_push",
+            [](shmem::SMQueue& self, nb::ndarray<> array) {
+                std::size_t nbytes = array.nbytes();
+                if (self.variable_size() ? nbytes > self.element_size() : nbytes != self.element_size()) {
+                    throw std::runtime_error("Array size does not match element size");
+                }
+
+                nb::gil_scoped_release release;
+                return self.try_push(reinterpret_cast<const std::byte*>(array.data()), nbytes);
+            },
+            "Push a message only if there is room for it now; never waits and never drops", nb::arg("array"))
+        .def(
+            "push_for",
+            [](shmem::SMQueue& self, nb::ndarray<> array, double timeout) {
+                std::size_t nbytes = array.nbytes();
+                if (self.variable_size() ? nbytes > self.element_size() : nbytes != self.element_size()) {
+                    throw std::runtime_error("Array size does not match element size");
+                }
+
+                nb::gil_scoped_release release;
+                return self.push_for(reinterpret_cast<const std::byte*>(array.data()), nbytes, to_timeout(timeout));
+            },
+            "Push a message, waiting at most timeout seconds for room on Block queues; False on timeout",
+            nb::arg("array"), nb::arg("timeout"))
+        // Zero-copy producer path: the returned ndarray is a writable view of the reserved slot. It must
+        // not be used after publish().
+        .def(
+            "reserve_np",
+            [](shmem::SMQueue& self, std::optional<std::size_t> length) -> std::optional<MessageArray> {
+                std::size_t size = length.value_or(self.element_size());
+                std::byte* dest;
+                {
+                    // Waits for the mutex (Locked) or for room (Block), which a consumer thread may need the
+                    // GIL to provide
+                    nb::gil_scoped_release release;
+                    dest = self.reserve(size);
+                }
+                if (dest == nullptr) {
+                    return std::nullopt;
+                }
+
+                // nanobind copies arrays without an owner; the queue object keeps this one a view of the slot
+                return message_array(self, dest, size, nb::find(self));
+            },
+            "Reserve the next slot and return a writable view of it, or None if the message would be dropped",
+            nb::arg("length") = nb::none())
+        .def("publish", &shmem::SMQueue::publish,
+             "Publish the reserved slot; returns True if no messages were dropped to make room")
         // Custom implementation for pop that returns generic arrays or None
         .def(
             "pop_np",
-            [](shmem::SMQueue& self) -> std::optional<nb::ndarray<nb::numpy, uint8_t>> {
+            [](shmem::SMQueue& self) -> std::optional<MessageArray> {
                 size_t size = self.element_size();
                 // Allocate memory for the array
                 uint8_t* data = new uint8_t[size];
 
                 // Pop directly into the allocated memory
-                bool success = self.pop(reinterpret_cast<std::byte*>(data));
+                bool success;
+                {
+                    nb::gil_scoped_release release;
+                    success = self.pop(reinterpret_cast<std::byte*>(data), size);
+                }
 
                 if (!success) {
                     // Clean up allocated memory if pop failed
@@ -61,28 +508,27 @@ NB_MODULE(cyshmem, m) {
                     return std::nullopt;
                 }
 
-                // Create shape array
-                std::vector<size_t> shape = {size};
                 // Create a capsule to manage the memory
                 nb::capsule deleter(data, [](void* p) noexcept { delete[] static_cast<uint8_t*>(p); });
 
-                auto result = nb::ndarray<nb::numpy, uint8_t>(data, shape.size(), shape.data(), deleter, nullptr,
-                                                              nb::dtype<uint8_t>(), nb::device::cpu::value);
-
-                return result;
+                return message_array(self, data, size, deleter);
             },
             "Pop a message from the queue (blocking) as an array")
         // Custom implementation for try_pop that returns generic arrays or None
         .def(
             "try_pop_np",
-            [](shmem::SMQueue& self) -> std::optional<nb::ndarray<nb::numpy, uint8_t>> {
+            [](shmem::SMQueue& self) -> std::optional<MessageArray> {
                 size_t size = self.element_size();
 
                 // Allocate memory for the array
                 uint8_t* data = new uint8_t[size];
 
                 // Try to pop directly into the allocated memory
-                bool success = self.try_pop(reinterpret_cast<std::byte*>(data));
+                bool success;
+                {
+                    nb::gil_scoped_release release;
+                    success = self.try_pop(reinterpret_cast<std::byte*>(data), size);
+                }
 
                 if (!success) {
                     // Clean up allocated memory if pop failed
@@ -91,63 +537,346 @@ NB_MODULE(cyshmem, m) {
                     return std::nullopt;
                 }
 
-                // Create shape array
-                std::vector<size_t> shape = {size};
                 // Create a capsule to manage the memory
                 nb::capsule deleter(data, [](void* p) noexcept { delete[] static_cast<uint8_t*>(p); });
 
                 // Create the ndarray with the allocated memory and the capsule as owner
-                auto result = nb::ndarray<nb::numpy, uint8_t>(data, shape.size(), shape.data(), deleter, nullptr,
-                                                              nb::dtype<uint8_t>(), nb::device::cpu::value);
-
-                return result;
+                return message_array(self, data, size, deleter);
             },
             "Try to pop a message (non-blocking) as an array")
+        .def(
+            "pop_for_np",
+            [](shmem::SMQueue& self, double timeout) -> std::optional<MessageArray> {
+                size_t size = self.element_size();
+                uint8_t* data = new uint8_t[size];
+
+                bool success;
+                {
+                    nb::gil_scoped_release release;
+                    success = self.pop_for(reinterpret_cast<std::byte*>(data), size, to_timeout(timeout));
+                }
+
+                if (!success) {
+                    delete[] data;
+                    return std::nullopt;
+                }
+
+                nb::capsule deleter(data, [](void* p) noexcept { delete[] static_cast<uint8_t*>(p); });
+                return message_array(self, data, size, deleter);
+            },
+            "Pop a message as an array, waiting up to timeout seconds; returns None on timeout", nb::arg("timeout"))
+        // Like pop_np/pop_for_np, but the array's buffer comes from a pool and goes back to it when the array
+        // is garbage-collected, so a steady consumer stops allocating and page-faulting per message
+        .def(
+            "pop_pooled",
+            [](shmem::SMQueue& self, std::optional<double> timeout) -> std::optional<MessageArray> {
+                size_t size = self.element_size();
+                BufferPool& pool = BufferPool::for_size(size);
+                void* base = pool.acquire();
+                auto* out = reinterpret_cast<std::byte*>(BufferPool::data(base));
+
+                bool success;
+                {
+                    nb::gil_scoped_release release;
+                    success = timeout ? self.pop_for(out, size, to_timeout(*timeout)) : self.pop(out, size);
+                }
+
+                if (!success) {
+                    BufferPool::release(base);
+                    return std::nullopt;
+                }
+
+                nb::capsule owner(base, [](void* p) noexcept { BufferPool::release(p); });
+                return message_array(self, BufferPool::data(base), size, owner);
+            },
+            "Pop a message into a pooled buffer, blocking or waiting up to timeout seconds; returns None on timeout",
+            nb::arg("timeout") = nb::none())
         // Zero-copy borrow (non-blocking). The ndarray returned references the shared memory slot
         // directly. When the ndarray is garbage-collected, the slot is released back to the queue.
         .def(
             "borrow_np",
-            [](shmem::SMQueue& self) -> std::optional<nb::ndarray<nb::numpy, uint8_t>> {
+            [](shmem::SMQueue& self) -> std::optional<MessageArray> {
+                const std::byte* data_ptr = nullptr;
+                std::size_t index = 0;
+                std::size_t length = 0;
+
+                bool ok = self.borrow(&data_ptr, index, length);
+                if (!ok) {
+                    return std::nullopt;
+                }
+
+                return borrowed_array(self, data_ptr, index, length);
+            },
+            "Borrow a message (non-blocking) without copy; slot is released when ndarray is GC-ed")
+        .def(
+            "borrow_for_np",
+            [](shmem::SMQueue& self, double timeout) -> std::optional<MessageArray> {
                 const std::byte* data_ptr = nullptr;
                 std::size_t index = 0;
+                std::size_t length = 0;
 
-                bool ok = self.borrow(&data_ptr, index);
+                bool ok;
+                {
+                    nb::gil_scoped_release release;
+                    ok = self.borrow_for(&data_ptr, index, length, to_timeout(timeout));
+                }
                 if (!ok) {
                     return std::nullopt;
                 }
 
-                // Create a small helper object that will release the slot on destruction
-                struct BorrowHandle {
+                return borrowed_array(self, data_ptr, index, length);
+            },
+            "Borrow a message without copy, waiting up to timeout seconds; returns None on timeout",
+            nb::arg("timeout"))
+        // Batch APIs: one synchronisation round per call instead of per message
+        .def(
+            "push_batch",
+            [](shmem::SMQueue& self, std::vector<nb::ndarray<>> arrays) -> std::size_t {
+                std::vector<const std::byte*> msgs;
+                std::vector<std::size_t> lengths;
+                msgs.reserve(arrays.size());
+                lengths.reserve(arrays.size());
+                for (auto& array : arrays) {
+                    std::size_t nbytes = array.nbytes();
+                    if (self.variable_size() ? nbytes > self.element_size() : nbytes != self.element_size()) {
+                        throw std::runtime_error("Array size does not match element size");
+                    }
+                    msgs.push_back(reinterpret_cast<const std::byte*>(array.data()));
+                    lengths.push_back(nbytes);
+                }
+                nb::gil_scoped_release release;
+                return self.push_batch(msgs.data(), lengths.data(), msgs.size());
+            },
+            "Push a sequence of arrays; returns the number of messages pushed", nb::arg("arrays"))
+        .def(
+            "pop_batch_np",
+            [](shmem::SMQueue& self, std::size_t max_n, bool block) -> nb::object {
+                size_t size = self.element_size();
+                if (size != 0 and max_n > SIZE_MAX / size) {
+                    throw std::runtime_error("max_n is too large for the queue's element size");
+                }
+                // The ring never holds more than max_elements() messages
+                max_n = std::min(max_n, self.max_elements());
+                const bool variable = self.variable_size();
+                std::vector<std::size_t> lengths(variable ? max_n : 0);
+
+                uint8_t* data = new uint8_t[max_n * size];
+                auto* out = reinterpret_cast<std::byte*>(data);
+                std::size_t n;
+                {
+                    nb::gil_scoped_release release;
+                    std::size_t* lens = variable ? lengths.data() : nullptr;
+                    n = block ? self.pop_batch(out, max_n, lens) : self.try_pop_batch(out, max_n, lens);
+                }
+
+                // Don't keep a buffer sized for max_n alive behind a shorter batch
+                if (n < max_n) {
+                    auto* fitted = new uint8_t[n * size];
+                    std::memcpy(fitted, data, n * size);
+                    delete[] data;
+                    data = fitted;
+                }
+
+                // Rows are element_size() bytes; the array may be empty
+                nb::capsule deleter(data, [](void* p) noexcept { delete[] static_cast<uint8_t*>(p); });
+                MessageArray rows = message_array(self, data, size, deleter, MessageRows{n, size});
+                if (!variable) {
+                    return nb::cast(rows);
+                }
+
+                // Row i holds lengths[i] valid bytes
+                auto* valid = new uint64_t[n];
+                std::copy(lengths.begin(), lengths.begin() + static_cast<std::ptrdiff_t>(n), valid);
+                nb::capsule owner(valid, [](void* p) noexcept { delete[] static_cast<uint64_t*>(p); });
+                return nb::make_tuple(rows, nb::ndarray<nb::numpy, uint64_t, nb::ndim<1>>(valid, {n}, owner));
+            },
+            "Pop up to max_n messages as an (n, element_size) array, or (n, *shape) for typed queues; blocks for "
+            "the first one unless block=False. Variable-size queues return (array, lengths) instead, row i "
+            "holding lengths[i] valid bytes",
+            nb::arg("max_n"), nb::arg("block") = true)
+        .def(
+            "try_pop_batch_into",
+            [](shmem::SMQueue& q, nb::ndarray<uint8_t, nb::ndim<2>> dst,
+               std::optional<nb::ndarray<uint64_t, nb::ndim<1>>> lengths) -> std::size_t {
+                if (dst.shape(1) != q.element_size() or dst.stride(1) != 1 or
+                    dst.stride(0) != static_cast<int64_t>(q.element_size()))
+                    throw std::runtime_error("dst must be a C-contiguous (n, element_size) array");
+                std::size_t max_n = dst.shape(0);
+                if (!lengths) {
+                    nb::gil_scoped_release release;
+                    return q.try_pop_batch(reinterpret_cast<std::byte*>(dst.data()), max_n);
+                }
+                if (lengths->size() < max_n or lengths->stride(0) != 1)
+                    throw std::runtime_error("lengths must be a contiguous array with one entry per row of dst");
+                static_assert(sizeof(uint64_t) == sizeof(std::size_t), "lengths are written as size_t");
+                nb::gil_scoped_release release;
+                return q.try_pop_batch(reinterpret_cast<std::byte*>(dst.data()), max_n,
+                                       reinterpret_cast<std::size_t*>(lengths->data()));
+            },
+            nb::arg("dst"), nb::arg("lengths") = nb::none(),
+            "Non-blocking batch pop into a pre-allocated (n, element_size) array; returns the number popped")
+        // Zero-copy batch borrow (non-blocking). The (n, element_size) array references consecutive slots
+        // and releases all of them when it is garbage-collected.
+        .def(
+            "borrow_batch_np",
+            [](shmem::SMQueue& self, std::size_t max_n) -> std::optional<MessageArray> {
+                const std::byte* data_ptr = nullptr;
+                std::size_t index = 0;
+
+                std::size_t count = self.borrow_batch(&data_ptr, index, max_n);
+                if (count == 0) {
+                    return std::nullopt;
+                }
+
+                struct BorrowBatchHandle {
                     shmem::SMQueue* q;
                     std::size_t idx;
+                    std::size_t count;
                 };
 
-                auto* handle = new BorrowHandle{&self, index};
+                auto* handle = new BorrowBatchHandle{&self, index, count};
 
-                // Capsule deleter releases the slot and deletes the handle
                 nb::capsule cap(handle, [](void* p) noexcept {
-                    auto* h = static_cast<BorrowHandle*>(p);
+                    auto* h = static_cast<BorrowBatchHandle*>(p);
                     if (h && h->q) {
-                        h->q->commit_pop(h->idx);
+                        h->q->commit_pop_batch(h->idx, h->count);
                     }
                     delete h;
                 });
 
-                std::vector<std::size_t> shape = {self.element_size()};
-
-                auto arr = nb::ndarray<nb::numpy, uint8_t>(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(data_ptr)),
-                                                           shape.size(), shape.data(), cap, nullptr,
-                                                           nb::dtype<uint8_t>(), nb::device::cpu::value);
-
-                return arr;
+                return message_array(self, data_ptr, self.element_size(), cap, MessageRows{count, self.slot_stride()});
             },
-            "Borrow a message (non-blocking) without copy; slot is released when ndarray is GC-ed")
+            "Borrow up to max_n consecutive messages without copy; slots are released when the array is GC-ed",
+            nb::arg("max_n"))
         .def("try_pop_into",
-             [](shmem::SMQueue &q, nb::ndarray<uint8_t, nb::ndim<1>> dst) -> bool {
-                 if (dst.size() != q.element_size())
+             [](shmem::SMQueue &q, nb::ndarray<nb::c_contig, nb::device::cpu> dst) -> bool {
+                 if (dst.nbytes() != q.element_size())
                      throw std::runtime_error("dst wrong size");
+                 nb::gil_scoped_release release;
                  return q.try_pop(reinterpret_cast<std::byte*>(dst.data()));
              },
              nb::arg("dst"),
-             "Non-blocking pop into a pre-allocated array");
-}
\ No newline at end of file
+             "Non-blocking pop into a pre-allocated C-contiguous array of element_size bytes (any dtype and shape)")
+        .def("pop_for_into",
+             [](shmem::SMQueue &q, nb::ndarray<nb::c_contig, nb::device::cpu> dst,
+                double timeout) -> std::optional<std::size_t> {
+                 if (dst.nbytes() != q.element_size())
+                     throw std::runtime_error("dst wrong size");
+                 std::size_t length = 0;
+                 bool ok;
+                 {
+                     nb::gil_scoped_release release;
+                     ok = q.pop_for(reinterpret_cast<std::byte*>(dst.data()), length, to_timeout(timeout));
+                 }
+                 if (!ok)
+                     return std::nullopt;
+                 return length;
+             },
+             nb::arg("dst"), nb::arg("timeout"),
+             "Pop into a pre-allocated array, waiting up to timeout seconds; returns the message length or None")
+        .def("try_pop_into_len",
+             [](shmem::SMQueue &q, nb::ndarray<nb::c_contig, nb::device::cpu> dst) -> std::optional<std::size_t> {
+                 if (dst.nbytes() != q.element_size())
+                     throw std::runtime_error("dst wrong size");
+                 std::size_t length = 0;
+                 bool ok;
+                 {
+                     nb::gil_scoped_release release;
+                     ok = q.try_pop(reinterpret_cast<std::byte*>(dst.data()), length);
+                 }
+                 if (!ok)
+                     return std::nullopt;
+                 return length;
+             },
+             nb::arg("dst"),
+             "Non-blocking pop into a pre-allocated array; returns the message length or None if empty");
+    // Multiplexed wait across many queues
+    nb::class_<shmem::QueueSet>(m, "QueueSet", "Waits until any of several queues has a message")
+        .def(nb::init<>())
+        .def("add", &shmem::QueueSet::add, "Register a queue and return its index in the set", nb::arg("queue"),
+             nb::keep_alive<1, 2>())
+        .def("clear", &shmem::QueueSet::clear, "Forget every registered queue")
+        .def("__len__", &shmem::QueueSet::size)
+        .def("ready", &shmem::QueueSet::ready, "Indices of the queues with a message ready, without waiting")
+        .def(
+            "wait_any",
+            [](shmem::QueueSet& self, std::optional<double> timeout) {
+                nb::gil_scoped_release release;
+                return timeout ? self.wait_any(to_timeout(*timeout)) : self.wait_any();
+            },
+            "Indices of the queues with a message ready, blocking or waiting up to timeout seconds; empty on timeout",
+            nb::arg("timeout") = nb::none());
+
+    m.def(
+        "wait_any",
+        [](const std::vector<shmem::SMQueue*>& queues, std::optional<double> timeout) {
+            shmem::QueueSet set;
+            for (shmem::SMQueue* queue : queues) {
+                set.add(*queue);
+            }
+            nb::gil_scoped_release release;
+            return timeout ? set.wait_any(to_timeout(*timeout)) : set.wait_any();
+        },
+        "Wait until any of queues has a message and return their indices; empty on timeout", nb::arg("queues"),
+        nb::arg("timeout") = nb::none());
+
+    // Latest-value mailbox
+    nb::class_<shmem::Mailbox>(m, "Mailbox")
+        .def_static("create", &shmem::Mailbox::create, "Create a new mailbox", nb::arg("name"), nb::arg("value_size"))
+        .def_static("open", &shmem::Mailbox::open, "Open an existing mailbox", nb::arg("name"))
+        .def_static("destroy", &shmem::Mailbox::destroy, "Destroy a mailbox", nb::arg("name"))
+        .def("close", &shmem::Mailbox::close, "Close the mailbox")
+        .def("value_size", &shmem::Mailbox::value_size, "Get value size in bytes")
+        .def("name", &shmem::Mailbox::name, "Get mailbox name")
+        .def("version", &shmem::Mailbox::version, "Version of the newest value (0 if nothing has been written)")
+        .def(
+            "write",
+            [](shmem::Mailbox& self, nb::ndarray<> array) {
+                if (array.nbytes() != self.value_size()) {
+                    throw std::runtime_error("Array size does not match value size");
+                }
+                nb::gil_scoped_release release;
+                self.write(reinterpret_cast<const std::byte*>(array.data()));
+            },
+            "Publish a new value (never blocks)", nb::arg("array"))
+        .def(
+            "read_np",
+            [](shmem::Mailbox& self,
+               std::uint64_t version) -> std::optional<std::pair<std::uint64_t, nb::ndarray<nb::numpy, uint8_t>>> {
+                size_t size = self.value_size();
+                uint8_t* data = new uint8_t[size];
+
+                bool fresh;
+                {
+                    nb::gil_scoped_release release;
+                    fresh = self.read_newer(reinterpret_cast<std::byte*>(data), version);
+                }
+                if (!fresh) {
+                    delete[] data;
+                    return std::nullopt;
+                }
+
+                std::vector<size_t> shape = {size};
+                nb::capsule deleter(data, [](void* p) noexcept { delete[] static_cast<uint8_t*>(p); });
+                return std::make_pair(version, nb::ndarray<nb::numpy, uint8_t>(data, shape.size(), shape.data(),
+                                                                               deleter, nullptr, nb::dtype<uint8_t>(),
+                                                                               nb::device::cpu::value));
+            },
+            "Copy the newest value as a (version, array) pair, or None if nothing newer than version has been written",
+            nb::arg("version") = 0);
+
+    // Copy kernels, exposed so benchmarks can compare them against a plain memcpy
+    m.def(
+        "copy_into",
+        [](nb::ndarray<uint8_t, nb::ndim<1>, nb::c_contig> dst, nb::ndarray<uint8_t, nb::ndim<1>, nb::c_contig> src,
+           const shmem::CopyStrategy& strategy) {
+            if (dst.size() != src.size()) {
+                throw std::runtime_error("dst and src sizes differ");
+            }
+            nb::gil_scoped_release release;
+            shmem::detail::copy_bytes(dst.data(), src.data(), src.size(), strategy);
+        },
+        "Copy src into dst with the kernel a queue handle would use", nb::arg("dst"), nb::arg("src"),
+        nb::arg("strategy") = shmem::CopyStrategy());
+    m.def("stream_kernel", &shmem::detail::stream_kernel, "Name of the streaming copy kernel selected for this CPU");
+}
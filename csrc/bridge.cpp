@@ -0,0 +1,1200 @@
+#include "bridge.h"
+
+#include <arpa/inet.h>   // for inet_pton
+#include <netdb.h>       // for getaddrinfo
+#include <netinet/in.h>  // for IPPROTO_TCP, IN_MULTICAST
+#include <netinet/tcp.h> // for TCP_NODELAY
+#include <poll.h>        // for poll
+#include <sys/socket.h>  // for socket, sendmsg, recvmsg
+#include <sys/uio.h>     // for iovec
+#include <unistd.h>      // for close
+
+#if defined(__linux__)
+#include <linux/errqueue.h> // for sock_extended_err, SO_EE_ORIGIN_ZEROCOPY
+#endif
+
+#include <algorithm> // for std::max, std::min
+#include <cerrno>    // for errno
+#include <climits>   // for IOV_MAX, NAME_MAX
+#include <cstring>   // for std::memcpy, std::memmove, strerror
+#include <deque>     // for std::deque
+#include <list>      // for std::list
+#include <mutex>     // for std::mutex, std::lock_guard
+#include <set>       // for std::set
+#include <stdexcept> // for std::runtime_error
+#include <thread>    // for std::thread
+
+#if defined(__linux__) and defined(MSG_ZEROCOPY) and defined(SO_ZEROCOPY)
+#define SHMEM_BRIDGE_ZEROCOPY 1
+#endif
+
+namespace shmem {
+
+namespace {
+
+// Wire format. Fields travel in host byte order, so both ends of a bridge must share it.
+
+constexpr char kHelloMagic[8] = {'S', 'H', 'M', 'B', 'R', 'D', 'G', '1'};
+
+// First bytes of a TCP stream, followed by name_length bytes of queue name
+struct Hello {
+    char magic[8];               // kHelloMagic
+    std::uint32_t mode;          // QueueMode of the source queue
+    std::uint32_t overflow;      // Its OverflowPolicy
+    std::uint32_t variable_size; // Whether it stores variable-size records
+    std::uint32_t name_length;
+    std::uint64_t max_elements;
+    std::uint64_t element_size;
+    std::uint64_t max_readers;
+};
+
+// Prefix of every message on a TCP stream
+struct FrameHeader {
+    std::uint32_t length; // Payload length
+    std::uint32_t flags;  // kFrameGeometry
+};
+
+// The payload is a Geometry: the source queue grew, and the messages that follow may be larger
+constexpr std::uint32_t kFrameGeometry = 1;
+
+struct Geometry {
+    std::uint64_t max_elements;
+    std::uint64_t element_size;
+};
+
+constexpr char kDatagramMagic[4] = {'S', 'H', 'M', 'B'};
+constexpr std::uint16_t kDatagramVersion = 1;
+
+// Start of every datagram, followed by count messages, each a 32-bit length and its payload. The
+// source queue's geometry and options travel in every datagram so receivers can join a multicast stream
+// at any time.
+struct DatagramHeader {
+    char magic[4]; // kDatagramMagic
+    std::uint16_t version;
+    std::uint16_t count;
+    std::uint32_t mode;        // QueueMode of the source queue
+    std::uint32_t flags;       // kDatagramVariable
+    std::uint32_t overflow;    // Its OverflowPolicy
+    std::uint32_t max_readers; // Its reader table size
+    std::uint64_t sequence;    // Sequence number of the first message
+    std::uint64_t max_elements;
+    std::uint64_t element_size;
+};
+
+constexpr std::uint32_t kDatagramVariable = 1;
+
+// Largest UDP payload over IPv4
+constexpr std::size_t kMaxDatagram = 65507;
+
+// Datagrams handled per sendmmsg/recvmmsg
+constexpr std::size_t kDatagramBatch = 64;
+
+// TCP receive buffer; larger messages get a buffer of their own size
+constexpr std::size_t kReceiveBuffer = std::size_t(1) << 20;
+
+// TCP receivers write the rest of a message at least this large straight into the ring (SPSC and
+// Broadcast queues, whose reservations hold nothing other handles wait for)
+constexpr std::size_t kDirectBytes = std::size_t(64) << 10;
+
+// How often blocked calls check for a stop request
+constexpr int kPollMs = 100;
+
+// Sends never block, so a receiver that stops reading cannot hold up a stop request
+#if defined(MSG_NOSIGNAL)
+constexpr int kSendFlags = MSG_DONTWAIT | MSG_NOSIGNAL; // A vanished peer is an error, not a SIGPIPE
+#else
+constexpr int kSendFlags = MSG_DONTWAIT;
+#endif
+
+[[noreturn]] void fail(const std::string& what) { throw std::runtime_error(what + ": " + strerror(errno)); }
+
+void close_socket(int fd) { detail::safe_close(fd); }
+
+// Split [host:]port, allowing a bracketed IPv6 host
+void split_endpoint(const std::string& endpoint, std::string& host, std::string& port) {
+    const std::size_t colon = endpoint.rfind(':');
+    host = colon == std::string::npos ? std::string() : endpoint.substr(0, colon);
+    port = colon == std::string::npos ? endpoint : endpoint.substr(colon + 1);
+    if (host.size() >= 2 and host.front() == '[' and host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    if (port.empty()) {
+        throw std::runtime_error("Missing port in endpoint: " + endpoint);
+    }
+}
+
+// Resolve an endpoint; the caller frees the list
+addrinfo* resolve(const std::string& endpoint, int family, int type, bool passive) {
+    std::string host;
+    std::string port;
+    split_endpoint(endpoint, host, port);
+
+    addrinfo hints = {};
+    hints.ai_family = family;
+    hints.ai_socktype = type;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* list = nullptr;
+    const int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &list);
+    if (error != 0) {
+        throw std::runtime_error("Cannot resolve " + endpoint + ": " + gai_strerror(error));
+    }
+    return list;
+}
+
+// Wait until fd is readable or timeout_ms passes
+bool wait_readable(int fd, int timeout_ms) {
+    pollfd entry = {fd, POLLIN, 0};
+    return poll(&entry, 1, timeout_ms) > 0;
+}
+
+// Receive exactly length bytes. Returns false if the peer closed the stream or stop was requested.
+bool recv_all(int fd, void* data, std::size_t length, const std::atomic<bool>& stop) {
+    auto* bytes = static_cast<std::byte*>(data);
+    while (length > 0) {
+        if (stop.load()) {
+            return false;
+        }
+        if (!wait_readable(fd, kPollMs)) {
+            continue;
+        }
+        const ssize_t received = recv(fd, bytes, length, 0);
+        if (received == 0) {
+            return false;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail("Failed to receive from bridge peer");
+        }
+        bytes += received;
+        length -= static_cast<std::size_t>(received);
+    }
+    return true;
+}
+
+// Whether a wrapping 32-bit id counter has reached target
+bool reached(std::uint32_t value, std::uint32_t target) { return static_cast<std::int32_t>(value - target) >= 0; }
+
+// Open the local queue a sender feeds, creating it like the source queue if it does not exist yet
+SMQueue local_queue(const std::string& name, QueueMode mode, OverflowPolicy overflow, bool variable_size,
+                    std::size_t max_elements, std::size_t element_size, std::size_t max_readers) {
+    QueueOptions options;
+    options.mode = mode;
+    options.overflow = overflow;
+    options.variable_size = variable_size;
+    options.max_readers = max_readers;
+    try {
+        return SMQueue::create(name, max_elements, element_size, options);
+    } catch (const std::runtime_error&) {
+        // It exists already, or another sender created it first
+    }
+
+    SMQueue queue = SMQueue::open(name);
+    if (queue.mode() == QueueMode::Broadcast) {
+        throw std::runtime_error("Broadcast queue already exists and only its creator can write to it: " + name);
+    }
+    if (queue.variable_size() != variable_size) {
+        throw std::runtime_error("Local queue does not match the remote one's message format: " + name);
+    }
+    return queue;
+}
+
+// Whether a remote queue's geometry stays within the ring size the receiver accepts
+bool within_limit(const BridgeOptions& options, std::uint64_t max_elements, std::uint64_t element_size) {
+    return element_size <= options.max_ring_bytes and
+           (element_size == 0 or max_elements <= options.max_ring_bytes / element_size);
+}
+
+// Refuse a remote geometry above the receiver's limit before creating or growing anything for it
+void check_limit(const BridgeOptions& options, std::uint64_t max_elements, std::uint64_t element_size) {
+    if (!within_limit(options, max_elements, element_size)) {
+        throw std::runtime_error("Bridge sender asked for a ring of " + std::to_string(max_elements) + " x " +
+                                 std::to_string(element_size) + " bytes, above the receiver's limit of " +
+                                 std::to_string(options.max_ring_bytes));
+    }
+}
+
+// Grow the local queue if the remote one is larger. Fixed-size messages must then match exactly.
+void fit(SMQueue& queue, std::size_t max_elements, std::size_t element_size, const BridgeOptions& options) {
+    check_limit(options, max_elements, element_size);
+    if (queue.max_elements() < max_elements or queue.element_size() < element_size) {
+        queue.grow(std::max(queue.max_elements(), max_elements), std::max(queue.element_size(), element_size));
+    }
+    if (!queue.variable_size() and queue.element_size() != element_size) {
+        throw std::runtime_error("Local queue does not match the remote one's element size: " + queue.name());
+    }
+}
+
+} // namespace
+
+namespace detail {
+
+// Receiver counters, shared by the connection threads
+struct BridgeCounters {
+    std::atomic<std::uint64_t> messages{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> sends{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<std::uint64_t> lost{0};
+    std::mutex lock;
+    std::string last_error;
+    std::set<std::string> feeding; // Single-producer queues a sender is feeding
+};
+
+/*
+ * Keeps the messages of MSG_ZEROCOPY sends borrowed until the kernel reports it no longer needs their
+ * pages. Each successful send gets the next 32-bit id; completions arrive on the socket's error queue as
+ * ranges of ids, in order for TCP.
+ */
+class ZeroCopyTracker {
+  public:
+    explicit ZeroCopyTracker(int fd) : m_fd(fd), m_issued(0), m_completed(0), m_borrowed(0) {}
+
+    // Count a successful MSG_ZEROCOPY send
+    void sent() { m_issued++; }
+
+    // Hold the messages of the batch just sent, and the frame headers sent with them, until every send
+    // so far has completed
+    void hold(std::vector<std::size_t>&& indices, std::vector<FrameHeader>&& headers) {
+        m_borrowed += indices.size();
+        m_pending.push_back(Pending{m_issued, std::move(indices), std::move(headers)});
+    }
+
+    // Messages still held
+    std::size_t borrowed() const { return m_borrowed; }
+
+    // Release every batch, completed or not, once the connection is going away
+    template <typename Release> void release_all(Release release) {
+        for (const Pending& pending : m_pending) {
+            release(pending.indices);
+        }
+        m_pending.clear();
+        m_borrowed = 0;
+    }
+
+    // Release the batches whose sends have completed. With wait, block until one has (or timeout_ms
+    // passes). Returns false if nothing could be released.
+    template <typename Release> bool reap(Release release, bool wait, int timeout_ms = kPollMs) {
+        bool released = false;
+        while (!m_pending.empty()) {
+            read_completions();
+            while (!m_pending.empty() and reached(m_completed, m_pending.front().end)) {
+                m_borrowed -= m_pending.front().indices.size();
+                release(m_pending.front().indices);
+                m_pending.pop_front();
+                released = true;
+            }
+            if (released or !wait or m_pending.empty()) {
+                break;
+            }
+            pollfd entry = {m_fd, 0, 0}; // POLLERR is always reported
+            if (poll(&entry, 1, timeout_ms) <= 0) {
+                break;
+            }
+        }
+        return released;
+    }
+
+  private:
+    struct Pending {
+        std::uint32_t end; // Completed once m_completed reaches it
+        std::vector<std::size_t> indices;
+        std::vector<FrameHeader> headers; // The kernel reads them with the payloads
+    };
+
+    void read_completions() {
+#if defined(SHMEM_BRIDGE_ZEROCOPY)
+        for (;;) {
+            char control[128];
+            msghdr message = {};
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            if (recvmsg(m_fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                return; // EAGAIN: nothing more for now
+            }
+            for (cmsghdr* entry = CMSG_FIRSTHDR(&message); entry != nullptr; entry = CMSG_NXTHDR(&message, entry)) {
+                const bool error = (entry->cmsg_level == SOL_IP and entry->cmsg_type == IP_RECVERR) or
+                                   (entry->cmsg_level == SOL_IPV6 and entry->cmsg_type == IPV6_RECVERR);
+                if (!error) {
+                    continue;
+                }
+                sock_extended_err report;
+                std::memcpy(&report, CMSG_DATA(entry), sizeof(report));
+                if (report.ee_errno == 0 and report.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                    // ee_info..ee_data is the range of completed ids, inclusive
+                    m_completed = report.ee_data + 1;
+                }
+            }
+        }
+#endif
+    }
+
+    int m_fd;
+    std::uint32_t m_issued;    // Ids handed out
+    std::uint32_t m_completed; // Every id below this has completed
+    std::size_t m_borrowed;
+    std::deque<Pending> m_pending;
+};
+
+} // namespace detail
+
+BridgeSender::BridgeSender(const std::string& queue_name, const std::string& destination,
+                           const BridgeOptions& options)
+    : m_queue(SMQueue::open(queue_name)), m_options(options), m_fd(-1), m_stop(nullptr),
+      m_borrow(m_queue.mode() != QueueMode::Broadcast), m_max_elements(m_queue.max_elements()),
+      m_element_size(m_queue.element_size()), m_sequence(0) {
+    if (m_options.batch_messages == 0) {
+        throw std::runtime_error("Bridge batches must hold at least one message");
+    }
+
+    if (m_options.transport == BridgeTransport::Udp) {
+        if (m_options.datagram_bytes > kMaxDatagram) {
+            throw std::runtime_error("Datagrams cannot exceed " + std::to_string(kMaxDatagram) + " bytes");
+        }
+        if (!m_queue.variable_size() and
+            sizeof(DatagramHeader) + sizeof(std::uint32_t) + m_element_size > m_options.datagram_bytes) {
+            throw std::runtime_error("Messages of " + std::to_string(m_element_size) +
+                                     " bytes do not fit a datagram; use TCP or larger datagrams");
+        }
+
+        addrinfo* list = resolve(destination, AF_INET, SOCK_DGRAM, false);
+        m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_fd < 0) {
+            freeaddrinfo(list);
+            fail("Failed to create UDP socket");
+        }
+        const in_addr group = reinterpret_cast<const sockaddr_in*>(list->ai_addr)->sin_addr;
+        if (IN_MULTICAST(ntohl(group.s_addr))) {
+            const int ttl = m_options.multicast_ttl;
+            setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+            in_addr interface = {};
+            if (!m_options.interface.empty() and inet_pton(AF_INET, m_options.interface.c_str(), &interface) == 1) {
+                setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+            }
+        }
+        const int result = connect(m_fd, list->ai_addr, list->ai_addrlen);
+        freeaddrinfo(list);
+        if (result != 0) {
+            close_socket(m_fd);
+            fail("Failed to address " + destination);
+        }
+        return;
+    }
+
+    addrinfo* list = resolve(destination, AF_UNSPEC, SOCK_STREAM, false);
+    for (addrinfo* entry = list; entry != nullptr and m_fd < 0; entry = entry->ai_next) {
+        m_fd = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+        if (m_fd >= 0 and connect(m_fd, entry->ai_addr, entry->ai_addrlen) != 0) {
+            close_socket(m_fd);
+            m_fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (m_fd < 0) {
+        fail("Failed to connect to " + destination);
+    }
+
+    const int on = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#if defined(SHMEM_BRIDGE_ZEROCOPY)
+    // Copies of Broadcast messages are reused by the next batch, so only borrowed messages go zero-copy
+    if (m_borrow and m_options.zerocopy_threshold != 0 and
+        setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0) {
+        m_zerocopy = std::make_unique<detail::ZeroCopyTracker>(m_fd);
+    }
+#endif
+    try {
+        send_hello();
+    } catch (...) {
+        close_socket(m_fd);
+        throw;
+    }
+}
+
+BridgeSender::~BridgeSender() {
+    if (m_zerocopy) {
+        // Give the kernel a moment to finish with the pages before handing the slots back
+        auto release_fn = [this](const std::vector<std::size_t>& indices) { release(indices); };
+        for (int i = 0; i < 10 and m_fd >= 0 and m_zerocopy->borrowed() != 0; ++i) {
+            m_zerocopy->reap(release_fn, true);
+        }
+        m_zerocopy->release_all(release_fn);
+    }
+    close_socket(m_fd);
+}
+
+void BridgeSender::run(const std::atomic<bool>& stop) {
+    while (!stop.load() and m_fd >= 0) {
+        poll(std::chrono::milliseconds(kPollMs), &stop);
+    }
+}
+
+std::size_t BridgeSender::poll(std::chrono::milliseconds wait, const std::atomic<bool>* stop) {
+    if (m_fd < 0) {
+        throw std::runtime_error("Bridge sender was stopped in the middle of a send; its connection is closed");
+    }
+    m_stop = stop;
+
+    auto release_fn = [this](const std::vector<std::size_t>& indices) { release(indices); };
+    if (m_zerocopy) {
+        // Held messages count against the ring; never let them take more than half of it. Completions
+        // follow the receiver's acknowledgements, so a receiver that stops reading holds them up.
+        m_zerocopy->reap(release_fn, false);
+        while (m_zerocopy->borrowed() != 0 and m_zerocopy->borrowed() >= std::max<std::size_t>(1, m_max_elements / 2)) {
+            if (m_stop != nullptr and m_stop->load()) {
+                return 0;
+            }
+            m_zerocopy->reap(release_fn, true);
+        }
+        // Come back soon for the completions of what is still held
+        if (m_zerocopy->borrowed() != 0) {
+            wait = std::min(wait, std::chrono::milliseconds(1));
+        }
+    }
+
+    gather(wait);
+    if (m_batch.empty()) {
+        return 0;
+    }
+
+    // The batch may come from a generation the queue grew into
+    if (m_queue.max_elements() != m_max_elements or m_queue.element_size() != m_element_size) {
+        m_max_elements = m_queue.max_elements();
+        m_element_size = m_queue.element_size();
+        if (m_options.transport == BridgeTransport::Tcp and !send_geometry()) {
+            abandon();
+            return 0;
+        }
+    }
+
+    if (m_options.transport == BridgeTransport::Udp) {
+        send_datagrams();
+    } else if (!send_stream()) {
+        abandon();
+        return 0;
+    }
+    return m_batch.size();
+}
+
+BridgeStats BridgeSender::stats() const { return m_stats; }
+
+// Take up to a batch of messages, waiting at most wait for the first
+void BridgeSender::gather(std::chrono::milliseconds wait) {
+    m_batch.clear();
+    const std::size_t element_size = m_queue.element_size();
+    if (!m_borrow) {
+        m_staging.resize(m_options.batch_messages * element_size);
+    }
+
+    std::size_t bytes = 0;
+    while (m_batch.size() < m_options.batch_messages and bytes < m_options.batch_bytes) {
+        Taken taken = {nullptr, 0, 0};
+        bool ok;
+        if (m_borrow) {
+            ok = m_batch.empty() ? m_queue.borrow_for(&taken.data, taken.index, taken.length, wait)
+                                 : m_queue.borrow(&taken.data, taken.index, taken.length);
+        } else {
+            std::byte* copy = m_staging.data() + m_batch.size() * element_size;
+            ok = m_batch.empty() ? m_queue.pop_for(copy, taken.length, wait) : m_queue.try_pop(copy, taken.length);
+            taken.data = copy;
+        }
+        if (!ok) {
+            break;
+        }
+        m_batch.push_back(taken);
+        bytes += taken.length;
+
+        // A consumer that just switched to a grown ring returns its element size anew
+        if (m_queue.element_size() != element_size) {
+            break;
+        }
+    }
+}
+
+// Wait until the socket takes more data. Returns false if stop was requested first.
+bool BridgeSender::wait_writable() {
+    for (;;) {
+        if (m_stop != nullptr and m_stop->load()) {
+            return false;
+        }
+        pollfd entry = {m_fd, POLLOUT, 0};
+        if (::poll(&entry, 1, kPollMs) <= 0) {
+            continue;
+        }
+        if ((entry.revents & POLLOUT) != 0 or !m_zerocopy) {
+            return true; // Errors surface in the next send
+        }
+        // POLLERR alone: zero-copy completions are waiting on the error queue, or the socket failed
+        if (!m_zerocopy->reap([this](const std::vector<std::size_t>& indices) { release(indices); }, false)) {
+            return true;
+        }
+    }
+}
+
+// Send all of data. Returns false if stop was requested first.
+bool BridgeSender::send_all(const void* data, std::size_t length) {
+    const auto* bytes = static_cast<const std::byte*>(data);
+    while (length > 0) {
+        const ssize_t sent = send(m_fd, bytes, length, kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN or errno == EWOULDBLOCK) {
+                if (!wait_writable()) {
+                    return false;
+                }
+                continue;
+            }
+            fail("Failed to send to bridge peer");
+        }
+        bytes += sent;
+        length -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+// Announce the source queue to the receiver
+void BridgeSender::send_hello() {
+    const QueueOptions& options = m_queue.get_control_block()->options;
+    Hello hello = {};
+    std::memcpy(hello.magic, kHelloMagic, sizeof(kHelloMagic));
+    hello.mode = static_cast<std::uint32_t>(m_queue.mode());
+    hello.overflow = static_cast<std::uint32_t>(options.overflow);
+    hello.variable_size = m_queue.variable_size() ? 1 : 0;
+    hello.name_length = static_cast<std::uint32_t>(m_queue.name().size());
+    hello.max_elements = m_max_elements;
+    hello.element_size = m_element_size;
+    hello.max_readers = options.max_readers;
+    send_all(&hello, sizeof(hello));
+    send_all(m_queue.name().data(), m_queue.name().size());
+}
+
+// Tell the receiver the source queue grew. Returns false if stop was requested first.
+bool BridgeSender::send_geometry() {
+    struct {
+        FrameHeader header;
+        Geometry geometry;
+    } frame = {{sizeof(Geometry), kFrameGeometry}, {m_max_elements, m_element_size}};
+    return send_all(&frame, sizeof(frame));
+}
+
+// Send the batch as one stream of frames, gathering headers and payloads straight from the ring. Returns
+// false if stop was requested before all of it went out.
+bool BridgeSender::send_stream() {
+    std::vector<FrameHeader> headers(m_batch.size());
+    std::vector<iovec> iov;
+    iov.reserve(m_batch.size() * 2);
+    std::size_t payload = 0;
+    for (std::size_t i = 0; i < m_batch.size(); ++i) {
+        headers[i] = FrameHeader{static_cast<std::uint32_t>(m_batch[i].length), 0};
+        iov.push_back(iovec{&headers[i], sizeof(FrameHeader)});
+        if (m_batch[i].length != 0) {
+            iov.push_back(iovec{const_cast<std::byte*>(m_batch[i].data), m_batch[i].length});
+        }
+        payload += m_batch[i].length;
+    }
+
+    int flags = kSendFlags;
+#if defined(SHMEM_BRIDGE_ZEROCOPY)
+    const bool zerocopy = m_zerocopy and payload >= m_options.zerocopy_threshold;
+    if (zerocopy) {
+        flags |= MSG_ZEROCOPY;
+    }
+#else
+    const bool zerocopy = false;
+#endif
+
+    std::size_t first = 0;
+    while (first < iov.size()) {
+        msghdr message = {};
+        message.msg_iov = iov.data() + first;
+        message.msg_iovlen = std::min<std::size_t>(iov.size() - first, IOV_MAX);
+        const ssize_t sent = sendmsg(m_fd, &message, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN or errno == EWOULDBLOCK) {
+                if (!wait_writable()) {
+                    return false;
+                }
+                continue;
+            }
+            if (errno == ENOBUFS and zerocopy) {
+                // Out of memory for pinning pages until earlier sends complete
+                if (m_stop != nullptr and m_stop->load()) {
+                    return false;
+                }
+                m_zerocopy->reap([this](const std::vector<std::size_t>& indices) { release(indices); }, true);
+                continue;
+            }
+            fail("Failed to send to bridge peer");
+        }
+        m_stats.sends++;
+        if (zerocopy) {
+            m_zerocopy->sent();
+            m_stats.zerocopy_sends++;
+        }
+
+        // Skip what went out; a partial send leaves the rest of an iovec for the next call
+        auto left = static_cast<std::size_t>(sent);
+        while (first < iov.size() and left >= iov[first].iov_len) {
+            left -= iov[first].iov_len;
+            first++;
+        }
+        if (left != 0) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+            iov[first].iov_len -= left;
+        }
+    }
+
+    m_stats.messages += m_batch.size();
+    m_stats.bytes += payload;
+
+    std::vector<std::size_t> indices;
+    indices.reserve(m_batch.size());
+    for (const Taken& taken : m_batch) {
+        indices.push_back(taken.index);
+    }
+    if (zerocopy) {
+        m_zerocopy->hold(std::move(indices), std::move(headers));
+    } else {
+        release(indices);
+    }
+    return true;
+}
+
+// Send the batch as datagrams, each holding as many whole messages as fit
+void BridgeSender::send_datagrams() {
+    const std::size_t limit = std::max(m_options.datagram_bytes, sizeof(DatagramHeader) + sizeof(std::uint32_t));
+    const bool variable = m_queue.variable_size();
+    const QueueOptions& options = m_queue.get_control_block()->options;
+
+    // Sized up front: the iovecs point into these
+    std::vector<DatagramHeader> headers;
+    headers.reserve(m_batch.size());
+    std::vector<std::uint32_t> lengths(m_batch.size());
+    std::vector<iovec> iov;
+    iov.reserve(m_batch.size() * 3);
+    std::vector<std::size_t> starts; // First iovec of each datagram
+    std::vector<std::size_t> counts; // Messages in each datagram
+
+    std::size_t size = limit; // Of the datagram being filled; starts "full" so the first message opens one
+    for (std::size_t i = 0; i < m_batch.size(); ++i) {
+        const std::size_t length = m_batch[i].length;
+        const std::size_t need = sizeof(std::uint32_t) + length;
+        if (sizeof(DatagramHeader) + need > limit) {
+            m_stats.dropped++; // Variable-size message too large for any datagram
+            continue;
+        }
+        if (size + need > limit or counts.back() == 0xffff) {
+            DatagramHeader header = {};
+            std::memcpy(header.magic, kDatagramMagic, sizeof(kDatagramMagic));
+            header.version = kDatagramVersion;
+            header.mode = static_cast<std::uint32_t>(m_queue.mode());
+            header.flags = variable ? kDatagramVariable : 0;
+            header.overflow = static_cast<std::uint32_t>(options.overflow);
+            header.max_readers = static_cast<std::uint32_t>(options.max_readers);
+            header.sequence = m_sequence;
+            header.max_elements = m_max_elements;
+            header.element_size = m_element_size;
+            headers.push_back(header);
+            starts.push_back(iov.size());
+            counts.push_back(0);
+            iov.push_back(iovec{&headers.back(), sizeof(DatagramHeader)});
+            size = sizeof(DatagramHeader);
+        }
+        lengths[i] = static_cast<std::uint32_t>(length);
+        iov.push_back(iovec{&lengths[i], sizeof(std::uint32_t)});
+        if (length != 0) {
+            iov.push_back(iovec{const_cast<std::byte*>(m_batch[i].data), length});
+        }
+        headers.back().count++;
+        counts.back()++;
+        size += need;
+        m_sequence++;
+        m_stats.messages++;
+        m_stats.bytes += length;
+    }
+
+    const std::size_t datagrams = starts.size();
+    std::size_t sent = 0;
+    while (sent < datagrams) {
+#if defined(__linux__)
+        mmsghdr messages[kDatagramBatch] = {};
+        const std::size_t n = std::min(kDatagramBatch, datagrams - sent);
+        for (std::size_t k = 0; k < n; ++k) {
+            const std::size_t d = sent + k;
+            const std::size_t end = d + 1 < datagrams ? starts[d + 1] : iov.size();
+            messages[k].msg_hdr.msg_iov = iov.data() + starts[d];
+            messages[k].msg_hdr.msg_iovlen = end - starts[d];
+        }
+        const int result = sendmmsg(m_fd, messages, static_cast<unsigned int>(n), MSG_DONTWAIT);
+#else
+        msghdr message = {};
+        const std::size_t end = sent + 1 < datagrams ? starts[sent + 1] : iov.size();
+        message.msg_iov = iov.data() + starts[sent];
+        message.msg_iovlen = end - starts[sent];
+        const int result = sendmsg(m_fd, &message, MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN or errno == EWOULDBLOCK) and wait_writable()) {
+                continue;
+            }
+            // Nobody listening (an ICMP error on unicast), or stopped while the socket buffer was full: the
+            // datagram is lost, as it would be on the wire, and the receiver sees the gap
+            m_stats.dropped += counts[sent];
+            m_stats.messages -= counts[sent];
+            sent++;
+            continue;
+        }
+        m_stats.sends += static_cast<std::uint64_t>(result);
+        sent += static_cast<std::size_t>(result);
+    }
+
+    std::vector<std::size_t> indices;
+    indices.reserve(m_batch.size());
+    for (const Taken& taken : m_batch) {
+        indices.push_back(taken.index);
+    }
+    release(indices);
+}
+
+// Give up on a TCP stream stopped partway through a frame, which cannot be resumed: close it, and hand
+// the batch and every held message back to the queue
+void BridgeSender::abandon() {
+    auto release_fn = [this](const std::vector<std::size_t>& indices) { release(indices); };
+    std::vector<std::size_t> indices;
+    indices.reserve(m_batch.size());
+    for (const Taken& taken : m_batch) {
+        indices.push_back(taken.index);
+    }
+    release(indices);
+    m_stats.dropped += m_batch.size();
+    m_batch.clear();
+    if (m_zerocopy) {
+        m_zerocopy->release_all(release_fn);
+    }
+    close_socket(m_fd);
+    m_fd = -1;
+}
+
+// Hand messages back to the queue once they are no longer needed
+void BridgeSender::release(const std::vector<std::size_t>& indices) {
+    if (!m_borrow) {
+        return;
+    }
+    for (const std::size_t index : indices) {
+        m_queue.commit_pop(index);
+    }
+}
+
+BridgeReceiver::BridgeReceiver(const std::string& endpoint, const BridgeOptions& options,
+                               const std::string& queue_name)
+    : m_options(options), m_queue_name(queue_name), m_fd(-1),
+      m_counters(std::make_unique<detail::BridgeCounters>()) {
+    const int on = 1;
+    if (m_options.transport == BridgeTransport::Udp) {
+        if (m_queue_name.empty()) {
+            throw std::runtime_error("UDP bridge receivers need the name of the queue to feed");
+        }
+
+        std::string host;
+        std::string port;
+        split_endpoint(endpoint, host, port);
+        in_addr group = {};
+        if (!host.empty() and inet_pton(AF_INET, host.c_str(), &group) != 1) {
+            throw std::runtime_error("UDP bridges need an IPv4 address: " + host);
+        }
+
+        m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_fd < 0) {
+            fail("Failed to create UDP socket");
+        }
+        // Several receivers on one host may join the same group
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        const int buffer = 8 << 20;
+        setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+        const bool multicast = IN_MULTICAST(ntohl(group.s_addr));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<std::uint16_t>(std::stoi(port)));
+        address.sin_addr.s_addr = multicast ? htonl(INADDR_ANY) : group.s_addr;
+        if (bind(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            close_socket(m_fd);
+            fail("Failed to bind " + endpoint);
+        }
+        if (multicast) {
+            ip_mreq membership = {};
+            membership.imr_multiaddr = group;
+            membership.imr_interface.s_addr = htonl(INADDR_ANY);
+            if (!m_options.interface.empty()) {
+                inet_pton(AF_INET, m_options.interface.c_str(), &membership.imr_interface);
+            }
+            if (setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+                close_socket(m_fd);
+                fail("Failed to join multicast group " + host);
+            }
+        }
+        return;
+    }
+
+    addrinfo* list = resolve(endpoint, AF_UNSPEC, SOCK_STREAM, true);
+    for (addrinfo* entry = list; entry != nullptr and m_fd < 0; entry = entry->ai_next) {
+        m_fd = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+        if (m_fd < 0) {
+            continue;
+        }
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(m_fd, entry->ai_addr, entry->ai_addrlen) != 0 or listen(m_fd, 16) != 0) {
+            close_socket(m_fd);
+            m_fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (m_fd < 0) {
+        fail("Failed to listen on " + endpoint);
+    }
+}
+
+BridgeReceiver::~BridgeReceiver() { close_socket(m_fd); }
+
+void BridgeReceiver::run(const std::atomic<bool>& stop) {
+    if (m_options.transport == BridgeTransport::Udp) {
+        serve_datagrams(stop);
+        return;
+    }
+
+    // One thread per sender. std::list keeps each flag in place while the threads run.
+    struct Connection {
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+    std::list<Connection> connections;
+    while (!stop.load()) {
+        // Join the threads of senders that went away
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (it->done.load()) {
+                it->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (!wait_readable(m_fd, kPollMs)) {
+            continue;
+        }
+        const int fd = accept(m_fd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        Connection& connection = connections.emplace_back();
+        connection.thread = std::thread([this, fd, &stop, &connection] {
+            try {
+                serve_stream(fd, stop);
+            } catch (const std::exception& e) {
+                // One broken sender must not take the others down
+                std::lock_guard<std::mutex> guard(m_counters->lock);
+                m_counters->last_error = e.what();
+            }
+            close_socket(fd);
+            connection.done.store(true);
+        });
+    }
+    for (Connection& connection : connections) {
+        connection.thread.join();
+    }
+}
+
+BridgeStats BridgeReceiver::stats() const {
+    BridgeStats stats;
+    stats.messages = m_counters->messages.load(std::memory_order_relaxed);
+    stats.bytes = m_counters->bytes.load(std::memory_order_relaxed);
+    stats.sends = m_counters->sends.load(std::memory_order_relaxed);
+    stats.dropped = m_counters->dropped.load(std::memory_order_relaxed);
+    stats.lost = m_counters->lost.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(m_counters->lock);
+    stats.last_error = m_counters->last_error;
+    return stats;
+}
+
+// Push one received message, waiting for room on Block queues. Returns false if stop was requested first.
+bool BridgeReceiver::deliver(SMQueue& queue, const std::byte* data, std::size_t length,
+                             const std::atomic<bool>& stop) {
+    if (blocks(queue)) {
+        while (!queue.push_for(data, length, std::chrono::milliseconds(kPollMs))) {
+            if (stop.load()) {
+                return false;
+            }
+        }
+    } else if (!queue.push(data, length)) {
+        m_counters->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_counters->messages.fetch_add(1, std::memory_order_relaxed);
+    m_counters->bytes.fetch_add(length, std::memory_order_relaxed);
+    return true;
+}
+
+// Reserve room for a message, waiting for it on Block queues. nullptr if the message would be dropped, or
+// if stop was requested first.
+std::byte* BridgeReceiver::reserve(SMQueue& queue, std::size_t length, const std::atomic<bool>& stop) {
+    if (!blocks(queue)) {
+        return queue.reserve(length);
+    }
+    for (;;) {
+        std::byte* dest =
+            queue.reserve_until(length, std::chrono::steady_clock::now() + std::chrono::milliseconds(kPollMs));
+        if (dest != nullptr or stop.load()) {
+            return dest;
+        }
+    }
+}
+
+// Whether pushes to queue wait for room
+bool BridgeReceiver::blocks(const SMQueue& queue) {
+    return queue.get_control_block()->options.overflow == OverflowPolicy::Block;
+}
+
+// Feed the local queue from one TCP sender
+void BridgeReceiver::serve_stream(int fd, const std::atomic<bool>& stop) {
+    Hello hello;
+    if (!recv_all(fd, &hello, sizeof(hello), stop)) {
+        return;
+    }
+    if (std::memcmp(hello.magic, kHelloMagic, sizeof(kHelloMagic)) != 0) {
+        throw std::runtime_error("Bridge peer did not identify itself as a sender");
+    }
+    if (hello.name_length > NAME_MAX) {
+        throw std::runtime_error("Bridge sender sent a queue name of " + std::to_string(hello.name_length) +
+                                 " bytes, longer than NAME_MAX");
+    }
+    std::string name(hello.name_length, '\0');
+    if (!recv_all(fd, &name[0], name.size(), stop)) {
+        return;
+    }
+    if (!m_queue_name.empty()) {
+        name = m_queue_name;
+    }
+
+    check_limit(m_options, hello.max_elements, hello.element_size);
+    SMQueue queue = local_queue(name, static_cast<QueueMode>(hello.mode), static_cast<OverflowPolicy>(hello.overflow),
+                                hello.variable_size != 0, hello.max_elements, hello.element_size, hello.max_readers);
+    fit(queue, hello.max_elements, hello.element_size, m_options);
+
+    // A second producer would corrupt an SPSC ring, and a Broadcast queue has only one writer
+    const bool single = queue.mode() == QueueMode::SPSC or queue.mode() == QueueMode::Broadcast;
+    if (single) {
+        std::lock_guard<std::mutex> guard(m_counters->lock);
+        if (!m_counters->feeding.insert(name).second) {
+            throw std::runtime_error("Another sender is already feeding single-producer queue " + name);
+        }
+    }
+    struct Done {
+        detail::BridgeCounters& counters;
+        const std::string& name;
+        bool single;
+        ~Done() {
+            if (single) {
+                std::lock_guard<std::mutex> guard(counters.lock);
+                counters.feeding.erase(name);
+            }
+        }
+    } done{*m_counters, name, single};
+
+    // Frames are parsed out of buffer[begin, end); the buffer always holds a whole frame of the largest size
+    std::vector<std::byte> buffer(std::max(kReceiveBuffer, sizeof(FrameHeader) + queue.element_size()));
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    while (!stop.load()) {
+        while (end - begin >= sizeof(FrameHeader)) {
+            FrameHeader header;
+            std::memcpy(&header, buffer.data() + begin, sizeof(header));
+            const std::size_t available = end - begin - sizeof(header);
+            const std::byte* payload = buffer.data() + begin + sizeof(header);
+
+            if ((header.flags & kFrameGeometry) != 0) {
+                if (available < sizeof(Geometry)) {
+                    break;
+                }
+                Geometry geometry;
+                std::memcpy(&geometry, payload, sizeof(geometry));
+                fit(queue, geometry.max_elements, geometry.element_size, m_options);
+                begin += sizeof(header) + sizeof(geometry);
+                if (buffer.size() < sizeof(FrameHeader) + queue.element_size()) {
+                    buffer.resize(sizeof(FrameHeader) + queue.element_size());
+                }
+                continue;
+            }
+            if (header.length > queue.element_size()) {
+                throw std::runtime_error("Bridge sender exceeded the element size of " + name);
+            }
+
+            if (available >= header.length) {
+                if (!deliver(queue, payload, header.length, stop)) {
+                    return;
+                }
+                begin += sizeof(header) + header.length;
+                continue;
+            }
+
+            if (!single or header.length - available < kDirectBytes) {
+                break; // Wait for the rest in the buffer
+            }
+
+            // A large message: receive the rest of it straight into the ring
+            std::byte* dest = reserve(queue, header.length, stop);
+            if (dest == nullptr and stop.load()) {
+                return;
+            }
+            if (dest == nullptr) {
+                // The local queue is full; read the message off the stream anyway
+                std::size_t left = header.length - available;
+                while (left > 0) {
+                    const std::size_t chunk = std::min(left, buffer.size());
+                    if (!recv_all(fd, buffer.data(), chunk, stop)) {
+                        return;
+                    }
+                    left -= chunk;
+                }
+                m_counters->dropped.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                std::memcpy(dest, payload, available);
+                if (!recv_all(fd, dest + available, header.length - available, stop)) {
+                    return; // The message is lost with the stream; its reservation is never published
+                }
+                if (!queue.publish()) {
+                    m_counters->dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+                m_counters->messages.fetch_add(1, std::memory_order_relaxed);
+                m_counters->bytes.fetch_add(header.length, std::memory_order_relaxed);
+            }
+            begin = end = 0;
+        }
+
+        // Move a partial frame to the front once the buffer runs out of room behind it
+        if (begin == end) {
+            begin = end = 0;
+        } else if (end == buffer.size() or buffer.size() - begin < sizeof(FrameHeader) + queue.element_size()) {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+
+        if (!wait_readable(fd, kPollMs)) {
+            continue;
+        }
+        const ssize_t received = recv(fd, buffer.data() + end, buffer.size() - end, 0);
+        if (received == 0) {
+            return; // The sender went away
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail("Failed to receive from bridge sender");
+        }
+        end += static_cast<std::size_t>(received);
+        m_counters->sends.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Feed the local queue from datagrams, counting the messages of lost ones
+void BridgeReceiver::serve_datagrams(const std::atomic<bool>& stop) {
+    std::vector<std::byte> buffers(kDatagramBatch * kMaxDatagram);
+    std::unique_ptr<SMQueue> queue; // Opened on the first datagram, which carries the geometry
+    std::uint64_t next = 0;         // Sequence number expected next
+    bool started = false;
+
+    while (!stop.load()) {
+        if (!wait_readable(m_fd, kPollMs)) {
+            continue;
+        }
+
+        std::size_t sizes[kDatagramBatch];
+        std::size_t n = 0;
+#if defined(__linux__)
+        mmsghdr messages[kDatagramBatch] = {};
+        iovec iov[kDatagramBatch];
+        for (std::size_t k = 0; k < kDatagramBatch; ++k) {
+            iov[k] = iovec{buffers.data() + k * kMaxDatagram, kMaxDatagram};
+            messages[k].msg_hdr.msg_iov = &iov[k];
+            messages[k].msg_hdr.msg_iovlen = 1;
+        }
+        const int result = recvmmsg(m_fd, messages, kDatagramBatch, MSG_DONTWAIT, nullptr);
+        for (int k = 0; k < result; ++k) {
+            sizes[n++] = messages[k].msg_len;
+        }
+#else
+        const ssize_t result = recv(m_fd, buffers.data(), kMaxDatagram, MSG_DONTWAIT);
+        if (result >= 0) {
+            sizes[n++] = static_cast<std::size_t>(result);
+        }
+#endif
+        if (result < 0) {
+            if (errno == EINTR or errno == EAGAIN or errno == EWOULDBLOCK) {
+                continue;
+            }
+            fail("Failed to receive bridge datagrams");
+        }
+
+        for (std::size_t k = 0; k < n; ++k) {
+            const std::byte* data = buffers.data() + k * kMaxDatagram;
+            DatagramHeader header;
+            if (sizes[k] < sizeof(header)) {
+                continue;
+            }
+            std::memcpy(&header, data, sizeof(header));
+            if (std::memcmp(header.magic, kDatagramMagic, sizeof(kDatagramMagic)) != 0 or
+                header.version != kDatagramVersion) {
+                continue; // Not ours
+            }
+            m_counters->sends.fetch_add(1, std::memory_order_relaxed);
+
+            // Datagrams are unauthenticated: drop those asking for a larger ring than allowed
+            if (!within_limit(m_options, header.max_elements, header.element_size)) {
+                m_counters->dropped.fetch_add(header.count, std::memory_order_relaxed);
+                continue;
+            }
+            if (!queue) {
+                queue = std::make_unique<SMQueue>(local_queue(
+                    m_queue_name, static_cast<QueueMode>(header.mode), static_cast<OverflowPolicy>(header.overflow),
+                    (header.flags & kDatagramVariable) != 0, header.max_elements, header.element_size,
+                    header.max_readers));
+            }
+            fit(*queue, header.max_elements, header.element_size, m_options);
+
+            // A sequence number behind the expected one means the sender restarted
+            if (started and header.sequence > next) {
+                m_counters->lost.fetch_add(header.sequence - next, std::memory_order_relaxed);
+            }
+            next = header.sequence + header.count;
+            started = true;
+
+            std::size_t offset = sizeof(header);
+            for (std::uint16_t i = 0; i < header.count; ++i) {
+                std::uint32_t length;
+                if (offset + sizeof(length) > sizes[k]) {
+                    break;
+                }
+                std::memcpy(&length, data + offset, sizeof(length));
+                offset += sizeof(length);
+                if (offset + length > sizes[k] or length > queue->element_size()) {
+                    break; // Truncated or corrupt
+                }
+                if (!deliver(*queue, data + offset, length, stop)) {
+                    return;
+                }
+                offset += length;
+            }
+        }
+    }
+}
+
+} // namespace shmem
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>  // for std::atomic
+#include <chrono>  // for std::chrono::milliseconds
+#include <cstddef> // for std::size_t
+#include <cstdint> // for std::uint64_t
+#include <memory>  // for std::unique_ptr
+#include <string>  // for std::string
+#include <vector>  // for std::vector
+
+#include "shmem.h"
+
+namespace shmem {
+
+namespace detail {
+struct BridgeCounters; // bridge.cpp
+class ZeroCopyTracker; // bridge.cpp
+} // namespace detail
+
+// How a bridge carries messages between hosts
+enum class BridgeTransport : std::uint32_t {
+    // One stream per remote host. Lossless and ordered; a full remote queue with the Block policy slows the
+    // sender down in turn.
+    Tcp = 0,
+    // Datagrams to one host, or to an IPv4 multicast group so any number of hosts receive the same stream
+    // at the cost of one send. Lost datagrams are counted by the receiver, never resent, and every
+    // message must fit in one datagram.
+    Udp = 1,
+};
+
+// Options accepted by BridgeSender and BridgeReceiver
+struct BridgeOptions {
+    BridgeTransport transport = BridgeTransport::Tcp;
+    std::size_t batch_messages = 64;                // Messages gathered into one send at most
+    std::size_t batch_bytes = std::size_t(1) << 20; // Payload bytes gathered into one send at most
+    // TCP: send batches of at least this many payload bytes with MSG_ZEROCOPY (Linux), straight from the
+    // queue's pages; the messages stay borrowed until the kernel is done with them. 0 disables it.
+    // Smaller sends are cheaper to copy than to pin.
+    std::size_t zerocopy_threshold = std::size_t(64) << 10;
+    std::size_t datagram_bytes = 1472; // UDP: largest datagram, headers included (1472 fits a 1500 MTU)
+    int multicast_ttl = 1;             // UDP multicast: hops the datagrams may travel; 1 stays on the subnet
+    std::string interface;             // UDP multicast: IPv4 address of the interface to use; empty for default
+    // Receivers: largest local ring (max_elements x element_size bytes) a sender may have created or grown
+    std::size_t max_ring_bytes = std::size_t(1) << 30;
+};
+
+// What a bridge has forwarded so far
+struct BridgeStats {
+    std::uint64_t messages = 0;       // Messages sent, or pushed into the local queue
+    std::uint64_t bytes = 0;          // Payload bytes of those messages
+    std::uint64_t sends = 0;          // Send calls (sendmsg, or datagrams with UDP)
+    std::uint64_t zerocopy_sends = 0; // Sends that went out with MSG_ZEROCOPY
+    std::uint64_t dropped = 0;        // Messages too large for a datagram, or dropped by the local queue
+    std::uint64_t lost = 0;           // UDP receivers: messages missing from the sequence
+    std::string last_error;           // TCP receivers: why the last sender was disconnected, if it was
+};
+
+/*
+ * Forwards the messages of a local queue to a BridgeReceiver on another host. Messages are borrowed
+ * from the ring, sent with one gathering sendmsg per batch (message headers and payloads as separate
+ * iovecs, so the payloads are never copied in user space) and released once sent. Broadcast queues
+ * cannot lend their slots, so their messages are copied out first. The bridge is an ordinary consumer:
+ * it shares the messages with the queue's other consumers, while on a Broadcast queue it sees all of
+ * them. RDMA is not supported.
+ */
+class BridgeSender {
+  public:
+    // destination is host:port (TCP), or the address:port of a host or multicast group (UDP)
+    BridgeSender(const std::string& queue_name, const std::string& destination,
+                 const BridgeOptions& options = BridgeOptions());
+    ~BridgeSender();
+
+    BridgeSender(const BridgeSender&) = delete;
+    BridgeSender& operator=(const BridgeSender&) = delete;
+
+    // Forward until stop becomes true
+    void run(const std::atomic<bool>& stop);
+
+    // Forward one batch, waiting at most wait for its first message. Returns the number of messages sent.
+    // With stop, a send the receiver is not keeping up with gives up once stop becomes true; a TCP stream
+    // stopped mid-batch is closed, and its messages are counted as dropped.
+    std::size_t poll(std::chrono::milliseconds wait, const std::atomic<bool>* stop = nullptr);
+
+    BridgeStats stats() const;
+
+  private:
+    // A message taken from the queue for the current batch
+    struct Taken {
+        const std::byte* data;
+        std::size_t length;
+        std::size_t index; // For commit_pop
+    };
+
+    void gather(std::chrono::milliseconds wait);
+    bool wait_writable();
+    bool send_all(const void* data, std::size_t length);
+    void send_hello();
+    bool send_geometry();
+    bool send_stream();
+    void send_datagrams();
+    void abandon();
+    void release(const std::vector<std::size_t>& indices);
+
+    SMQueue m_queue;
+    BridgeOptions m_options;
+    int m_fd;
+    const std::atomic<bool>* m_stop; // As given to the poll() in progress
+    bool m_borrow;                   // Whether messages are borrowed (all but Broadcast)
+    std::size_t m_max_elements; // Geometry last announced to the receiver
+    std::size_t m_element_size;
+    std::uint64_t m_sequence; // UDP: sequence number of the next message
+    std::vector<Taken> m_batch;
+    std::vector<std::byte> m_staging; // Broadcast: copies of the batch's messages
+    std::unique_ptr<detail::ZeroCopyTracker> m_zerocopy;
+    BridgeStats m_stats;
+};
+
+/*
+ * Receives what BridgeSenders forward and pushes it into a local queue. Over TCP it accepts any number
+ * of senders, one thread each; every sender names its queue, which is opened or else created like the
+ * original. A queue with a single producer (SPSC or Broadcast) is fed by one sender at a time; further
+ * senders of it are turned away. Over UDP it joins the multicast group (if the address is one) and feeds
+ * queue_name, creating it like the original from the first datagram.
+ */
+class BridgeReceiver {
+  public:
+    // endpoint is [address:]port to listen on (TCP; queue_name, if given, overrides the senders' names),
+    // or the address:port of the multicast group or local interface to receive on (UDP)
+    BridgeReceiver(const std::string& endpoint, const BridgeOptions& options = BridgeOptions(),
+                   const std::string& queue_name = std::string());
+    ~BridgeReceiver();
+
+    BridgeReceiver(const BridgeReceiver&) = delete;
+    BridgeReceiver& operator=(const BridgeReceiver&) = delete;
+
+    // Receive until stop becomes true
+    void run(const std::atomic<bool>& stop);
+
+    BridgeStats stats() const;
+
+  private:
+    void serve_stream(int fd, const std::atomic<bool>& stop);
+    void serve_datagrams(const std::atomic<bool>& stop);
+    bool deliver(SMQueue& queue, const std::byte* data, std::size_t length, const std::atomic<bool>& stop);
+    static std::byte* reserve(SMQueue& queue, std::size_t length, const std::atomic<bool>& stop);
+    static bool blocks(const SMQueue& queue);
+
+    BridgeOptions m_options;
+    std::string m_queue_name;
+    int m_fd; // Listening (TCP) or bound (UDP) socket
+    std::unique_ptr<detail::BridgeCounters> m_counters;
+};
+
+} // namespace shmem
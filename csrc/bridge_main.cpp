@@ -0,0 +1,174 @@
+// shmem_bridge: forward the messages of a queue to other hosts over TCP or UDP multicast, and push what
+// arrives from them into a local queue.
+
+#include <signal.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "bridge.h"
+
+namespace {
+
+std::atomic<bool> g_stop(false);
+
+void handle_signal(int) { g_stop.store(true); }
+
+void usage() {
+    std::cerr << "Usage: shmem_bridge send QUEUE tcp|udp HOST:PORT [options]\n"
+                 "       shmem_bridge receive tcp [ADDRESS:]PORT [--queue NAME] [--max-ring-bytes N]\n"
+                 "       shmem_bridge receive udp GROUP:PORT QUEUE [--interface ADDRESS] [--max-ring-bytes N]\n"
+                 "Send options:\n"
+                 "  --batch N               Messages gathered into one send at most (default 64)\n"
+                 "  --zerocopy-threshold N  TCP: send batches of at least N bytes with MSG_ZEROCOPY, e.g. 64K;\n"
+                 "                          0 disables it (default 64K)\n"
+                 "  --datagram-bytes N      UDP: largest datagram, headers included (default 1472)\n"
+                 "  --ttl N                 UDP multicast: hops the datagrams may travel (default 1)\n"
+                 "  --interface ADDRESS     UDP multicast: IPv4 address of the interface to use\n"
+                 "Receive options:\n"
+                 "  --max-ring-bytes N      Largest ring a sender may create or grow locally, e.g. 256M (default 1G)\n";
+}
+
+// Parse a byte count with an optional K, M or G suffix
+std::uint64_t parse_bytes(const std::string& text) {
+    char* end = nullptr;
+    std::uint64_t value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        throw std::runtime_error("Invalid number: " + text);
+    }
+    switch (*end) {
+    case 'K':
+    case 'k':
+        value <<= 10;
+        break;
+    case 'M':
+    case 'm':
+        value <<= 20;
+        break;
+    case 'G':
+    case 'g':
+        value <<= 30;
+        break;
+    case '\0':
+        break;
+    default:
+        throw std::runtime_error("Invalid number: " + text);
+    }
+    return value;
+}
+
+shmem::BridgeTransport parse_transport(const std::string& text) {
+    if (text == "tcp") {
+        return shmem::BridgeTransport::Tcp;
+    }
+    if (text == "udp") {
+        return shmem::BridgeTransport::Udp;
+    }
+    throw std::runtime_error("Unknown transport: " + text);
+}
+
+void print_stats(const char* what, const shmem::BridgeStats& stats) {
+    std::cerr << what << " " << stats.messages << " messages (" << stats.bytes << " bytes) in " << stats.sends
+              << " sends, " << stats.zerocopy_sends << " zero-copy; dropped " << stats.dropped << ", lost "
+              << stats.lost << std::endl;
+    if (!stats.last_error.empty()) {
+        std::cerr << "Last sender error: " << stats.last_error << std::endl;
+    }
+}
+
+int send(const std::string& queue, const std::string& transport, const std::string& destination, int argc,
+         char* argv[]) {
+    shmem::BridgeOptions options;
+    options.transport = parse_transport(transport);
+    for (int i = 0; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + arg);
+        }
+        const std::string value = argv[++i];
+        if (arg == "--batch") {
+            options.batch_messages = static_cast<std::size_t>(std::stoul(value));
+        } else if (arg == "--zerocopy-threshold") {
+            options.zerocopy_threshold = static_cast<std::size_t>(parse_bytes(value));
+        } else if (arg == "--datagram-bytes") {
+            options.datagram_bytes = static_cast<std::size_t>(parse_bytes(value));
+        } else if (arg == "--ttl") {
+            options.multicast_ttl = std::stoi(value);
+        } else if (arg == "--interface") {
+            options.interface = value;
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+
+    shmem::BridgeSender sender(queue, destination, options);
+    sender.run(g_stop);
+    print_stats("Sent", sender.stats());
+    return 0;
+}
+
+int receive(const std::string& transport, const std::string& endpoint, int argc, char* argv[]) {
+    shmem::BridgeOptions options;
+    options.transport = parse_transport(transport);
+    std::string queue;
+    int i = 0;
+    if (options.transport == shmem::BridgeTransport::Udp) {
+        if (argc < 1) {
+            throw std::runtime_error("UDP receivers need the name of the queue to feed");
+        }
+        queue = argv[i++];
+    }
+    for (; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + arg);
+        }
+        const std::string value = argv[++i];
+        if (arg == "--queue") {
+            queue = value;
+        } else if (arg == "--max-ring-bytes") {
+            options.max_ring_bytes = static_cast<std::size_t>(parse_bytes(value));
+        } else if (arg == "--interface") {
+            options.interface = value;
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+
+    shmem::BridgeReceiver receiver(endpoint, options, queue);
+    receiver.run(g_stop);
+    print_stats("Received", receiver.stats());
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        usage();
+        return argc > 1 and (std::string(argv[1]) == "--help" or std::string(argv[1]) == "-h") ? 0 : 1;
+    }
+
+    // Without SA_RESTART, so a signal also cuts short whatever call the bridge is waiting in
+    struct sigaction action = {};
+    action.sa_handler = handle_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    try {
+        const std::string command = argv[1];
+        if (command == "send" and argc >= 5) {
+            return send(argv[2], argv[3], argv[4], argc - 5, argv + 5);
+        }
+        if (command == "receive") {
+            return receive(argv[2], argv[3], argc - 4, argv + 4);
+        }
+        usage();
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
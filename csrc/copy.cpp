@@ -0,0 +1,268 @@
+#include "copy.h"
+
+#include <unistd.h> // for getpid
+
+#include <algorithm>          // for std::min
+#include <atomic>             // for std::atomic
+#include <condition_variable> // for std::condition_variable
+#include <cstdint>            // for std::uintptr_t
+#include <mutex>              // for std::mutex
+#include <thread>             // for std::thread
+#include <vector>             // for std::vector
+
+#if defined(__x86_64__)
+#include <immintrin.h> // for _mm512_stream_si512, _mm256_stream_si256, _mm_stream_si128
+#endif
+
+namespace shmem {
+namespace detail {
+
+namespace {
+
+// Bytes needed to bring p up to a multiple of alignment
+std::size_t misalignment(const void* p, std::size_t alignment) {
+    return (alignment - (reinterpret_cast<std::uintptr_t>(p) & (alignment - 1))) & (alignment - 1);
+}
+
+#if defined(__x86_64__)
+
+// Streaming stores need an aligned destination: copy the unaligned head and tail with memcpy and stream
+// the 64-byte blocks in between
+__attribute__((target("avx512f"))) void stream_avx512(std::byte* dst, const std::byte* src, std::size_t n) {
+    const std::size_t head = std::min(misalignment(dst, 64), n);
+    std::memcpy(dst, src, head);
+    std::size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        const __m512i v = _mm512_loadu_si512(src + i);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i), v);
+    }
+    std::memcpy(dst + i, src + i, n - i);
+    _mm_sfence();
+}
+
+__attribute__((target("avx2"))) void stream_avx2(std::byte* dst, const std::byte* src, std::size_t n) {
+    const std::size_t head = std::min(misalignment(dst, 32), n);
+    std::memcpy(dst, src, head);
+    std::size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + 32), b);
+    }
+    std::memcpy(dst + i, src + i, n - i);
+    _mm_sfence();
+}
+
+void stream_sse2(std::byte* dst, const std::byte* src, std::size_t n) {
+    const std::size_t head = std::min(misalignment(dst, 16), n);
+    std::memcpy(dst, src, head);
+    std::size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        for (std::size_t j = 0; j < 64; j += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + j));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + j), v);
+        }
+    }
+    std::memcpy(dst + i, src + i, n - i);
+    _mm_sfence();
+}
+
+using StreamFn = void (*)(std::byte*, const std::byte*, std::size_t);
+
+struct StreamKernel {
+    StreamFn fn;
+    const char* name;
+};
+
+StreamKernel select_kernel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return {stream_avx512, "avx512"};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return {stream_avx2, "avx2"};
+    }
+    return {stream_sse2, "sse2"};
+}
+
+const StreamKernel& kernel() {
+    static const StreamKernel selected = select_kernel();
+    return selected;
+}
+
+#elif defined(__aarch64__)
+
+// LDP/STNP moves 32 bytes per step with a non-temporal hint; STNP takes any 16-byte aligned address
+void stream_neon(std::byte* dst, const std::byte* src, std::size_t n) {
+    const std::size_t head = std::min(misalignment(dst, 16), n);
+    std::memcpy(dst, src, head);
+    std::size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        asm volatile("ldp q0, q1, [%[s]]\n\t"
+                     "ldp q2, q3, [%[s], #32]\n\t"
+                     "stnp q0, q1, [%[d]]\n\t"
+                     "stnp q2, q3, [%[d], #32]"
+                     :
+                     : [s] "r"(src + i), [d] "r"(dst + i)
+                     : "v0", "v1", "v2", "v3", "memory");
+    }
+    std::memcpy(dst + i, src + i, n - i);
+    asm volatile("dmb ishst" ::: "memory");
+}
+
+#endif
+
+// Process-wide pool for parallel copies. Workers are spawned on first use and wait for jobs; the
+// caller takes part in every job, so a copy across k threads wakes only k - 1 workers.
+class CopyPool {
+  public:
+    static CopyPool& instance() {
+        static CopyPool pool;
+        return pool;
+    }
+
+    ~CopyPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    void run(std::byte* dst, const std::byte* src, std::size_t n, std::uint32_t threads) {
+        // One job at a time; concurrent callers queue up here
+        std::lock_guard<std::mutex> serial(m_serial);
+
+        // Threads do not survive fork(): a child must not wait for its parent's workers
+        if (m_pid != getpid()) {
+            new std::vector<std::thread>(std::move(m_workers)); // Leaked: the handles cannot be joined
+            m_workers.clear();
+            m_pid = getpid();
+        }
+        while (m_workers.size() + 1 < threads) {
+            m_workers.emplace_back([this] { work(); });
+        }
+
+        // Page-sized chunks keep every part's streaming stores aligned
+        const std::size_t page = 4096;
+        const std::size_t chunk = (n / threads + page - 1) / page * page;
+        {
+            // Workers still looking at the previous job read its description without the lock
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [this] { return m_busy == 0; });
+            m_dst = dst;
+            m_src = src;
+            m_size = n;
+            m_chunk = chunk;
+            m_parts = static_cast<std::uint32_t>((n + chunk - 1) / chunk);
+            m_next.store(0, std::memory_order_relaxed);
+            m_pending = m_parts;
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        const std::uint32_t finished = copy_parts();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pending -= finished;
+        m_done.wait(lock, [this] { return m_pending == 0 and m_busy == 0; });
+    }
+
+  private:
+    CopyPool() : m_pid(getpid()) {}
+
+    // Claim and copy parts of the current job until none are left. Returns the number of parts copied.
+    std::uint32_t copy_parts() {
+        std::uint32_t finished = 0;
+        for (;;) {
+            const std::uint32_t part = m_next.fetch_add(1, std::memory_order_relaxed);
+            if (part >= m_parts) {
+                return finished;
+            }
+            const std::size_t offset = part * m_chunk;
+            stream_copy(m_dst + offset, m_src + offset, std::min(m_chunk, m_size - offset));
+            ++finished;
+        }
+    }
+
+    void work() {
+        std::uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_wake.wait(lock, [&] { return m_stop or m_generation != seen; });
+            if (m_stop) {
+                return;
+            }
+            seen = m_generation;
+
+            // Counted as busy so the next job is not published while this worker still looks at this one
+            ++m_busy;
+            lock.unlock();
+            const std::uint32_t finished = copy_parts();
+            lock.lock();
+            --m_busy;
+            m_pending -= finished;
+            if (m_busy == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    std::mutex m_serial; // Serialises jobs
+    std::mutex m_mutex;  // Guards the job description, m_pending and m_busy
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::vector<std::thread> m_workers;
+    pid_t m_pid; // Process that spawned m_workers
+    bool m_stop = false;
+
+    // Current job
+    std::uint64_t m_generation = 0;
+    std::byte* m_dst = nullptr;
+    const std::byte* m_src = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_chunk = 0;
+    std::uint32_t m_parts = 0;
+    std::atomic<std::uint32_t> m_next{0};
+    std::uint32_t m_pending = 0; // Parts not yet copied
+    std::uint32_t m_busy = 0;    // Workers inside copy_parts()
+};
+
+} // namespace
+
+void stream_copy(void* dst, const void* src, std::size_t n) {
+    auto* d = static_cast<std::byte*>(dst);
+    const auto* s = static_cast<const std::byte*>(src);
+#if defined(__x86_64__)
+    kernel().fn(d, s, n);
+#elif defined(__aarch64__)
+    stream_neon(d, s, n);
+#else
+    std::memcpy(d, s, n);
+#endif
+}
+
+void parallel_copy(void* dst, const void* src, std::size_t n, std::uint32_t threads) {
+    if (threads <= 1 or n < 2 * 4096) {
+        stream_copy(dst, src, n);
+        return;
+    }
+    CopyPool::instance().run(static_cast<std::byte*>(dst), static_cast<const std::byte*>(src), n, threads);
+}
+
+const char* stream_kernel() {
+#if defined(__x86_64__)
+    return kernel().name;
+#elif defined(__aarch64__)
+    return "neon";
+#else
+    return "memcpy";
+#endif
+}
+
+} // namespace detail
+} // namespace shmem
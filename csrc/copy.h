@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef> // for std::size_t
+#include <cstring> // for std::memcpy
+
+#include "shmem.h"
+
+namespace shmem {
+namespace detail {
+
+/*
+ * Copy kernels used to move message payloads in and out of a queue. Large frames are written with
+ * non-temporal (streaming) stores so they do not evict the working set of either side: AVX-512 or
+ * AVX2 on x86-64, picked at runtime, and STNP on AArch64. Parallel copies split a frame across a
+ * process-wide pool of worker threads, each of which streams its share.
+ */
+
+// Copy n bytes with non-temporal stores. Everything is globally visible when it returns.
+void stream_copy(void* dst, const void* src, std::size_t n);
+
+// Copy n bytes by splitting it across up to threads threads (the caller included)
+void parallel_copy(void* dst, const void* src, std::size_t n, std::uint32_t threads);
+
+// Name of the streaming kernel selected for this CPU ("avx512", "avx2", "sse2", "neon" or "memcpy")
+const char* stream_kernel();
+
+// Copy n bytes as requested by strategy
+inline void copy_bytes(void* dst, const void* src, std::size_t n, const CopyStrategy& strategy) {
+    if (strategy.policy == CopyPolicy::Memcpy or n < strategy.streaming_threshold) {
+        std::memcpy(dst, src, n);
+    } else if (strategy.policy == CopyPolicy::Parallel and n >= strategy.parallel_threshold and
+               strategy.threads > 1) {
+        parallel_copy(dst, src, n, strategy.threads);
+    } else {
+        stream_copy(dst, src, n);
+    }
+}
+
+} // namespace detail
+} // namespace shmem
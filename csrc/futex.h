@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm> // for std::min
+#include <atomic>    // for std::atomic
+#include <cerrno>    // for errno
+#include <chrono>    // for std::chrono::microseconds
+#include <cstddef>   // for std::size_t
+#include <cstdint>   // for std::uint32_t
+#include <thread>    // for std::this_thread
+
+#if defined(__linux__)
+#include <linux/futex.h> // for FUTEX_WAIT, FUTEX_WAKE
+#include <sys/syscall.h> // for SYS_futex
+#include <time.h>        // for timespec
+#include <unistd.h>      // for syscall
+#elif defined(__APPLE__)
+// Darwin's futex equivalent. Not in the public SDK headers but exported by libSystem since macOS 10.12.
+extern "C" int __ulock_wait(std::uint32_t operation, void* addr, std::uint64_t value, std::uint32_t timeout_us);
+extern "C" int __ulock_wake(std::uint32_t operation, void* addr, std::uint64_t wake_value);
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // for _mm_pause
+#endif
+
+namespace shmem {
+namespace detail {
+
+/*
+ * Minimal cross-process futex wrappers. The futex word must live in shared memory; the
+ * non-private variants are used so that waiters in different processes are woken.
+ */
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "Futex words must be plain 32-bit");
+
+#if defined(__linux__)
+// futex_waitv (Linux 5.16) ABI, spelled out so older kernel headers still build
+struct FutexWaitv {
+    std::uint64_t val;
+    std::uint64_t uaddr;
+    std::uint32_t flags;
+    std::uint32_t reserved;
+};
+constexpr long kSysFutexWaitv = 449;
+constexpr std::uint32_t kFutex2SizeU32 = 0x02;
+#endif
+
+// Most words futex_wait_any() can wait on
+constexpr std::size_t kFutexWaitAnyMax = 128;
+
+#if defined(__APPLE__)
+constexpr std::uint32_t kUlCompareAndWaitShared = 3;
+constexpr std::uint32_t kUlfWakeAll = 0x100;
+#endif
+
+// Hint to the CPU that we are busy-waiting
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Block while *word == expected. May return spuriously; callers must re-check their condition.
+inline void futex_wait(std::atomic<std::uint32_t>* word, std::uint32_t expected) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+#elif defined(__APPLE__)
+    __ulock_wait(kUlCompareAndWaitShared, word, expected, 0);
+#else
+    if (word->load(std::memory_order_acquire) == expected) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+#endif
+}
+
+// Block while *word == expected for at most timeout. May return early or spuriously, like futex_wait.
+inline void futex_wait_for(std::atomic<std::uint32_t>* word, std::uint32_t expected, std::chrono::nanoseconds timeout) {
+    if (timeout.count() <= 0) {
+        return;
+    }
+#if defined(__linux__)
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#elif defined(__APPLE__)
+    // A timeout of 0 means forever; round up to at least 1us
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(timeout).count() + 1;
+    __ulock_wait(kUlCompareAndWaitShared, word, expected,
+                 us > UINT32_MAX ? UINT32_MAX : static_cast<std::uint32_t>(us));
+#else
+    if (word->load(std::memory_order_acquire) == expected) {
+        std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(timeout, std::chrono::microseconds(50)));
+    }
+#endif
+}
+
+// Block while words[i] == expected[i] for every i, until deadline (steady_clock::time_point::max() waits
+// forever). May return early or spuriously, like futex_wait. Returns false without waiting if the system
+// cannot wait on several words at once: futex_waitv needs Linux 5.16 and at most kFutexWaitAnyMax words.
+inline bool futex_wait_any(std::atomic<std::uint32_t>* const* words, const std::uint32_t* expected, std::size_t count,
+                           std::chrono::steady_clock::time_point deadline) {
+#if defined(__linux__)
+    if (count > kFutexWaitAnyMax) {
+        return false;
+    }
+    FutexWaitv waiters[kFutexWaitAnyMax];
+    for (std::size_t i = 0; i < count; ++i) {
+        waiters[i] = FutexWaitv{expected[i], reinterpret_cast<std::uintptr_t>(words[i]), kFutex2SizeU32, 0};
+    }
+
+    // The timeout is absolute on CLOCK_MONOTONIC, which steady_clock reads
+    timespec ts;
+    timespec* timeout = nullptr;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+        const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+        ts.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+        ts.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+        timeout = &ts;
+    }
+    const long result = syscall(kSysFutexWaitv, waiters, static_cast<unsigned>(count), 0, timeout, CLOCK_MONOTONIC);
+    return result >= 0 or (errno != ENOSYS and errno != EINVAL);
+#else
+    (void)words;
+    (void)expected;
+    (void)count;
+    (void)deadline;
+    return false;
+#endif
+}
+
+// Wake every waiter blocked on word
+inline void futex_wake_all(std::atomic<std::uint32_t>* word) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#elif defined(__APPLE__)
+    __ulock_wake(kUlCompareAndWaitShared | kUlfWakeAll, word, 0);
+#else
+    (void)word;
+#endif
+}
+
+} // namespace detail
+} // namespace shmem
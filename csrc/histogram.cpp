@@ -0,0 +1,113 @@
+#include "histogram.h"
+
+#include <algorithm> // for std::min, std::max
+#include <limits>    // for std::numeric_limits
+
+namespace shmem {
+namespace detail {
+
+namespace {
+
+using Histogram = LatencyHistogram;
+
+// Bucket holding value
+std::size_t bucket_of(std::uint64_t value) {
+    if (value < Histogram::kSubBuckets) {
+        return static_cast<std::size_t>(value);
+    }
+    const unsigned magnitude = 63 - static_cast<unsigned>(__builtin_clzll(value)); // >= kSubBits
+    const unsigned shift = magnitude - Histogram::kSubBits;
+    const auto sub = static_cast<std::size_t>(value >> shift) - Histogram::kSubBuckets;
+    return Histogram::kSubBuckets + shift * Histogram::kSubBuckets + sub;
+}
+
+// Largest value that falls in bucket
+std::uint64_t bucket_top(std::size_t bucket) {
+    if (bucket < Histogram::kSubBuckets) {
+        return bucket;
+    }
+    const std::size_t shift = (bucket - Histogram::kSubBuckets) / Histogram::kSubBuckets;
+    const std::uint64_t sub = Histogram::kSubBuckets + (bucket - Histogram::kSubBuckets) % Histogram::kSubBuckets;
+    const std::uint64_t bottom = sub << shift;
+    return bottom + ((std::uint64_t(1) << shift) - 1);
+}
+
+// Upper bound of the bucket holding the value at quantile (0-1) of count recorded values
+std::uint64_t value_at(const Histogram& histogram, std::uint64_t count, double quantile) {
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(quantile * static_cast<double>(count)));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < Histogram::kBuckets; ++i) {
+        seen += histogram.buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return bucket_top(i);
+        }
+    }
+    return bucket_top(Histogram::kBuckets - 1);
+}
+
+} // namespace
+
+void reset_latency(LatencyHistogram& histogram) {
+    for (auto& bucket : histogram.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    histogram.count.store(0, std::memory_order_relaxed);
+    histogram.sum_ns.store(0, std::memory_order_relaxed);
+    histogram.min_ns.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
+    histogram.max_ns.store(0, std::memory_order_relaxed);
+}
+
+void record_latency(LatencyHistogram& histogram, std::uint64_t ns) {
+    histogram.buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    std::uint64_t min = histogram.min_ns.load(std::memory_order_relaxed);
+    while (ns < min and !histogram.min_ns.compare_exchange_weak(min, ns, std::memory_order_relaxed)) {
+    }
+    std::uint64_t max = histogram.max_ns.load(std::memory_order_relaxed);
+    while (ns > max and !histogram.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void merge_latency(LatencyHistogram& into, const LatencyHistogram& from) {
+    for (std::size_t i = 0; i < LatencyHistogram::kBuckets; ++i) {
+        into.buckets[i].fetch_add(from.buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    into.count.fetch_add(from.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    into.sum_ns.fetch_add(from.sum_ns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    const std::uint64_t from_min = from.min_ns.load(std::memory_order_relaxed);
+    std::uint64_t min = into.min_ns.load(std::memory_order_relaxed);
+    while (from_min < min and !into.min_ns.compare_exchange_weak(min, from_min, std::memory_order_relaxed)) {
+    }
+    const std::uint64_t from_max = from.max_ns.load(std::memory_order_relaxed);
+    std::uint64_t max = into.max_ns.load(std::memory_order_relaxed);
+    while (from_max > max and !into.max_ns.compare_exchange_weak(max, from_max, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyStats summarize_latency(const LatencyHistogram& histogram) {
+    LatencyStats stats;
+    stats.enabled = true;
+
+    // Recorders bump their bucket before the count, so the buckets normally cover count values
+    stats.count = histogram.count.load(std::memory_order_relaxed);
+    if (stats.count == 0) {
+        return stats;
+    }
+
+    stats.min_ns = histogram.min_ns.load(std::memory_order_relaxed);
+    stats.max_ns = histogram.max_ns.load(std::memory_order_relaxed);
+    stats.mean_ns = histogram.sum_ns.load(std::memory_order_relaxed) / stats.count;
+
+    // Bucket tops overestimate; the true maximum is a tighter bound
+    stats.p50_ns = std::min(value_at(histogram, stats.count, 0.5), stats.max_ns);
+    stats.p90_ns = std::min(value_at(histogram, stats.count, 0.9), stats.max_ns);
+    stats.p99_ns = std::min(value_at(histogram, stats.count, 0.99), stats.max_ns);
+    stats.p999_ns = std::min(value_at(histogram, stats.count, 0.999), stats.max_ns);
+    return stats;
+}
+
+} // namespace detail
+} // namespace shmem
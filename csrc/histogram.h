@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>  // for std::atomic
+#include <chrono>  // for std::chrono::steady_clock
+#include <cstddef> // for std::size_t
+#include <cstdint> // for std::uint64_t
+
+#include "shmem.h"
+
+namespace shmem {
+namespace detail {
+
+/*
+ * Log-linear (HDR-style) histogram of nanosecond durations that lives in shared memory. Values below 32ns
+ * get a bucket each; above that every power of two is split into 32 buckets, so a percentile is never off
+ * by more than about 3% and the whole uint64 range fits in 1920 buckets. Recording is a few relaxed
+ * atomic operations, so any number of processes can record into the same histogram.
+ */
+struct LatencyHistogram {
+    static constexpr unsigned kSubBits = 5;
+    static constexpr std::size_t kSubBuckets = std::size_t(1) << kSubBits;
+    static constexpr std::size_t kBuckets = kSubBuckets + (64 - kSubBits) * kSubBuckets;
+
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> sum_ns;
+    std::atomic<std::uint64_t> min_ns; // UINT64_MAX while empty
+    std::atomic<std::uint64_t> max_ns;
+    alignas(64) std::atomic<std::uint64_t> buckets[kBuckets];
+};
+
+// Current time on the clock shared by every process (CLOCK_MONOTONIC), in nanoseconds
+inline std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count());
+}
+
+// Empty the histogram
+void reset_latency(LatencyHistogram& histogram);
+
+// Add one duration
+void record_latency(LatencyHistogram& histogram, std::uint64_t ns);
+
+// Add every value recorded in from to into
+void merge_latency(LatencyHistogram& into, const LatencyHistogram& from);
+
+// Count, extremes, mean and percentiles of the histogram
+LatencyStats summarize_latency(const LatencyHistogram& histogram);
+
+} // namespace detail
+} // namespace shmem
@@ -0,0 +1,181 @@
+#include "mailbox.h"
+
+#include <sys/mman.h> // for munmap
+
+#include <cstring>   // for memcpy
+#include <limits>    // for std::numeric_limits
+#include <new>       // for placement new
+#include <stdexcept> // for std::runtime_error
+
+#include "segment.h"
+
+namespace shmem {
+
+// Create a new mailbox
+Mailbox Mailbox::create(const std::string& name, std::size_t value_size) {
+    if (value_size == 0) {
+        throw std::runtime_error("Mailbox must have a non-zero value size");
+    }
+
+    // Each buffer starts on its own cache line so the writer filling one never disturbs readers of the other
+    if (value_size > (std::numeric_limits<std::size_t>::max() - sizeof(ControlBlock)) / kBuffers - 63) {
+        throw std::runtime_error("Mailbox value too large, would cause integer overflow");
+    }
+    std::size_t stride = (value_size + 63) & ~std::size_t(63);
+    std::size_t total_size = sizeof(ControlBlock) + kBuffers * stride;
+
+    void* addr = detail::create_segment(name, total_size);
+
+    ControlBlock* cb = new (addr) ControlBlock();
+    cb->value_size = value_size;
+    cb->buffer_stride = stride;
+    cb->data_offset = sizeof(ControlBlock);
+    cb->version.store(0, std::memory_order_relaxed);
+    for (auto& seq : cb->seq) {
+        seq.store(0, std::memory_order_relaxed);
+    }
+
+    cb->magic.store(kMagic, std::memory_order_release);
+    return Mailbox(name, addr, total_size);
+}
+
+// Open an existing mailbox
+Mailbox Mailbox::open(const std::string& name) {
+    std::size_t size = 0;
+    void* addr = detail::open_segment(name, size);
+
+    if (size < sizeof(ControlBlock) or
+        static_cast<ControlBlock*>(addr)->magic.load(std::memory_order_acquire) != kMagic) {
+        munmap(addr, size);
+        throw std::runtime_error("Shared memory is not an initialized mailbox: " + name);
+    }
+
+    // Every buffer, at the stride and offset the header claims, must lie inside the segment
+    const auto* cb = static_cast<const ControlBlock*>(addr);
+    if (cb->data_offset < sizeof(ControlBlock) or cb->data_offset > size or
+        cb->buffer_stride > (size - cb->data_offset) / kBuffers or cb->value_size > cb->buffer_stride) {
+        munmap(addr, size);
+        throw std::runtime_error("Mailbox layout does not fit its shared memory: " + name);
+    }
+
+    return Mailbox(name, addr, size);
+}
+
+// Destroy a mailbox
+void Mailbox::destroy(const std::string& name) { detail::unlink_segment(name); }
+
+// Move constructor
+Mailbox::Mailbox(Mailbox&& other) noexcept
+    : m_name(std::move(other.m_name)), m_addr(other.m_addr), m_size(other.m_size) {
+    other.m_addr = nullptr;
+    other.m_size = 0;
+}
+
+// Move assignment
+Mailbox& Mailbox::operator=(Mailbox&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_name = std::move(other.m_name);
+        m_addr = other.m_addr;
+        m_size = other.m_size;
+        other.m_addr = nullptr;
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+// Destructor
+Mailbox::~Mailbox() noexcept { close(); }
+
+// Publish a new value into the buffer readers are not using
+void Mailbox::write(const std::byte* data) {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("Mailbox not initialized");
+    }
+
+    auto* cb = get_control_block();
+    const std::uint64_t version = cb->version.load(std::memory_order_relaxed) + 1;
+    auto& seq = cb->seq[version % kBuffers];
+
+    // Open the seqlock so readers still copying the version this buffer held two writes ago notice
+    seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(get_buffer(version), data, cb->value_size);
+
+    seq.store(version, std::memory_order_release);
+    cb->version.store(version, std::memory_order_release);
+}
+
+// Copy the newest value
+std::uint64_t Mailbox::read(std::byte* buffer) const {
+    std::uint64_t version = 0;
+    return read_newer(buffer, version) ? version : 0;
+}
+
+// Copy the newest value if it is newer than version
+bool Mailbox::read_newer(std::byte* buffer, std::uint64_t& version) const {
+    if (m_addr == nullptr) {
+        return false;
+    }
+
+    auto* cb = get_control_block();
+    for (;;) {
+        const std::uint64_t latest = cb->version.load(std::memory_order_acquire);
+        if (latest == 0 or latest == version) {
+            return false;
+        }
+        if (try_copy(buffer, latest)) {
+            version = latest;
+            return true;
+        }
+        // The writer lapped us while copying; the version has moved on, so retry with the new one
+    }
+}
+
+// Version of the newest value
+std::uint64_t Mailbox::version() const {
+    return m_addr != nullptr ? get_control_block()->version.load(std::memory_order_acquire) : 0;
+}
+
+// Close the mailbox
+void Mailbox::close() {
+    if (m_addr != nullptr) {
+        munmap(m_addr, m_size);
+        m_addr = nullptr;
+        m_size = 0;
+    }
+}
+
+// Get value size in bytes
+std::size_t Mailbox::value_size() const { return m_addr != nullptr ? get_control_block()->value_size : 0; }
+
+// Get mailbox name
+const std::string& Mailbox::name() const { return m_name; }
+
+// Constructor
+Mailbox::Mailbox(const std::string& name, void* addr, std::size_t size) : m_name(name), m_addr(addr), m_size(size) {}
+
+// Copy a version out of its buffer, validating the seqlock before and after
+bool Mailbox::try_copy(std::byte* buffer, std::uint64_t version) const {
+    auto* cb = get_control_block();
+    const auto& seq = cb->seq[version % kBuffers];
+
+    if (seq.load(std::memory_order_acquire) != version) {
+        return false;
+    }
+    std::memcpy(buffer, get_buffer(version), cb->value_size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq.load(std::memory_order_relaxed) == version;
+}
+
+// Get control block
+Mailbox::ControlBlock* Mailbox::get_control_block() const { return static_cast<ControlBlock*>(m_addr); }
+
+// Get value buffer of the given version
+std::byte* Mailbox::get_buffer(std::uint64_t version) const {
+    auto* cb = get_control_block();
+    return static_cast<std::byte*>(m_addr) + cb->data_offset + (version % kBuffers) * cb->buffer_stride;
+}
+
+} // namespace shmem
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>  // for std::atomic
+#include <cstddef> // for std::byte
+#include <cstdint> // for std::uint64_t
+#include <string>  // for std::string
+
+namespace shmem {
+
+/*
+ * A "latest value" mailbox in shared memory: a writer publishes snapshots and readers always see
+ * the newest complete one. There is no queueing, so stale values never have to be drained.
+ *
+ * The value is double-buffered behind a seqlock. write() fills the buffer readers are not using
+ * and then flips the version, so it never blocks. read() never blocks either. It only retries
+ * when the writer publishes twice while a read is still copying. No semaphores are involved.
+ *
+ * One writer at a time; any number of readers.
+ */
+class Mailbox {
+  public:
+    // Create a new mailbox holding values of value_size bytes
+    static Mailbox create(const std::string& name, std::size_t value_size);
+
+    // Open an existing mailbox
+    static Mailbox open(const std::string& name);
+
+    // Destroy a mailbox
+    static void destroy(const std::string& name);
+
+    // Move constructor and assignment
+    Mailbox(Mailbox&& other) noexcept;
+    Mailbox& operator=(Mailbox&& other) noexcept;
+
+    // Destructor
+    ~Mailbox() noexcept;
+
+    // Publish a new value of value_size() bytes. Never blocks.
+    void write(const std::byte* data);
+
+    // Copy the newest value into buffer (value_size() bytes). Returns its version, which starts at 1 and
+    // increases with every write, or 0 if nothing has been written yet (buffer is left untouched).
+    std::uint64_t read(std::byte* buffer) const;
+
+    // Copy the newest value only if it is newer than version, and update version. Returns true if a
+    // newer value was copied.
+    bool read_newer(std::byte* buffer, std::uint64_t& version) const;
+
+    // Version of the newest value (0 if nothing has been written yet)
+    std::uint64_t version() const;
+
+    // Close the mailbox
+    void close();
+
+    // Get value size in bytes
+    std::size_t value_size() const;
+
+    // Get mailbox name
+    const std::string& name() const;
+
+  private:
+    // Written last by create() so open() can reject segments that are not (yet) mailboxes
+    static constexpr std::uint32_t kMagic = 0x584d4853; // "SHMX"
+
+    // Number of value buffers
+    static constexpr std::size_t kBuffers = 2;
+
+    // Control block structure
+    struct alignas(64) ControlBlock {
+        std::atomic<std::uint32_t> magic; // kMagic once initialized
+        std::size_t value_size;           // Size of the value in bytes
+        std::size_t buffer_stride;        // Distance between value buffers, a multiple of 64
+        std::size_t data_offset;          // Offset of the first value buffer
+        // Version of the newest complete value; it lives in buffer version % kBuffers
+        alignas(64) std::atomic<std::uint64_t> version;
+        // Per-buffer seqlock: the version a buffer holds, or 0 while it is being rewritten
+        alignas(64) std::atomic<std::uint64_t> seq[kBuffers];
+    };
+
+    // Constructor
+    Mailbox(const std::string& name, void* addr, std::size_t size);
+
+    // Copy the value of the given version if it is still intact
+    bool try_copy(std::byte* buffer, std::uint64_t version) const;
+
+    // Get control block
+    ControlBlock* get_control_block() const;
+
+    // Get value buffer of the given version
+    std::byte* get_buffer(std::uint64_t version) const;
+
+    // Member variables
+    std::string m_name; // Mailbox name
+    void* m_addr;       // Mapped memory address
+    std::size_t m_size; // Memory size
+};
+
+} // namespace shmem
@@ -0,0 +1,123 @@
+#include "notify.h"
+
+#include <fcntl.h>  // for fcntl, O_NONBLOCK
+#include <unistd.h> // for read, write, pipe, getpid
+
+#if defined(__linux__)
+#include <sys/eventfd.h> // for eventfd
+#endif
+
+#include <cerrno>    // for errno
+#include <cstring>   // for strerror
+#include <stdexcept> // for std::runtime_error
+#include <string>    // for std::string
+
+#include "futex.h"
+#include "shmem.h"
+
+namespace shmem {
+namespace detail {
+
+namespace {
+
+// Upper bound on how long the watcher sleeps between checks of m_stop
+constexpr std::chrono::milliseconds kWatchInterval(100);
+
+} // namespace
+
+Notifier::Notifier(std::atomic<std::uint32_t>* word, std::atomic<std::uint32_t>* waiters)
+    : m_word(word), m_waiters(waiters), m_read_fd(-1), m_write_fd(-1), m_pid(getpid()), m_stop(false) {
+#if defined(__linux__)
+    m_read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_write_fd = m_read_fd;
+    if (m_read_fd == -1) {
+        throw std::runtime_error("Failed to create eventfd: " + std::string(strerror(errno)));
+    }
+#else
+    int fds[2];
+    if (pipe(fds) == -1) {
+        throw std::runtime_error("Failed to create notification pipe: " + std::string(strerror(errno)));
+    }
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    m_read_fd = fds[0];
+    m_write_fd = fds[1];
+#endif
+
+    start();
+}
+
+Notifier::~Notifier() {
+    stop();
+    safe_close(m_read_fd);
+    if (m_write_fd != m_read_fd) {
+        safe_close(m_write_fd);
+    }
+}
+
+void Notifier::retarget(std::atomic<std::uint32_t>* word, std::atomic<std::uint32_t>* waiters) {
+    stop();
+    m_word = word;
+    m_waiters = waiters;
+    m_pid = getpid();
+    m_stop.store(false, std::memory_order_relaxed);
+    start();
+    signal();
+}
+
+void Notifier::start() {
+    // Registered before the thread starts so no publish after construction goes unnoticed
+    m_waiters->fetch_add(1, std::memory_order_seq_cst);
+    m_thread = std::thread([this] { watch(); });
+}
+
+void Notifier::stop() {
+    if (m_pid == getpid()) {
+        m_stop.store(true, std::memory_order_relaxed);
+        futex_wake_all(m_word);
+        m_thread.join();
+        m_waiters->fetch_sub(1, std::memory_order_relaxed);
+    } else {
+        // A forked child has no watcher thread, and the parent still owns the waiter registration
+        m_thread.detach();
+    }
+}
+
+void Notifier::clear() {
+#if defined(__linux__)
+    std::uint64_t count;
+    (void)!read(m_read_fd, &count, sizeof(count));
+#else
+    char buffer[64];
+    while (read(m_read_fd, buffer, sizeof(buffer)) > 0) {
+    }
+#endif
+}
+
+void Notifier::watch() {
+    std::uint32_t last = m_word->load(std::memory_order_acquire);
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        futex_wait_for(m_word, last, kWatchInterval);
+        const std::uint32_t current = m_word->load(std::memory_order_acquire);
+        if (current != last) {
+            last = current;
+            signal();
+        }
+    }
+}
+
+void Notifier::signal() {
+    // A full pipe or a saturated eventfd is already readable, so failed writes are harmless
+#if defined(__linux__)
+    const std::uint64_t one = 1;
+    (void)!write(m_write_fd, &one, sizeof(one));
+#else
+    const char one = 1;
+    (void)!write(m_write_fd, &one, sizeof(one));
+#endif
+}
+
+} // namespace detail
+} // namespace shmem
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <sys/types.h> // for pid_t
+
+#include <atomic>  // for std::atomic
+#include <cstdint> // for std::uint32_t
+#include <thread>  // for std::thread
+
+namespace shmem {
+namespace detail {
+
+/*
+ * Bridges a queue's futex wake-ups to a file descriptor that event loops can poll. A watcher thread
+ * stays registered as a waiter for its whole lifetime, so producers bump the futex word on every
+ * publish, and turns each change of the word into a readable descriptor: an eventfd on Linux, the read
+ * end of a pipe elsewhere (which kqueue and select handle alike).
+ */
+class Notifier {
+  public:
+    // word and waiters are the queue's items_futex and waiters fields
+    Notifier(std::atomic<std::uint32_t>* word, std::atomic<std::uint32_t>* waiters);
+    ~Notifier();
+
+    Notifier(const Notifier&) = delete;
+    Notifier& operator=(const Notifier&) = delete;
+
+    // Descriptor that is readable while a notification is pending
+    int fd() const { return m_read_fd; }
+
+    // Consume pending notifications
+    void clear();
+
+    // Watch another queue's words instead (after SMQueue::grow), keeping the same descriptor. The
+    // descriptor is signalled once since the new queue may already hold messages.
+    void retarget(std::atomic<std::uint32_t>* word, std::atomic<std::uint32_t>* waiters);
+
+  private:
+    void start();
+    void stop();
+    void watch();
+    void signal();
+
+    std::atomic<std::uint32_t>* m_word;
+    std::atomic<std::uint32_t>* m_waiters;
+    int m_read_fd;  // eventfd, or the read end of the pipe
+    int m_write_fd; // Same as m_read_fd for an eventfd
+    pid_t m_pid;    // Process that started the watcher
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+};
+
+} // namespace detail
+} // namespace shmem
@@ -0,0 +1,178 @@
+#include "placement.h"
+
+#include <pthread.h> // for pthread_setschedparam, pthread_setaffinity_np
+#include <sched.h>   // for sched_getaffinity, SCHED_FIFO
+
+#include <algorithm> // for std::find, std::max
+#include <cerrno>    // for errno
+#include <cstdlib>   // for std::strtol
+#include <fstream>   // for std::ifstream
+#include <stdexcept> // for std::runtime_error
+
+namespace shmem {
+namespace detail {
+
+namespace {
+
+// First line of a sysfs file, empty if it cannot be read
+std::string read_line(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Preference of a CPU sharing cache level with a peer: an L2 shared by separate cores is closest without
+// competing for the same core, then the LLC, then an SMT sibling
+int cache_rank(int level) {
+    switch (level) {
+    case 0:
+        return 0;
+    case 1:
+        return 1;
+    case 2:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+} // namespace
+
+std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    const char* p = text.c_str();
+    while (*p != '\0') {
+        char* end = nullptr;
+        const long first = std::strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = std::strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (*p == ',') {
+            ++p;
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+std::vector<int> node_cpus(int node) {
+#ifdef __linux__
+    return parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+#else
+    (void)node;
+    return {};
+#endif
+}
+
+int shared_cache_level(int a, int b) {
+    int lowest = 0;
+#ifdef __linux__
+    const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(a) + "/cache/index";
+    for (int index = 0;; ++index) {
+        const std::string level = read_line(base + std::to_string(index) + "/level");
+        if (level.empty()) {
+            break;
+        }
+        const std::vector<int> shared = parse_cpu_list(read_line(base + std::to_string(index) + "/shared_cpu_list"));
+        const int value = std::atoi(level.c_str());
+        if (std::find(shared.begin(), shared.end(), b) != shared.end() and (lowest == 0 or value < lowest)) {
+            lowest = value;
+        }
+    }
+#else
+    (void)a;
+    (void)b;
+#endif
+    return lowest;
+}
+
+int choose_cpu(const std::vector<int>& candidates, const std::vector<int>& peers) {
+    std::vector<int> free;
+    for (const int cpu : candidates) {
+        if (std::find(peers.begin(), peers.end(), cpu) == peers.end()) {
+            free.push_back(cpu);
+        }
+    }
+    if (free.empty()) {
+        free = candidates;
+    }
+    if (free.empty()) {
+        throw std::runtime_error("No CPU available to pin the thread to");
+    }
+
+    int best = free.front();
+    int best_rank = -1;
+    for (const int cpu : free) {
+        int rank = 0;
+        for (const int peer : peers) {
+            rank = std::max(rank, cache_rank(shared_cache_level(cpu, peer)));
+        }
+        if (rank > best_rank) {
+            best = cpu;
+            best_rank = rank;
+        }
+    }
+    return best;
+}
+
+void pin_thread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 or cpu >= CPU_SETSIZE) {
+        throw std::runtime_error("Invalid CPU: " + std::to_string(cpu));
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        throw std::runtime_error("Failed to pin thread to CPU " + std::to_string(cpu) +
+                                 " (errno: " + std::to_string(error) + ")");
+    }
+#else
+    (void)cpu;
+    throw std::runtime_error("Pinning threads to CPUs is only supported on Linux");
+#endif
+}
+
+void set_realtime(int priority) {
+    if (priority < sched_get_priority_min(SCHED_FIFO) or priority > sched_get_priority_max(SCHED_FIFO)) {
+        throw std::runtime_error("Invalid SCHED_FIFO priority: " + std::to_string(priority));
+    }
+    sched_param param = {};
+    param.sched_priority = priority;
+    const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error == EPERM) {
+        throw std::runtime_error("Not permitted to use SCHED_FIFO (needs CAP_SYS_NICE or RLIMIT_RTPRIO)");
+    }
+    if (error != 0) {
+        throw std::runtime_error("Failed to set SCHED_FIFO (errno: " + std::to_string(error) + ")");
+    }
+}
+
+} // namespace detail
+} // namespace shmem
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string> // for std::string
+#include <vector> // for std::vector
+
+namespace shmem {
+namespace detail {
+
+/*
+ * CPU topology and thread placement, read from sysfs. Topology queries return empty results where the
+ * information is unavailable (and everywhere but Linux); placement calls throw std::runtime_error.
+ */
+
+// Parse a kernel CPU list such as "0-3,8,10-11"
+std::vector<int> parse_cpu_list(const std::string& text);
+
+// CPUs the calling thread may run on, in ascending order
+std::vector<int> allowed_cpus();
+
+// CPUs of a NUMA node, in ascending order
+std::vector<int> node_cpus(int node);
+
+// Lowest cache level that CPUs a and b share: 1 for SMT siblings, 2 for cores sharing an L2, 3 for an LLC
+// shared by the package. 0 if they share none (or the topology is unknown).
+int shared_cache_level(int a, int b);
+
+// Pick a CPU among candidates for a thread that exchanges messages with threads pinned to peers. Prefers a
+// core sharing an L2 with a peer, then an LLC, then an SMT sibling, and avoids the peers' own CPUs while
+// candidates remain. Without peers it takes the first candidate.
+int choose_cpu(const std::vector<int>& candidates, const std::vector<int>& peers);
+
+// Pin the calling thread to cpu (Linux only)
+void pin_thread(int cpu);
+
+// Run the calling thread under SCHED_FIFO at priority
+void set_realtime(int priority);
+
+} // namespace detail
+} // namespace shmem
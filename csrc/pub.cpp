@@ -1,12 +1,12 @@
 #include <signal.h>
 
+#include <cctype>
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <random>
 #include <thread>
-#include <vector>
 
 #include "shmem.h"
 
@@ -27,6 +27,23 @@ void cleanup() {
     }
 }
 
+// Parse --pin [CPU] and --realtime PRIORITY into a thread placement
+shmem::ThreadPlacement parse_placement(int argc, char* argv[]) {
+    shmem::ThreadPlacement placement;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--pin") == 0) {
+            placement.pin = true;
+            if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                placement.cpu = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--realtime") == 0 && i + 1 < argc) {
+            placement.realtime = true;
+            placement.priority = atoi(argv[++i]);
+        }
+    }
+    return placement;
+}
+
 int main(int argc, char* argv[]) {
     // Check for cleanup flag
     if (argc > 1 && (strcmp(argv[1], "--cleanup") == 0 || strcmp(argv[1], "-c") == 0)) {
@@ -46,8 +63,16 @@ int main(int argc, char* argv[]) {
             // Ignore errors during initial cleanup
         }
 
-        // Create queue with fixed-size messages
-        auto queue = shmem::SMQueue::create(queue_name, MAX_ELEMENTS, MESSAGE_SIZE);
+        // Create queue with fixed-size messages, recording how long each one waits for the subscriber
+        shmem::QueueOptions options;
+        options.latency = true;
+        auto queue = shmem::SMQueue::create(queue_name, MAX_ELEMENTS, MESSAGE_SIZE, options);
+
+        // Optionally keep the publisher on one CPU, and out of reach of ordinary threads
+        const shmem::ThreadPlacement placement = parse_placement(argc, argv);
+        if (placement.pin || placement.realtime) {
+            std::cout << "Publisher placed on CPU " << queue.place_thread(placement) << std::endl;
+        }
 
         int counter = 0;
         std::cout << "Publisher started. Press Ctrl+C to stop." << std::endl;
@@ -56,19 +81,6 @@ int main(int argc, char* argv[]) {
         // Set stdout to be unbuffered for more accurate timing
         std::cout.setf(std::ios::unitbuf);
 
-        // Setup random number generator
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> distrib(0, 255);
-
-        // Pre-allocate buffer for message and pre-fill with random data
-        std::vector<std::byte> message_buffer(MESSAGE_SIZE);
-
-        // Fill the buffer with random data once (after header)
-        for (size_t i = HEADER_SIZE; i < MESSAGE_SIZE; i++) {
-            message_buffer[i] = static_cast<std::byte>(distrib(gen));
-        }
-
         // Use high-resolution clock for more accurate timing
         using clock = std::chrono::high_resolution_clock;
 
@@ -77,14 +89,20 @@ int main(int argc, char* argv[]) {
             auto now = std::chrono::steady_clock::now();
             auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
 
-            // Create message header with timestamp and counter - use snprintf for efficiency
-            int header_len = snprintf(reinterpret_cast<char*>(message_buffer.data()), HEADER_SIZE, "Message #%d %lld",
-                                      counter++, (long long)timestamp);
+            // Write the message straight into the next queue slot instead of copying it from a local buffer
+            std::byte* slot = queue.reserve();
+            if (slot == nullptr) {
+                // No slot free yet: back off before retrying rather than spinning on the queue
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
 
-            // No need to fill the rest with random data - already done once
+            // Fill the payload (one pass over the slot), then the header with timestamp and counter
+            std::memset(slot + HEADER_SIZE, counter & 0xff, MESSAGE_SIZE - HEADER_SIZE);
+            snprintf(reinterpret_cast<char*>(slot), HEADER_SIZE, "Message #%d %lld", counter++, (long long)timestamp);
 
-            // Push the message to the queue
-            bool no_drop = queue.push(message_buffer.data());
+            // Make the message visible to subscribers
+            bool no_drop = queue.publish();
             if (no_drop) {
                 std::cout << "Published: Message #" << counter - 1 << std::endl;
             } else {
@@ -0,0 +1,152 @@
+#include "queue_set.h"
+
+#include <poll.h> // for poll
+
+#include <algorithm> // for std::min
+#include <limits>    // for std::numeric_limits
+#include <stdexcept> // for std::runtime_error
+#include <thread>    // for std::this_thread::yield
+
+#include "futex.h"
+
+namespace shmem {
+
+namespace {
+
+using SteadyTime = std::chrono::steady_clock::time_point;
+
+constexpr SteadyTime kForever = SteadyTime::max();
+
+} // namespace
+
+// Register a queue
+std::size_t QueueSet::add(SMQueue& queue) {
+    if (queue.m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    m_queues.push_back(&queue);
+    return m_queues.size() - 1;
+}
+
+// Forget every registered queue
+void QueueSet::clear() { m_queues.clear(); }
+
+// Number of registered queues
+std::size_t QueueSet::size() const { return m_queues.size(); }
+
+// Queue at index
+SMQueue& QueueSet::queue(std::size_t index) const {
+    if (index >= m_queues.size()) {
+        throw std::runtime_error("QueueSet index out of range");
+    }
+    return *m_queues[index];
+}
+
+// Wait for a message on any queue
+std::vector<std::size_t> QueueSet::wait_any() { return wait_until(kForever); }
+
+// Wait at most timeout for a message on any queue
+std::vector<std::size_t> QueueSet::wait_any(std::chrono::nanoseconds timeout) {
+    // Saturate instead of overflowing for very long timeouts
+    const auto now = std::chrono::steady_clock::now();
+    if (timeout > kForever - now) {
+        return wait_until(kForever);
+    }
+    return wait_until(now + std::max(timeout, std::chrono::nanoseconds::zero()));
+}
+
+// Wait until deadline for a message on any queue: spin, then yield, then park
+std::vector<std::size_t> QueueSet::wait_until(std::chrono::steady_clock::time_point deadline) {
+    if (m_queues.empty()) {
+        return {};
+    }
+
+    for (std::uint32_t attempt = 0;; ++attempt) {
+        std::vector<std::size_t> indices = ready();
+        if (!indices.empty()) {
+            return indices;
+        }
+        if (deadline != kForever and attempt % 64 == 0 and std::chrono::steady_clock::now() >= deadline) {
+            return indices;
+        }
+
+        if (attempt < m_wait.spin_iterations) {
+            detail::cpu_relax();
+        } else if (attempt < m_wait.spin_iterations + m_wait.yield_iterations) {
+            std::this_thread::yield();
+        } else {
+            park(deadline);
+            if (deadline != kForever and std::chrono::steady_clock::now() >= deadline) {
+                return ready();
+            }
+        }
+    }
+}
+
+// Indices of the queues with a message ready
+std::vector<std::size_t> QueueSet::ready() const {
+    std::vector<std::size_t> indices;
+    for (std::size_t i = 0; i < m_queues.size(); ++i) {
+        if (m_queues[i]->readable()) {
+            indices.push_back(i);
+        }
+    }
+    return indices;
+}
+
+// Set how wait_any() spins and yields before parking
+void QueueSet::set_wait_strategy(const WaitStrategy& strategy) { m_wait = strategy; }
+
+// Park on every queue's items_futex at once
+void QueueSet::park(std::chrono::steady_clock::time_point deadline) {
+    if (!m_use_fds and m_queues.size() <= detail::kFutexWaitAnyMax) {
+        // Announce ourselves on every queue before the final check, as pop() does, so a producer publishing
+        // concurrently either sees the waiter or its message is seen by the check
+        std::atomic<std::uint32_t>* words[detail::kFutexWaitAnyMax];
+        std::uint32_t observed[detail::kFutexWaitAnyMax];
+        for (std::size_t i = 0; i < m_queues.size(); ++i) {
+            auto* cb = m_queues[i]->get_control_block();
+            cb->waiters.fetch_add(1, std::memory_order_seq_cst);
+            words[i] = &cb->items_futex;
+            observed[i] = cb->items_futex.load(std::memory_order_acquire);
+            m_queues[i]->heartbeat();
+        }
+
+        if (ready().empty() and !detail::futex_wait_any(words, observed, m_queues.size(), deadline)) {
+            m_use_fds = true;
+        }
+
+        for (SMQueue* queue : m_queues) {
+            queue->get_control_block()->waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (!m_use_fds) {
+            return;
+        }
+    }
+    park_poll(deadline);
+}
+
+// Park in poll() on every queue's notify_fd()
+void QueueSet::park_poll(std::chrono::steady_clock::time_point deadline) {
+    std::vector<pollfd> fds;
+    fds.reserve(m_queues.size());
+    for (SMQueue* queue : m_queues) {
+        // Clear before the final check so a message published after it leaves the descriptor readable
+        fds.push_back(pollfd{queue->notify_fd(), POLLIN, 0});
+        queue->clear_notify();
+    }
+    if (!ready().empty()) {
+        return;
+    }
+
+    int timeout_ms = -1;
+    if (deadline != kForever) {
+        const auto remaining =
+            std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        timeout_ms = static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(
+            remaining.count(), 0, std::numeric_limits<int>::max()));
+    }
+    poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout_ms);
+}
+
+} // namespace shmem
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>  // for std::chrono::nanoseconds
+#include <cstddef> // for std::size_t
+#include <cstdint> // for std::uint32_t
+#include <vector>  // for std::vector
+
+#include "shmem.h"
+
+namespace shmem {
+
+/*
+ * Waits on many queues at once, like select() for queues: wait_any() blocks until at least one of the
+ * registered queues has a message and returns which ones do. Callers then drain those with try_pop().
+ *
+ * Waiting spins and yields like a blocking pop() and then parks on the items_futex of every queue with a
+ * single futex_waitv call (Linux 5.16+), so no thread is spent per queue. Where that is unavailable, or
+ * for more than 128 queues, it falls back to poll() over each queue's notify_fd().
+ *
+ * The set does not own its queues; they must outlive it and stay at the same address. One thread at a
+ * time may wait on a set.
+ */
+class QueueSet {
+  public:
+    QueueSet() = default;
+
+    // Register a queue and return its index in the set
+    std::size_t add(SMQueue& queue);
+
+    // Forget every registered queue
+    void clear();
+
+    // Number of registered queues
+    std::size_t size() const;
+
+    // Queue at index
+    SMQueue& queue(std::size_t index) const;
+
+    // Indices of the queues with a message ready, waiting at most timeout (wait_any) or until deadline
+    // (wait_until) for one. Returns an empty vector on timeout or if the set is empty. A returned queue
+    // can still turn out empty if another consumer gets to it first.
+    std::vector<std::size_t> wait_any();
+    std::vector<std::size_t> wait_any(std::chrono::nanoseconds timeout);
+    std::vector<std::size_t> wait_until(std::chrono::steady_clock::time_point deadline);
+
+    // Indices of the queues with a message ready, without waiting
+    std::vector<std::size_t> ready() const;
+
+    // Set how wait_any() spins and yields before parking
+    void set_wait_strategy(const WaitStrategy& strategy);
+
+  private:
+    // Park until a queue's items_futex moves or deadline passes
+    void park(std::chrono::steady_clock::time_point deadline);
+    void park_poll(std::chrono::steady_clock::time_point deadline);
+
+    std::vector<SMQueue*> m_queues;
+    WaitStrategy m_wait;
+    bool m_use_fds = false; // futex_waitv is unavailable: park in poll() on notify_fd()s
+};
+
+} // namespace shmem
@@ -0,0 +1,480 @@
+#include "segment.h"
+
+#ifdef __linux__
+#include <linux/mempolicy.h> // for MPOL_BIND, MPOL_MF_MOVE
+#include <sys/syscall.h>     // for SYS_mbind, SYS_move_pages
+#endif
+
+#include <dirent.h>   // for opendir, readdir
+#include <sys/file.h> // for flock
+
+#include <algorithm> // for std::min
+#include <cstdint>   // for std::uintptr_t
+#include <cstdlib>   // for std::getenv
+#include <fstream>   // for std::ifstream
+
+namespace shmem {
+namespace detail {
+
+namespace {
+
+// Path of a huge page segment on hugetlbfs
+std::string hugetlbfs_path(const std::string& name) {
+    return hugetlbfs_dir() + (!name.empty() and name[0] == '/' ? name : "/" + name);
+}
+
+// Map fd at an address that is a multiple of alignment. Over-reserves an inaccessible region, maps the
+// segment over its aligned part and gives the slack back.
+void* map_aligned(int fd, std::size_t size, std::size_t alignment, int prot, int flags) {
+    if (alignment <= page_size()) {
+        return mmap(nullptr, size, prot, MAP_SHARED | flags, fd, 0);
+    }
+
+    const std::size_t reserved = size + alignment;
+    void* region = mmap(nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    const auto start = reinterpret_cast<std::uintptr_t>(region);
+    const std::uintptr_t aligned = (start + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+    void* addr = mmap(reinterpret_cast<void*>(aligned), size, prot, MAP_SHARED | MAP_FIXED | flags, fd, 0);
+    if (addr == MAP_FAILED) {
+        munmap(region, reserved);
+        return MAP_FAILED;
+    }
+
+    const std::uintptr_t mapped_end = aligned + ((size + page_size() - 1) & ~(page_size() - 1));
+    if (aligned > start) {
+        munmap(region, aligned - start);
+    }
+    if (start + reserved > mapped_end) {
+        munmap(reinterpret_cast<void*>(mapped_end), start + reserved - mapped_end);
+    }
+    return addr;
+}
+
+// Set the NUMA policy of the pages spanning [addr, addr + size). Returns 0 or an errno value.
+int set_policy(void* addr, std::size_t size, NumaPolicy policy, std::uint64_t nodes, bool move) {
+#ifdef __linux__
+    int mode = MPOL_DEFAULT;
+    switch (policy) {
+    case NumaPolicy::Bind:
+        mode = MPOL_BIND;
+        break;
+    case NumaPolicy::Interleave:
+        mode = MPOL_INTERLEAVE;
+        break;
+    case NumaPolicy::Preferred:
+        mode = MPOL_PREFERRED;
+        break;
+    default:
+        break;
+    }
+
+    // The kernel reads the node mask as an array of unsigned long
+    constexpr std::size_t kBits = sizeof(unsigned long) * 8;
+    unsigned long mask[64 / kBits];
+    for (std::size_t i = 0; i < 64 / kBits; ++i) {
+        mask[i] = static_cast<unsigned long>(nodes >> (i * kBits));
+    }
+
+    const auto start = reinterpret_cast<std::uintptr_t>(addr) & ~(std::uintptr_t(page_size()) - 1);
+    const std::size_t length = reinterpret_cast<std::uintptr_t>(addr) + size - start;
+    const bool has_nodes = policy != NumaPolicy::Default;
+    if (syscall(SYS_mbind, start, length, mode, has_nodes ? mask : nullptr, has_nodes ? 64 + 1 : 0,
+                move ? MPOL_MF_MOVE : 0) != 0) {
+        return errno;
+    }
+    return 0;
+#else
+    (void)addr;
+    (void)size;
+    (void)nodes;
+    (void)move;
+    return policy == NumaPolicy::Default ? 0 : ENOSYS;
+#endif
+}
+
+// Map fd as requested by options: aligned, NUMA-bound, pre-faulted and locked. Returns MAP_FAILED with
+// errno set.
+void* map_segment(int fd, std::size_t size, const SegmentOptions& options) {
+    // The NUMA policy must be in place before the first fault, so MAP_POPULATE is only usable without one
+    bool touch = options.populate;
+    int flags = 0;
+#ifdef MAP_POPULATE
+    if (options.populate and options.numa_policy == NumaPolicy::Default) {
+        flags |= MAP_POPULATE;
+        touch = false;
+    }
+#endif
+
+    const int prot = options.read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* addr = map_aligned(fd, size, options.alignment, prot, flags);
+    if (addr == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    if (options.numa_policy != NumaPolicy::Default) {
+        const int error = set_policy(addr, size, options.numa_policy, options.numa_nodes, false);
+        if (error != 0) {
+            munmap(addr, size);
+            errno = error;
+            return MAP_FAILED;
+        }
+    }
+
+    // Pre-fault by touching every page
+    if (touch) {
+        for (std::size_t offset = 0; offset < size; offset += page_size()) {
+            static_cast<volatile const char*>(addr)[offset];
+        }
+    }
+
+    if (options.lock and mlock(addr, size) != 0) {
+        const int error = errno;
+        munmap(addr, size);
+        errno = error;
+        return MAP_FAILED;
+    }
+    return addr;
+}
+
+// Whether a POSIX shm object of this name exists
+bool access_shm(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    safe_close(fd);
+    return fd >= 0;
+}
+
+// Remove a segment this process just created
+void remove_created(const std::string& name, const SegmentOptions& options) {
+    if (is_file_path(name)) {
+        ::unlink(name.c_str());
+    } else if (options.huge_pages) {
+        ::unlink(hugetlbfs_path(name).c_str());
+    } else {
+        shm_unlink(name.c_str());
+    }
+}
+
+// Describe a failed mapping, with a hint for the usual causes
+std::string map_error(const std::string& name, const SegmentOptions& options) {
+    std::string message = "Failed to map shared memory: " + name + " (errno: " + std::to_string(errno) + ")";
+    if (options.lock and (errno == ENOMEM or errno == EPERM or errno == EAGAIN)) {
+        message += "; mlock may exceed RLIMIT_MEMLOCK";
+    } else if (options.numa_policy != NumaPolicy::Default and (errno == EINVAL or errno == ENOSYS)) {
+        message += "; NUMA policy rejected (check the node mask)";
+    } else if (options.huge_pages and errno == ENOMEM) {
+        message += "; not enough huge pages reserved (vm.nr_hugepages)";
+    }
+    return message;
+}
+
+} // namespace
+
+// Size of a regular page
+std::size_t page_size() {
+    static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+// Directory of the hugetlbfs mount
+std::string hugetlbfs_dir() {
+    const char* dir = std::getenv("SHMEM_HUGETLBFS_DIR");
+    return dir != nullptr and dir[0] != '\0' ? dir : "/dev/hugepages";
+}
+
+// Whether a name refers to a regular file rather than a POSIX shm object
+bool is_file_path(const std::string& name) { return name.find('/', 1) != std::string::npos; }
+
+// Create and map a new segment
+void* create_segment(const std::string& name, std::size_t& size, const SegmentOptions& options) {
+    const bool file = is_file_path(name);
+    int fd;
+    if (file) {
+        if (options.huge_pages) {
+            throw std::runtime_error("File-backed segments cannot use huge pages: " + name);
+        }
+        fd = ::open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create segment file: " + name + " (errno: " + std::to_string(errno) +
+                                     ")");
+        }
+    } else if (options.huge_pages) {
+        // hugetlbfs mappings must cover whole huge pages
+        if (size > std::numeric_limits<std::size_t>::max() - kHugePageSize) {
+            throw std::runtime_error("Segment size too large, would cause integer overflow: " + name);
+        }
+        size = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+        const std::string path = hugetlbfs_path(name);
+        fd = ::open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create huge page segment: " + path + " (errno: " +
+                                     std::to_string(errno) + "; is hugetlbfs mounted there?)");
+        }
+    } else {
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create shared memory: " + name + " (errno: " + std::to_string(errno) +
+                                     ")");
+        }
+    }
+
+    // A name refers to a single segment, so refuse to shadow one in the other namespace
+    const bool shadowed =
+        !file and (options.huge_pages ? access_shm(name) : ::access(hugetlbfs_path(name).c_str(), F_OK) == 0);
+    if (shadowed) {
+        safe_close(fd);
+        remove_created(name, options);
+        throw std::runtime_error("Failed to create shared memory: " + name + " (errno: " +
+                                 std::to_string(EEXIST) + ")");
+    }
+
+    // Set size
+    if (ftruncate(fd, size) < 0) {
+        safe_close(fd);
+        remove_created(name, options);
+        throw std::runtime_error("Failed to set size of shared memory: " + name);
+    }
+
+    // Map memory
+    void* addr = map_segment(fd, size, options);
+    if (addr == MAP_FAILED) {
+        const std::string message = map_error(name, options);
+        safe_close(fd);
+        remove_created(name, options);
+        throw std::runtime_error(message);
+    }
+
+#ifdef __linux__
+    if (!options.huge_pages and !file) {
+        // Hint the kernel to back the mapping with transparent huge pages and pre-populate if possible.
+        // The advice values are not flags and must be given one at a time.
+        madvise(addr, size, MADV_HUGEPAGE);
+        madvise(addr, size, MADV_WILLNEED);
+    }
+#endif
+
+    // The mapping keeps the segment alive
+    safe_close(fd);
+    return addr;
+}
+
+// Map an existing segment
+void* open_segment(const std::string& name, std::size_t& size, const SegmentOptions& options) {
+    // Open shared memory, falling back to a huge page segment of the same name
+    const int mode = options.read_only ? O_RDONLY : O_RDWR;
+    const bool file = is_file_path(name);
+    int fd = file ? ::open(name.c_str(), mode) : shm_open(name.c_str(), mode, 0660);
+    if (fd < 0 and errno == ENOENT and !file) {
+        fd = ::open(hugetlbfs_path(name).c_str(), mode);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open shared memory: " + name);
+    }
+
+    // Get size
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        safe_close(fd);
+        throw std::runtime_error("Failed to get shared memory size: " + name);
+    }
+
+    // Map memory
+    void* addr = map_segment(fd, static_cast<std::size_t>(st.st_size), options);
+    if (addr == MAP_FAILED) {
+        const std::string message = map_error(name, options);
+        safe_close(fd);
+        throw std::runtime_error(message);
+    }
+
+    safe_close(fd);
+    size = static_cast<std::size_t>(st.st_size);
+    return addr;
+}
+
+// Remove a segment by name
+bool unlink_segment(const std::string& name) {
+    if (is_file_path(name)) {
+        return ::unlink(name.c_str()) == 0;
+    }
+    const bool shm = shm_unlink(name.c_str()) == 0;
+    const bool huge = ::unlink(hugetlbfs_path(name).c_str()) == 0;
+    return shm or huge;
+}
+
+// List the segments in /dev/shm and on hugetlbfs
+std::vector<std::string> list_segments() {
+#ifdef __linux__
+    std::vector<std::string> names;
+    for (const std::string& dir : {std::string("/dev/shm"), hugetlbfs_dir()}) {
+        DIR* handle = opendir(dir.c_str());
+        if (handle == nullptr) {
+            continue;
+        }
+        while (const dirent* entry = readdir(handle)) {
+            // Named semaphores live in /dev/shm too, as sem.<name>
+            const std::string file = entry->d_name;
+            if (file == "." or file == ".." or file.compare(0, 4, "sem.") == 0) {
+                continue;
+            }
+            if (entry->d_type == DT_REG or entry->d_type == DT_UNKNOWN) {
+                names.push_back("/" + file);
+            }
+        }
+        closedir(handle);
+    }
+    return names;
+#else
+    throw std::runtime_error("Listing shared memory segments is not supported on this system");
+#endif
+}
+
+// Write the dirty pages of a mapping back to its file
+void flush_memory(void* addr, std::size_t size, bool wait) {
+    if (msync(addr, size, wait ? MS_SYNC : MS_ASYNC) != 0) {
+        throw std::runtime_error("Failed to flush mapping (errno: " + std::to_string(errno) + ")");
+    }
+}
+
+Flusher::Flusher(void* addr, std::size_t size, std::chrono::milliseconds interval)
+    : m_addr(addr), m_size(size), m_interval(interval), m_pid(getpid()), m_stop(false) {
+    m_thread = std::thread([this] { run(); });
+}
+
+Flusher::~Flusher() {
+    if (getpid() != m_pid) {
+        // A forked child has no flusher thread
+        m_thread.detach();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    msync(m_addr, m_size, MS_SYNC);
+}
+
+void Flusher::run() {
+    std::unique_lock<std::mutex> guard(m_lock);
+    while (!m_wake.wait_for(guard, m_interval, [this] { return m_stop; })) {
+        guard.unlock();
+        msync(m_addr, m_size, MS_SYNC);
+        guard.lock();
+    }
+}
+
+// Hold an exclusive lock on a segment file
+int lock_file(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open segment file: " + path + " (errno: " + std::to_string(errno) + ")");
+    }
+    int result;
+    do {
+        result = flock(fd, LOCK_EX);
+    } while (result != 0 and errno == EINTR);
+    if (result != 0) {
+        const int error = errno;
+        safe_close(fd);
+        throw std::runtime_error("Failed to lock segment file: " + path + " (errno: " + std::to_string(error) + ")");
+    }
+    return fd;
+}
+
+// Identifier of the current boot: a hash of the kernel's random boot id
+std::uint64_t boot_id() {
+#ifdef __linux__
+    static const std::uint64_t id = [] {
+        std::ifstream file("/proc/sys/kernel/random/boot_id");
+        std::string text;
+        std::getline(file, text);
+
+        // 64-bit FNV-1a; never 0, so a cleared field always reads as another boot
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const char c : text) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash != 0 ? hash : 1;
+    }();
+    return id;
+#else
+    return 0;
+#endif
+}
+
+// Free the backing pages of a range of a shared mapping
+void discard_memory(void* addr, std::size_t size) {
+#ifdef __linux__
+    // Only whole pages can be freed
+    const std::uintptr_t mask = std::uintptr_t(page_size()) - 1;
+    const std::uintptr_t start = (reinterpret_cast<std::uintptr_t>(addr) + mask) & ~mask;
+    const std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(addr) + size) & ~mask;
+    if (end > start) {
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_REMOVE);
+    }
+#else
+    (void)addr;
+    (void)size;
+#endif
+}
+
+// Apply a NUMA policy to a range of memory
+void bind_memory(void* addr, std::size_t size, NumaPolicy policy, std::uint64_t nodes, bool move) {
+    const int error = set_policy(addr, size, policy, nodes, move);
+    if (error == ENOSYS) {
+        throw std::runtime_error("NUMA policies are not supported on this system");
+    }
+    if (error != 0) {
+        throw std::runtime_error("Failed to apply NUMA policy (errno: " + std::to_string(error) + ")");
+    }
+}
+
+// Report the NUMA node of every page in a range
+NumaResidency memory_residency(const void* addr, std::size_t size) {
+    NumaResidency residency;
+    residency.page_size = page_size();
+
+#ifdef __linux__
+    const auto start = reinterpret_cast<std::uintptr_t>(addr) & ~(std::uintptr_t(page_size()) - 1);
+    const std::size_t count = (reinterpret_cast<std::uintptr_t>(addr) + size - start + page_size() - 1) / page_size();
+
+    // move_pages with no target nodes only queries; ask in chunks to bound the temporary arrays
+    constexpr std::size_t kChunk = 1024;
+    std::vector<void*> pages(kChunk);
+    std::vector<int> status(kChunk);
+    for (std::size_t first = 0; first < count; first += kChunk) {
+        const std::size_t n = std::min(kChunk, count - first);
+        for (std::size_t i = 0; i < n; ++i) {
+            pages[i] = reinterpret_cast<void*>(start + (first + i) * page_size());
+        }
+        if (syscall(SYS_move_pages, 0, n, pages.data(), nullptr, status.data(), 0) != 0) {
+            throw std::runtime_error("Failed to query page placement (errno: " + std::to_string(errno) + ")");
+        }
+
+        for (std::size_t i = 0; i < n; ++i) {
+            if (status[i] < 0) {
+                residency.not_present++;
+                continue;
+            }
+            if (static_cast<std::size_t>(status[i]) >= residency.pages_per_node.size()) {
+                residency.pages_per_node.resize(status[i] + 1);
+            }
+            residency.pages_per_node[status[i]]++;
+        }
+    }
+#else
+    (void)addr;
+    (void)size;
+    throw std::runtime_error("NUMA introspection is not supported on this system");
+#endif
+
+    return residency;
+}
+
+} // namespace detail
+} // namespace shmem
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <sys/types.h> // for pid_t
+
+#include <chrono>             // for std::chrono::milliseconds
+#include <condition_variable> // for std::condition_variable
+#include <cstddef>            // for std::size_t
+#include <cstdint>            // for std::uint64_t
+#include <mutex>              // for std::mutex
+#include <string>             // for std::string
+#include <thread>             // for std::thread
+#include <vector>             // for std::vector
+
+#include "shmem.h"
+
+namespace shmem {
+namespace detail {
+
+/*
+ * Shared memory plumbing shared by SMQueue and Mailbox. Segments are POSIX shm objects, files on
+ * hugetlbfs when huge pages are requested, or regular files when the name is a path (a slash after the
+ * first character). All functions throw std::runtime_error on failure and leave nothing behind.
+ */
+
+// Size of a transparent huge page
+constexpr std::size_t kHugePageSize = std::size_t(2) << 20;
+
+// Size of a regular page
+std::size_t page_size();
+
+// How a segment is backed and mapped
+struct SegmentOptions {
+    std::size_t alignment = 0; // Required alignment of the mapping's base address
+    bool huge_pages = false;   // Back the segment with a hugetlbfs file (creation only)
+    bool populate = false;     // Pre-fault the whole mapping
+    bool lock = false;         // mlock the mapping
+    bool read_only = false;    // Map the segment read-only (open only)
+    // NUMA placement, applied before the first page is touched (creation only)
+    NumaPolicy numa_policy = NumaPolicy::Default;
+    std::uint64_t numa_nodes = 0;
+};
+
+// Directory of the hugetlbfs mount used for huge page segments: $SHMEM_HUGETLBFS_DIR or /dev/hugepages
+std::string hugetlbfs_dir();
+
+// Whether name is a file path (a slash after its first character) rather than a POSIX shm name
+bool is_file_path(const std::string& name);
+
+// Create a new segment of at least size bytes and map it read-write. size is rounded up to the huge page
+// size for hugetlbfs segments. Fails if name already exists.
+void* create_segment(const std::string& name, std::size_t& size, const SegmentOptions& options = SegmentOptions());
+
+// Map an existing segment (read-write unless options.read_only) and report its size. POSIX shm is searched
+// first, then hugetlbfs; file paths are opened as they are.
+void* open_segment(const std::string& name, std::size_t& size, const SegmentOptions& options = SegmentOptions());
+
+// Remove a segment by name. Returns false if no such segment exists.
+bool unlink_segment(const std::string& name);
+
+// Give the pages spanning [addr, addr + size) back to the system; the range reads as zeros afterwards, in
+// every process that maps it (Linux only, a no-op elsewhere)
+void discard_memory(void* addr, std::size_t size);
+
+// Write the dirty pages spanning [addr, addr + size) back to the file behind them. wait blocks until the
+// data is on stable storage; otherwise the writeback is only scheduled.
+void flush_memory(void* addr, std::size_t size, bool wait);
+
+// Take an exclusive advisory lock on a segment file, held until the returned descriptor is closed
+int lock_file(const std::string& path);
+
+/*
+ * Flushes a file-backed mapping from a background thread at a fixed interval, so a host crash loses at
+ * most about one interval of messages while the handle itself never waits for the disk. The mapping is
+ * flushed once more on destruction.
+ */
+class Flusher {
+  public:
+    Flusher(void* addr, std::size_t size, std::chrono::milliseconds interval);
+    ~Flusher();
+
+    Flusher(const Flusher&) = delete;
+    Flusher& operator=(const Flusher&) = delete;
+
+  private:
+    void run();
+
+    void* m_addr;
+    std::size_t m_size;
+    std::chrono::milliseconds m_interval;
+    pid_t m_pid; // Process that started the thread
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+// Identifier of the current boot, so state recorded in a file can be told stale after a reboot (Linux
+// only, 0 elsewhere)
+std::uint64_t boot_id();
+
+// Names of all segments on this host, POSIX shm objects first, each with a leading slash (Linux only)
+std::vector<std::string> list_segments();
+
+// Apply a NUMA policy to the pages spanning [addr, addr + size). move migrates pages already allocated.
+void bind_memory(void* addr, std::size_t size, NumaPolicy policy, std::uint64_t nodes, bool move);
+
+// Report the NUMA node of every page spanning [addr, addr + size)
+NumaResidency memory_residency(const void* addr, std::size_t size);
+
+} // namespace detail
+} // namespace shmem
@@ -1,439 +1,3115 @@
 #include "shmem.h"
 
+#include <signal.h> // for kill
+
+#include <algorithm> // for std::min, std::replace, std::find, std::find_if
+#include <cstdio>    // for std::snprintf
+#include <new>       // for placement new
+#include <thread>    // for std::this_thread::yield
+
+#include "copy.h"
+#include "futex.h"
+#include "histogram.h"
+#include "notify.h"
+#include "placement.h"
+#include "segment.h"
+
 namespace shmem {
 
+namespace detail {
+namespace {
+
+using SteadyTime = std::chrono::steady_clock::time_point;
+
+// Deadline timeout from now, saturating instead of overflowing for very long timeouts
+SteadyTime deadline_after(std::chrono::nanoseconds timeout) {
+    const auto now = std::chrono::steady_clock::now();
+    if (timeout > SteadyTime::max() - now) {
+        return SteadyTime::max();
+    }
+    return now + std::max(timeout, std::chrono::nanoseconds::zero());
+}
+
+// Whether a bounded wait has run out of time. Polling loops only read the clock every 64 attempts.
+bool deadline_passed(SteadyTime deadline, std::uint32_t attempt) {
+    return deadline != SteadyTime::max() and attempt % 64 == 0 and std::chrono::steady_clock::now() >= deadline;
+}
+
+// Wait on a semaphore until deadline. Returns false on timeout or error.
+bool sem_wait_until(sem_t* sem, SteadyTime deadline) {
+#if defined(__APPLE__)
+    // macOS has no sem_timedwait: poll
+    while (sem_trywait(sem) != 0) {
+        if ((errno != EAGAIN and errno != EINTR) or std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    return true;
+#else
+#if defined(__GLIBC__) and (__GLIBC__ > 2 or (__GLIBC__ == 2 and __GLIBC_MINOR__ >= 30))
+    // steady_clock is CLOCK_MONOTONIC, so the deadline can be passed through unchanged
+    const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+#else
+    const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        (std::chrono::system_clock::now() + (deadline - std::chrono::steady_clock::now())).time_since_epoch());
+#endif
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+
+    int result;
+    do {
+#if defined(__GLIBC__) and (__GLIBC__ > 2 or (__GLIBC__ == 2 and __GLIBC_MINOR__ >= 30))
+        result = sem_clockwait(sem, CLOCK_MONOTONIC, &ts);
+#else
+        result = sem_timedwait(sem, &ts);
+#endif
+    } while (result == -1 and errno == EINTR);
+    return result == 0;
+#endif
+}
+
+// Adds the time from start() until destruction to a stats counter. Does nothing unless started with a
+// counter, so blocking calls only read the clock once they actually have to wait.
+class WaitTimer {
+  public:
+    explicit WaitTimer(std::atomic<std::uint64_t>* counter) : m_counter(counter) {}
+
+    ~WaitTimer() {
+        if (m_started) {
+            const auto waited = std::chrono::steady_clock::now() - m_start;
+            m_counter->fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+                                 std::memory_order_relaxed);
+        }
+    }
+
+    WaitTimer(const WaitTimer&) = delete;
+    WaitTimer& operator=(const WaitTimer&) = delete;
+
+    void start() {
+        if (m_counter != nullptr and !m_started) {
+            m_start = std::chrono::steady_clock::now();
+            m_started = true;
+        }
+    }
+
+  private:
+    std::atomic<std::uint64_t>* m_counter;
+    SteadyTime m_start;
+    bool m_started = false;
+};
+
+// Whether a process exists. A process we may not signal (EPERM) exists too.
+bool process_alive(std::int32_t pid) { return pid > 0 and (kill(pid, 0) == 0 or errno == EPERM); }
+
+#ifdef __linux__
+// Initialize a process-shared mutex whose next locker is told when its owner died
+void init_robust_mutex(pthread_mutex_t* mutex) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    const int result = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (result != 0) {
+        throw std::runtime_error("Failed to initialize robust mutex");
+    }
+}
+#endif
+
+// Check that a message type describes an array that fits in element_size bytes
+void validate_message_type(const MessageType& type, std::size_t element_size) {
+    if (type.ndim > MessageType::kMaxDims) {
+        throw std::runtime_error("Message types have at most " + std::to_string(MessageType::kMaxDims) +
+                                 " dimensions");
+    }
+    if (type.bits == 0 or type.bits % 8 != 0 or type.code > DTypeCode::Bool) {
+        throw std::runtime_error("Invalid message element type");
+    }
+
+    bool contiguous = true;
+    for (std::uint32_t i = 0; i < type.ndim; ++i) {
+        if (type.shape[i] <= 0 or type.strides[i] < 0) {
+            throw std::runtime_error("Message shape must be positive and strides non-negative");
+        }
+        contiguous = contiguous and type.strides[i] == 0;
+    }
+
+    // Number of elements spanned by the array, from its first element to its last
+    const std::size_t itemsize = type.bits / 8;
+    std::size_t span = 1;
+    for (std::uint32_t i = 0; i < type.ndim; ++i) {
+        const auto extent = static_cast<std::size_t>(type.shape[i]);
+        const std::size_t step = contiguous ? span : static_cast<std::size_t>(type.strides[i]);
+        if ((extent - 1) != 0 and step > (element_size / itemsize) / (extent - 1)) {
+            throw std::runtime_error("Message type does not fit in element_size");
+        }
+        span += (extent - 1) * step;
+        if (span > element_size / itemsize) {
+            throw std::runtime_error("Message type does not fit in element_size");
+        }
+    }
+}
+
+} // namespace
+} // namespace detail
+
 // Create a new shared memory queue
-SMQueue SMQueue::create(const std::string& name, std::size_t max_elements, std::size_t element_size) {
+SMQueue SMQueue::create(const std::string& name, std::size_t max_elements, std::size_t element_size,
+                        const QueueOptions& options) {
     // Validate name - no spaces allowed for semaphore compatibility
     if (name.find(' ') != std::string::npos) {
         throw std::runtime_error("Queue name cannot contain spaces: " + name);
     }
 
-    // Check for potential integer overflow
-    if (max_elements > std::numeric_limits<std::size_t>::max() / element_size) {
-        throw std::runtime_error("Queue size too large, would cause integer overflow");
+    if (max_elements == 0 or element_size == 0) {
+        throw std::runtime_error("Queue must have a non-zero element count and element size");
     }
 
-    // Open shared memory
-    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
-    if (fd < 0) {
-        throw std::runtime_error("Failed to create shared memory: " + name + " (errno: " + std::to_string(errno) + ")");
+    if (options.variable_size) {
+        if (options.mode != QueueMode::Locked and options.mode != QueueMode::SPSC) {
+            throw std::runtime_error("Variable-size messages require a Locked or SPSC queue");
+        }
+        if (element_size > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::runtime_error("Variable-size messages are limited to 4GB");
+        }
+        // Reserve room for one extra maximum-size record, enough for the padding lost at the wrap
+        // point, so max_elements maximum-size messages always fit
+        if (max_elements + 1 > std::numeric_limits<std::size_t>::max() / record_size(element_size)) {
+            throw std::runtime_error("Queue size too large, would cause integer overflow");
+        }
     }
 
-    // Calculate total size needed (header + data)
-    std::size_t header_size = sizeof(ControlBlock);
-    std::size_t data_size = max_elements * element_size;
+    if (options.message_type.ndim != 0) {
+        if (options.variable_size) {
+            throw std::runtime_error("Message types require a fixed-size queue");
+        }
+        detail::validate_message_type(options.message_type, element_size);
+    }
 
-    // Check for potential integer overflow in total size calculation
-    if (header_size > std::numeric_limits<std::size_t>::max() - data_size) {
-        detail::safe_close(fd);
-        shm_unlink(name.c_str());
-        throw std::runtime_error("Queue size too large, would cause integer overflow in total size calculation");
+    if (options.latency and options.variable_size) {
+        throw std::runtime_error("Latency histograms require a fixed-size queue");
     }
 
-    std::size_t total_size = header_size + data_size;
+    if (options.robust) {
+        if (options.mode != QueueMode::Locked) {
+            throw std::runtime_error("Robust locking requires a Locked queue; the other modes take no lock");
+        }
+#ifndef __linux__
+        throw std::runtime_error("Robust queues are only supported on Linux");
+#endif
+    }
+#if defined(__APPLE__)
+    if (options.mode == QueueMode::Locked and options.sync == SyncPrimitives::InSegment) {
+        throw std::runtime_error("In-segment semaphores are not supported on macOS");
+    }
+#endif
 
-    // Set size
-    if (ftruncate(fd, total_size) < 0) {
-        detail::safe_close(fd);
-        shm_unlink(name.c_str());
-        throw std::runtime_error("Failed to set size of shared memory: " + name);
+    const bool broadcast = options.mode == QueueMode::Broadcast;
+    if (broadcast and options.max_readers == 0) {
+        throw std::runtime_error("Broadcast queues need room for at least one reader");
+    }
+    if (broadcast and options.overflow == OverflowPolicy::Block) {
+        throw std::runtime_error("Broadcast queues cannot block: the writer never waits for readers");
+    }
+    if (options.max_participants == 0) {
+        throw std::runtime_error("Queues need room for at least one participant");
+    }
+    if (options.flush_interval_ms != 0 and !detail::is_file_path(name)) {
+        throw std::runtime_error("Periodic flushing requires a file-backed queue: " + name);
     }
 
-    // Map memory
-    void* addr = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (addr == MAP_FAILED) {
-        detail::safe_close(fd);
-        shm_unlink(name.c_str());
-        throw std::runtime_error("Failed to map shared memory: " + name);
+    // Slot stride granularity and data buffer alignment requested by the layout
+    std::size_t granularity = 1;
+    std::size_t alignment = 64;
+    switch (options.layout) {
+    case SlotLayout::CacheLine:
+        granularity = 64;
+        break;
+    case SlotLayout::Page:
+        granularity = alignment = detail::page_size();
+        break;
+    case SlotLayout::HugePage:
+        granularity = alignment = detail::kHugePageSize;
+        break;
+    default:
+        break;
+    }
+    if (element_size > std::numeric_limits<std::size_t>::max() - granularity) {
+        throw std::runtime_error("Queue size too large, would cause integer overflow");
     }
+    std::size_t stride =
+        options.variable_size ? element_size : (element_size + granularity - 1) / granularity * granularity;
 
-#ifdef __linux__
-    // Hint the kernel to back the mapping with huge pages and pre-populate if possible.
-    madvise(addr, total_size, MADV_HUGEPAGE | MADV_WILLNEED);
-#endif
+    // Check for potential integer overflow
+    if (max_elements > std::numeric_limits<std::size_t>::max() / stride or
+        max_elements > (std::numeric_limits<std::size_t>::max() - sizeof(ControlBlock) - 63) / sizeof(SlotHeader)) {
+        throw std::runtime_error("Queue size too large, would cause integer overflow");
+    }
+
+    // Calculate total size needed (header + slot metadata + reader table + participant table + latency
+    // histogram + data), keeping the tables, the histogram and the data cache-line aligned
+    std::size_t readers_offset = (sizeof(ControlBlock) + max_elements * sizeof(SlotHeader) + 63) & ~std::size_t(63);
+    std::size_t max_readers = broadcast ? options.max_readers : 0;
+    if (max_readers > (std::numeric_limits<std::size_t>::max() - readers_offset) / sizeof(ReaderSlot)) {
+        throw std::runtime_error("Too many readers, would cause integer overflow");
+    }
+    std::size_t readers_end = readers_offset + max_readers * sizeof(ReaderSlot);
+    std::size_t participants_offset = (readers_end + 63) & ~std::size_t(63);
+    if (options.max_participants >
+        (std::numeric_limits<std::size_t>::max() - participants_offset) / sizeof(ParticipantSlot)) {
+        throw std::runtime_error("Too many participants, would cause integer overflow");
+    }
+    std::size_t participants_end = participants_offset + options.max_participants * sizeof(ParticipantSlot);
+    std::size_t latency_offset = (participants_end + 63) & ~std::size_t(63);
+    std::size_t latency_end = latency_offset + (options.latency ? sizeof(detail::LatencyHistogram) : 0);
+    if (latency_end > std::numeric_limits<std::size_t>::max() - alignment) {
+        throw std::runtime_error("Queue size too large, would cause integer overflow");
+    }
+    std::size_t header_size = (latency_end + alignment - 1) / alignment * alignment;
+    std::size_t data_size =
+        options.variable_size ? (max_elements + 1) * record_size(element_size) : max_elements * stride;
+
+    // Check for potential integer overflow in total size calculation
+    if (header_size > std::numeric_limits<std::size_t>::max() - data_size) {
+        throw std::runtime_error("Queue size too large, would cause integer overflow in total size calculation");
+    }
+
+    std::size_t total_size = header_size + data_size;
+    detail::SegmentOptions segment;
+    segment.alignment = alignment;
+    segment.huge_pages = options.huge_pages;
+    segment.populate = options.populate;
+    segment.lock = options.lock_memory;
+    segment.numa_policy = options.numa_policy;
+    segment.numa_nodes = options.numa_nodes;
+    void* addr = detail::create_segment(name, total_size, segment);
 
     // Initialize control block
-    ControlBlock* cb = static_cast<ControlBlock*>(addr);
+    ControlBlock* cb = new (addr) ControlBlock();
+    cb->mode = options.mode;
+    cb->overflow = options.overflow;
     cb->max_elements = max_elements;
     cb->element_size = element_size;
+    cb->slot_stride = stride;
+    cb->map_alignment = alignment;
+    cb->data_offset = header_size;
+    cb->ring_bytes = options.variable_size ? data_size : 0;
     cb->head = 0;
     cb->tail = 0;
+    cb->read = 0;
     cb->count = 0;
+    cb->max_readers = max_readers;
+    cb->readers_offset = readers_offset;
+    cb->message_type = options.message_type;
+    cb->stats = options.stats;
+    cb->robust = options.robust;
+    cb->sync = options.sync;
+    cb->options = options;
+    cb->boot_id.store(detail::boot_id(), std::memory_order_relaxed);
+    cb->max_participants = options.max_participants;
+    cb->participants_offset = participants_offset;
+    cb->latency_offset = options.latency ? latency_offset : 0;
+    if (options.latency) {
+        detail::reset_latency(*new (static_cast<char*>(addr) + latency_offset) detail::LatencyHistogram());
+    }
+
+    // Slot i is initially free for the producer of position i
+    auto* slots = reinterpret_cast<SlotHeader*>(cb + 1);
+    for (std::size_t i = 0; i < max_elements; ++i) {
+        new (&slots[i]) SlotHeader();
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    for (std::size_t i = 0; i < max_readers; ++i) {
+        new (static_cast<char*>(addr) + readers_offset + i * sizeof(ReaderSlot)) ReaderSlot();
+    }
+    for (std::size_t i = 0; i < options.max_participants; ++i) {
+        new (static_cast<char*>(addr) + participants_offset + i * sizeof(ParticipantSlot)) ParticipantSlot();
+    }
 
     // Create queue and initialize semaphores
     try {
         SMQueue queue(name, addr, total_size);
-        queue.init_semaphores(cb);
-        detail::safe_close(fd);
+        if (options.mode == QueueMode::Locked) {
+#ifdef __linux__
+            if (options.robust) {
+                detail::init_robust_mutex(&cb->mutex);
+            }
+#endif
+            queue.init_semaphores(cb);
+        }
+        queue.register_participant();
+        cb->magic.store(kMagic, std::memory_order_release);
         return queue;
     } catch (const std::exception& e) {
-        detail::safe_close(fd);
         if (addr != nullptr and addr != MAP_FAILED)
             munmap(addr, total_size);
-        shm_unlink(name.c_str());
+        detail::unlink_segment(name);
         throw; // Re-throw the exception
     }
 }
 
 // Open an existing shared memory queue
-SMQueue SMQueue::open(const std::string& name) {
+SMQueue SMQueue::open(const std::string& name, const OpenOptions& options) {
     // Validate name - no spaces allowed for semaphore compatibility
     if (name.find(' ') != std::string::npos) {
         throw std::runtime_error("Queue name cannot contain spaces: " + name);
     }
 
-    // Open shared memory
-    int fd = shm_open(name.c_str(), O_RDWR, 0660);
-    if (fd < 0) {
-        throw std::runtime_error("Failed to open shared memory: " + name);
-    }
-
-    // Get size
-    struct stat st;
-    if (fstat(fd, &st) != 0) {
-        detail::safe_close(fd);
-        throw std::runtime_error("Failed to get shared memory size: " + name);
-    }
-
-    // Map memory
-    void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (addr == MAP_FAILED) {
-        detail::safe_close(fd);
-        throw std::runtime_error("Failed to map shared memory: " + name);
-    }
+    std::size_t size = 0;
+    void* addr = detail::open_segment(name, size);
 
     // Create queue and open semaphores
     try {
-        SMQueue queue(name, addr, static_cast<std::size_t>(st.st_size));
-        queue.open_semaphores();
-        detail::safe_close(fd);
+        if (size < sizeof(ControlBlock) or
+            static_cast<ControlBlock*>(addr)->magic.load(std::memory_order_acquire) != kMagic) {
+            throw std::runtime_error("Shared memory is not an initialized queue: " + name);
+        }
+
+        // Remap if this mapping would leave the data buffer misaligned, or to pre-fault and lock it
+        detail::SegmentOptions segment;
+        segment.alignment = static_cast<ControlBlock*>(addr)->map_alignment;
+        segment.populate = options.populate;
+        segment.lock = options.lock_memory;
+        if (reinterpret_cast<std::uintptr_t>(addr) % segment.alignment != 0 or segment.populate or segment.lock) {
+            munmap(addr, size);
+            addr = nullptr;
+            addr = detail::open_segment(name, size, segment);
+        }
+
+        SMQueue queue(name, addr, size);
+        // A file-backed queue may come from an earlier boot, whose processes and semaphores are gone
+        if (detail::is_file_path(name) and
+            queue.get_control_block()->boot_id.load(std::memory_order_acquire) != detail::boot_id()) {
+            queue.restart();
+        }
+        if (queue.m_mode == QueueMode::Locked and queue.m_items == nullptr) {
+            queue.open_semaphores();
+        }
+        // Recover before registering, so the repairs only consider the handles that were already open
+        if (options.recover) {
+            queue.recover();
+        }
+        queue.register_participant();
+        if (queue.m_mode == QueueMode::Broadcast) {
+            queue.register_reader(options.rewind);
+        }
+        if (options.placement.pin or options.placement.realtime) {
+            queue.place_thread(options.placement);
+        }
         return queue;
     } catch (const std::exception& e) {
-        detail::safe_close(fd);
         if (addr != nullptr and addr != MAP_FAILED)
-            munmap(addr, st.st_size);
+            munmap(addr, size);
         throw;
     }
-}
+}
+
+// Destroy a shared memory queue and the generations it grew into
+void SMQueue::destroy(const std::string& name) {
+    // Validate name - no spaces allowed for semaphore compatibility
+    if (name.find(' ') != std::string::npos) {
+        throw std::runtime_error("Queue name cannot contain spaces: " + name);
+    }
+
+    for (std::uint32_t generation = 0;; ++generation) {
+        const std::string segment_name = generation_name(name, generation);
+
+        // The control block records which semaphores the queue uses (none for in-segment ones); a segment
+        // left behind by a failed create() may not, so fall back to the names create() would have used
+        const std::string base_name = sem_base_name(segment_name);
+        std::string mutex_name = make_sem_name(base_name, "_mutex");
+        std::string items_name = make_sem_name(base_name, "_items");
+        bool grown = false;
+        try {
+            std::size_t size = 0;
+            const ControlBlock* cb = map_control_block(segment_name, size);
+            mutex_name = cb->mutex_name;
+            items_name = cb->items_name;
+            grown = cb->sealed.load(std::memory_order_acquire) != 0;
+            munmap(const_cast<ControlBlock*>(cb), size);
+        } catch (const std::runtime_error&) {
+        }
+
+        // Unlink shared memory; if it doesn't exist, just return
+        if (!detail::unlink_segment(segment_name)) {
+            return;
+        }
+
+        // Unlink semaphores
+        if (!mutex_name.empty()) {
+            sem_unlink(mutex_name.c_str());
+        }
+        if (!items_name.empty()) {
+            sem_unlink(items_name.c_str());
+        }
+
+        if (!grown) {
+            return;
+        }
+    }
+}
+
+// Read the counters of a queue through a read-only mapping
+QueueStats SMQueue::read_stats(const std::string& name) {
+    std::size_t size = 0;
+    const ControlBlock* cb = map_newest(name, size);
+    const QueueStats stats = snapshot_stats(cb);
+    munmap(const_cast<ControlBlock*>(cb), size);
+    return stats;
+}
+
+// Read the latency histogram of a queue through a read-only mapping
+LatencyStats SMQueue::read_latency(const std::string& name) {
+    std::size_t size = 0;
+    const ControlBlock* cb = map_newest(name, size);
+
+    LatencyStats stats;
+    if (cb->latency_offset != 0) {
+        stats = detail::summarize_latency(
+            *reinterpret_cast<const detail::LatencyHistogram*>(reinterpret_cast<const char*>(cb) + cb->latency_offset));
+    }
+    munmap(const_cast<ControlBlock*>(cb), size);
+    return stats;
+}
+
+// List the segments that hold an initialized queue. Later generations are part of the queue they grew
+// from and are not listed.
+std::vector<std::string> SMQueue::list_queues() {
+    std::vector<std::string> queues;
+    for (const std::string& name : detail::list_segments()) {
+        // Segments can vanish or turn out not to be queues while we look
+        try {
+            std::size_t size = 0;
+            const ControlBlock* cb = map_control_block(name, size);
+            const bool first = cb->generation == 0;
+            munmap(const_cast<ControlBlock*>(cb), size);
+            if (first) {
+                queues.push_back(name);
+            }
+        } catch (const std::runtime_error&) {
+        }
+    }
+    return queues;
+}
+
+// Move constructor
+SMQueue::SMQueue(SMQueue&& other) noexcept
+    : m_name(std::move(other.m_name)), m_addr(other.m_addr), m_size(other.m_size), m_mutex(other.m_mutex),
+      m_items(other.m_items), m_named(other.m_named), m_mode(other.m_mode), m_wait(other.m_wait), m_copy(other.m_copy),
+      m_variable(other.m_variable), m_stats(other.m_stats), m_robust(other.m_robust), m_pid(other.m_pid),
+      m_roles(other.m_roles), m_generation(other.m_generation), m_borrowed(other.m_borrowed),
+      m_mpmc_borrows(std::move(other.m_mpmc_borrows)), m_grown(other.m_grown), m_block(other.m_block),
+      m_evict(other.m_evict), m_participant(other.m_participant), m_reader(other.m_reader),
+      m_histogram(other.m_histogram), m_notifier(std::move(other.m_notifier)), m_flusher(std::move(other.m_flusher)),
+      m_cached_head(other.m_cached_head), m_cached_tail(other.m_cached_tail), m_reserved(other.m_reserved),
+      m_reserve_dropped(other.m_reserve_dropped), m_reserve_pos(other.m_reserve_pos),
+      m_reserve_length(other.m_reserve_length) {
+    other.m_reserved = false;
+    other.m_participant = nullptr;
+    other.m_reader = nullptr;
+    other.m_histogram = nullptr;
+    other.m_addr = nullptr;
+    other.m_size = 0;
+    other.m_mutex = nullptr;
+    other.m_items = nullptr;
+}
+
+// Move assignment
+SMQueue& SMQueue::operator=(SMQueue&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_name = std::move(other.m_name);
+        m_addr = other.m_addr;
+        m_size = other.m_size;
+        m_mutex = other.m_mutex;
+        m_items = other.m_items;
+        m_named = other.m_named;
+        m_mode = other.m_mode;
+        m_wait = other.m_wait;
+        m_copy = other.m_copy;
+        m_variable = other.m_variable;
+        m_stats = other.m_stats;
+        m_robust = other.m_robust;
+        m_pid = other.m_pid;
+        m_roles = other.m_roles;
+        m_generation = other.m_generation;
+        m_borrowed = other.m_borrowed;
+        m_mpmc_borrows = std::move(other.m_mpmc_borrows);
+        m_grown = other.m_grown;
+        m_block = other.m_block;
+        m_evict = other.m_evict;
+        m_participant = other.m_participant;
+        m_reader = other.m_reader;
+        m_histogram = other.m_histogram;
+        m_notifier = std::move(other.m_notifier);
+        m_flusher = std::move(other.m_flusher);
+        m_cached_head = other.m_cached_head;
+        m_cached_tail = other.m_cached_tail;
+        m_reserved = other.m_reserved;
+        m_reserve_dropped = other.m_reserve_dropped;
+        m_reserve_pos = other.m_reserve_pos;
+        m_reserve_length = other.m_reserve_length;
+        other.m_reserved = false;
+        other.m_participant = nullptr;
+        other.m_reader = nullptr;
+        other.m_histogram = nullptr;
+        other.m_addr = nullptr;
+        other.m_size = 0;
+        other.m_mutex = nullptr;
+        other.m_items = nullptr;
+    }
+    return *this;
+}
+
+// Destructor
+SMQueue::~SMQueue() noexcept { close(); }
+
+// Push a message to the queue
+// If the queue is full, the oldest message will be dropped to make room
+bool SMQueue::push(const std::byte* data) {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+
+    std::byte* dest = reserve();
+    if (dest == nullptr) {
+        return false;
+    }
+
+    detail::copy_bytes(dest, data, get_control_block()->element_size, m_copy);
+
+    // Return true if no messages were dropped, false if one was dropped
+    return publish();
+}
+
+// Push a message of a given length
+bool SMQueue::push(const std::byte* data, std::size_t length) {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+
+    std::byte* dest = reserve(length);
+    if (dest == nullptr) {
+        return false;
+    }
+
+    detail::copy_bytes(dest, data, length, m_copy);
+    return publish();
+}
+
+// Push a message, waiting at most timeout for room
+bool SMQueue::push_for(const std::byte* data, std::chrono::nanoseconds timeout) {
+    return push_for(data, element_size(), timeout);
+}
+
+// Push a message of a given length, waiting at most timeout for room
+bool SMQueue::push_for(const std::byte* data, std::size_t length, std::chrono::nanoseconds timeout) {
+    std::byte* dest = reserve_until(length, detail::deadline_after(timeout));
+    if (dest == nullptr) {
+        return false;
+    }
+
+    detail::copy_bytes(dest, data, length, m_copy);
+    return publish();
+}
+
+// Push a message if there is room for it
+bool SMQueue::try_push(const std::byte* data) { return try_push(data, element_size()); }
+
+// Push a message of a given length if there is room for it
+bool SMQueue::try_push(const std::byte* data, std::size_t length) {
+    std::byte* dest = reserve_until(length, kNoWait);
+    if (dest == nullptr) {
+        return false;
+    }
+
+    detail::copy_bytes(dest, data, length, m_copy);
+    return publish();
+}
+
+// Reserve the next slot for in-place writing
+std::byte* SMQueue::reserve() {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    return reserve(get_control_block()->element_size);
+}
+
+// Reserve room for a message of the given length
+std::byte* SMQueue::reserve(std::size_t length) { return reserve_until(length, kForever); }
+
+// Reserve room for a message, waiting for it until deadline on Block queues
+std::byte* SMQueue::reserve_until(std::size_t length, std::chrono::steady_clock::time_point deadline) {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    if (m_reserved) {
+        throw std::runtime_error("A reservation is already pending on this handle");
+    }
+    if (m_reader != nullptr) {
+        throw std::runtime_error("Broadcast readers cannot push");
+    }
+
+    // A sealed generation takes no new messages: move on to the ring that replaced it
+    while (get_control_block()->sealed.load(std::memory_order_acquire) == kSealed) {
+        follow_successor();
+    }
+
+    auto* cb = get_control_block();
+    if (length > cb->element_size) {
+        throw std::runtime_error("Message length exceeds element size");
+    }
+    if (!m_variable and length != cb->element_size) {
+        throw std::runtime_error("Message length does not match element size");
+    }
+    mark_role(kRoleProducer);
+
+    m_reserve_dropped = false;
+    m_evict = deadline != kNoWait;
+    std::byte* dest = claim(length);
+    if (dest == nullptr and m_block and deadline != kNoWait) {
+        // Full: wait for consumers to free a slot. A seal ends the wait too.
+        wait_space(
+            [&] {
+                dest = claim(length);
+                return dest != nullptr or cb->sealed.load(std::memory_order_acquire) == kSealed;
+            },
+            deadline);
+    }
+
+    if (dest != nullptr) {
+        m_reserved = true;
+        m_reserve_length = length;
+    } else if (cb->sealed.load(std::memory_order_acquire) == kSealed) {
+        // Sealed while we were claiming (Locked and MPMC): the message goes to the next generation
+        return reserve_until(length, deadline);
+    } else if (m_evict and !m_block) {
+        count_pushes(0, 1); // Dropped by the overflow policy
+    }
+    return dest;
+}
+
+// Claim room for the next message without waiting
+std::byte* SMQueue::claim(std::size_t length) {
+    if (m_variable) {
+        return record_reserve(length);
+    }
+    if (m_mode == QueueMode::SPSC) {
+        return spsc_reserve();
+    }
+    if (m_mode == QueueMode::MPMC) {
+        return mpmc_reserve();
+    }
+    if (m_mode == QueueMode::Broadcast) {
+        return broadcast_claim(get_control_block()->head.load(std::memory_order_relaxed));
+    }
+    return locked_reserve();
+}
+
+// Whether the message being pushed may discard the oldest one: only with DropOldest, and never in try_push()
+bool SMQueue::may_evict() const {
+    return m_evict and get_control_block()->overflow == OverflowPolicy::DropOldest;
+}
+
+// Make the reserved message visible to consumers
+bool SMQueue::publish() {
+    if (!m_reserved) {
+        throw std::runtime_error("No reservation is pending on this handle");
+    }
+    m_reserved = false;
+
+    auto* cb = get_control_block();
+    if (!m_variable) {
+        stamp_slots(m_reserve_pos, 1);
+    }
+    if (m_variable) {
+        *record_at(m_reserve_pos) = RecordHeader{static_cast<std::uint32_t>(m_reserve_length), 0};
+        const std::uint64_t head = m_reserve_pos + record_size(m_reserve_length);
+        if (m_mode == QueueMode::SPSC) {
+            cb->head.store(head, std::memory_order_release);
+            wake_consumers();
+        } else {
+            // Release: taps read head without the mutex
+            cb->head.store(head, std::memory_order_release);
+            cb->count++;
+            sem_post(m_items);
+            unlock_mutex();
+            wake_consumers();
+        }
+    } else if (m_mode == QueueMode::SPSC) {
+        // Publish the slot; pairs with the acquire load of head in spsc_borrow
+        cb->head.store(m_reserve_pos + 1, std::memory_order_release);
+        wake_consumers();
+    } else if (m_mode == QueueMode::MPMC) {
+        // Make the message visible to consumers
+        get_slot(m_reserve_pos % cb->max_elements)->seq.store(m_reserve_pos + 1, std::memory_order_release);
+        wake_consumers();
+    } else if (m_mode == QueueMode::Broadcast) {
+        // Close the slot's seqlock, then publish the position to readers
+        get_slot(m_reserve_pos % cb->max_elements)->seq.store(m_reserve_pos + 1, std::memory_order_release);
+        cb->head.store(m_reserve_pos + 1, std::memory_order_release);
+        wake_consumers();
+    } else {
+        // Advance the head. Taps read it without the mutex.
+        cb->head.store(m_reserve_pos + 1, std::memory_order_release);
+        cb->count++;
+
+        // Signal that a new item is available
+        sem_post(m_items);
+
+        // Unlock the mutex
+        unlock_mutex();
+        wake_consumers();
+    }
+
+    count_pushes(1, 0);
+    return !m_reserve_dropped;
+}
+
+// Locked reserve: take the mutex and keep it until publish()
+std::byte* SMQueue::locked_reserve() {
+    if (!lock_mutex(producer_wait_counter())) {
+        throw std::runtime_error("Failed to lock mutex");
+    }
+
+    // grow() seals the ring under the mutex, so no message slips in behind the seal
+    auto* cb = get_control_block();
+    std::byte* dest = cb->sealed.load(std::memory_order_relaxed) == kSealed
+                          ? nullptr
+                          : locked_claim(cb->head.load(std::memory_order_relaxed));
+    if (dest == nullptr) {
+        unlock_mutex();
+    }
+    return dest;
+}
+
+// Make room for the slot at head, dropping the oldest message if allowed. Caller holds the mutex.
+std::byte* SMQueue::locked_claim(std::uint64_t head) {
+    auto* cb = get_control_block();
+
+    // Check if queue is full. The oldest message can only be dropped if no consumer has borrowed it;
+    // a pinned slot pushes back on the producer and the new message is dropped instead.
+    if (cb->count >= cb->max_elements and (!may_evict() or cb->tail.load() != cb->read.load())) {
+        return nullptr;
+    }
+    if (cb->count >= cb->max_elements) {
+        // Drop the oldest message by advancing the tail
+        cb->tail.fetch_add(1, std::memory_order_relaxed);
+        cb->read.fetch_add(1, std::memory_order_relaxed);
+        cb->count--;
+        m_reserve_dropped = true;
+        count_eviction();
+
+        // Decrement the semaphore count since we're removing a message
+        sem_trywait(m_items);
+    }
+
+    // Get pointer to the element at head position
+    m_reserve_pos = head;
+    return get_element(head % cb->max_elements);
+}
+
+// Spin, then yield, then park until try_fn succeeds or deadline passes
+template <typename TryFn> bool SMQueue::wait_lock_free(TryFn try_fn, std::chrono::steady_clock::time_point deadline) {
+    detail::WaitTimer timer(consumer_wait_counter());
+    m_grown = false;
+
+    for (std::uint32_t attempt = 0;; ++attempt) {
+        if (try_fn()) {
+            return true;
+        }
+        // try_fn() moved to a generation with larger messages: let the caller resize its buffers
+        if (m_grown or detail::deadline_passed(deadline, attempt)) {
+            return false;
+        }
+        timer.start();
+
+        if (attempt < m_wait.spin_iterations) {
+            detail::cpu_relax();
+            continue;
+        }
+        if (attempt < m_wait.spin_iterations + m_wait.yield_iterations) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Announce ourselves before the final check so a producer publishing concurrently either
+        // sees the waiter or its message is seen by the check. try_fn() may have moved us to another
+        // generation, so look the control block up again.
+        heartbeat();
+        auto* cb = get_control_block();
+        cb->waiters.fetch_add(1, std::memory_order_seq_cst);
+        const std::uint32_t observed = cb->items_futex.load(std::memory_order_acquire);
+        bool done = try_fn();
+        if (!done) {
+            if (deadline == kForever) {
+                detail::futex_wait(&cb->items_futex, observed);
+            } else {
+                detail::futex_wait_for(&cb->items_futex, observed, deadline - std::chrono::steady_clock::now());
+            }
+            done = try_fn();
+        }
+        cb->waiters.fetch_sub(1, std::memory_order_relaxed);
+        if (done) {
+            return true;
+        }
+        if (m_grown) {
+            return false;
+        }
+        if (deadline != kForever and std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+}
+
+// Spin, then yield, then park on space_futex until try_fn succeeds or deadline passes
+template <typename TryFn> bool SMQueue::wait_space(TryFn try_fn, std::chrono::steady_clock::time_point deadline) {
+    auto* cb = get_control_block();
+    detail::WaitTimer timer(producer_wait_counter());
+
+    for (std::uint32_t attempt = 0;; ++attempt) {
+        if (try_fn()) {
+            return true;
+        }
+        if (detail::deadline_passed(deadline, attempt)) {
+            return false;
+        }
+        timer.start();
+
+        if (attempt < m_wait.spin_iterations) {
+            detail::cpu_relax();
+            continue;
+        }
+        if (attempt < m_wait.spin_iterations + m_wait.yield_iterations) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Announce ourselves before the final check so a consumer freeing a slot concurrently either sees
+        // the waiter or its slot is seen by the check
+        heartbeat();
+        cb->space_waiters.fetch_add(1, std::memory_order_seq_cst);
+        const std::uint32_t observed = cb->space_futex.load(std::memory_order_acquire);
+        bool done = try_fn();
+        if (!done) {
+            if (deadline == kForever) {
+                detail::futex_wait(&cb->space_futex, observed);
+            } else {
+                detail::futex_wait_for(&cb->space_futex, observed, deadline - std::chrono::steady_clock::now());
+            }
+            done = try_fn();
+        }
+        cb->space_waiters.fetch_sub(1, std::memory_order_relaxed);
+        if (done) {
+            return true;
+        }
+        if (deadline != kForever and std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+}
+
+// Pop a message from the queue (blocking)
+bool SMQueue::pop(std::byte* buffer) {
+    std::size_t length;
+    return pop(buffer, length);
+}
+
+// Pop a message and report its length (blocking)
+bool SMQueue::pop(std::byte* buffer, std::size_t& length) { return pop_until(buffer, length, kForever); }
+
+// Pop a message, waiting at most timeout
+bool SMQueue::pop_for(std::byte* buffer, std::chrono::nanoseconds timeout) {
+    std::size_t length;
+    return pop_until(buffer, length, detail::deadline_after(timeout));
+}
+
+// Pop a message and report its length, waiting at most timeout
+bool SMQueue::pop_for(std::byte* buffer, std::size_t& length, std::chrono::nanoseconds timeout) {
+    return pop_until(buffer, length, detail::deadline_after(timeout));
+}
+
+// Pop a message, waiting until deadline
+bool SMQueue::pop_until(std::byte* buffer, std::chrono::steady_clock::time_point deadline) {
+    std::size_t length;
+    return pop_until(buffer, length, deadline);
+}
+
+// Pop a message and report its length, waiting until deadline
+bool SMQueue::pop_until(std::byte* buffer, std::size_t& length, std::chrono::steady_clock::time_point deadline) {
+    if (m_addr == nullptr) {
+        return false;
+    }
+
+    if (m_mode != QueueMode::Locked) {
+        return wait_lock_free([&] { return try_pop(buffer, length); }, deadline);
+    }
+    mark_role(kRoleConsumer);
+
+    for (;;) {
+        if (!wait_item(deadline)) {
+            return false;
+        }
+
+        // Lock mutex
+        if (!lock_mutex()) {
+            sem_post(m_items);
+            return false;
+        }
+
+        // A token without a message is left over from crash recovery: drop it and wait for the next one
+        const bool available = locked_available();
+        if (available) {
+            locked_take(buffer, length);
+        }
+
+        // Unlock the mutex
+        unlock_mutex();
+        if (available) {
+            return true;
+        }
+
+        // grow() also posts tokens to wake consumers once the ring is sealed
+        if (consumer_switch() and m_grown) {
+            return false;
+        }
+    }
+}
+
+// Wait for an item to be available, polling before blocking in the kernel
+bool SMQueue::wait_item(std::chrono::steady_clock::time_point deadline) {
+    detail::WaitTimer timer(consumer_wait_counter());
+    for (std::uint32_t attempt = 0; attempt < m_wait.spin_iterations + m_wait.yield_iterations; ++attempt) {
+        if (sem_trywait(m_items) == 0) {
+            return true;
+        }
+        if (detail::deadline_passed(deadline, attempt)) {
+            return false;
+        }
+        timer.start();
+        if (attempt < m_wait.spin_iterations) {
+            detail::cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    timer.start();
+    heartbeat();
+    if (deadline != kForever) {
+        return detail::sem_wait_until(m_items, deadline);
+    }
+
+    int result;
+    do {
+        result = sem_wait(m_items);
+    } while (result == -1 and errno == EINTR);
+    return result == 0;
+}
+
+// Try to pop a message (non-blocking)
+bool SMQueue::try_pop(std::byte* buffer) {
+    std::size_t length;
+    return try_pop(buffer, length);
+}
+
+// Try to pop a message and report its length (non-blocking)
+bool SMQueue::try_pop(std::byte* buffer, std::size_t& length) {
+    if (m_addr == nullptr) {
+        return false;
+    }
+    mark_role(kRoleConsumer);
+
+    // An empty sealed ring sends the consumer on to the next generation, unless its messages grew
+    if (m_mode == QueueMode::SPSC) {
+        return spsc_try_pop(buffer, length) or (consumer_switch() and !m_grown and try_pop(buffer, length));
+    }
+    if (m_mode == QueueMode::MPMC) {
+        length = get_control_block()->element_size;
+        return mpmc_try_pop(buffer) or (consumer_switch() and !m_grown and try_pop(buffer, length));
+    }
+    if (m_mode == QueueMode::Broadcast) {
+        length = get_control_block()->element_size;
+        return broadcast_try_pop(buffer) or (consumer_switch() and !m_grown and try_pop(buffer, length));
+    }
+
+    // Try to get an item (non-blocking)
+    if (sem_trywait(m_items) != 0) {
+        return consumer_switch() and !m_grown and try_pop(buffer, length);
+    }
+
+    // Lock mutex
+    if (!lock_mutex()) {
+        sem_post(m_items);
+        return false;
+    }
+
+    // A token left over from crash recovery may have no message
+    const bool available = locked_available();
+    if (available) {
+        locked_take(buffer, length);
+    }
+
+    // Unlock the mutex
+    unlock_mutex();
+    return available or (consumer_switch() and !m_grown and try_pop(buffer, length));
+}
+
+// Zero-copy borrow (non-blocking). Returns true if a message was borrowed.
+bool SMQueue::borrow(std::byte const** data_ptr, std::size_t& index_out) {
+    std::size_t length;
+    return borrow(data_ptr, index_out, length);
+}
+
+// Zero-copy borrow that also reports the message length
+bool SMQueue::borrow(std::byte const** data_ptr, std::size_t& index_out, std::size_t& length) {
+    if (m_addr == nullptr) {
+        return false;
+    }
+    mark_role(kRoleConsumer);
+
+    bool borrowed;
+    if (m_mode == QueueMode::SPSC) {
+        borrowed = spsc_borrow(data_ptr, index_out, length);
+    } else if (m_mode == QueueMode::MPMC) {
+        length = get_control_block()->element_size;
+        std::uint64_t pos;
+        borrowed = mpmc_borrow(data_ptr, index_out, pos);
+        if (borrowed) {
+            m_mpmc_borrows.push_back(pos);
+        }
+    } else if (m_mode == QueueMode::Broadcast) {
+        throw std::runtime_error("Broadcast queues do not support borrowing; the writer never waits for readers");
+    } else {
+        // Attempt to grab an item – same as try_pop but without copying.
+        borrowed = sem_trywait(m_items) == 0 and locked_borrow(data_ptr, index_out, length);
+    }
+
+    if (borrowed) {
+        m_borrowed++;
+        return true;
+    }
+    return consumer_switch() and !m_grown and borrow(data_ptr, index_out, length);
+}
+
+// Zero-copy borrow, waiting at most timeout
+bool SMQueue::borrow_for(std::byte const** data_ptr, std::size_t& index_out, std::chrono::nanoseconds timeout) {
+    std::size_t length;
+    return borrow_until(data_ptr, index_out, length, detail::deadline_after(timeout));
+}
+
+// Zero-copy borrow that reports the message length, waiting at most timeout
+bool SMQueue::borrow_for(std::byte const** data_ptr, std::size_t& index_out, std::size_t& length,
+                         std::chrono::nanoseconds timeout) {
+    return borrow_until(data_ptr, index_out, length, detail::deadline_after(timeout));
+}
+
+// Zero-copy borrow, waiting until deadline
+bool SMQueue::borrow_until(std::byte const** data_ptr, std::size_t& index_out, std::size_t& length,
+                           std::chrono::steady_clock::time_point deadline) {
+    if (m_addr == nullptr) {
+        return false;
+    }
+    if (m_mode == QueueMode::Broadcast) {
+        throw std::runtime_error("Broadcast queues do not support borrowing; the writer never waits for readers");
+    }
+
+    if (m_mode != QueueMode::Locked) {
+        return wait_lock_free([&] { return borrow(data_ptr, index_out, length); }, deadline);
+    }
+    mark_role(kRoleConsumer);
+
+    // locked_borrow() only fails for tokens left over from crash recovery or posted when the ring was
+    // sealed; wait for the next one
+    while (wait_item(deadline)) {
+        if (locked_borrow(data_ptr, index_out, length)) {
+            m_borrowed++;
+            return true;
+        }
+        if (consumer_switch() and m_grown) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Borrow the next message; the caller holds an item token (Locked mode). Returns false if the token had
+// no message behind it.
+bool SMQueue::locked_borrow(std::byte const** data_ptr, std::size_t& index_out, std::size_t& length) {
+    // Lock the mutex to read metadata safely
+    if (!lock_mutex()) {
+        // Failed to lock – restore semaphore so we don't lose the item
+        sem_post(m_items);
+        throw std::runtime_error("Failed to lock mutex");
+    }
+
+    if (!locked_available()) {
+        unlock_mutex();
+        return false;
+    }
+
+    // Advance the read cursor only. The slot stays pinned until commit_pop(), so producers cannot
+    // overwrite it while it is still in use by the consumer.
+    window_borrow(data_ptr, index_out, length);
+
+#ifdef __GNUC__
+    // Prefetch first cache line to hide latency
+    __builtin_prefetch(*data_ptr, 0, 3);
+#endif
+
+    // Unlock mutex so producers/other consumers can proceed.
+    unlock_mutex();
+    return true;
+}
+
+// Release a previously borrowed slot and make it reusable. Indices that are not borrowed are ignored.
+void SMQueue::commit_pop(std::size_t index) {
+    if (m_addr == nullptr) {
+        return;
+    }
+    if (m_mode == QueueMode::Broadcast) {
+        throw std::runtime_error("Broadcast queues do not support borrowing; the writer never waits for readers");
+    }
+
+    bool released;
+    if (m_mode == QueueMode::SPSC) {
+        released = window_release(index);
+    } else if (m_mode == QueueMode::MPMC) {
+        released = mpmc_commit_pop(index);
+    } else {
+        // Lock mutex
+        if (!lock_mutex()) {
+            return; // failed to lock, leak the slot – worst-case scenario is transient memory pressure
+        }
+
+        released = window_release(index);
+
+        // Unlock mutex
+        unlock_mutex();
+    }
+
+    if (released and m_borrowed != 0) {
+        m_borrowed--;
+    }
+}
+
+// Push a batch of fixed-size messages
+std::size_t SMQueue::push_batch(const std::byte* const* msgs, std::size_t n) { return push_batch(msgs, nullptr, n); }
+
+// Push a batch of messages with one synchronisation round, or as few as room allows on Block queues
+std::size_t SMQueue::push_batch(const std::byte* const* msgs, const std::size_t* lengths, std::size_t n) {
+    std::size_t pushed = push_batch_some(msgs, lengths, n);
+
+    // Block queues wait for room for the next message instead of stopping at a full ring
+    while (pushed < n and m_block) {
+        const std::size_t length = lengths != nullptr ? lengths[pushed] : get_control_block()->element_size;
+        if (!push(msgs[pushed], length)) {
+            break;
+        }
+        pushed++;
+        pushed += push_batch_some(msgs + pushed, lengths != nullptr ? lengths + pushed : nullptr, n - pushed);
+    }
+    return pushed;
+}
+
+// Push as many messages of a batch as fit right now, with one synchronisation round
+std::size_t SMQueue::push_batch_some(const std::byte* const* msgs, const std::size_t* lengths, std::size_t n) {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    if (m_reserved) {
+        throw std::runtime_error("A reservation is already pending on this handle");
+    }
+    if (m_reader != nullptr) {
+        throw std::runtime_error("Broadcast readers cannot push");
+    }
+    while (get_control_block()->sealed.load(std::memory_order_acquire) == kSealed) {
+        follow_successor();
+    }
+
+    auto* cb = get_control_block();
+    const std::size_t element_size = cb->element_size;
+    for (std::size_t i = 0; lengths != nullptr and i < n; ++i) {
+        if (lengths[i] > element_size) {
+            throw std::runtime_error("Message length exceeds element size");
+        }
+        if (!m_variable and lengths[i] != element_size) {
+            throw std::runtime_error("Message length does not match element size");
+        }
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+    mark_role(kRoleProducer);
+    m_evict = true;
+
+    // Messages left out on a Block queue are not lost: push_batch() waits for room for them
+    const auto rejected = [&](std::size_t pushed) { return m_block ? 0 : n - pushed; };
+    if (m_mode == QueueMode::MPMC) {
+        const std::size_t pushed = mpmc_push_batch(msgs, n);
+        if (pushed < n and cb->sealed.load(std::memory_order_acquire) == kSealed) {
+            // Sealed partway through: the rest of the batch goes to the next generation
+            count_pushes(pushed, 0);
+            return pushed + push_batch_some(msgs + pushed, nullptr, n - pushed);
+        }
+        count_pushes(pushed, rejected(pushed));
+        return pushed;
+    }
+    if (m_mode == QueueMode::Locked) {
+        if (!lock_mutex(producer_wait_counter())) {
+            throw std::runtime_error("Failed to lock mutex");
+        }
+        if (cb->sealed.load(std::memory_order_relaxed) == kSealed) {
+            unlock_mutex();
+            return push_batch_some(msgs, lengths, n);
+        }
+    }
+
+    std::uint64_t head = cb->head.load(std::memory_order_relaxed);
+    std::size_t pushed = 0;
+
+    if (m_mode == QueueMode::SPSC and !m_variable) {
+        // One look at tail decides how many messages fit
+        std::uint64_t space = cb->max_elements - (head - m_cached_tail);
+        if (space < n) {
+            m_cached_tail = cb->tail.load(std::memory_order_acquire);
+            space = cb->max_elements - (head - m_cached_tail);
+        }
+
+        pushed = static_cast<std::size_t>(std::min<std::uint64_t>(n, space));
+        for (std::size_t i = 0; i < pushed; ++i) {
+            detail::copy_bytes(get_element((head + i) % cb->max_elements), msgs[i], element_size, m_copy);
+        }
+        stamp_slots(head, pushed);
+        head += pushed;
+    } else if (m_mode == QueueMode::Broadcast) {
+        // The writer never waits: the whole batch goes in, lapping slow readers if it must
+        for (; pushed < n; ++pushed) {
+            detail::copy_bytes(broadcast_claim(head), msgs[pushed], element_size, m_copy);
+            stamp_slots(head, 1);
+            get_slot(head % cb->max_elements)->seq.store(head + 1, std::memory_order_release);
+            head++;
+        }
+    } else {
+        for (; pushed < n; ++pushed) {
+            const std::size_t length = lengths != nullptr ? lengths[pushed] : element_size;
+            std::byte* dest = m_variable ? record_claim(head, length) : locked_claim(head);
+            if (dest == nullptr) {
+                break;
+            }
+
+            detail::copy_bytes(dest, msgs[pushed], length, m_copy);
+            if (m_variable) {
+                *record_at(m_reserve_pos) = RecordHeader{static_cast<std::uint32_t>(length), 0};
+                head = m_reserve_pos + record_size(length);
+            } else {
+                stamp_slots(m_reserve_pos, 1);
+                head = m_reserve_pos + 1;
+            }
+
+            // Consumers that take the item block on the mutex until the whole batch is published. Head moves
+            // with every message so a producer dying mid-batch leaves a consistent queue behind.
+            if (m_mode == QueueMode::Locked) {
+                cb->head.store(head, std::memory_order_release);
+                cb->count++;
+                sem_post(m_items);
+            }
+        }
+    }
+
+    // Locked queues published each message above; the other modes publish the whole batch at once. Pairs
+    // with the acquire load of head in the consumer.
+    if (pushed != 0 and m_mode != QueueMode::Locked) {
+        cb->head.store(head, std::memory_order_release);
+    }
+
+    if (m_mode == QueueMode::Locked) {
+        unlock_mutex();
+    }
+    if (pushed != 0) {
+        wake_consumers();
+    }
+    count_pushes(pushed, rejected(pushed));
+    return pushed;
+}
+
+// Pop a batch of messages (blocking until at least one is available)
+std::size_t SMQueue::pop_batch(std::byte* out, std::size_t max_n, std::size_t* lengths) {
+    if (m_addr == nullptr or max_n == 0) {
+        return 0;
+    }
+
+    if (m_mode != QueueMode::Locked) {
+        std::size_t popped = 0;
+        wait_lock_free([&] { return (popped = try_pop_batch(out, max_n, lengths)) != 0; });
+        return popped;
+    }
+    mark_role(kRoleConsumer);
+
+    if (!wait_item()) {
+        return 0;
+    }
+
+    // Take whatever else is already available without waiting
+    std::size_t items = 1;
+    while (items < max_n and sem_trywait(m_items) == 0) {
+        items++;
+    }
+
+    if (!lock_mutex()) {
+        for (std::size_t i = 0; i < items; ++i) {
+            sem_post(m_items);
+        }
+        return 0;
+    }
+
+    // Fewer messages than tokens only after crash recovery, or once the ring is sealed
+    const std::size_t taken =
+        window_take(out, items, lengths, get_control_block()->head.load(std::memory_order_relaxed));
+    unlock_mutex();
+    if (taken == 0 and consumer_switch() and !m_grown) {
+        return pop_batch(out, max_n, lengths);
+    }
+    return taken;
+}
+
+// Pop a batch of messages (non-blocking)
+std::size_t SMQueue::try_pop_batch(std::byte* out, std::size_t max_n, std::size_t* lengths) {
+    if (m_addr == nullptr or max_n == 0) {
+        return 0;
+    }
+    mark_role(kRoleConsumer);
+
+    auto* cb = get_control_block();
+    std::size_t popped = 0;
+
+    if (m_mode == QueueMode::MPMC) {
+        popped = mpmc_pop_batch(out, max_n, lengths);
+    } else if (m_mode == QueueMode::Broadcast) {
+        while (popped < max_n and broadcast_try_pop(out + popped * cb->element_size)) {
+            if (lengths != nullptr) {
+                lengths[popped] = cb->element_size;
+            }
+            popped++;
+        }
+    } else if (m_mode == QueueMode::SPSC) {
+        // Refresh the cached head only if it cannot satisfy the whole batch, or another handle consumed past it
+        const std::uint64_t read = cb->read.load(std::memory_order_relaxed);
+        if (read >= m_cached_head or (!m_variable and m_cached_head - read < max_n)) {
+            m_cached_head = cb->head.load(std::memory_order_acquire);
+        }
+        popped = window_take(out, max_n, lengths, m_cached_head);
+    } else {
+        std::size_t items = 0;
+        while (items < max_n and sem_trywait(m_items) == 0) {
+            items++;
+        }
+
+        if (items != 0) {
+            if (!lock_mutex()) {
+                for (std::size_t i = 0; i < items; ++i) {
+                    sem_post(m_items);
+                }
+                return 0;
+            }
+            popped = window_take(out, items, lengths, cb->head.load(std::memory_order_relaxed));
+            unlock_mutex();
+        }
+    }
+
+    if (popped == 0 and consumer_switch() and !m_grown) {
+        return try_pop_batch(out, max_n, lengths);
+    }
+    return popped;
+}
+
+// Zero-copy borrow of a contiguous run of messages (non-blocking)
+std::size_t SMQueue::borrow_batch(std::byte const** data_ptr, std::size_t& index_out, std::size_t max_n) {
+    if (m_addr == nullptr or max_n == 0) {
+        return 0;
+    }
+    if (m_variable) {
+        throw std::runtime_error("borrow_batch requires a fixed-size queue");
+    }
+    if (m_mode == QueueMode::Broadcast) {
+        throw std::runtime_error("Broadcast queues do not support borrowing; the writer never waits for readers");
+    }
+    mark_role(kRoleConsumer);
+
+    auto* cb = get_control_block();
+    std::size_t borrowed = 0;
+
+    if (m_mode == QueueMode::MPMC) {
+        std::uint64_t pos;
+        borrowed = mpmc_claim(cb->tail, 1, max_n, true, pos);
+        if (borrowed != 0) {
+            for (std::size_t i = 0; i < borrowed; ++i) {
+                m_mpmc_borrows.push_back(pos + i);
+            }
+            index_out = pos % cb->max_elements;
+            *data_ptr = get_element(index_out);
+            count_pops(borrowed);
+            record_residency(index_out, borrowed);
+        }
+    } else if (m_mode == QueueMode::SPSC) {
+        const std::uint64_t read = cb->read.load(std::memory_order_relaxed);
+        if (read >= m_cached_head or m_cached_head - read < max_n) {
+            m_cached_head = cb->head.load(std::memory_order_acquire);
+        }
+        borrowed = window_borrow_run(data_ptr, index_out, max_n, m_cached_head);
+    } else {
+        std::size_t items = 0;
+        while (items < max_n and sem_trywait(m_items) == 0) {
+            items++;
+        }
+
+        if (items != 0) {
+            if (!lock_mutex()) {
+                for (std::size_t i = 0; i < items; ++i) {
+                    sem_post(m_items);
+                }
+                return 0;
+            }
+
+            // The run stops at the end of the ring; give back the items left on the other side, but no more
+            // than there are messages (tokens left over from crash recovery may have none)
+            const std::uint64_t head = cb->head.load(std::memory_order_relaxed);
+            borrowed = window_borrow_run(data_ptr, index_out, items, head);
+            const std::uint64_t unread = head - cb->read.load(std::memory_order_relaxed);
+            for (std::size_t i = borrowed; i < items and i - borrowed < unread; ++i) {
+                sem_post(m_items);
+            }
+            unlock_mutex();
+        }
+    }
+
+    if (borrowed != 0) {
+        m_borrowed += borrowed;
+        return borrowed;
+    }
+    return consumer_switch() and !m_grown ? borrow_batch(data_ptr, index_out, max_n) : 0;
+}
+
+// Release a run of messages borrowed by borrow_batch()
+void SMQueue::commit_pop_batch(std::size_t index, std::size_t count) {
+    if (m_addr == nullptr or count == 0) {
+        return;
+    }
+    if (m_variable) {
+        throw std::runtime_error("commit_pop_batch requires a fixed-size queue");
+    }
+    if (m_mode == QueueMode::Broadcast) {
+        throw std::runtime_error("Broadcast queues do not support borrowing; the writer never waits for readers");
+    }
+    auto* cb = get_control_block();
+
+    if (m_mode == QueueMode::MPMC) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (mpmc_commit_pop((index + i) % cb->max_elements) and m_borrowed != 0) {
+                m_borrowed--;
+            }
+        }
+        return;
+    }
+    m_borrowed -= std::min(m_borrowed, count);
+
+    if (m_mode == QueueMode::SPSC) {
+        window_release_batch(index, count);
+        return;
+    }
+
+    if (!lock_mutex()) {
+        return; // failed to lock, leak the slots
+    }
+    window_release_batch(index, count);
+    unlock_mutex();
+}
+
+// Close the queue
+void SMQueue::close() {
+    // The watcher and the flusher use the mapping, so they go first
+    m_notifier.reset();
+    m_flusher.reset();
+
+    if (m_reader != nullptr) {
+        // Clear the pid first so recovery never mistakes a reader registering in this entry for us
+        m_reader->pid.store(0, std::memory_order_relaxed);
+        m_reader->active.store(0, std::memory_order_release);
+        m_reader = nullptr;
+    }
+
+    if (m_participant != nullptr) {
+        m_participant->roles.store(0, std::memory_order_relaxed);
+        m_participant->pid.store(0, std::memory_order_release);
+        m_participant = nullptr;
+        m_roles = 0;
+    }
+
+    // In-segment semaphores go away with the mapping
+    if (m_mutex != nullptr) {
+        if (m_named) {
+            sem_close(m_mutex);
+        }
+        m_mutex = nullptr;
+    }
+
+    if (m_items != nullptr) {
+        if (m_named) {
+            sem_close(m_items);
+        }
+        m_items = nullptr;
+    }
+    m_named = false;
+
+    if (m_addr != nullptr) {
+        munmap(m_addr, m_size);
+        m_addr = nullptr;
+        m_size = 0;
+        m_histogram = nullptr;
+    }
+}
+
+// Get maximum number of elements
+std::size_t SMQueue::max_elements() const { return m_addr != nullptr ? get_control_block()->max_elements : 0; }
+
+// Get element size in bytes
+std::size_t SMQueue::element_size() const { return m_addr != nullptr ? get_control_block()->element_size : 0; }
+
+// Get the distance between consecutive slots
+std::size_t SMQueue::slot_stride() const { return m_addr != nullptr ? get_control_block()->slot_stride : 0; }
+
+// Whether the queue stores variable-size records
+bool SMQueue::variable_size() const { return m_variable; }
+
+// Get queue name
+const std::string& SMQueue::name() const { return m_name; }
+
+// Set how blocking calls on this handle wait for messages
+void SMQueue::set_wait_strategy(const WaitStrategy& strategy) { m_wait = strategy; }
+
+// Whether a message looks ready for this handle
+bool SMQueue::readable() const {
+    if (m_addr == nullptr) {
+        return false;
+    }
+
+    // A drained sealed ring counts as readable: the next pop moves on to the generation that replaced it
+    const auto* cb = get_control_block();
+    if (cb->sealed.load(std::memory_order_acquire) == kSealed and drained()) {
+        return true;
+    }
+    switch (m_mode) {
+    case QueueMode::MPMC: {
+        const std::uint64_t tail = cb->tail.load(std::memory_order_relaxed);
+        return get_slot(tail % cb->max_elements)->seq.load(std::memory_order_acquire) == tail + 1;
+    }
+    case QueueMode::Broadcast:
+        return m_reader != nullptr and
+               m_reader->cursor.load(std::memory_order_relaxed) != cb->head.load(std::memory_order_acquire);
+    default:
+        return cb->read.load(std::memory_order_relaxed) != cb->head.load(std::memory_order_acquire);
+    }
+}
+
+// Event loop descriptor, starting the watcher on first use
+int SMQueue::notify_fd() {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    if (!m_notifier) {
+        auto* cb = get_control_block();
+        m_notifier = std::make_unique<detail::Notifier>(&cb->items_futex, &cb->waiters);
+    }
+    return m_notifier->fd();
+}
+
+// Consume pending notifications
+void SMQueue::clear_notify() {
+    if (m_notifier) {
+        m_notifier->clear();
+    }
+}
+
+// Set how payloads are copied on this handle
+void SMQueue::set_copy_strategy(const CopyStrategy& strategy) { m_copy = strategy; }
+
+// Get synchronization mode
+QueueMode SMQueue::mode() const { return m_mode; }
+
+// Get the overflow policy
+OverflowPolicy SMQueue::overflow() const {
+    return m_addr != nullptr ? get_control_block()->overflow : OverflowPolicy::DropOldest;
+}
+
+// Layout of the array in each message
+const MessageType& SMQueue::message_type() const {
+    static const MessageType untyped;
+    return m_addr != nullptr ? get_control_block()->message_type : untyped;
+}
+
+// Apply a NUMA policy to the data buffer and migrate the pages mapped so far
+void SMQueue::bind_numa(NumaPolicy policy, std::uint64_t nodes) {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    detail::bind_memory(get_data_buffer(), m_size - get_control_block()->data_offset, policy, nodes, true);
+}
+
+// Report where the pages of the data buffer reside
+NumaResidency SMQueue::numa_residency() const {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    return detail::memory_residency(get_data_buffer(), m_size - get_control_block()->data_offset);
+}
+
+// Messages this Broadcast reader missed
+std::uint64_t SMQueue::overruns() const {
+    return m_reader != nullptr ? m_reader->overruns.load(std::memory_order_relaxed) : 0;
+}
+
+// Snapshot of this queue's counters
+QueueStats SMQueue::stats() const {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    return snapshot_stats(get_control_block());
+}
+
+// Queue residency times measured so far
+LatencyStats SMQueue::latency() const {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    return m_histogram != nullptr ? detail::summarize_latency(*m_histogram) : LatencyStats();
+}
+
+// Empty the latency histogram
+void SMQueue::reset_latency() {
+    if (m_histogram != nullptr) {
+        detail::reset_latency(*m_histogram);
+    }
+}
+
+// Every handle that has the queue open
+std::vector<Participant> SMQueue::participants() const {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+
+    std::vector<Participant> participants;
+    for (std::size_t i = 0; i < get_control_block()->max_participants; ++i) {
+        const ParticipantSlot* slot = get_participant(i);
+        Participant participant;
+        participant.pid = slot->pid.load(std::memory_order_acquire);
+        if (participant.pid == 0) {
+            continue;
+        }
+        const std::uint32_t roles = slot->roles.load(std::memory_order_relaxed);
+        participant.producer = (roles & kRoleProducer) != 0;
+        participant.consumer = (roles & kRoleConsumer) != 0;
+        participant.alive = detail::process_alive(participant.pid);
+        participant.heartbeat_ns = slot->heartbeat_ns.load(std::memory_order_relaxed);
+        participant.cpu = slot->cpu.load(std::memory_order_relaxed);
+        participants.push_back(participant);
+    }
+    return participants;
+}
+
+// Record a sign of life for this handle
+void SMQueue::heartbeat() {
+    if (m_participant != nullptr) {
+        m_participant->heartbeat_ns.store(detail::now_ns(), std::memory_order_relaxed);
+    }
+}
+
+// Write the mapping back to its file
+void SMQueue::flush() {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+    detail::flush_memory(m_addr, m_size, true);
+}
+
+// Pin the calling thread and set its scheduling policy
+int SMQueue::place_thread(const ThreadPlacement& placement) {
+    if (m_addr == nullptr) {
+        throw std::runtime_error("SMQueue not initialized");
+    }
+
+    int cpu = -1;
+    if (placement.pin) {
+        cpu = placement.cpu >= 0 ? placement.cpu : choose_cpu();
+        detail::pin_thread(cpu);
+        if (m_participant != nullptr) {
+            m_participant->cpu.store(cpu, std::memory_order_relaxed);
+        }
+    }
+    if (placement.realtime) {
+        detail::set_realtime(placement.priority);
+    }
+    return cpu;
+}
+
+// Constructor
+SMQueue::SMQueue(const std::string& name, void* addr, std::size_t size)
+    : m_name(name), m_addr(addr), m_size(size), m_mutex(nullptr), m_items(nullptr), m_named(false),
+      m_mode(static_cast<ControlBlock*>(addr)->mode), m_variable(static_cast<ControlBlock*>(addr)->ring_bytes != 0),
+      m_stats(static_cast<ControlBlock*>(addr)->stats), m_robust(static_cast<ControlBlock*>(addr)->robust),
+      m_pid(static_cast<std::int32_t>(getpid())), m_roles(0),
+      m_generation(static_cast<ControlBlock*>(addr)->generation), m_borrowed(0), m_grown(false),
+      m_block(static_cast<ControlBlock*>(addr)->overflow == OverflowPolicy::Block), m_evict(true),
+      m_participant(nullptr), m_reader(nullptr), m_histogram(nullptr),
+      m_cached_head(static_cast<ControlBlock*>(addr)->head.load(std::memory_order_acquire)),
+      m_cached_tail(static_cast<ControlBlock*>(addr)->tail.load(std::memory_order_acquire)), m_reserved(false),
+      m_reserve_dropped(false), m_reserve_pos(0), m_reserve_length(0) {
+    const std::size_t latency_offset = static_cast<ControlBlock*>(addr)->latency_offset;
+    if (latency_offset != 0) {
+        m_histogram = reinterpret_cast<detail::LatencyHistogram*>(static_cast<char*>(addr) + latency_offset);
+    }
+}
+
+// Lock the queue mutex, retrying on signal interruption
+bool SMQueue::lock_mutex(std::atomic<std::uint64_t>* wait_ns) {
+    auto* cb = get_control_block();
+    if (m_robust) {
+        int result = wait_ns != nullptr ? pthread_mutex_trylock(&cb->mutex) : EBUSY;
+        if (result == EBUSY) {
+            detail::WaitTimer timer(wait_ns);
+            timer.start();
+            result = pthread_mutex_lock(&cb->mutex);
+        }
+#ifdef __linux__
+        if (result == EOWNERDEAD) {
+            // The previous owner died holding the mutex, possibly halfway through an update
+            repair_locked();
+            pthread_mutex_consistent(&cb->mutex);
+            result = 0;
+        }
+#endif
+        return result == 0;
+    }
+
+    int result = wait_ns != nullptr ? sem_trywait(m_mutex) : -1;
+    if (result != 0) {
+        detail::WaitTimer timer(wait_ns);
+        timer.start();
+        do {
+            result = sem_wait(m_mutex);
+        } while (result == -1 and errno == EINTR);
+    }
+    if (result == 0) {
+        cb->lock_owner.store(m_pid, std::memory_order_relaxed);
+    }
+    return result == 0;
+}
+
+// Unlock the queue mutex
+void SMQueue::unlock_mutex() {
+    auto* cb = get_control_block();
+    if (m_robust) {
+        pthread_mutex_unlock(&cb->mutex);
+        return;
+    }
+    cb->lock_owner.store(0, std::memory_order_relaxed);
+    sem_post(m_mutex);
+}
+
+// Whether a message is waiting at read. Caller holds the mutex.
+bool SMQueue::locked_available() const {
+    const auto* cb = get_control_block();
+    return cb->read.load(std::memory_order_relaxed) != cb->head.load(std::memory_order_relaxed);
+}
+
+// Bytes taken by a record with the given payload length
+std::uint64_t SMQueue::record_size(std::size_t length) {
+    return sizeof(RecordHeader) + ((static_cast<std::uint64_t>(length) + 7) & ~std::uint64_t(7));
+}
+
+// Record header at byte position pos
+SMQueue::RecordHeader* SMQueue::record_at(std::uint64_t pos) const {
+    return reinterpret_cast<RecordHeader*>(get_data_buffer() + pos % get_control_block()->ring_bytes);
+}
+
+// Filler needed before a record of size bytes at pos so that the record does not wrap
+std::uint64_t SMQueue::wrap_padding(std::uint64_t pos, std::uint64_t size) const {
+    const std::uint64_t remaining = get_control_block()->ring_bytes - pos % get_control_block()->ring_bytes;
+    return remaining < size ? remaining : 0;
+}
+
+// Skip a padding record at pos, if any. A padding record is always published together with the
+// record that follows it.
+std::uint64_t SMQueue::skip_padding(std::uint64_t pos) const {
+    const RecordHeader* header = record_at(pos);
+    return (header->flags & kRecordPadding) != 0 ? pos + header->length : pos;
+}
+
+// Reserve room for a variable-size record. Locked queues keep the mutex until publish().
+std::byte* SMQueue::record_reserve(std::size_t length) {
+    if (m_mode == QueueMode::Locked and !lock_mutex(producer_wait_counter())) {
+        throw std::runtime_error("Failed to lock mutex");
+    }
+
+    auto* cb = get_control_block();
+    std::byte* dest = m_mode == QueueMode::Locked and cb->sealed.load(std::memory_order_relaxed) == kSealed
+                          ? nullptr
+                          : record_claim(cb->head.load(std::memory_order_relaxed), length);
+    if (dest == nullptr and m_mode == QueueMode::Locked) {
+        unlock_mutex();
+    }
+    return dest;
+}
+
+// Make room for a record of the given length at head. Locked callers hold the mutex.
+std::byte* SMQueue::record_claim(std::uint64_t head, std::size_t length) {
+    auto* cb = get_control_block();
+    const std::uint64_t ring = cb->ring_bytes;
+    const std::uint64_t size = record_size(length);
+    const std::uint64_t padding = wrap_padding(head, size);
+
+    if (m_mode == QueueMode::SPSC) {
+        if (ring - (head - m_cached_tail) < padding + size) {
+            m_cached_tail = cb->tail.load(std::memory_order_acquire);
+            if (ring - (head - m_cached_tail) < padding + size) {
+                return nullptr; // Full: drop the new message
+            }
+        }
+
+        return place_record(head, padding);
+    }
+
+    // Drop the oldest records until the new one fits. Records pinned by a borrow cannot be dropped.
+    while (ring - (head - cb->tail.load(std::memory_order_relaxed)) < padding + size) {
+        if (!may_evict() or cb->tail.load() != cb->read.load()) {
+            return nullptr;
+        }
+
+        const std::uint64_t tail = skip_padding(cb->tail.load(std::memory_order_relaxed));
+        cb->tail.store(tail + record_size(record_at(tail)->length), std::memory_order_relaxed);
+        cb->read.store(cb->tail.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        cb->count--;
+        m_reserve_dropped = true;
+        count_eviction();
+        sem_trywait(m_items);
+    }
+
+    return place_record(head, padding);
+}
+
+// Write the padding record (if any) in front of a reserved record and return its payload. The
+// record header itself is written by publish().
+std::byte* SMQueue::place_record(std::uint64_t pos, std::uint64_t padding) {
+    if (padding != 0) {
+        *record_at(pos) = RecordHeader{static_cast<std::uint32_t>(padding), kRecordPadding};
+        pos += padding;
+    }
+
+    m_reserve_pos = pos;
+    return reinterpret_cast<std::byte*>(record_at(pos) + 1);
+}
+
+// Copy out and consume the next unread message. Caller holds the mutex and an item token (Locked mode).
+void SMQueue::locked_take(std::byte* buffer, std::size_t& length) {
+    std::byte const* src = nullptr;
+    std::size_t index = 0;
+    window_borrow(&src, index, length);
+    detail::copy_bytes(buffer, src, length, m_copy);
+    window_release(index);
+}
+
+// Hand out the next unread message and advance the read cursor (Locked and SPSC modes). The caller
+// has checked that a message is available; Locked callers hold the mutex.
+void SMQueue::window_borrow(std::byte const** data_ptr, std::size_t& index_out, std::size_t& length) {
+    auto* cb = get_control_block();
+    std::uint64_t read = cb->read.load(std::memory_order_relaxed);
+
+    if (m_variable) {
+        read = skip_padding(read);
+        const RecordHeader* header = record_at(read);
+        index_out = read % cb->ring_bytes;
+        length = header->length;
+        *data_ptr = reinterpret_cast<const std::byte*>(header + 1);
+        cb->read.store(read + record_size(length), std::memory_order_relaxed);
+    } else {
+        index_out = read % cb->max_elements;
+        length = cb->element_size;
+        *data_ptr = get_element(index_out);
+        cb->read.store(read + 1, std::memory_order_relaxed);
+        record_residency(index_out, 1);
+    }
+    count_pops(1);
+}
+
+// Release a borrowed message (Locked and SPSC modes). Messages may be released in any order, but they
+// are handed back to producers strictly in order: tail advances over every released message and stops
+// at the oldest one still borrowed. Locked callers hold the mutex. Returns false if index is not borrowed.
+bool SMQueue::window_release(std::size_t index) {
+    auto* cb = get_control_block();
+    std::uint64_t tail = cb->tail.load(std::memory_order_relaxed);
+    const std::uint64_t read = cb->read.load(std::memory_order_relaxed);
+    const std::uint64_t modulus = m_variable ? cb->ring_bytes : cb->max_elements;
+
+    // Map the index back to its position inside the borrowed window [tail, read)
+    const std::uint64_t pos = tail + (index + modulus - tail % modulus) % modulus;
+    if (pos >= read) {
+        return false; // not borrowed
+    }
+
+    if (m_variable) {
+        RecordHeader* header = record_at(pos);
+        if ((header->flags & kRecordReleased) != 0) {
+            return false; // released already
+        }
+        header->flags |= kRecordReleased;
+    } else {
+        SlotHeader* slot = get_slot(pos % modulus);
+        if (slot->released.load(std::memory_order_relaxed) != 0) {
+            return false; // released already
+        }
+        slot->released.store(1, std::memory_order_relaxed);
+    }
+
+    while (tail != read) {
+        if (m_variable) {
+            tail = skip_padding(tail);
+            const RecordHeader* header = record_at(tail);
+            if ((header->flags & kRecordReleased) == 0) {
+                break;
+            }
+            tail += record_size(header->length);
+        } else {
+            SlotHeader* slot = get_slot(tail % modulus);
+            if (slot->released.load(std::memory_order_relaxed) == 0) {
+                break;
+            }
+            slot->released.store(0, std::memory_order_relaxed);
+            tail += 1;
+        }
+
+        if (m_mode == QueueMode::Locked) {
+            cb->count--;
+        }
+    }
+
+    // Hand the slots back to the producer only after we are done reading them
+    cb->tail.store(tail, std::memory_order_release);
+    wake_producers();
+    return true;
+}
+
+// Hand out up to max_n consecutive fixed-size messages between read and end, stopping at the end of
+// the ring (Locked and SPSC modes). Returns the number of messages in the run.
+std::size_t SMQueue::window_borrow_run(std::byte const** data_ptr, std::size_t& index_out, std::size_t max_n,
+                                       std::uint64_t end) {
+    auto* cb = get_control_block();
+    const std::uint64_t read = cb->read.load(std::memory_order_relaxed);
+    const std::uint64_t index = read % cb->max_elements;
+    const auto run = static_cast<std::size_t>(
+        std::min<std::uint64_t>({max_n, end - read, cb->max_elements - index}));
+
+    if (run != 0) {
+        index_out = index;
+        *data_ptr = get_element(index);
+        cb->read.store(read + run, std::memory_order_relaxed);
+        count_pops(run);
+        record_residency(index, run);
+    }
+    return run;
+}
+
+// Copy out and consume up to max_n messages between read and end (Locked and SPSC modes). Message i
+// lands at out + i * element_size. The messages are handed back to producers with a single release.
+std::size_t SMQueue::window_take(std::byte* out, std::size_t max_n, std::size_t* lengths, std::uint64_t end) {
+    auto* cb = get_control_block();
+    const std::size_t element_size = cb->element_size;
+    std::size_t taken = 0;
+    std::size_t first = 0;
+
+    if (m_variable) {
+        for (; taken < max_n and cb->read.load(std::memory_order_relaxed) != end; ++taken) {
+            std::byte const* src = nullptr;
+            std::size_t index = 0;
+            std::size_t length = 0;
+            window_borrow(&src, index, length);
+            detail::copy_bytes(out + taken * element_size, src, length, m_copy);
+            if (lengths != nullptr) {
+                lengths[taken] = length;
+            }
+
+            // Mark all but the first record released so releasing the first frees the whole batch
+            if (taken == 0) {
+                first = static_cast<std::size_t>(index);
+            } else {
+                record_at(index)->flags |= kRecordReleased;
+            }
+        }
+        if (taken != 0) {
+            window_release(first);
+        }
+        return taken;
+    }
+
+    // At most two runs: up to the end of the ring, then from its start
+    while (taken < max_n) {
+        std::byte const* src = nullptr;
+        std::size_t index = 0;
+        const std::size_t run = window_borrow_run(&src, index, max_n - taken, end);
+        if (run == 0) {
+            break;
+        }
+        if (taken == 0) {
+            first = index;
+        }
+        if (cb->slot_stride == element_size) {
+            detail::copy_bytes(out + taken * element_size, src, run * element_size, m_copy);
+        } else {
+            for (std::size_t i = 0; i < run; ++i) {
+                detail::copy_bytes(out + (taken + i) * element_size, src + i * cb->slot_stride, element_size,
+                                   m_copy);
+            }
+        }
+        taken += run;
+    }
+
+    for (std::size_t i = 0; lengths != nullptr and i < taken; ++i) {
+        lengths[i] = element_size;
+    }
+    if (taken != 0) {
+        window_release_batch(first, taken);
+    }
+    return taken;
+}
+
+// Release count consecutive fixed-size slots starting at index (Locked and SPSC modes). Locked callers
+// hold the mutex.
+void SMQueue::window_release_batch(std::size_t index, std::size_t count) {
+    auto* cb = get_control_block();
+
+    // Mark all but the first slot released so releasing the first frees the whole run
+    for (std::size_t i = 1; i < count; ++i) {
+        get_slot((index + i) % cb->max_elements)->released.store(1, std::memory_order_relaxed);
+    }
+    window_release(index);
+}
+
+// Count published and rejected messages, and track the deepest the queue has been
+void SMQueue::count_pushes(std::uint64_t pushed, std::uint64_t dropped) {
+    if (!m_stats) {
+        return;
+    }
+    auto& stats = get_control_block()->producer_stats;
+    if (dropped != 0) {
+        stats.drops.fetch_add(dropped, std::memory_order_relaxed);
+    }
+    if (pushed == 0) {
+        return;
+    }
+
+    const std::uint64_t pushes = stats.pushes.fetch_add(pushed, std::memory_order_relaxed) + pushed;
+    if (m_mode == QueueMode::Broadcast) {
+        return; // Every reader has its own depth
+    }
+
+    // A consumer can count a pop before its producer counts the push, hence the clamp
+    const std::uint64_t gone =
+        stats.evictions.load(std::memory_order_relaxed) +
+        get_control_block()->consumer_stats.pops.load(std::memory_order_relaxed);
+    const std::uint64_t depth = pushes > gone ? pushes - gone : 0;
+    std::uint64_t max_depth = stats.max_depth.load(std::memory_order_relaxed);
+    while (depth > max_depth and !stats.max_depth.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed)) {
+    }
+}
+
+// Count a message discarded to make room for a new one
+void SMQueue::count_eviction() {
+    if (m_stats) {
+        auto& stats = get_control_block()->producer_stats;
+        stats.drops.fetch_add(1, std::memory_order_relaxed);
+        stats.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Count messages popped or borrowed
+void SMQueue::count_pops(std::uint64_t popped) {
+    if (m_stats and popped != 0) {
+        get_control_block()->consumer_stats.pops.fetch_add(popped, std::memory_order_relaxed);
+    }
+}
+
+// Counters for time spent blocked, or nullptr if the queue keeps no stats
+std::atomic<std::uint64_t>* SMQueue::producer_wait_counter() const {
+    return m_stats ? &get_control_block()->producer_stats.wait_ns : nullptr;
+}
+
+std::atomic<std::uint64_t>* SMQueue::consumer_wait_counter() const {
+    return m_stats ? &get_control_block()->consumer_stats.wait_ns : nullptr;
+}
+
+// Read the counters of a control block
+QueueStats SMQueue::snapshot_stats(const ControlBlock* cb) {
+    QueueStats stats;
+    stats.enabled = cb->stats;
+    if (!stats.enabled) {
+        return stats;
+    }
+
+    // Reading pops first makes it unlikely to run ahead of pushes; depth is clamped at zero regardless
+    stats.pops = cb->consumer_stats.pops.load(std::memory_order_relaxed);
+    stats.consumer_wait_ns = cb->consumer_stats.wait_ns.load(std::memory_order_relaxed);
+    stats.drops = cb->producer_stats.drops.load(std::memory_order_relaxed);
+    const std::uint64_t evictions = cb->producer_stats.evictions.load(std::memory_order_relaxed);
+    stats.pushes = cb->producer_stats.pushes.load(std::memory_order_relaxed);
+    stats.max_depth = cb->producer_stats.max_depth.load(std::memory_order_relaxed);
+    stats.producer_wait_ns = cb->producer_stats.wait_ns.load(std::memory_order_relaxed);
+    if (cb->mode != QueueMode::Broadcast and stats.pushes > stats.pops + evictions) {
+        stats.depth = stats.pushes - stats.pops - evictions;
+    }
+    return stats;
+}
+
+// Timestamp slots ahead of publishing them
+void SMQueue::stamp_slots(std::uint64_t pos, std::size_t count) {
+    if (m_histogram == nullptr or count == 0) {
+        return;
+    }
+    const std::uint64_t now = detail::now_ns();
+    const std::uint64_t capacity = get_control_block()->max_elements;
+    for (std::size_t i = 0; i < count; ++i) {
+        get_slot((pos + i) % capacity)->stamp.store(now, std::memory_order_relaxed);
+    }
+}
+
+// Record how long each slot waited since it was published. The caller still owns the slots.
+void SMQueue::record_residency(std::size_t index, std::size_t count) {
+    if (m_histogram == nullptr or count == 0) {
+        return;
+    }
+    const std::uint64_t now = detail::now_ns();
+    const std::uint64_t capacity = get_control_block()->max_elements;
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::uint64_t stamp = get_slot((index + i) % capacity)->stamp.load(std::memory_order_relaxed);
+        detail::record_latency(*m_histogram, now > stamp ? now - stamp : 0);
+    }
+}
+
+// Wake producers waiting for room. The fence orders the preceding release of slots before the waiters
+// check; it pairs with the seq_cst increment of space_waiters in wait_space().
+void SMQueue::wake_producers() {
+    if (!m_block) {
+        return;
+    }
+    auto* cb = get_control_block();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (cb->space_waiters.load(std::memory_order_relaxed) != 0) {
+        cb->space_futex.fetch_add(1, std::memory_order_release);
+        detail::futex_wake_all(&cb->space_futex);
+    }
+}
+
+// Wake parked consumers. The fence orders the preceding publish before the waiters check; it pairs
+// with the seq_cst increment of waiters in pop().
+void SMQueue::wake_consumers() {
+    auto* cb = get_control_block();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (cb->waiters.load(std::memory_order_relaxed) != 0) {
+        cb->items_futex.fetch_add(1, std::memory_order_release);
+        detail::futex_wake_all(&cb->items_futex);
+    }
+}
+
+// SPSC reserve: only the producer writes head, only the consumer writes tail
+std::byte* SMQueue::spsc_reserve() {
+    auto* cb = get_control_block();
+    const std::uint64_t head = cb->head.load(std::memory_order_relaxed);
+
+    if (head - m_cached_tail >= cb->max_elements) {
+        m_cached_tail = cb->tail.load(std::memory_order_acquire);
+        if (head - m_cached_tail >= cb->max_elements) {
+            // Full: the consumer owns the oldest slot, so drop the new message instead
+            return nullptr;
+        }
+    }
+
+    m_reserve_pos = head;
+    return get_element(head % cb->max_elements);
+}
+
+// SPSC non-blocking pop
+bool SMQueue::spsc_try_pop(std::byte* buffer, std::size_t& length) {
+    std::byte const* src = nullptr;
+    std::size_t index = 0;
+    if (!spsc_borrow(&src, index, length)) {
+        return false;
+    }
+
+    detail::copy_bytes(buffer, src, length, m_copy);
+    window_release(index);
+    return true;
+}
+
+// SPSC zero-copy borrow of the next unread message
+bool SMQueue::spsc_borrow(std::byte const** data_ptr, std::size_t& index_out, std::size_t& length) {
+    auto* cb = get_control_block();
+    const std::uint64_t read = cb->read.load(std::memory_order_relaxed);
+
+    // The cached head falls behind read when another handle consumed since this one last looked
+    if (read >= m_cached_head) {
+        m_cached_head = cb->head.load(std::memory_order_acquire);
+        if (read == m_cached_head) {
+            return false; // queue empty
+        }
+    }
+
+    window_borrow(data_ptr, index_out, length);
+    return true;
+}
+
+// MPMC reserve: claim the slot at head with a CAS; publish() releases it through its sequence number
+std::byte* SMQueue::mpmc_reserve() {
+    auto* cb = get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
+
+    std::uint64_t pos = cb->head.load(std::memory_order_relaxed);
+    for (;;) {
+        if ((pos & kHeadSealed) != 0) {
+            return nullptr; // Sealed by grow()
+        }
+
+        SlotHeader* slot = get_slot(pos % capacity);
+        const std::uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::int64_t>(seq - pos);
+
+        if (diff == 0) {
+            // Slot is free for this position; try to claim it
+            if (cb->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Slot still holds the message from one lap ago: the queue is full
+            if (!may_evict()) {
+                return nullptr;
+            }
+
+            // Discard the oldest message, but only if it is readable and nobody has claimed it yet.
+            // A message that is being written, read or borrowed cannot be dropped.
+            std::uint64_t oldest = pos - capacity;
+            if (cb->tail.load(std::memory_order_relaxed) != oldest or seq != oldest + 1) {
+                return nullptr;
+            }
+            if (cb->tail.compare_exchange_strong(oldest, oldest + 1, std::memory_order_relaxed)) {
+                slot->seq.store(oldest + capacity, std::memory_order_release);
+                m_reserve_dropped = true;
+                count_eviction();
+            }
+            pos = cb->head.load(std::memory_order_relaxed);
+        } else {
+            // Another producer claimed this position; retry with the new head
+            pos = cb->head.load(std::memory_order_relaxed);
+        }
+    }
+
+    m_reserve_pos = pos;
+    return get_element(pos % capacity);
+}
+
+// MPMC non-blocking pop
+bool SMQueue::mpmc_try_pop(std::byte* buffer) {
+    std::byte const* src = nullptr;
+    std::size_t index = 0;
+    std::uint64_t pos = 0;
+    if (!mpmc_borrow(&src, index, pos)) {
+        return false;
+    }
+
+    detail::copy_bytes(buffer, src, get_control_block()->element_size, m_copy);
+    mpmc_release(pos);
+    return true;
+}
+
+// MPMC borrow: claim the slot at tail with a CAS. The slot stays reserved until commit_pop().
+bool SMQueue::mpmc_borrow(std::byte const** data_ptr, std::size_t& index_out, std::uint64_t& pos_out) {
+    auto* cb = get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
+
+    std::uint64_t pos = cb->tail.load(std::memory_order_relaxed);
+    for (;;) {
+        SlotHeader* slot = get_slot(pos % capacity);
+        const std::uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::int64_t>(seq - (pos + 1));
+
+        if (diff == 0) {
+            if (cb->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // queue empty (or the next message is still being written)
+        } else {
+            pos = cb->tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    pos_out = pos;
+    index_out = pos % capacity;
+    *data_ptr = get_element(index_out);
+    count_pops(1);
+    record_residency(index_out, 1);
+    return true;
+}
+
+// MPMC commit_pop: release the slot if this handle borrowed it. Slots may be released in any order.
+// Returns false for an index this handle does not hold, which would otherwise move the slot a lap ahead.
+bool SMQueue::mpmc_commit_pop(std::size_t index) {
+    const std::uint64_t capacity = get_control_block()->max_elements;
+
+    // Releases mostly come oldest first, so the search usually stops at the front
+    const auto it = std::find_if(m_mpmc_borrows.begin(), m_mpmc_borrows.end(),
+                                 [&](std::uint64_t pos) { return pos % capacity == index; });
+    if (it == m_mpmc_borrows.end()) {
+        return false;
+    }
+    const std::uint64_t pos = *it;
+    m_mpmc_borrows.erase(it);
+    mpmc_release(pos);
+    return true;
+}
+
+// MPMC release: hand the slot at pos, which holds pos + 1 while borrowed, to the producer one lap later
+void SMQueue::mpmc_release(std::uint64_t pos) {
+    get_slot(pos % get_control_block()->max_elements)
+        ->seq.store(pos + get_control_block()->max_elements, std::memory_order_release);
+    wake_producers();
+}
+
+// Claim up to max_n consecutive slots at cursor (head for producers, tail for consumers) with a single
+// CAS. The slot at pos is ready when its sequence number is pos + offset: 0 for producers, 1 for
+// consumers. contiguous stops the run at the end of the ring. Returns the number of slots claimed.
+std::size_t SMQueue::mpmc_claim(std::atomic<std::uint64_t>& cursor, std::uint64_t offset, std::size_t max_n,
+                                bool contiguous, std::uint64_t& pos_out) {
+    const std::uint64_t capacity = get_control_block()->max_elements;
+
+    std::uint64_t pos = cursor.load(std::memory_order_relaxed);
+    for (;;) {
+        std::size_t limit = max_n;
+        if (contiguous) {
+            limit = static_cast<std::size_t>(std::min<std::uint64_t>(limit, capacity - pos % capacity));
+        }
+
+        std::size_t ready = 0;
+        while (ready < limit and get_slot((pos + ready) % capacity)->seq.load(std::memory_order_acquire) ==
+                                     pos + ready + offset) {
+            ready++;
+        }
+
+        if (ready == 0) {
+            const std::uint64_t seq = get_slot(pos % capacity)->seq.load(std::memory_order_acquire);
+            if (static_cast<std::int64_t>(seq - (pos + offset)) < 0) {
+                return 0; // full (producers) or empty (consumers)
+            }
+            // Another thread claimed this position; retry with the new cursor
+            pos = cursor.load(std::memory_order_relaxed);
+            continue;
+        }
+
+        if (cursor.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed)) {
+            pos_out = pos;
+            return ready;
+        }
+    }
+}
+
+// MPMC batch push: claim runs of free slots and fall back to mpmc_reserve() once the ring is full so
+// the overflow policy applies
+std::size_t SMQueue::mpmc_push_batch(const std::byte* const* msgs, std::size_t n) {
+    auto* cb = get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
+    std::size_t pushed = 0;
+
+    while (pushed < n) {
+        std::uint64_t pos;
+        std::size_t claimed = mpmc_claim(cb->head, 0, n - pushed, false, pos);
+        if (claimed == 0) {
+            if (mpmc_reserve() == nullptr) {
+                break;
+            }
+            pos = m_reserve_pos;
+            claimed = 1;
+        }
+
+        stamp_slots(pos, claimed);
+        for (std::size_t i = 0; i < claimed; ++i) {
+            detail::copy_bytes(get_element((pos + i) % capacity), msgs[pushed + i], cb->element_size, m_copy);
+            get_slot((pos + i) % capacity)->seq.store(pos + i + 1, std::memory_order_release);
+        }
+        pushed += claimed;
+    }
 
-// Destroy a shared memory queue
-void SMQueue::destroy(const std::string& name) {
-    // Validate name - no spaces allowed for semaphore compatibility
-    if (name.find(' ') != std::string::npos) {
-        throw std::runtime_error("Queue name cannot contain spaces: " + name);
+    if (pushed != 0) {
+        wake_consumers();
     }
+    return pushed;
+}
 
-    // Try to open the shared memory to check if it exists
-    int fd = shm_open(name.c_str(), O_RDWR, 0660);
-    if (fd < 0) {
-        // If it doesn't exist, just return
-        if (errno == ENOENT) {
-            return;
+// MPMC batch pop: claim a run of readable slots with one CAS on tail
+std::size_t SMQueue::mpmc_pop_batch(std::byte* out, std::size_t max_n, std::size_t* lengths) {
+    auto* cb = get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
+    const std::size_t element_size = cb->element_size;
+
+    std::uint64_t pos = 0;
+    const std::size_t claimed = mpmc_claim(cb->tail, 1, max_n, false, pos);
+    count_pops(claimed);
+    record_residency(pos % capacity, claimed);
+    for (std::size_t i = 0; i < claimed; ++i) {
+        detail::copy_bytes(out + i * element_size, get_element((pos + i) % capacity), element_size, m_copy);
+        get_slot((pos + i) % capacity)->seq.store(pos + i + capacity, std::memory_order_release);
+        if (lengths != nullptr) {
+            lengths[i] = element_size;
         }
-        throw std::runtime_error("Failed to open shared memory for destruction: " + name);
     }
-
-    // Get size to check if it's a valid queue
-    struct stat st;
-    if (fstat(fd, &st) != 0) {
-        detail::safe_close(fd);
-        throw std::runtime_error("Failed to get shared memory size for destruction: " + name);
+    if (claimed != 0) {
+        wake_producers();
     }
+    return claimed;
+}
 
-    // Close the file descriptor
-    detail::safe_close(fd);
+// Broadcast claim: open the seqlock of the slot at pos so readers still copying the message it holds
+// notice they were lapped. publish() closes it again.
+std::byte* SMQueue::broadcast_claim(std::uint64_t pos) {
+    const std::size_t index = pos % get_control_block()->max_elements;
+    get_slot(index)->seq.store(kSlotWriting, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
 
-    // Unlink shared memory
-    shm_unlink(name.c_str());
+    m_reserve_pos = pos;
+    return get_element(index);
+}
 
-    // Remove leading slash if present for semaphore names
-    std::string sem_base_name = name;
-    if (!sem_base_name.empty() && sem_base_name[0] == '/') {
-        sem_base_name = sem_base_name.substr(1);
+// Broadcast non-blocking pop: copy the next message for this reader and validate it was not
+// overwritten meanwhile. Messages the writer has lapped are skipped and counted as overruns.
+bool SMQueue::broadcast_try_pop(std::byte* buffer) {
+    if (m_reader == nullptr) {
+        throw std::runtime_error("The Broadcast writer cannot pop; open() the queue to read it");
     }
 
-    // Ensure base name is not too long (leave room for suffix)
-    if (sem_base_name.length() > 24) {
-        sem_base_name = sem_base_name.substr(0, 24);
-    }
+    auto* cb = get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
 
-    // Unlink semaphores
-    std::string mutex_name = make_sem_name(sem_base_name, "_mutex");
-    std::string items_name = make_sem_name(sem_base_name, "_items");
-    sem_unlink(mutex_name.c_str());
-    sem_unlink(items_name.c_str());
-}
+    std::uint64_t pos = m_reader->cursor.load(std::memory_order_relaxed);
+    for (;;) {
+        const std::uint64_t head = cb->head.load(std::memory_order_acquire);
+        if (pos == head) {
+            return false; // caught up
+        }
+        if (head - pos > capacity) {
+            // Lapped: everything before head - capacity has been overwritten
+            m_reader->overruns.fetch_add(head - capacity - pos, std::memory_order_relaxed);
+            pos = head - capacity;
+        }
 
-// Move constructor
-SMQueue::SMQueue(SMQueue&& other) noexcept
-    : m_name(std::move(other.m_name)), m_addr(other.m_addr), m_size(other.m_size), m_mutex(other.m_mutex),
-      m_items(other.m_items) {
-    other.m_addr = nullptr;
-    other.m_size = 0;
-    other.m_mutex = nullptr;
-    other.m_items = nullptr;
-}
+        SlotHeader* slot = get_slot(pos % capacity);
+        if (slot->seq.load(std::memory_order_acquire) == pos + 1) {
+            detail::copy_bytes(buffer, get_element(pos % capacity), cb->element_size, m_copy);
+            const std::uint64_t stamp = slot->stamp.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->seq.load(std::memory_order_relaxed) == pos + 1) {
+                m_reader->cursor.store(pos + 1, std::memory_order_relaxed);
+                count_pops(1);
+                if (m_histogram != nullptr) {
+                    const std::uint64_t now = detail::now_ns();
+                    detail::record_latency(*m_histogram, now > stamp ? now - stamp : 0);
+                }
+                return true;
+            }
+        }
 
-// Move assignment
-SMQueue& SMQueue::operator=(SMQueue&& other) noexcept {
-    if (this != &other) {
-        close();
-        m_name = std::move(other.m_name);
-        m_addr = other.m_addr;
-        m_size = other.m_size;
-        m_mutex = other.m_mutex;
-        m_items = other.m_items;
-        other.m_addr = nullptr;
-        other.m_size = 0;
-        other.m_mutex = nullptr;
-        other.m_items = nullptr;
+        // pos < head, so the slot was published for pos; a different sequence number means the writer
+        // has started overwriting it
+        m_reader->overruns.fetch_add(1, std::memory_order_relaxed);
+        pos++;
     }
-    return *this;
 }
 
-// Destructor
-SMQueue::~SMQueue() noexcept { close(); }
+// Claim a free reader entry for this handle. New readers start at the newest message, or at the oldest one
+// the ring still holds.
+void SMQueue::register_reader(bool oldest) {
+    auto* cb = get_control_block();
 
-// Push a message to the queue
-// If the queue is full, the oldest message will be dropped to make room
-bool SMQueue::push(const std::byte* data) {
-    if (m_addr == nullptr) {
-        throw std::runtime_error("SMQueue not initialized");
+    for (std::size_t i = 0; i < cb->max_readers; ++i) {
+        ReaderSlot* reader = get_reader(i);
+        std::uint32_t expected = 0;
+        if (reader->active.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+            reader->pid.store(static_cast<std::int32_t>(getpid()), std::memory_order_relaxed);
+            reader->overruns.store(0, std::memory_order_relaxed);
+            const std::uint64_t head = cb->head.load(std::memory_order_acquire);
+            const std::uint64_t first = head > cb->max_elements ? head - cb->max_elements : 0;
+            reader->cursor.store(oldest ? first : head, std::memory_order_relaxed);
+            m_reader = reader;
+            return;
+        }
     }
 
-    auto* cb = get_control_block();
+    throw std::runtime_error("No free reader slot in broadcast queue: " + m_name);
+}
 
-    // Lock mutex
-    int result;
-    do {
-        result = sem_wait(m_mutex);
-    } while (result == -1 and errno == EINTR);
+// Claim a free participant entry for this handle, reclaiming entries of dead processes if the table is full
+void SMQueue::register_participant() {
+    auto* cb = get_control_block();
 
-    if (result == -1) {
-        throw std::runtime_error("Failed to lock mutex");
+    for (int pass = 0; pass < 2; ++pass) {
+        for (std::size_t i = 0; i < cb->max_participants; ++i) {
+            ParticipantSlot* slot = get_participant(i);
+            std::int32_t expected = 0;
+            if (slot->pid.compare_exchange_strong(expected, m_pid, std::memory_order_acq_rel)) {
+                slot->roles.store(0, std::memory_order_relaxed);
+                slot->cpu.store(-1, std::memory_order_relaxed);
+                m_participant = slot;
+                m_roles = 0;
+                heartbeat();
+                return;
+            }
+        }
+        reap_participants();
     }
 
-    // Check if queue is full
-    bool dropped_message = false;
-    if (cb->count >= cb->max_elements) {
-        // Drop the oldest message by advancing the tail
-        cb->tail = (cb->tail + 1) % cb->max_elements;
-        cb->count--;
-        dropped_message = true;
+    throw std::runtime_error("No free participant slot in queue: " + m_name);
+}
 
-        // Decrement the semaphore count since we're removing a message
-        sem_trywait(m_items);
-    }
+// Free the participant and Broadcast reader entries of processes that no longer exist
+void SMQueue::reap_participants() {
+    auto* cb = get_control_block();
 
-    // Get pointer to the element at head position
-    std::byte* dest = get_element(cb->head);
+    for (std::size_t i = 0; i < cb->max_participants; ++i) {
+        ParticipantSlot* slot = get_participant(i);
+        std::int32_t pid = slot->pid.load(std::memory_order_acquire);
+        if (pid != 0 and !detail::process_alive(pid)) {
+            slot->pid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+        }
+    }
 
-    std::memcpy(dest, data, cb->element_size);
+    // A reader entry whose pid is still 0 is being registered
+    for (std::size_t i = 0; i < cb->max_readers; ++i) {
+        ReaderSlot* reader = get_reader(i);
+        const std::int32_t pid = reader->pid.load(std::memory_order_relaxed);
+        if (reader->active.load(std::memory_order_acquire) != 0 and pid != 0 and !detail::process_alive(pid)) {
+            reader->pid.store(0, std::memory_order_relaxed);
+            reader->active.store(0, std::memory_order_release);
+        }
+    }
+}
 
-    // Advance the head
-    cb->head = (cb->head + 1) % cb->max_elements;
-    cb->count++;
+// Get the participant table entry at index
+SMQueue::ParticipantSlot* SMQueue::get_participant(std::size_t index) const {
+    return reinterpret_cast<ParticipantSlot*>(static_cast<char*>(m_addr) + get_control_block()->participants_offset) +
+           index;
+}
 
-    // Signal that a new item is available
-    sem_post(m_items);
+// Record that this handle acts as producer or consumer, the first time it does
+void SMQueue::mark_role(std::uint32_t role) {
+    if ((m_roles & role) == 0 and m_participant != nullptr) {
+        m_roles |= role;
+        m_participant->roles.fetch_or(role, std::memory_order_relaxed);
 
-    // Unlock the mutex
-    sem_post(m_mutex);
+        const std::uint32_t interval = get_control_block()->options.flush_interval_ms;
+        if ((role & kRoleProducer) != 0 and interval != 0 and !m_flusher) {
+            m_flusher = std::make_unique<detail::Flusher>(m_addr, m_size, std::chrono::milliseconds(interval));
+        }
+    }
+}
 
-    // Return true if no messages were dropped, false if one was dropped
-    return !dropped_message;
+// Whether a live handle, this one included, has ever popped or borrowed
+bool SMQueue::consumer_alive() const {
+    auto* cb = get_control_block();
+    for (std::size_t i = 0; i < cb->max_participants; ++i) {
+        const ParticipantSlot* slot = get_participant(i);
+        const std::int32_t pid = slot->pid.load(std::memory_order_acquire);
+        if (pid != 0 and (slot->roles.load(std::memory_order_relaxed) & kRoleConsumer) != 0 and
+            detail::process_alive(pid)) {
+            return true;
+        }
+    }
+    return false;
 }
 
-// Pop a message from the queue (blocking)
-bool SMQueue::pop(std::byte* buffer) {
-    if (m_addr == nullptr) {
-        return false;
+// Whether any live handle other than this one has the queue open
+bool SMQueue::others_alive() const {
+    auto* cb = get_control_block();
+    for (std::size_t i = 0; i < cb->max_participants; ++i) {
+        const ParticipantSlot* slot = get_participant(i);
+        const std::int32_t pid = slot->pid.load(std::memory_order_acquire);
+        if (slot != m_participant and pid != 0 and detail::process_alive(pid)) {
+            return true;
+        }
     }
+    return false;
+}
 
+// Repair the queue after a crash (OpenOptions::recover)
+void SMQueue::recover() {
     auto* cb = get_control_block();
+    reap_participants();
 
-    // Wait for an item to be available
-    int result;
-    do {
-        result = sem_wait(m_items);
-    } while (result == -1 and errno == EINTR);
+    const bool alone = !others_alive();
+    if (alone) {
+        // Consumers that died parked in pop(), or producers waiting for room, never decremented waiters
+        cb->waiters.store(0, std::memory_order_relaxed);
+        cb->space_waiters.store(0, std::memory_order_relaxed);
 
-    if (result == -1) {
-        return false;
+        // A grow() that died before sealing the ring
+        std::uint32_t growing = kGrowing;
+        cb->sealed.compare_exchange_strong(growing, 0, std::memory_order_relaxed);
     }
 
-    // Lock mutex
-    do {
-        result = sem_wait(m_mutex);
-    } while (result == -1 and errno == EINTR);
+    if (m_mode == QueueMode::Locked) {
+        // A mutex semaphore held by a dead process is never posted again: take it over. A robust mutex
+        // reports a dead owner to lock_mutex(), which repairs the queue on its own.
+        std::int32_t owner = cb->lock_owner.load(std::memory_order_relaxed);
+        const bool inherited = !m_robust and owner != 0 and !detail::process_alive(owner) and
+                               cb->lock_owner.compare_exchange_strong(owner, m_pid, std::memory_order_relaxed);
+        if (!inherited and !lock_mutex()) {
+            throw std::runtime_error("Failed to lock mutex");
+        }
+        repair_locked();
+        unlock_mutex();
+    } else if (m_mode == QueueMode::SPSC) {
+        // Only the consumer moves read and tail, so nobody else is touching them
+        if (!consumer_alive()) {
+            rewind_window();
+        }
+    } else if (m_mode == QueueMode::MPMC) {
+        if (alone) {
+            compact_ring();
+        }
+    }
+}
 
-    if (result == -1) {
-        sem_post(m_items);
-        return false;
+// Bring a file-backed queue back after the host rebooted. Every process that used it is gone, and so are
+// its named semaphores and whatever its in-segment ones and mutex held, so the runtime state is rebuilt
+// as for a queue nobody uses. Messages borrowed but never released are delivered again.
+void SMQueue::restart() {
+    auto* cb = get_control_block();
+
+    // Concurrent openers wait here, and find the queue already restarted
+    const int lock = detail::lock_file(m_name);
+    try {
+        if (cb->boot_id.load(std::memory_order_acquire) != detail::boot_id()) {
+            for (std::size_t i = 0; i < cb->max_participants; ++i) {
+                get_participant(i)->pid.store(0, std::memory_order_relaxed);
+                get_participant(i)->roles.store(0, std::memory_order_relaxed);
+            }
+            for (std::size_t i = 0; i < cb->max_readers; ++i) {
+                get_reader(i)->pid.store(0, std::memory_order_relaxed);
+                get_reader(i)->active.store(0, std::memory_order_relaxed);
+            }
+            cb->waiters.store(0, std::memory_order_relaxed);
+            cb->space_waiters.store(0, std::memory_order_relaxed);
+            cb->lock_owner.store(0, std::memory_order_relaxed);
+            std::uint32_t growing = kGrowing;
+            cb->sealed.compare_exchange_strong(growing, 0, std::memory_order_relaxed);
+
+            if (m_mode == QueueMode::Locked) {
+#ifdef __linux__
+                if (m_robust) {
+                    detail::init_robust_mutex(&cb->mutex);
+                }
+#endif
+                init_semaphores(cb);
+                repair_locked();
+            } else if (m_mode == QueueMode::SPSC) {
+                rewind_window();
+            } else if (m_mode == QueueMode::MPMC) {
+                compact_ring();
+            }
+            cb->boot_id.store(detail::boot_id(), std::memory_order_release);
+        }
+    } catch (const std::exception&) {
+        detail::safe_close(lock);
+        throw;
     }
+    detail::safe_close(lock);
+}
 
-    // Get pointer to the element at tail position
-    const std::byte* src = get_element(cb->tail);
+// Bring a Locked queue back in line after its mutex owner died, or on a recovering open. Caller holds the
+// mutex. Every update of a Locked queue keeps the cursors consistent, so besides the messages borrowed by
+// dead consumers only the message count and the item tokens can be off.
+void SMQueue::repair_locked() {
+    auto* cb = get_control_block();
 
-    std::memcpy(buffer, src, cb->element_size);
+    // An eviction interrupted between moving tail and read
+    if (cb->read.load(std::memory_order_relaxed) < cb->tail.load(std::memory_order_relaxed)) {
+        cb->read.store(cb->tail.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
 
-    // Advance the tail
-    cb->tail = (cb->tail + 1) % cb->max_elements;
-    cb->count--;
+    // Every borrow belongs to a dead consumer once none is alive
+    if (!consumer_alive()) {
+        rewind_window();
+    }
 
-    // Unlock the mutex
-    sem_post(m_mutex);
+    const std::uint64_t head = cb->head.load(std::memory_order_relaxed);
+    cb->count = messages_between(cb->tail.load(std::memory_order_relaxed), head);
+    const std::uint64_t unread = messages_between(cb->read.load(std::memory_order_relaxed), head);
 
-    return true;
+    // Consumers already holding a token each take a message once they get the mutex, so tokens are only
+    // topped up; a surplus is harmless since consumers check for a message. With no other handle open the
+    // count can be made exact.
+    if (!others_alive()) {
+        while (sem_trywait(m_items) == 0) {
+        }
+    }
+    int tokens = 0;
+    sem_getvalue(m_items, &tokens);
+    for (std::uint64_t i = tokens > 0 ? static_cast<std::uint64_t>(tokens) : 0; i < unread; ++i) {
+        sem_post(m_items);
+    }
 }
 
-// Try to pop a message (non-blocking)
-bool SMQueue::try_pop(std::byte* buffer) {
-    if (m_addr == nullptr) {
-        return false;
+// Hand the borrowed window [tail, read) out again (Locked and SPSC modes), clearing the marks of messages
+// released ahead of older borrows. Their consumers are gone, so those are delivered a second time.
+void SMQueue::rewind_window() {
+    auto* cb = get_control_block();
+    const std::uint64_t read = cb->read.load(std::memory_order_relaxed);
+    std::uint64_t pos = cb->tail.load(std::memory_order_relaxed);
+
+    while (pos < read) {
+        if (m_variable) {
+            pos = skip_padding(pos);
+            RecordHeader* header = record_at(pos);
+            header->flags &= ~kRecordReleased;
+            pos += record_size(header->length);
+        } else {
+            get_slot(pos % cb->max_elements)->released.store(0, std::memory_order_relaxed);
+            pos++;
+        }
     }
 
+    cb->read.store(cb->tail.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+// Rebuild an MPMC ring that no other handle uses. Dead producers leave claimed slots that were never
+// published, which would stop consumers for good, and dead consumers leave slots they never released,
+// which would stop producers. Every published message that was not consumed, borrowed ones included,
+// is moved up against head in order and every other slot is freed.
+void SMQueue::compact_ring() {
     auto* cb = get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
+    const std::size_t element_size = cb->element_size;
+    const std::uint64_t head = cb->head.load(std::memory_order_relaxed) & ~kHeadSealed;
+    const std::uint64_t first = head > capacity ? head - capacity : 0;
+
+    std::vector<std::byte> kept;
+    std::vector<std::uint64_t> stamps;
+    for (std::uint64_t pos = first; pos < head; ++pos) {
+        const SlotHeader* slot = get_slot(pos % capacity);
+        if (slot->seq.load(std::memory_order_acquire) == pos + 1) {
+            const std::byte* element = get_element(pos % capacity);
+            kept.insert(kept.end(), element, element + element_size);
+            stamps.push_back(slot->stamp.load(std::memory_order_relaxed));
+        }
+    }
 
-    // Try to get an item (non-blocking)
-    if (sem_trywait(m_items) != 0) {
-        return false;
+    // The kept messages take positions [tail, head) and the slots of [head, tail + capacity) are free
+    const std::uint64_t tail = head - stamps.size();
+    for (std::size_t i = 0; i < stamps.size(); ++i) {
+        const std::uint64_t pos = tail + i;
+        std::memcpy(get_element(pos % capacity), kept.data() + i * element_size, element_size);
+        get_slot(pos % capacity)->stamp.store(stamps[i], std::memory_order_relaxed);
+        get_slot(pos % capacity)->seq.store(pos + 1, std::memory_order_relaxed);
     }
+    for (std::uint64_t pos = head; pos < tail + capacity; ++pos) {
+        get_slot(pos % capacity)->seq.store(pos, std::memory_order_relaxed);
+    }
+    cb->tail.store(tail, std::memory_order_release);
+}
 
-    // Lock mutex
-    int result;
-    do {
-        result = sem_wait(m_mutex);
-    } while (result == -1 and errno == EINTR);
+// Number of messages between two positions (Locked and SPSC modes)
+std::uint64_t SMQueue::messages_between(std::uint64_t from, std::uint64_t to) const {
+    if (!m_variable) {
+        return to - from;
+    }
+    std::uint64_t count = 0;
+    while (from < to) {
+        from = skip_padding(from);
+        from += record_size(record_at(from)->length);
+        count++;
+    }
+    return count;
+}
 
-    if (result == -1) {
-        sem_post(m_items);
-        return false;
+// NUMA node holding most pages of the data buffer. Before any page is touched, the node the queue was
+// bound to at creation.
+int SMQueue::memory_node() const {
+    NumaResidency residency;
+    try {
+        residency = numa_residency();
+    } catch (const std::runtime_error&) {
+        return -1; // Placement is best effort; not knowing the node only widens the choice
     }
 
-    // Get pointer to the element at tail position
-    const std::byte* src = get_element(cb->tail);
+    int node = -1;
+    std::size_t most = 0;
+    for (std::size_t i = 0; i < residency.pages_per_node.size(); ++i) {
+        if (residency.pages_per_node[i] > most) {
+            node = static_cast<int>(i);
+            most = residency.pages_per_node[i];
+        }
+    }
 
-    // MacOS memcpy works really well, so we use it
-    std::memcpy(buffer, src, cb->element_size);
+    const QueueOptions& options = get_control_block()->options;
+    if (node < 0 and options.numa_nodes != 0 and
+        (options.numa_policy == NumaPolicy::Bind or options.numa_policy == NumaPolicy::Preferred)) {
+        for (node = 0; (options.numa_nodes >> node & 1) == 0; ++node) {
+        }
+    }
+    return node;
+}
 
-    // Advance the tail
-    cb->tail = (cb->tail + 1) % cb->max_elements;
-    cb->count--;
+// CPU for this handle's thread: on the queue's memory node, near the CPUs of the other pinned handles
+int SMQueue::choose_cpu() const {
+    std::vector<int> candidates = detail::allowed_cpus();
+    const int node = memory_node();
+    if (node >= 0) {
+        const std::vector<int> local = detail::node_cpus(node);
+        std::vector<int> both;
+        for (const int cpu : candidates) {
+            if (std::find(local.begin(), local.end(), cpu) != local.end()) {
+                both.push_back(cpu);
+            }
+        }
+        // The thread may not be allowed on the node at all; stay within what it is allowed
+        if (!both.empty()) {
+            candidates = both;
+        }
+    }
 
-    // Unlock the mutex
-    sem_post(m_mutex);
-    return true;
+    std::vector<int> peers;
+    for (std::size_t i = 0; i < get_control_block()->max_participants; ++i) {
+        const ParticipantSlot* slot = get_participant(i);
+        const std::int32_t pid = slot->pid.load(std::memory_order_acquire);
+        const std::int32_t cpu = slot->cpu.load(std::memory_order_relaxed);
+        if (slot != m_participant and pid != 0 and cpu >= 0 and detail::process_alive(pid)) {
+            peers.push_back(cpu);
+        }
+    }
+    return detail::choose_cpu(candidates, peers);
 }
 
-// Zero-copy borrow (non-blocking). Returns true if a message was borrowed.
-bool SMQueue::borrow(std::byte const** data_ptr, std::size_t& index_out) {
+// Move the queue to a larger ring and seal the current one
+void SMQueue::grow(std::size_t max_elements, std::size_t element_size) {
     if (m_addr == nullptr) {
-        return false;
+        throw std::runtime_error("SMQueue not initialized");
     }
-
-    // Attempt to grab an item – same as try_pop but without copying.
-    if (sem_trywait(m_items) != 0) {
-        return false; // queue empty
+    if (m_reserved) {
+        throw std::runtime_error("A reservation is already pending on this handle");
+    }
+    if (m_reader != nullptr) {
+        throw std::runtime_error("Broadcast readers cannot grow the queue");
     }
 
-    // Lock the mutex to read metadata safely
-    int result;
-    do {
-        result = sem_wait(m_mutex);
-    } while (result == -1 && errno == EINTR);
-
-    if (result == -1) {
-        // Failed to lock – restore semaphore so we don't lose the item
-        sem_post(m_items);
-        return false;
+    // Grow the newest generation
+    while (get_control_block()->sealed.load(std::memory_order_acquire) == kSealed) {
+        follow_successor();
     }
 
     auto* cb = get_control_block();
+    if (max_elements < cb->max_elements or element_size < cb->element_size) {
+        throw std::runtime_error("Queues can only grow: the new ring needs room for every queued message");
+    }
+    std::uint32_t state = 0;
+    if (!cb->sealed.compare_exchange_strong(state, kGrowing, std::memory_order_acq_rel)) {
+        throw std::runtime_error("Another handle is already growing queue: " + m_name);
+    }
 
-    index_out = cb->tail;
-    const std::byte* src = get_element(cb->tail);
-
-#ifdef __GNUC__
-    // Prefetch first cache line to hide latency
-    __builtin_prefetch(src, 0, 3);
-#endif
-
-    *data_ptr = src;
+    const std::uint32_t generation = m_generation + 1;
+    const std::string next_name = generation_name(m_name, generation);
+    SMQueue next = [&] {
+        try {
+            // A grow() that died before sealing may have left the segment behind
+            destroy(next_name);
+            return create(next_name, max_elements, element_size, cb->options);
+        } catch (const std::exception&) {
+            cb->sealed.store(0, std::memory_order_release);
+            throw;
+        }
+    }();
+    // Nobody opens the new segment before the seal below links it
+    next.get_control_block()->generation = generation;
+    next.m_generation = generation;
+    next.m_name = m_name;
+
+    // Seal the old ring. Locked producers check the seal under the mutex and MPMC producers through head;
+    // the other modes have a single producer, this handle.
+    if (m_mode == QueueMode::Locked) {
+        if (!lock_mutex()) {
+            next.close();
+            destroy(next_name);
+            cb->sealed.store(0, std::memory_order_release);
+            throw std::runtime_error("Failed to lock mutex");
+        }
+        cb->sealed.store(kSealed, std::memory_order_release);
+        unlock_mutex();
 
-    // NOTE: We purposely *do not* advance tail/count here. The slot will be released later via
-    // commit_pop(). This keeps the message reserved so that producers cannot overwrite it while it
-    // is still in use by the consumer.
+        // Wake consumers blocked on the item semaphore; they find no message behind the extra tokens
+        for (std::size_t i = 0; i < cb->max_participants; ++i) {
+            sem_post(m_items);
+        }
+    } else {
+        cb->sealed.store(kSealed, std::memory_order_release);
+        if (m_mode == QueueMode::MPMC) {
+            cb->head.fetch_or(kHeadSealed, std::memory_order_acq_rel);
+        }
+    }
+    wake_consumers();
+    wake_producers();
 
-    // Unlock mutex so producers/other consumers can proceed.
-    sem_post(m_mutex);
-    return true;
+    adopt(std::move(next));
 }
 
-// Release a previously borrowed slot and make it reusable.
-void SMQueue::commit_pop(std::size_t index) {
-    if (m_addr == nullptr) {
-        return;
-    }
+// Generation of the ring this handle uses
+std::uint32_t SMQueue::generation() const { return m_generation; }
 
-    auto* cb = get_control_block();
+// Name of the segment holding a generation of a queue
+std::string SMQueue::generation_name(const std::string& name, std::uint32_t generation) {
+    return generation == 0 ? name : name + ".gen" + std::to_string(generation);
+}
 
-    // Lock mutex
-    int result;
-    do {
-        result = sem_wait(m_mutex);
-    } while (result == -1 && errno == EINTR);
+// Map one segment read-only and check that it holds an initialized queue
+const SMQueue::ControlBlock* SMQueue::map_control_block(const std::string& segment_name, std::size_t& size) {
+    detail::SegmentOptions segment;
+    segment.read_only = true;
+    void* addr = detail::open_segment(segment_name, size, segment);
 
-    if (result == -1) {
-        return; // failed to lock, leak the slot – worst-case scenario is transient memory pressure
+    const auto* cb = static_cast<const ControlBlock*>(addr);
+    if (size < sizeof(ControlBlock) or cb->magic.load(std::memory_order_acquire) != kMagic) {
+        munmap(addr, size);
+        throw std::runtime_error("Shared memory is not an initialized queue: " + segment_name);
     }
+    return cb;
+}
 
-    // Sanity-check index belongs to current tail
-    if (index == cb->tail) {
-        cb->tail = (cb->tail + 1) % cb->max_elements;
-        cb->count--; // item fully consumed
+// Map the newest generation of a queue read-only
+const SMQueue::ControlBlock* SMQueue::map_newest(const std::string& name, std::size_t& size) {
+    const ControlBlock* cb = map_control_block(name, size);
+    while (cb->sealed.load(std::memory_order_acquire) == kSealed) {
+        std::size_t next_size = 0;
+        const ControlBlock* next;
+        try {
+            next = map_control_block(generation_name(name, cb->generation + 1), next_size);
+        } catch (const std::runtime_error&) {
+            munmap(const_cast<ControlBlock*>(cb), size);
+            throw;
+        }
+        munmap(const_cast<ControlBlock*>(cb), size);
+        cb = next;
+        size = next_size;
     }
+    return cb;
+}
 
-    // Unlock mutex
-    sem_post(m_mutex);
+// Move this handle to the generation that replaced its sealed one
+void SMQueue::follow_successor() {
+    const auto* cb = get_control_block();
+    OpenOptions options;
+    options.populate = cb->options.populate;
+    options.lock_memory = cb->options.lock_memory;
+    SMQueue next = open(generation_name(m_name, m_generation + 1), options);
+
+    if (next.m_reader != nullptr) {
+        if (m_reader == nullptr) {
+            // The Broadcast writer is no reader
+            next.m_reader->pid.store(0, std::memory_order_relaxed);
+            next.m_reader->active.store(0, std::memory_order_release);
+            next.m_reader = nullptr;
+        } else {
+            // This reader has seen every message of the old ring, so it starts at the oldest of the new one
+            next.m_reader->cursor.store(0, std::memory_order_relaxed);
+        }
+    }
+    next.m_name = m_name;
+    adopt(std::move(next));
 }
 
-// Close the queue
-void SMQueue::close() {
-    if (m_mutex != nullptr) {
-        sem_close(m_mutex);
-        m_mutex = nullptr;
+// Replace this handle's mapping with next, a handle on the following generation, keeping the settings and
+// roles of this handle
+void SMQueue::adopt(SMQueue&& next) {
+    std::unique_ptr<detail::Notifier> notifier = std::move(m_notifier);
+    if (notifier) {
+        // Stop watching the old ring before it is unmapped
+        auto* cb = next.get_control_block();
+        notifier->retarget(&cb->items_futex, &cb->waiters);
+    }
+    const WaitStrategy wait = m_wait;
+    const CopyStrategy copy = m_copy;
+    const std::uint32_t roles = m_roles;
+    const std::int32_t cpu = m_participant != nullptr ? m_participant->cpu.load(std::memory_order_relaxed) : -1;
+
+    *this = std::move(next);
+    m_wait = wait;
+    m_copy = copy;
+    m_notifier = std::move(notifier);
+    mark_role(roles);
+    if (m_participant != nullptr) {
+        m_participant->cpu.store(cpu, std::memory_order_relaxed);
     }
+}
 
-    if (m_items != nullptr) {
-        sem_close(m_items);
-        m_items = nullptr;
+// Whether the sealed ring holds nothing more for this handle: every message has been handed out, to this
+// or another consumer, and this handle has released everything it borrowed
+bool SMQueue::drained() const {
+    if (m_borrowed != 0 or m_reserved) {
+        return false;
     }
 
-    if (m_addr != nullptr) {
-        munmap(m_addr, m_size);
-        m_addr = nullptr;
-        m_size = 0;
+    const auto* cb = get_control_block();
+    switch (m_mode) {
+    case QueueMode::MPMC: {
+        // A producer that claimed a slot before the seal may still be writing it; tail only passes the slot
+        // once it was published and claimed by a consumer
+        const std::uint64_t head = cb->head.load(std::memory_order_acquire);
+        return (head & kHeadSealed) != 0 and cb->tail.load(std::memory_order_acquire) == (head & ~kHeadSealed);
+    }
+    case QueueMode::Broadcast:
+        return m_reader == nullptr or
+               m_reader->cursor.load(std::memory_order_relaxed) == cb->head.load(std::memory_order_acquire);
+    default:
+        return cb->read.load(std::memory_order_acquire) == cb->head.load(std::memory_order_acquire);
     }
 }
 
-// Get maximum number of elements
-std::size_t SMQueue::max_elements() const { return m_addr != nullptr ? get_control_block()->max_elements : 0; }
+// Move a consumer on once its sealed ring holds nothing more for it. Returns true if it moved; m_grown
+// then tells whether the element size grew.
+bool SMQueue::consumer_switch() {
+    auto* cb = get_control_block();
+    if (cb->sealed.load(std::memory_order_acquire) != kSealed or !drained()) {
+        return false;
+    }
 
-// Get element size in bytes
-std::size_t SMQueue::element_size() const { return m_addr != nullptr ? get_control_block()->element_size : 0; }
+    // The last one out frees the old ring's pages. The control block stays for open() to find the way to
+    // the newest generation.
+    if (!others_alive()) {
+        detail::discard_memory(get_data_buffer(), m_size - cb->data_offset);
+    }
 
-// Get queue name
-const std::string& SMQueue::name() const { return m_name; }
+    const std::size_t element_size = cb->element_size;
+    follow_successor();
+    m_grown = get_control_block()->element_size != element_size;
+    return true;
+}
 
-// Constructor
-SMQueue::SMQueue(const std::string& name, void* addr, std::size_t size)
-    : m_name(name), m_addr(addr), m_size(size), m_mutex(nullptr), m_items(nullptr) {}
+// Get the reader table entry at index
+SMQueue::ReaderSlot* SMQueue::get_reader(std::size_t index) const {
+    return reinterpret_cast<ReaderSlot*>(static_cast<char*>(m_addr) + get_control_block()->readers_offset) + index;
+}
 
 // Get control block
 SMQueue::ControlBlock* SMQueue::get_control_block() const { return static_cast<ControlBlock*>(m_addr); }
 
+// Get slot metadata at index
+SMQueue::SlotHeader* SMQueue::get_slot(std::size_t index) const {
+    return reinterpret_cast<SlotHeader*>(get_control_block() + 1) + index;
+}
+
 // Get data buffer
 std::byte* SMQueue::get_data_buffer() const {
     if (m_addr == nullptr) {
@@ -441,7 +3117,7 @@ std::byte* SMQueue::get_data_buffer() const {
     }
 
     // Cast directly to std::byte* to avoid multiple pointer conversions
-    return reinterpret_cast<std::byte*>(static_cast<char*>(m_addr) + sizeof(ControlBlock));
+    return reinterpret_cast<std::byte*>(static_cast<char*>(m_addr) + get_control_block()->data_offset);
 }
 
 // Get element at index
@@ -452,10 +3128,32 @@ std::byte* SMQueue::get_element(std::size_t index) const {
 
     auto* cb = get_control_block();
     // Calculate the offset directly to avoid multiple pointer arithmetic operations
-    std::size_t offset = index * cb->element_size;
+    std::size_t offset = index * cb->slot_stride;
     return get_data_buffer() + offset;
 }
 
+// Base of a queue's semaphore names. macOS limits semaphore names to 31 characters, so longer queue names
+// keep their first 15 characters followed by a hash of the whole name; queues whose names merely share a
+// prefix still get semaphores of their own.
+std::string SMQueue::sem_base_name(const std::string& name) {
+    std::string base = !name.empty() and name[0] == '/' ? name.substr(1) : name;
+    // Semaphore names cannot hold the slashes of a file path, so paths always take the hashed form and
+    // cannot clash with the shm name they would turn into
+    const bool path = base.find('/') != std::string::npos;
+    if (base.length() > 24 or path) {
+        // 32-bit FNV-1a
+        std::uint32_t hash = 2166136261u;
+        for (const char c : base) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        char suffix[10];
+        std::snprintf(suffix, sizeof(suffix), "_%08x", static_cast<unsigned>(hash));
+        std::replace(base.begin(), base.end(), '/', '_');
+        base = base.substr(0, 15) + suffix;
+    }
+    return base;
+}
+
 // Create semaphore name
 std::string SMQueue::make_sem_name(const std::string& name, const std::string& suffix) {
     // Assert that name doesn't start with a slash (for macOS compatibility)
@@ -472,17 +3170,22 @@ std::string SMQueue::make_sem_name(const std::string& name, const std::string& s
 
 // Initialize semaphores
 void SMQueue::init_semaphores(ControlBlock* cb) {
-    // Remove leading slash if present for semaphore names
-    std::string sem_base_name = m_name;
-    if (!sem_base_name.empty() and sem_base_name[0] == '/') {
-        sem_base_name = sem_base_name.substr(1);
+    if (cb->sync == SyncPrimitives::InSegment) {
+        // Robust queues lock the pthread mutex instead of a mutex semaphore
+        if (!cb->robust and sem_init(&cb->mutex_sem, 1, 1) != 0) {
+            throw std::runtime_error("Failed to initialize mutex semaphore (errno: " + std::to_string(errno) + ")");
+        }
+        if (sem_init(&cb->items_sem, 1, 0) != 0) {
+            throw std::runtime_error("Failed to initialize items semaphore (errno: " + std::to_string(errno) + ")");
+        }
+        open_semaphores();
+        return;
     }
 
-    assert(sem_base_name.length() <= 24);
-
     // Create semaphore names
-    std::string mutex_name = make_sem_name(sem_base_name, "_mutex");
-    std::string items_name = make_sem_name(sem_base_name, "_items");
+    const std::string sem_base = sem_base_name(m_name);
+    std::string mutex_name = cb->robust ? std::string() : make_sem_name(sem_base, "_mutex");
+    std::string items_name = make_sem_name(sem_base, "_items");
 
     // Check if names are too long for the buffer
     if (mutex_name.length() >= sizeof(cb->mutex_name) or items_name.length() >= sizeof(cb->items_name)) {
@@ -497,19 +3200,29 @@ void SMQueue::init_semaphores(ControlBlock* cb) {
     cb->items_name[sizeof(cb->items_name) - 1] = '\0';
 
     // Unlink any existing semaphores
-    sem_unlink(mutex_name.c_str());
+    if (!cb->robust) {
+        sem_unlink(mutex_name.c_str());
+    }
     sem_unlink(items_name.c_str());
 
     // Create semaphores
-    m_mutex = sem_open(mutex_name.c_str(), O_CREAT, 0666, 1);
-    if (m_mutex == SEM_FAILED) {
-        throw std::runtime_error("Failed to create mutex semaphore: " + mutex_name);
+    m_named = true;
+    if (!cb->robust) {
+        m_mutex = sem_open(mutex_name.c_str(), O_CREAT, 0666, 1);
+        if (m_mutex == SEM_FAILED) {
+            m_mutex = nullptr;
+            throw std::runtime_error("Failed to create mutex semaphore: " + mutex_name);
+        }
     }
 
     m_items = sem_open(items_name.c_str(), O_CREAT, 0666, 0);
     if (m_items == SEM_FAILED) {
-        sem_close(m_mutex);
-        sem_unlink(mutex_name.c_str());
+        m_items = nullptr;
+        if (m_mutex != nullptr) {
+            sem_close(m_mutex);
+            m_mutex = nullptr;
+            sem_unlink(mutex_name.c_str());
+        }
         throw std::runtime_error("Failed to create items semaphore: " + items_name);
     }
 }
@@ -518,15 +3231,31 @@ void SMQueue::init_semaphores(ControlBlock* cb) {
 void SMQueue::open_semaphores() {
     ControlBlock* cb = get_control_block();
 
+    // In-segment semaphores are already mapped
+    if (cb->sync == SyncPrimitives::InSegment) {
+        m_mutex = cb->robust ? nullptr : &cb->mutex_sem;
+        m_items = &cb->items_sem;
+        m_named = false;
+        return;
+    }
+
     // Open semaphores
-    m_mutex = sem_open(cb->mutex_name, 0);
-    if (m_mutex == SEM_FAILED) {
-        throw std::runtime_error("Failed to open mutex semaphore: " + std::string(cb->mutex_name));
+    m_named = true;
+    if (!cb->robust) {
+        m_mutex = sem_open(cb->mutex_name, 0);
+        if (m_mutex == SEM_FAILED) {
+            m_mutex = nullptr;
+            throw std::runtime_error("Failed to open mutex semaphore: " + std::string(cb->mutex_name));
+        }
     }
 
     m_items = sem_open(cb->items_name, 0);
     if (m_items == SEM_FAILED) {
-        sem_close(m_mutex);
+        m_items = nullptr;
+        if (m_mutex != nullptr) {
+            sem_close(m_mutex);
+            m_mutex = nullptr;
+        }
         throw std::runtime_error("Failed to open items semaphore: " + std::string(cb->items_name));
     }
 }
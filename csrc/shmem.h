@@ -1,18 +1,24 @@
 #pragma once
 
 #include <fcntl.h>     // for O_CREAT, O_RDWR
+#include <pthread.h>   // for pthread_mutex_t
 #include <semaphore.h> // for sem_t, sem_open
 #include <sys/mman.h>  // for shm_open, mmap
 #include <sys/stat.h>  // for fstat
 #include <unistd.h>    // for close, ftruncate
 
+#include <atomic>    // for std::atomic
 #include <cassert>   // for assert
 #include <cerrno>    // for errno
+#include <chrono>    // for std::chrono::steady_clock
 #include <cstddef>   // for std::byte
+#include <cstdint>   // for std::uint32_t, std::uint64_t
 #include <cstring>   // for memcpy, strncpy
 #include <limits>    // for std::numeric_limits
+#include <memory>    // for std::unique_ptr
 #include <stdexcept> // for std::runtime_error
 #include <string>    // for std::string
+#include <vector>    // for std::vector
 
 namespace shmem {
 
@@ -22,10 +28,21 @@ namespace shmem {
  *
  * Features:
  * - Uses shm_open/mmap for shared memory
- * - Uses named semaphores for synchronization (macOS compatible)
+ * - Uses named semaphores for synchronization (macOS compatible), or process-shared ones inside the segment
+ * - Optional lock-free single-producer/single-consumer and multi-producer/multi-consumer modes
+ * - Broadcast mode: one writer fans out to many independent readers
  * - Thread and process safe
- * - Fixed-size message support
+ * - Fixed-size messages, or variable-size length-prefixed records
  * - Non-blocking operations available
+ * - Batch operations that synchronise once per batch
+ * - Optional streaming and multi-threaded copies for large messages
+ * - Optional shared counters that monitoring tools can read without opening the queue
+ * - Liveness tracking of every open handle, robust locking and recovery after a process crash
+ * - Online growth: a queue can move to a larger ring while its producers and consumers keep running
+ * - File-backed queues that survive a reboot and can be replayed by opening the file again
+ * - TypedQueue<T, Capacity> (typed_queue.h): compile-time element type and capacity with inline lock-free push/pop
+ * - Thread placement: pin producers and consumers to cores near the queue and each other, optionally SCHED_FIFO
+ * - Bridges (bridge.h): forward a queue to other hosts over TCP (zero-copy sends) or UDP multicast
  */
 
 // Helper functions
@@ -36,22 +53,280 @@ inline void safe_close(int fd) {
         close(fd);
     }
 }
+
+class Notifier;          // notify.h
+class Flusher;           // segment.h
+struct LatencyHistogram; // histogram.h
 } // namespace detail
 
+// Synchronization scheme of a queue, fixed when the queue is created
+enum class QueueMode : std::uint32_t {
+    // Named semaphores guard every operation; any number of producers and consumers
+    Locked = 0,
+    // Lock-free ring for exactly one producer and one consumer. push/pop never make a syscall.
+    // A full ring never overwrites unread data: push drops the new message and returns false.
+    SPSC = 1,
+    // Lock-free bounded ring for any number of producers and consumers (Vyukov-style). Every slot
+    // carries a sequence number and both sides claim slots with a CAS on head/tail.
+    MPMC = 2,
+    // Lock-free fan-out ring: one writer, and every handle returned by open() is a reader with its own
+    // cursor, so each reader sees every message. The writer never waits for readers and overwrites the
+    // oldest message; a reader that falls more than max_elements behind skips ahead and counts the
+    // messages it missed (see SMQueue::overruns). Fixed-size messages only; readers cannot borrow.
+    Broadcast = 3,
+};
+
+// Where the semaphores of a Locked queue live
+enum class SyncPrimitives : std::uint32_t {
+    // sem_open semaphores named after the queue (default). Each create/open pays for two more opens and
+    // each queue adds two files to /dev/shm.
+    Named = 0,
+    // Process-shared sem_t inside the control block (Linux). open() is a single shm_open+mmap and queues
+    // can never share semaphores, whatever their names.
+    InSegment = 1,
+};
+
+// What push does when the queue is full
+enum class OverflowPolicy : std::uint32_t {
+    DropOldest = 0, // Discard the oldest unread message to make room (default)
+    DropNewest = 1, // Leave the queue untouched and discard the message being pushed
+    // Lossless: push() waits for room and push_for() gives up after its timeout. Consumers wake waiting
+    // producers as they free slots. Not available for Broadcast queues, whose writer never waits.
+    Block = 2,
+};
+
+// How fixed-size message slots are laid out in the data buffer. Padding the stride keeps writers of
+// neighbouring slots from false-sharing and keeps each slot within as few pages as possible.
+enum class SlotLayout : std::uint32_t {
+    Packed = 0,    // Slots are element_size bytes apart; the data buffer starts on a cache line (default)
+    CacheLine = 1, // Stride padded to a multiple of 64 bytes
+    Page = 2,      // Stride padded to the page size; the data buffer starts on a page boundary
+    // Stride padded to 2MB; the data buffer and the mapping start on a 2MB boundary so the kernel can
+    // back the ring with transparent huge pages (shmem_enabled must allow it)
+    HugePage = 3,
+};
+
+// NUMA memory policy for the pages of a queue (Linux only). The policy is attached to the shared
+// memory object itself, so it applies no matter which process touches a page first.
+enum class NumaPolicy : std::uint32_t {
+    Default = 0,    // First-touch placement
+    Bind = 1,       // Allocate only on the nodes in the mask
+    Interleave = 2, // Spread pages round-robin over the nodes in the mask
+    Preferred = 3,  // Prefer the lowest node in the mask, falling back to others when it is full
+};
+
+// Where the pages of a queue's data buffer currently reside
+struct NumaResidency {
+    std::vector<std::size_t> pages_per_node; // Resident pages, indexed by node id
+    std::size_t not_present = 0;             // Pages that have not been faulted in yet
+    std::size_t page_size = 0;               // Size of the pages counted above
+};
+
+// Snapshot of a queue's counters (see QueueOptions::stats). Counters are cumulative since creation and
+// updated with relaxed atomics, so a snapshot of a busy queue is only approximately consistent.
+struct QueueStats {
+    bool enabled = false;               // Whether the queue maintains counters; all zero otherwise
+    std::uint64_t pushes = 0;           // Messages published
+    std::uint64_t pops = 0;             // Messages popped or borrowed, summed over all Broadcast readers
+    std::uint64_t drops = 0;            // Messages discarded by the overflow policy, newest or oldest
+    std::uint64_t depth = 0;            // Messages published but not yet popped (0 for Broadcast queues)
+    std::uint64_t max_depth = 0;        // Largest depth seen by a producer after publishing
+    std::uint64_t producer_wait_ns = 0; // Time producers spent blocked on the queue mutex
+    std::uint64_t consumer_wait_ns = 0; // Time consumers spent waiting for messages in blocking calls
+};
+
+// How long messages stayed in a queue, from publish until a consumer popped or borrowed them (see
+// QueueOptions::latency). Percentiles come from a log-linear histogram and overestimate by at most ~3%.
+struct LatencyStats {
+    bool enabled = false;    // Whether the queue records latencies; all zero otherwise
+    std::uint64_t count = 0; // Messages measured
+    std::uint64_t min_ns = 0;
+    std::uint64_t mean_ns = 0;
+    std::uint64_t p50_ns = 0;
+    std::uint64_t p90_ns = 0;
+    std::uint64_t p99_ns = 0;
+    std::uint64_t p999_ns = 0;
+    std::uint64_t max_ns = 0;
+};
+
+// A handle that has the queue open, as recorded in the queue's participant table (SMQueue::participants)
+struct Participant {
+    std::int32_t pid = 0;           // Process that opened the handle
+    bool producer = false;          // Whether the handle has pushed
+    bool consumer = false;          // Whether the handle has popped or borrowed
+    bool alive = false;             // Whether the process still exists
+    std::uint64_t heartbeat_ns = 0; // Last sign of life (open, heartbeat() or a blocking wait), steady_clock ns
+    std::int32_t cpu = -1;          // CPU the handle's thread was pinned to (SMQueue::place_thread), -1 if none
+};
+
+// How blocking calls such as pop() wait for a message. The caller first busy-polls, then yields
+// its time slice, and finally parks in the kernel (futex on Linux, ulock on macOS) until a
+// producer wakes it. Producers only make the wake-up syscall while a consumer is parked.
+struct WaitStrategy {
+    std::uint32_t spin_iterations = 4096; // Busy-poll attempts before yielding
+    std::uint32_t yield_iterations = 64;  // Yielding attempts before parking
+};
+
+// How a handle copies message payloads between the queue and caller buffers
+enum class CopyPolicy : std::uint32_t {
+    Memcpy = 0,    // std::memcpy (default)
+    Streaming = 1, // Non-temporal stores (AVX-512/AVX2 on x86-64, STNP on AArch64) that bypass the cache
+    Parallel = 2,  // Streaming stores split across a pool of worker threads
+};
+
+// Per-handle copy settings. Streaming only pays off for frames much larger than the cache footprint the
+// caller wants to keep, so smaller messages always use memcpy.
+struct CopyStrategy {
+    CopyPolicy policy = CopyPolicy::Memcpy;
+    std::size_t streaming_threshold = std::size_t(256) << 10; // Smallest message copied with streaming stores
+    std::size_t parallel_threshold = std::size_t(4) << 20;    // Smallest message split across threads
+    std::uint32_t threads = 4;                                // Threads per parallel copy, the caller included
+};
+
+// Element type codes of a MessageType, numbered as in DLPack's DLDataTypeCode
+enum class DTypeCode : std::uint8_t {
+    Int = 0,
+    UInt = 1,
+    Float = 2,
+    Bfloat = 4,
+    Complex = 5,
+    Bool = 6,
+};
+
+// Optional description of the N-d array stored in every message of a fixed-size queue. It is recorded
+// in the control block so every process sees the same layout; the queue itself never interprets it,
+// but the Python bindings use it to return typed arrays.
+struct MessageType {
+    static constexpr std::uint32_t kMaxDims = 8;
+
+    std::uint32_t ndim = 0;              // 0 for untyped messages (flat bytes)
+    DTypeCode code = DTypeCode::UInt;    // Element type
+    std::uint8_t bits = 8;               // Bits per element; a multiple of 8
+    std::int64_t shape[kMaxDims] = {};   // Extent of each dimension
+    std::int64_t strides[kMaxDims] = {}; // In elements; all zero for a C-contiguous array
+};
+
+// Options accepted by SMQueue::create
+struct QueueOptions {
+    QueueMode mode = QueueMode::Locked;
+    // Honoured by Locked and MPMC queues. SPSC queues drop the newest message instead of the oldest since
+    // only the consumer may move tail, but they honour Block.
+    OverflowPolicy overflow = OverflowPolicy::DropOldest;
+    // Store length-prefixed records in a contiguous byte ring instead of fixed-size slots. element_size
+    // becomes the maximum message length, and the ring can hold max_elements messages of that size
+    // (many more if they are smaller). Supported by Locked and SPSC queues.
+    bool variable_size = false;
+    // Broadcast queues: maximum number of concurrently open readers
+    std::size_t max_readers = 16;
+    // Slot stride and data buffer alignment. Variable-size queues only use the alignment.
+    SlotLayout layout = SlotLayout::Packed;
+    // Back the queue with a file on hugetlbfs ($SHMEM_HUGETLBFS_DIR, default /dev/hugepages) instead of
+    // POSIX shm, so the ring is always mapped with 2MB pages. Needs pages reserved via vm.nr_hugepages.
+    // open() finds such queues by name like any other.
+    bool huge_pages = false;
+    // Pre-fault the whole mapping so the first pass over the ring takes no page faults
+    bool populate = false;
+    // mlock the mapping so it is never paged out (subject to RLIMIT_MEMLOCK)
+    bool lock_memory = false;
+    // NUMA placement, applied before any page is touched. numa_nodes is a mask: bit n selects node n.
+    NumaPolicy numa_policy = NumaPolicy::Default;
+    std::uint64_t numa_nodes = 0;
+    // Layout of the array in each message. Must fit within element_size; fixed-size queues only.
+    MessageType message_type;
+    // Maintain shared counters (SMQueue::stats). Costs a relaxed atomic add per message and clock reads
+    // in blocking calls once they have to wait; queues created without it pay nothing.
+    bool stats = false;
+    // Timestamp every message on publish and record its queue residency time in a shared histogram when it
+    // is popped or borrowed (SMQueue::latency). Costs a clock read per publish and per pop; fixed-size
+    // queues only.
+    bool latency = false;
+    // Locked queues: guard the queue with a robust process-shared mutex inside the segment instead of the
+    // mutex semaphore. A process that dies holding it cannot hang the others: the next locker is told the
+    // owner died and repairs the queue. The mutex belongs to a thread, so reserve() and publish() must be
+    // called from the same thread. Linux only.
+    bool robust = false;
+    // Locked queues: named semaphores, or semaphores inside the segment
+    SyncPrimitives sync = SyncPrimitives::Named;
+    // Size of the participant table; create() and open() fail once this many handles are open
+    std::size_t max_participants = 64;
+    // File-backed queues: every producer handle writes the mapping back to the file from a background thread
+    // this often, so a host crash loses at most about one interval of messages. 0 leaves writeback to the
+    // kernel and to SMQueue::flush().
+    std::uint32_t flush_interval_ms = 0;
+};
+
+// Where SMQueue::place_thread puts the calling thread
+struct ThreadPlacement {
+    // Pin the thread to a single CPU (Linux only)
+    bool pin = false;
+    // CPU to pin to, or -1 to choose one: a CPU of the NUMA node holding the queue's pages that shares the
+    // closest cache (an L2, else the LLC) with the CPUs other handles of the queue are pinned to, without
+    // taking one of theirs. Handles placing themselves at the same moment may pick alike.
+    int cpu = -1;
+    // Run the thread under SCHED_FIFO, so it is never preempted by ordinary threads. Needs CAP_SYS_NICE or
+    // an RLIMIT_RTPRIO of at least priority; a thread that spins at this priority can starve its CPU.
+    bool realtime = false;
+    int priority = 1; // SCHED_FIFO priority, 1 to 99
+};
+
+// Options accepted by SMQueue::open
+struct OpenOptions {
+    // Pre-fault the whole mapping so the first pass over the ring takes no page faults
+    bool populate = false;
+    // mlock the mapping so it is never paged out (subject to RLIMIT_MEMLOCK)
+    bool lock_memory = false;
+    // Repair the queue after a process using it crashed: release entries of dead processes, take over a
+    // mutex semaphore held by a dead process (Locked) and re-queue messages borrowed by consumers that
+    // died, so no data is lost (delivery becomes at-least-once). Messages can only be re-queued once no
+    // live consumer remains (Locked, SPSC) or no other live handle at all (MPMC).
+    bool recover = false;
+    // Broadcast queues: start the new reader at the oldest message still in the ring rather than the
+    // newest, e.g. to replay a recorded file-backed queue
+    bool rewind = false;
+    // Place the calling thread once the queue is open (see SMQueue::place_thread)
+    ThreadPlacement placement;
+};
+
+class QueueSet;       // queue_set.h
+class Tap;            // tap.h
+class BridgeSender;   // bridge.h
+class BridgeReceiver; // bridge.h
+template <typename T, std::size_t Capacity> class TypedQueue; // typed_queue.h
+
 // Forward declarations
 class SMQueue {
   public:
     // Create a new shared memory queue
+    // name: POSIX shm name, or a file path (any name with a slash after its first character) to map a
+    //       regular file instead. A file-backed queue outlives a reboot: open() finds its messages again, and
+    //       resets the state left by the processes of the earlier boot. A file on a DAX filesystem maps
+    //       persistent memory directly.
     // max_elements: Maximum number of elements in the queue
     // element_size: Size of each element in bytes
-    static SMQueue create(const std::string& name, std::size_t max_elements, std::size_t element_size);
+    // options: Synchronization mode and other creation-time settings
+    static SMQueue create(const std::string& name, std::size_t max_elements, std::size_t element_size,
+                          const QueueOptions& options = QueueOptions());
 
-    // Open an existing shared memory queue
-    static SMQueue open(const std::string& name);
+    // Open an existing shared memory queue. For Broadcast queues this registers a new reader, which
+    // starts at the newest message (the oldest with options.rewind) and is unregistered by close(). With
+    // options.recover the queue is repaired first (see OpenOptions::recover).
+    static SMQueue open(const std::string& name, const OpenOptions& options = OpenOptions());
 
-    // Destroy a shared memory queue
+    // Destroy a shared memory queue, every generation left by grow() included
     static void destroy(const std::string& name);
 
+    // Read the counters of a queue without opening it: the segment is mapped read-only, and no semaphore
+    // or Broadcast reader entry is taken, so a monitoring process never disturbs the queue. A queue that
+    // has grown reports the counters of its newest generation, which start from zero.
+    static QueueStats read_stats(const std::string& name);
+
+    // Read the latency histogram of a queue without opening it, like read_stats()
+    static LatencyStats read_latency(const std::string& name);
+
+    // Names of all queues on this host: POSIX shm objects and hugetlbfs files that hold an initialized
+    // queue (Linux only)
+    static std::vector<std::string> list_queues();
+
     // Move constructor and assignment
     SMQueue(SMQueue&& other) noexcept;
     SMQueue& operator=(SMQueue&& other) noexcept;
@@ -64,57 +339,482 @@ class SMQueue {
     // Returns true if no messages were dropped, false if some were dropped
     bool push(const std::byte* data);
 
+    // Push a message of the given length. Variable-size queues accept any length up to element_size();
+    // fixed-size queues require length == element_size().
+    bool push(const std::byte* data, std::size_t length);
+
+    // Push a message, waiting at most timeout for room on Block queues (other queues do not wait and
+    // behave like push). Returns false on timeout; the message was not queued.
+    bool push_for(const std::byte* data, std::chrono::nanoseconds timeout);
+    bool push_for(const std::byte* data, std::size_t length, std::chrono::nanoseconds timeout);
+
+    // Push a message only if there is room for it right now (non-blocking). Never waits and never drops
+    // an older message, whatever the overflow policy: returns false if the queue is full.
+    bool try_push(const std::byte* data);
+    bool try_push(const std::byte* data, std::size_t length);
+
+    // Zero-copy producer API. reserve() returns a pointer to writable storage inside the queue for the
+    // next message (element_size() bytes, or length bytes for variable-size queues) and publish() makes
+    // it visible to consumers. On a full queue, Block queues wait for room; otherwise reserve() returns
+    // nullptr if the message would be dropped (DropNewest, or an oldest message that cannot be dropped:
+    // an SPSC ring, or a borrowed slot). Each handle can hold one reservation at a time, and every
+    // successful reserve() must be followed by publish(). On Locked queues the mutex stays held in
+    // between, so fill the slot promptly.
+    std::byte* reserve();
+    std::byte* reserve(std::size_t length);
+
+    // Publish the reserved message. Returns true if no messages were dropped to make room for it.
+    bool publish();
+
     // Pop a message from the queue (blocking)
     // Returns true if successful, false if an error occurred
     bool pop(std::byte* buffer);
 
+    // Pop a message and report its length. buffer must hold element_size() bytes.
+    bool pop(std::byte* buffer, std::size_t& length);
+
     // Try to pop a message (non-blocking)
     bool try_pop(std::byte* buffer);
 
+    // Try to pop a message and report its length (non-blocking)
+    bool try_pop(std::byte* buffer, std::size_t& length);
+
+    // Pop a message, waiting at most timeout (pop_for) or until deadline (pop_until) for one to arrive.
+    // Return false on timeout, so consumers can block efficiently and still check for shutdown.
+    bool pop_for(std::byte* buffer, std::chrono::nanoseconds timeout);
+    bool pop_for(std::byte* buffer, std::size_t& length, std::chrono::nanoseconds timeout);
+    bool pop_until(std::byte* buffer, std::chrono::steady_clock::time_point deadline);
+    bool pop_until(std::byte* buffer, std::size_t& length, std::chrono::steady_clock::time_point deadline);
+
+    // Set how blocking calls on this handle wait for messages
+    void set_wait_strategy(const WaitStrategy& strategy);
+
+    // Whether a message looks ready for this handle (non-blocking, no side effects). Only a hint: another
+    // consumer may take the message first, so follow it with try_pop().
+    bool readable() const;
+
+    // Set how push, pop and their batch variants on this handle copy payloads
+    void set_copy_strategy(const CopyStrategy& strategy);
+
     // Zero-copy borrow of the next message (non-blocking). Returns true on success. The caller receives
     // a pointer to the message data living inside the queue and the element index that must later be
-    // released via commit_pop(index).
+    // released via commit_pop(index). Several messages can be borrowed at once and released in any
+    // order; a borrowed slot is never overwritten, so producers see the queue as full once they catch
+    // up with the oldest borrow.
     bool borrow(std::byte const** data_ptr, std::size_t& index);
 
+    // Zero-copy borrow that also reports the message length
+    bool borrow(std::byte const** data_ptr, std::size_t& index, std::size_t& length);
+
+    // Zero-copy borrow that waits at most timeout (borrow_for) or until deadline (borrow_until) for a
+    // message. Returns false on timeout.
+    bool borrow_for(std::byte const** data_ptr, std::size_t& index, std::chrono::nanoseconds timeout);
+    bool borrow_for(std::byte const** data_ptr, std::size_t& index, std::size_t& length,
+                    std::chrono::nanoseconds timeout);
+    bool borrow_until(std::byte const** data_ptr, std::size_t& index, std::size_t& length,
+                      std::chrono::steady_clock::time_point deadline);
+
     // Release a previously borrowed element (identified by its index) and make the slot reusable.
     void commit_pop(std::size_t index);
 
+    // Batch operations synchronise once per call rather than once per message: one mutex round-trip on
+    // Locked queues, one cursor update and at most one wake-up on lock-free queues.
+
+    // Push n messages of element_size() bytes each (or lengths[i] bytes for variable-size queues).
+    // Stops at the first message that would be dropped and returns the number of messages pushed.
+    // With DropOldest, older unread messages may be discarded to make room as push() does; with Block,
+    // the call waits for room until every message is in.
+    std::size_t push_batch(const std::byte* const* msgs, std::size_t n);
+    std::size_t push_batch(const std::byte* const* msgs, const std::size_t* lengths, std::size_t n);
+
+    // Pop up to max_n messages into out, message i at out + i * element_size(), and optionally report
+    // their lengths. pop_batch blocks until at least one message is available. Returns the number of
+    // messages popped (0 on error, or if try_pop_batch finds the queue empty).
+    std::size_t pop_batch(std::byte* out, std::size_t max_n, std::size_t* lengths = nullptr);
+    std::size_t try_pop_batch(std::byte* out, std::size_t max_n, std::size_t* lengths = nullptr);
+
+    // Zero-copy borrow of up to max_n consecutive messages (non-blocking, fixed-size queues only). Message
+    // i lives at *data_ptr + i * slot_stride(), so a batch never crosses the end of the ring.
+    // Returns the number of messages borrowed; release them with commit_pop_batch(index, count).
+    std::size_t borrow_batch(std::byte const** data_ptr, std::size_t& index, std::size_t max_n);
+
+    // Release count messages borrowed together by borrow_batch()
+    void commit_pop_batch(std::size_t index, std::size_t count);
+
+    // Move the queue to a larger ring without recreating it. A new segment (the next generation, named
+    // name() + ".gen<N>") is created with the same options and linked from the current one, which is sealed:
+    // producers, this handle included, switch to the new ring on their next push, and consumers switch once
+    // they have drained the old ring and released their borrows, so no message is lost or reordered. Other
+    // handles remap lazily; open() still takes the original name. When the element size grows, the call in
+    // which a consumer switches returns without a message (pop() included) so the caller can size its
+    // buffers from element_size() again. Sizes may not shrink, and only one handle can grow a queue at a
+    // time. Broadcast readers cannot grow.
+    void grow(std::size_t max_elements, std::size_t element_size);
+
+    // Generation of the ring this handle currently uses: 0 until the queue grows
+    std::uint32_t generation() const;
+
+    // Descriptor that becomes readable when a message is published, so event loops (asyncio, epoll,
+    // kqueue) can wait on the queue without polling: an eventfd on Linux, a pipe elsewhere. The first
+    // call starts a watcher thread owned by this handle. Readability is only a hint: call clear_notify(),
+    // then drain the queue with try_pop() before waiting on the descriptor again.
+    int notify_fd();
+
+    // Consume pending notifications on notify_fd()
+    void clear_notify();
+
     // Close the queue
     void close();
 
     // Get maximum number of elements
     std::size_t max_elements() const;
 
-    // Get element size in bytes
+    // Get element size in bytes (the maximum message length for variable-size queues)
     std::size_t element_size() const;
 
+    // Distance in bytes between consecutive slots of a fixed-size queue (element_size() padded as
+    // requested by QueueOptions::layout)
+    std::size_t slot_stride() const;
+
+    // Whether the queue stores variable-size records
+    bool variable_size() const;
+
     // Get queue name
     const std::string& name() const;
 
+    // Get synchronization mode
+    QueueMode mode() const;
+
+    // What push does when the queue is full
+    OverflowPolicy overflow() const;
+
+    // Layout of the array in each message, as given at creation (ndim == 0 if none was)
+    const MessageType& message_type() const;
+
+    // Apply a NUMA policy to the data buffer, e.g. to bind it to the node of its consumer, and migrate the
+    // pages this process has mapped so far (Linux only). Pages shared with other processes only move
+    // with CAP_SYS_NICE.
+    void bind_numa(NumaPolicy policy, std::uint64_t nodes);
+
+    // Report the NUMA node of every page of the data buffer (Linux only)
+    NumaResidency numa_residency() const;
+
+    // Broadcast readers: number of messages missed because the writer overwrote them before this reader
+    // got to them. Always 0 for other queues and for the writer.
+    std::uint64_t overruns() const;
+
+    // Snapshot of the queue's counters (enabled == false unless created with QueueOptions::stats), for the
+    // generation this handle uses
+    QueueStats stats() const;
+
+    // Queue residency times measured so far (enabled == false unless created with QueueOptions::latency),
+    // for the generation this handle uses
+    LatencyStats latency() const;
+
+    // Empty the latency histogram, e.g. to measure the next interval on its own
+    void reset_latency();
+
+    // Every handle that has the queue open, from the participant table
+    std::vector<Participant> participants() const;
+
+    // Record a sign of life for this handle. Blocking waits do this on their own; busy handles that never
+    // wait can call it periodically so monitors can tell them from hung ones.
+    void heartbeat();
+
+    // Write the queue back to its file and wait until it is on stable storage (file-backed queues; a
+    // no-op for shm)
+    void flush();
+
+    // Pin the calling thread and/or switch it to SCHED_FIFO as placement asks, and record the CPU in the
+    // participant table so the queue's other handles can pick cores near it. Call it from the thread that
+    // uses the handle. Returns the CPU pinned to, or -1 if placement.pin is false.
+    int place_thread(const ThreadPlacement& placement);
+
   private:
+    friend class QueueSet;       // Parks on the items_futex of many queues at once
+    friend class Tap;            // Copies messages out of the ring without consuming them
+    friend class BridgeSender;   // Announces the queue's options to the remote end
+    friend class BridgeReceiver; // Waits for room on Block queues without missing a stop request
+    // Runs the SPSC and MPMC fast paths inline
+    template <typename T, std::size_t Capacity> friend class TypedQueue;
+
+    // Written last by create() so open() can reject segments that are not (yet) queues
+    static constexpr std::uint32_t kMagic = 0x514d4853; // "SHMQ"
+
+    // Stats counters, grouped by the side that writes them so each group has its own cache line
+    struct alignas(64) ProducerStats {
+        std::atomic<std::uint64_t> pushes;
+        std::atomic<std::uint64_t> drops;
+        std::atomic<std::uint64_t> evictions; // Drops of messages already in the queue
+        std::atomic<std::uint64_t> max_depth;
+        std::atomic<std::uint64_t> wait_ns;
+    };
+    struct alignas(64) ConsumerStats {
+        std::atomic<std::uint64_t> pops;
+        std::atomic<std::uint64_t> wait_ns;
+    };
+
+    // One entry per open handle, on its own cache line
+    struct alignas(64) ParticipantSlot {
+        std::atomic<std::int32_t> pid;           // Owning process, 0 while the entry is free
+        std::atomic<std::uint32_t> roles;        // kRoleProducer / kRoleConsumer
+        std::atomic<std::uint64_t> heartbeat_ns; // Last sign of life
+        std::atomic<std::int32_t> cpu;           // CPU the handle's thread is pinned to, -1 if none
+    };
+
+    static constexpr std::uint32_t kRoleProducer = 1;
+    static constexpr std::uint32_t kRoleConsumer = 2;
+
+    // Growth states of a generation (ControlBlock::sealed)
+    static constexpr std::uint32_t kGrowing = 1; // A handle is creating the next generation
+    static constexpr std::uint32_t kSealed = 2;  // The next generation exists and takes every new message
+
+    // MPMC mode: set in head when the ring is sealed, so that no producer can claim a slot behind it
+    static constexpr std::uint64_t kHeadSealed = std::uint64_t(1) << 63;
+
     // Control block structure
     struct alignas(64) ControlBlock {
-        std::size_t max_elements; // Maximum number of elements
-        std::size_t element_size; // Size of each element in bytes
-        std::size_t head;         // Write position (element index)
-        std::size_t tail;         // Read position (element index)
-        std::size_t count;        // Number of elements in the queue
-        char mutex_name[128];     // Mutex semaphore name
-        char items_name[128];     // Items semaphore name
+        std::atomic<std::uint32_t> magic;  // kMagic once initialized
+        std::atomic<std::uint32_t> sealed; // 0, kGrowing or kSealed
+        QueueMode mode;                    // Synchronization mode
+        OverflowPolicy overflow;          // Behaviour of push on a full queue
+        std::size_t max_elements;         // Maximum number of elements
+        std::size_t element_size;         // Size of each element in bytes
+        std::size_t slot_stride;          // Distance between fixed-size slots (element_size plus padding)
+        std::size_t map_alignment;        // Required alignment of the mapping's base address
+        std::size_t data_offset;          // Offset of the data buffer from the start of the segment
+        std::size_t ring_bytes;           // Size of the record ring; 0 for fixed-size queues
+        std::size_t count;                // Number of elements in the queue (Locked mode)
+        std::size_t max_readers;          // Size of the reader table (Broadcast mode)
+        std::size_t readers_offset;       // Offset of the reader table from the start of the segment
+        std::size_t latency_offset;       // Offset of the latency histogram, 0 if the queue has none
+        std::size_t max_participants;     // Size of the participant table
+        std::size_t participants_offset;  // Offset of the participant table
+        MessageType message_type;         // Layout of the array in each message
+        bool stats;                       // Whether producer_stats and consumer_stats are maintained
+        bool robust;                      // Locked mode: mutex below guards the queue, not the mutex semaphore
+        SyncPrimitives sync;              // Locked mode: where the semaphores live
+        std::uint32_t generation;         // 0 for the segment created by create(), N for name + ".genN"
+        QueueOptions options;             // As given to create(), so grow() creates the next generation alike
+        // Boot the runtime state (participants, waiters, semaphores) belongs to, see restart()
+        std::atomic<std::uint64_t> boot_id;
+        char mutex_name[128];             // Mutex semaphore name (Named, without robust)
+        char items_name[128];             // Items semaphore name (Named)
+        sem_t mutex_sem;                  // InSegment, without robust: process-shared mutex semaphore
+        sem_t items_sem;                  // InSegment: process-shared items semaphore
+        pthread_mutex_t mutex;            // Locked mode with robust: robust process-shared mutex
+        // Locked mode without robust: process holding the mutex semaphore, 0 if none, so recovery can
+        // tell a semaphore abandoned by a dead process
+        std::atomic<std::int32_t> lock_owner;
+        // Cursors are monotonically increasing positions (index = pos % max_elements), or byte positions
+        // for variable-size queues (offset = pos % ring_bytes). Each side has its own cache line so
+        // producers and consumers never false-share.
+        //
+        // Locked and SPSC consumers hand messages out at read and give slots back to producers at
+        // tail, so [tail, read) is the window of borrowed messages. MPMC queues do not use read.
+        alignas(64) std::atomic<std::uint64_t> head; // Write position
+        alignas(64) std::atomic<std::uint64_t> tail; // Release position: oldest slot not yet reusable
+        std::atomic<std::uint64_t> read;             // Next message to hand out
+        // Lock-free modes: consumers park on items_futex once they run out of spins. Producers
+        // bump it and wake the kernel only while waiters is non-zero. notify_fd() watchers wait on it
+        // in every mode.
+        alignas(64) std::atomic<std::uint32_t> items_futex;
+        std::atomic<std::uint32_t> waiters;
+        // Block policy: producers waiting for room park on space_futex, which consumers bump and wake while
+        // space_waiters is non-zero
+        alignas(64) std::atomic<std::uint32_t> space_futex;
+        std::atomic<std::uint32_t> space_waiters;
+        ProducerStats producer_stats;
+        ConsumerStats consumer_stats;
+    };
+
+    // Per-slot metadata, stored as an array between the control block and the data buffer
+    struct SlotHeader {
+        // MPMC mode: pos when the slot is free for the producer of pos, pos + 1 once the message at
+        // pos is readable, and pos + max_elements after it has been consumed
+        std::atomic<std::uint64_t> seq;
+        // Locked and SPSC modes: set when a borrowed slot is released ahead of older borrows
+        std::atomic<std::uint32_t> released;
+        // Publish time in ns (QueueOptions::latency)
+        std::atomic<std::uint64_t> stamp;
+    };
+
+    // Broadcast mode: seq is pos + 1 once the message at pos is complete, and kSlotWriting while the
+    // writer is overwriting the slot. Readers validate it before and after copying (a per-slot seqlock).
+    static constexpr std::uint64_t kSlotWriting = std::numeric_limits<std::uint64_t>::max();
+
+    // Broadcast mode: one entry per registered reader, on its own cache line
+    struct alignas(64) ReaderSlot {
+        std::atomic<std::uint32_t> active;    // Non-zero while a reader owns the entry
+        std::atomic<std::int32_t> pid;        // Process id of the owning reader
+        std::atomic<std::uint64_t> cursor;    // Next position this reader will read
+        std::atomic<std::uint64_t> overruns;  // Messages this reader missed
+    };
+
+    // Prefix of every record in a variable-size queue. Records are 8-byte aligned.
+    struct RecordHeader {
+        std::uint32_t length; // Payload length (padding records: bytes to skip)
+        std::uint32_t flags;  // kRecordPadding / kRecordReleased
     };
 
+    static constexpr std::uint32_t kRecordPadding = 1;
+    static constexpr std::uint32_t kRecordReleased = 2; // Released ahead of older borrows
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Queue cursors must be lock-free");
+
     // Constructor
     SMQueue(const std::string& name, void* addr, std::size_t size);
 
+    // Lock and unlock the queue mutex (Locked mode). If wait_ns is given, time spent blocked is added to it.
+    bool lock_mutex(std::atomic<std::uint64_t>* wait_ns = nullptr);
+    void unlock_mutex();
+
+    // Whether a message is waiting at read (Locked mode). Recovery may leave more item tokens than
+    // messages, so consumers holding a token check under the mutex.
+    bool locked_available() const;
+
+    // Waits without a deadline
+    static constexpr std::chrono::steady_clock::time_point kForever = std::chrono::steady_clock::time_point::max();
+
+    // Deadline of try_push(): never wait, and never drop older messages either
+    static constexpr std::chrono::steady_clock::time_point kNoWait = std::chrono::steady_clock::time_point::min();
+
+    // Reserve room for a message of length bytes. Block queues wait for room until deadline.
+    std::byte* reserve_until(std::size_t length, std::chrono::steady_clock::time_point deadline);
+
+    // reserve() without waiting: claim room in the mode's own way
+    std::byte* claim(std::size_t length);
+
+    // push_batch() without waiting for room
+    std::size_t push_batch_some(const std::byte* const* msgs, const std::size_t* lengths, std::size_t n);
+
+    // Whether the current push may discard the oldest message to make room
+    bool may_evict() const;
+
+    // Retry try_fn until it succeeds like wait_lock_free(), parking on space_futex (Block policy)
+    template <typename TryFn>
+    bool wait_space(TryFn try_fn, std::chrono::steady_clock::time_point deadline);
+
+    // Wake producers waiting for room after slots were freed (Block policy)
+    void wake_producers();
+
+    // Wait for an item token (Locked mode), polling before blocking in the kernel. Returns false on
+    // error or once deadline has passed.
+    bool wait_item(std::chrono::steady_clock::time_point deadline = kForever);
+
+    // Retry try_fn until it succeeds: spin, then yield, then park on items_futex (lock-free modes).
+    // Returns false if deadline passes first.
+    template <typename TryFn>
+    bool wait_lock_free(TryFn try_fn, std::chrono::steady_clock::time_point deadline = kForever);
+
+    // Borrow the next message once an item token is held (Locked mode)
+    bool locked_borrow(std::byte const** data_ptr, std::size_t& index, std::size_t& length);
+
+    // Variable-size record implementations (Locked and SPSC modes)
+    static std::uint64_t record_size(std::size_t length);
+    RecordHeader* record_at(std::uint64_t pos) const;
+    std::uint64_t wrap_padding(std::uint64_t pos, std::uint64_t size) const;
+    std::byte* place_record(std::uint64_t pos, std::uint64_t padding);
+    std::uint64_t skip_padding(std::uint64_t pos) const;
+    std::byte* record_reserve(std::size_t length);
+    std::byte* record_claim(std::uint64_t head, std::size_t length);
+
+    // Borrowed-window implementations shared by Locked and SPSC modes
+    void locked_take(std::byte* buffer, std::size_t& length);
+    void window_borrow(std::byte const** data_ptr, std::size_t& index, std::size_t& length);
+    bool window_release(std::size_t index);
+    std::size_t window_borrow_run(std::byte const** data_ptr, std::size_t& index, std::size_t max_n,
+                                  std::uint64_t end);
+    std::size_t window_take(std::byte* out, std::size_t max_n, std::size_t* lengths, std::uint64_t end);
+    void window_release_batch(std::size_t index, std::size_t count);
+
+    // Stats hooks, no-ops unless the queue maintains counters. count_pushes() also tracks max_depth.
+    void count_pushes(std::uint64_t pushed, std::uint64_t dropped);
+    void count_eviction();
+    void count_pops(std::uint64_t popped);
+    std::atomic<std::uint64_t>* producer_wait_counter() const;
+    std::atomic<std::uint64_t>* consumer_wait_counter() const;
+    static QueueStats snapshot_stats(const ControlBlock* cb);
+
+    // Latency hooks, no-ops unless the queue records latencies. stamp_slots() timestamps count slots from
+    // position pos before they are published; record_residency() measures count slots from index.
+    void stamp_slots(std::uint64_t pos, std::size_t count);
+    void record_residency(std::size_t index, std::size_t count);
+
+    // Liveness tracking and crash recovery
+    void register_participant();
+    void reap_participants();
+    ParticipantSlot* get_participant(std::size_t index) const;
+    void mark_role(std::uint32_t role);
+    bool consumer_alive() const;
+    bool others_alive() const;
+    void recover();
+    void restart();
+    void repair_locked();
+    void rewind_window();
+    void compact_ring();
+    std::uint64_t messages_between(std::uint64_t from, std::uint64_t to) const;
+
+    // Thread placement: the NUMA node holding most of the data buffer (-1 if unknown), and the CPU
+    // place_thread() picks when none is given
+    int memory_node() const;
+    int choose_cpu() const;
+
+    // Online growth. follow_successor() moves this handle to the next generation; consumers only call it
+    // through consumer_switch(), once drained() says the sealed ring holds nothing more for them.
+    static std::string generation_name(const std::string& name, std::uint32_t generation);
+    static const ControlBlock* map_control_block(const std::string& segment_name, std::size_t& size);
+    static const ControlBlock* map_newest(const std::string& name, std::size_t& size);
+    void follow_successor();
+    void adopt(SMQueue&& next);
+    bool drained() const;
+    bool consumer_switch();
+
+    // Wake consumers parked in pop() (lock-free modes) and notify_fd() watchers after a message was
+    // published
+    void wake_consumers();
+
+    // Locked reserve. locked_claim() makes room at head; the caller holds the mutex.
+    std::byte* locked_reserve();
+    std::byte* locked_claim(std::uint64_t head);
+
+    // Lock-free SPSC implementations
+    std::byte* spsc_reserve();
+    bool spsc_try_pop(std::byte* buffer, std::size_t& length);
+    bool spsc_borrow(std::byte const** data_ptr, std::size_t& index, std::size_t& length);
+
+    // Lock-free MPMC implementations
+    std::byte* mpmc_reserve();
+    bool mpmc_try_pop(std::byte* buffer);
+    bool mpmc_borrow(std::byte const** data_ptr, std::size_t& index, std::uint64_t& pos);
+    bool mpmc_commit_pop(std::size_t index);
+    void mpmc_release(std::uint64_t pos);
+    std::size_t mpmc_claim(std::atomic<std::uint64_t>& cursor, std::uint64_t offset, std::size_t max_n,
+                           bool contiguous, std::uint64_t& pos_out);
+    std::size_t mpmc_push_batch(const std::byte* const* msgs, std::size_t n);
+    std::size_t mpmc_pop_batch(std::byte* out, std::size_t max_n, std::size_t* lengths);
+
+    // Broadcast implementations
+    std::byte* broadcast_claim(std::uint64_t pos);
+    bool broadcast_try_pop(std::byte* buffer);
+    void register_reader(bool oldest);
+    ReaderSlot* get_reader(std::size_t index) const;
+
     // Get control block
     ControlBlock* get_control_block() const;
 
+    // Get slot metadata at index
+    SlotHeader* get_slot(std::size_t index) const;
+
     // Get data buffer
     std::byte* get_data_buffer() const;
 
     // Get element at index
     std::byte* get_element(std::size_t index) const;
 
+    // Base of a queue's semaphore names: the name without its leading slash, at most 24 characters
+    static std::string sem_base_name(const std::string& name);
+
     // Create semaphore name
     static std::string make_sem_name(const std::string& name, const std::string& suffix);
 
@@ -128,8 +828,39 @@ class SMQueue {
     std::string m_name; // Queue name
     void* m_addr;       // Mapped memory address
     std::size_t m_size; // Memory size
-    sem_t* m_mutex;     // Mutex semaphore
+    sem_t* m_mutex;     // Mutex semaphore (nullptr for robust queues)
     sem_t* m_items;     // Items semaphore
+    bool m_named;       // Whether m_mutex and m_items came from sem_open
+    QueueMode m_mode;   // Cached copy of the control block mode
+    WaitStrategy m_wait; // How blocking calls wait
+    CopyStrategy m_copy; // How payloads are copied
+    bool m_variable;     // Whether the queue stores variable-size records
+    bool m_stats;        // Whether the queue maintains counters
+    bool m_robust;       // Whether the queue mutex is the robust mutex in the control block
+    std::int32_t m_pid;  // Process id, recorded in the segment as owner of this handle's entries
+    std::uint32_t m_roles; // Roles already recorded in m_participant
+    std::uint32_t m_generation; // Generation of the mapped segment
+    std::size_t m_borrowed;     // Messages this handle has borrowed and not yet released
+    std::vector<std::uint64_t> m_mpmc_borrows; // MPMC: positions of those messages, oldest first
+    bool m_grown;               // Set when a consumer switch grew the element size
+    bool m_block;               // Whether the queue's overflow policy is Block
+    bool m_evict;               // Whether the push in progress may drop the oldest message (not try_push)
+    ParticipantSlot* m_participant; // This handle's participant entry
+    ReaderSlot* m_reader; // Broadcast mode: this handle's reader entry (nullptr for the writer)
+    detail::LatencyHistogram* m_histogram; // Latency histogram in the segment, nullptr if the queue has none
+    std::unique_ptr<detail::Notifier> m_notifier; // Watcher behind notify_fd(), started on demand
+    std::unique_ptr<detail::Flusher> m_flusher;   // Periodic writeback, started by the first push
+
+    // SPSC mode: each side caches the last seen value of the other side's cursor so the shared
+    // cache line is only read when the ring looks full (producer) or empty (consumer)
+    std::uint64_t m_cached_head; // Consumer's view of head
+    std::uint64_t m_cached_tail; // Producer's view of tail
+
+    // Pending reserve()/publish() on this handle
+    bool m_reserved;               // Whether a reservation is pending
+    bool m_reserve_dropped;        // Whether making room dropped a message
+    std::uint64_t m_reserve_pos;   // Reserved position (slot position or record byte position)
+    std::size_t m_reserve_length;  // Reserved message length
 };
 
 } // namespace shmem
\ No newline at end of file
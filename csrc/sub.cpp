@@ -1,13 +1,14 @@
 #include <signal.h>
 
+#include <cctype>
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
 #include <sstream>
 #include <string>
-#include <thread>
 #include <vector>
 
 #include "shmem.h"
@@ -47,14 +48,33 @@ bool parse_header(const char* header, int& msg_num, long long& timestamp) {
     return true;
 }
 
-int main() {
+// Parse --pin [CPU] and --realtime PRIORITY into a thread placement
+shmem::ThreadPlacement parse_placement(int argc, char* argv[]) {
+    shmem::ThreadPlacement placement;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--pin") == 0) {
+            placement.pin = true;
+            if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                placement.cpu = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--realtime") == 0 && i + 1 < argc) {
+            placement.realtime = true;
+            placement.priority = atoi(argv[++i]);
+        }
+    }
+    return placement;
+}
+
+int main(int argc, char* argv[]) {
     // Set up signal handling for clean shutdown
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
     try {
-        // Open existing queue
-        auto queue = shmem::SMQueue::open(queue_name);
+        // Open existing queue, pinned next to the publisher with --pin
+        shmem::OpenOptions open_options;
+        open_options.placement = parse_placement(argc, argv);
+        auto queue = shmem::SMQueue::open(queue_name, open_options);
         std::cout << "Subscriber started. Press Ctrl+C to stop." << std::endl;
         std::cout << "Element size: " << queue.element_size() << " bytes, Max elements: " << queue.max_elements()
                   << std::endl;
@@ -78,8 +98,8 @@ int main() {
         using clock = std::chrono::steady_clock;
 
         while (running) {
-            // Try to pop a message (non-blocking)
-            if (queue.try_pop(buffer.data())) {
+            // Wait for a message, waking up periodically to notice a shutdown request
+            if (queue.pop_for(buffer.data(), std::chrono::milliseconds(100))) {
                 // Get current time for latency calculation - immediately after receiving
                 auto now = clock::now();
                 auto receive_time =
@@ -128,9 +148,14 @@ int main() {
                           << std::endl;
                 std::cout << "  Running average: " << std::fixed << std::setprecision(3) << running_avg << " ms (over "
                           << message_count << " messages)" << std::endl;
-            } else {
-                // Queue is empty, wait a bit before trying again - use a shorter sleep time
-                std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+                // The average hides the tail; the queue's residency histogram shows it
+                const shmem::LatencyStats latency = message_count % 100 == 0 ? queue.latency() : shmem::LatencyStats();
+                if (latency.enabled) {
+                    std::cout << "  Queue residency p50/p99/p99.9: " << std::fixed << std::setprecision(3)
+                              << latency.p50_ns / 1e6 << " / " << latency.p99_ns / 1e6 << " / "
+                              << latency.p999_ns / 1e6 << " ms" << std::endl;
+                }
             }
         }
 
@@ -0,0 +1,703 @@
+#include "tap.h"
+
+#include <dirent.h>   // for opendir, readdir
+#include <fcntl.h>    // for O_DIRECT
+#include <sys/stat.h> // for mkdir
+#include <unistd.h>   // for pwrite, ftruncate
+
+#include <algorithm>          // for std::min, std::sort
+#include <condition_variable> // for std::condition_variable
+#include <cstdlib>            // for std::aligned_alloc, std::free
+#include <cstring>            // for std::memcpy, std::memset
+#include <limits>             // for std::numeric_limits
+#include <mutex>              // for std::mutex
+#include <new>                // for std::bad_alloc
+#include <stdexcept>          // for std::runtime_error
+#include <thread>             // for std::thread, std::this_thread::sleep_until
+
+#include "histogram.h"
+
+namespace shmem {
+
+namespace {
+
+// Segment files are written in whole blocks, the unit O_DIRECT requires
+constexpr std::size_t kBlockSize = 4096;
+
+constexpr char kSegmentMagic[8] = {'S', 'H', 'M', 'T', 'A', 'P', '1', '\0'};
+
+// Start of every segment file
+struct SegmentHeader {
+    char magic[8];       // kSegmentMagic
+    std::uint64_t index; // Position of the segment in the recording
+    std::uint64_t reserved[6];
+};
+
+// Prefix of every recorded message; payloads are padded to 8 bytes. A header without kEntryValid (the
+// zero padding of the last block) ends the segment.
+struct EntryHeader {
+    std::uint64_t stamp_ns; // Capture time, steady_clock
+    std::uint32_t length;   // Payload length
+    std::uint32_t flags;    // kEntryValid
+};
+
+constexpr std::uint32_t kEntryValid = 1;
+
+// Messages copied per poll() at most, so a busy queue still lets run() check for a stop
+constexpr std::size_t kPollBatch = 4096;
+
+std::size_t round_up(std::size_t value, std::size_t unit) { return (value + unit - 1) / unit * unit; }
+
+// Path of the segment file at index
+std::string segment_path(const std::string& directory, std::uint64_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%06llu.tap", static_cast<unsigned long long>(index));
+    return directory + name;
+}
+
+// Write all of data at offset. Returns 0 or an errno value.
+int write_all(int fd, const std::byte* data, std::size_t length, std::uint64_t offset) {
+    while (length > 0) {
+        const ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        data += written;
+        length -= static_cast<std::size_t>(written);
+        offset += static_cast<std::uint64_t>(written);
+    }
+    return 0;
+}
+
+} // namespace
+
+namespace detail {
+
+// Block-aligned buffer of recorded messages
+struct LogBuffer {
+    std::byte* data = nullptr;
+    std::size_t capacity = 0; // A whole number of blocks
+    std::size_t used = 0;
+
+    LogBuffer() = default;
+    LogBuffer(const LogBuffer&) = delete;
+    LogBuffer& operator=(const LogBuffer&) = delete;
+    ~LogBuffer() { std::free(data); }
+
+    // Make room for size bytes, keeping the used ones
+    void reserve(std::size_t size) {
+        if (size <= capacity) {
+            return;
+        }
+        const std::size_t grown = round_up(size, kBlockSize);
+        auto* bigger = static_cast<std::byte*>(std::aligned_alloc(kBlockSize, grown));
+        if (bigger == nullptr) {
+            throw std::bad_alloc();
+        }
+        if (used != 0) {
+            std::memcpy(bigger, data, used);
+        }
+        std::free(data);
+        data = bigger;
+        capacity = grown;
+    }
+};
+
+/*
+ * Segmented log behind TapRecorder. The recording thread appends to one buffer; once it fills up, its
+ * whole blocks go to the writer thread and the partial block at the end moves to the front of the other
+ * buffer. The recording thread only waits if the disk falls a whole buffer behind.
+ */
+class LogWriter {
+  public:
+    LogWriter(const std::string& directory, const RecorderOptions& options);
+    ~LogWriter();
+
+    LogWriter(const LogWriter&) = delete;
+    LogWriter& operator=(const LogWriter&) = delete;
+
+    void append(std::uint64_t stamp_ns, const std::byte* data, std::size_t length);
+
+    // Hand the whole blocks gathered so far to the writer thread
+    void flush();
+
+    // Write everything out, close the last segment and stop the writer thread
+    void finish();
+
+    // Segment files started
+    std::uint64_t segments() const { return m_index + 1; }
+
+  private:
+    // One write of the writer thread. A segment's last write also truncates the file to its real size
+    // (dropping the padding of the last block) and closes it.
+    struct Job {
+        LogBuffer* buffer = nullptr; // nullptr while no job is pending
+        int fd = -1;
+        std::uint64_t offset = 0;
+        std::size_t length = 0; // A whole number of blocks
+        bool last = false;
+        std::uint64_t size = 0; // Size of the finished segment, for the last write
+    };
+
+    void open_segment();
+    void submit(bool last);
+    void stop_thread();
+    void run();
+
+    std::string m_directory;
+    RecorderOptions m_options;
+    LogBuffer m_buffers[2];
+    LogBuffer* m_fill;            // Buffer being appended to
+    int m_fd;                     // Current segment file
+    std::uint64_t m_index;        // Current segment
+    std::uint64_t m_offset;       // File offset of m_fill's first byte
+    std::uint64_t m_segment_size; // Bytes of the current segment, buffered ones included
+    bool m_finished;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake; // A job was handed over, or finished
+    Job m_job;
+    bool m_stop;
+    int m_error; // errno of a failed write, reported to the recording thread
+    std::thread m_thread;
+};
+
+LogWriter::LogWriter(const std::string& directory, const RecorderOptions& options)
+    : m_directory(directory), m_options(options), m_fill(&m_buffers[0]), m_fd(-1), m_index(0), m_offset(0),
+      m_segment_size(0), m_finished(false), m_stop(false), m_error(0) {
+    if (options.buffer_bytes == 0) {
+        throw std::runtime_error("Tap buffers must not be empty");
+    }
+    m_buffers[0].reserve(options.buffer_bytes);
+    m_buffers[1].reserve(options.buffer_bytes);
+
+    if (::mkdir(directory.c_str(), 0755) != 0 and errno != EEXIST) {
+        throw std::runtime_error("Failed to create tap directory: " + directory + " (errno: " + std::to_string(errno) +
+                                 ")");
+    }
+    open_segment();
+    m_thread = std::thread([this] { run(); });
+}
+
+LogWriter::~LogWriter() {
+    try {
+        finish();
+    } catch (const std::exception&) {
+    }
+}
+
+// Create the segment file at m_index and start it with its header
+void LogWriter::open_segment() {
+    const std::string path = segment_path(m_directory, m_index);
+    const int flags = O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC;
+    int fd = -1;
+#ifdef O_DIRECT
+    if (m_options.direct) {
+        fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    }
+    // Filesystems such as tmpfs refuse O_DIRECT, so those go through the page cache
+    if (fd < 0 and (!m_options.direct or errno == EINVAL)) {
+        fd = ::open(path.c_str(), flags, 0644);
+    }
+#else
+    fd = ::open(path.c_str(), flags, 0644);
+#endif
+    if (fd < 0 and errno == EEXIST) {
+        throw std::runtime_error("Directory already holds a tap recording: " + m_directory);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create tap segment: " + path + " (errno: " + std::to_string(errno) + ")");
+    }
+
+    SegmentHeader header = {};
+    std::memcpy(header.magic, kSegmentMagic, sizeof(header.magic));
+    header.index = m_index;
+    std::memcpy(m_fill->data + m_fill->used, &header, sizeof(header));
+    m_fill->used += sizeof(header);
+
+    m_fd = fd;
+    m_offset = 0;
+    m_segment_size = sizeof(header);
+}
+
+void LogWriter::append(std::uint64_t stamp_ns, const std::byte* data, std::size_t length) {
+    if (length > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("Tap recordings are limited to 4GB messages");
+    }
+    const std::size_t size = sizeof(EntryHeader) + round_up(length, 8);
+
+    if (m_segment_size + size > m_options.segment_bytes and m_segment_size > sizeof(SegmentHeader)) {
+        submit(true);
+        m_index++;
+        open_segment();
+    }
+    if (m_fill->used + size > m_fill->capacity) {
+        submit(false);
+        // A message larger than the buffer gets a buffer of its own size
+        m_fill->reserve(m_fill->used + size);
+    }
+
+    const EntryHeader header = {stamp_ns, static_cast<std::uint32_t>(length), kEntryValid};
+    std::byte* dest = m_fill->data + m_fill->used;
+    std::memcpy(dest, &header, sizeof(header));
+    std::memcpy(dest + sizeof(header), data, length);
+    std::memset(dest + sizeof(header) + length, 0, size - sizeof(header) - length);
+    m_fill->used += size;
+    m_segment_size += size;
+}
+
+void LogWriter::flush() { submit(false); }
+
+// Hand m_fill to the writer thread once it is done with the other buffer. Only whole blocks are written
+// unless this is the segment's last write, whose final block is padded with zeros.
+void LogWriter::submit(bool last) {
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_wake.wait(guard, [this] { return m_job.buffer == nullptr; });
+    if (m_error != 0) {
+        throw std::runtime_error("Failed to write tap segment in: " + m_directory + " (errno: " +
+                                 std::to_string(m_error) + ")");
+    }
+
+    const std::size_t used = m_fill->used;
+    const std::size_t length = last ? round_up(used, kBlockSize) : used / kBlockSize * kBlockSize;
+    if (length == 0 and !last) {
+        return;
+    }
+    std::memset(m_fill->data + used, 0, length > used ? length - used : 0);
+
+    // The partial block at the end is written with the next job
+    LogBuffer* next = m_fill == &m_buffers[0] ? &m_buffers[1] : &m_buffers[0];
+    const std::size_t rest = used > length ? used - length : 0;
+    next->used = 0;
+    next->reserve(rest);
+    std::memcpy(next->data, m_fill->data + length, rest);
+    next->used = rest;
+
+    m_job.buffer = m_fill;
+    m_job.fd = m_fd;
+    m_job.offset = m_offset;
+    m_job.length = length;
+    m_job.last = last;
+    m_job.size = m_offset + used;
+    m_fill = next;
+    m_offset += length;
+    if (last) {
+        m_fd = -1;
+    }
+    guard.unlock();
+    m_wake.notify_all();
+}
+
+void LogWriter::finish() {
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    try {
+        submit(true);
+    } catch (const std::exception&) {
+        safe_close(m_fd);
+        stop_thread();
+        throw;
+    }
+    stop_thread();
+    if (m_error != 0) {
+        throw std::runtime_error("Failed to write tap segment in: " + m_directory + " (errno: " +
+                                 std::to_string(m_error) + ")");
+    }
+}
+
+// Let the writer thread finish the pending job and exit
+void LogWriter::stop_thread() {
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_wake.wait(guard, [this] { return m_job.buffer == nullptr; });
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+void LogWriter::run() {
+    std::unique_lock<std::mutex> guard(m_lock);
+    for (;;) {
+        m_wake.wait(guard, [this] { return m_job.buffer != nullptr or m_stop; });
+        if (m_job.buffer == nullptr) {
+            return;
+        }
+
+        const Job job = m_job;
+        guard.unlock();
+        int error = write_all(job.fd, job.buffer->data, job.length, job.offset);
+        if (job.last) {
+            if (error == 0 and ftruncate(job.fd, static_cast<off_t>(job.size)) != 0) {
+                error = errno;
+            }
+            safe_close(job.fd);
+        }
+        guard.lock();
+
+        if (error != 0 and m_error == 0) {
+            m_error = error;
+        }
+        m_job.buffer = nullptr;
+        m_wake.notify_all();
+    }
+}
+
+} // namespace detail
+
+// Open the queue and start at its newest message
+Tap::Tap(const std::string& name) : m_queue(SMQueue::open(name)), m_pos(0), m_missed(0) {
+    if (m_queue.m_mode != QueueMode::Broadcast) {
+        m_pos = m_queue.get_control_block()->head.load(std::memory_order_acquire) & ~SMQueue::kHeadSealed;
+    }
+}
+
+// Copy the next message, moving to the next generation once this one is sealed and fully seen
+bool Tap::next(std::vector<std::byte>& message) {
+    for (;;) {
+        bool found;
+        switch (m_queue.m_mode) {
+        case QueueMode::Broadcast:
+            // An ordinary reader, which follows grow() on its own
+            message.resize(m_queue.element_size());
+            return m_queue.try_pop(message.data());
+        case QueueMode::MPMC:
+            found = next_mpmc(message);
+            break;
+        default:
+            found = m_queue.m_variable ? next_record(message) : next_slot(message);
+            break;
+        }
+        if (found) {
+            return true;
+        }
+        if (!follow()) {
+            return false;
+        }
+    }
+}
+
+std::uint64_t Tap::missed() const {
+    return m_missed + (m_queue.m_mode == QueueMode::Broadcast ? m_queue.overruns() : 0);
+}
+
+// Locked and SPSC fixed-size rings. The producer only writes the slot of pos once head reached
+// pos + capacity and the consumers released pos, so a copy is intact if either was not the case after it.
+bool Tap::next_slot(std::vector<std::byte>& message) {
+    auto* cb = m_queue.get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
+    message.resize(cb->element_size);
+
+    for (;;) {
+        const std::uint64_t head = cb->head.load(std::memory_order_acquire);
+        if (m_pos == head) {
+            return false;
+        }
+        const std::uint64_t tail = cb->tail.load(std::memory_order_acquire);
+        if (head - m_pos >= capacity and tail > m_pos) {
+            // Lapped: resume at the oldest slot the producer cannot be writing
+            const std::uint64_t resume = std::min(head - capacity + 1, tail);
+            m_missed += resume - m_pos;
+            m_pos = resume;
+            continue;
+        }
+
+        std::memcpy(message.data(), m_queue.get_element(m_pos % capacity), cb->element_size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (cb->head.load(std::memory_order_relaxed) - m_pos < capacity or
+            cb->tail.load(std::memory_order_relaxed) <= m_pos) {
+            m_pos++;
+            return true;
+        }
+    }
+}
+
+// Locked and SPSC variable-size rings. The producer writes at most a padding record and a maximum-size
+// record past head, and never past tail + ring_bytes, so a copy is intact if neither reached it.
+bool Tap::next_record(std::vector<std::byte>& message) {
+    auto* cb = m_queue.get_control_block();
+    const std::uint64_t ring = cb->ring_bytes;
+    const std::uint64_t reach = 2 * SMQueue::record_size(cb->element_size);
+
+    const auto intact = [&](std::uint64_t pos) {
+        const std::uint64_t tail = cb->tail.load(std::memory_order_acquire);
+        const std::uint64_t head = cb->head.load(std::memory_order_acquire);
+        return std::min(tail + ring, head + reach) <= pos + ring;
+    };
+
+    for (;;) {
+        const std::uint64_t head = cb->head.load(std::memory_order_acquire);
+        if (m_pos == head) {
+            return false;
+        }
+        if (!intact(m_pos)) {
+            // Lapped: tail is the oldest record boundary still intact
+            m_missed++;
+            m_pos = cb->tail.load(std::memory_order_acquire);
+            continue;
+        }
+
+        std::uint64_t pos = m_pos;
+        SMQueue::RecordHeader header = *m_queue.record_at(pos);
+        if ((header.flags & SMQueue::kRecordPadding) != 0) {
+            pos += header.length;
+            header = *m_queue.record_at(pos);
+        }
+        const bool valid = (header.flags & SMQueue::kRecordPadding) == 0 and header.length <= cb->element_size and
+                           pos + SMQueue::record_size(header.length) <= head;
+        if (valid) {
+            message.resize(header.length);
+            std::memcpy(message.data(), m_queue.record_at(pos) + 1, header.length);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!intact(m_pos)) {
+            continue;
+        }
+        if (!valid) {
+            throw std::runtime_error("Corrupt record in queue: " + m_queue.name());
+        }
+        m_pos = pos + SMQueue::record_size(header.length);
+        return true;
+    }
+}
+
+// MPMC rings. A slot holds the message of pos from its publish (seq pos + 1) through its consumption
+// (pos + capacity) until the producer one lap later claims it through head, so a copy is intact if head
+// had not passed pos + capacity after it.
+bool Tap::next_mpmc(std::vector<std::byte>& message) {
+    auto* cb = m_queue.get_control_block();
+    const std::uint64_t capacity = cb->max_elements;
+    message.resize(cb->element_size);
+
+    for (;;) {
+        const std::uint64_t head = cb->head.load(std::memory_order_acquire) & ~SMQueue::kHeadSealed;
+        if (m_pos == head) {
+            return false;
+        }
+        if (head - m_pos > capacity) {
+            m_missed += head - capacity - m_pos;
+            m_pos = head - capacity;
+            continue;
+        }
+
+        const std::uint64_t seq = m_queue.get_slot(m_pos % capacity)->seq.load(std::memory_order_acquire);
+        if (seq == m_pos) {
+            return false; // Claimed but not yet published; later messages wait behind it
+        }
+        if (seq != m_pos + 1 and seq != m_pos + capacity) {
+            // A later lap took the slot already
+            m_missed++;
+            m_pos++;
+            continue;
+        }
+
+        std::memcpy(message.data(), m_queue.get_element(m_pos % capacity), cb->element_size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((cb->head.load(std::memory_order_relaxed) & ~SMQueue::kHeadSealed) - m_pos <= capacity) {
+            m_pos++;
+            return true;
+        }
+    }
+}
+
+// Move to the next generation once this one is sealed and the tap has copied everything published to it
+bool Tap::follow() {
+    const auto* cb = m_queue.get_control_block();
+    if (cb->sealed.load(std::memory_order_acquire) != SMQueue::kSealed) {
+        return false;
+    }
+    // MPMC producers may claim slots until head itself is sealed
+    const std::uint64_t head = cb->head.load(std::memory_order_acquire);
+    if ((m_queue.m_mode == QueueMode::MPMC and (head & SMQueue::kHeadSealed) == 0) or
+        m_pos != (head & ~SMQueue::kHeadSealed)) {
+        return false;
+    }
+    m_queue.follow_successor();
+    m_pos = 0;
+    return true;
+}
+
+TapRecorder::TapRecorder(const std::string& queue_name, const std::string& directory, const RecorderOptions& options)
+    : m_tap(queue_name), m_options(options), m_writer(std::make_unique<detail::LogWriter>(directory, options)),
+      m_last_flush(std::chrono::steady_clock::now()) {}
+
+TapRecorder::~TapRecorder() {
+    try {
+        close();
+    } catch (const std::exception&) {
+    }
+}
+
+void TapRecorder::run(const std::atomic<bool>& stop) {
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (poll() == 0) {
+            std::this_thread::sleep_for(m_options.poll_interval);
+        }
+    }
+    close();
+}
+
+std::size_t TapRecorder::poll() {
+    if (!m_writer) {
+        throw std::runtime_error("TapRecorder is closed");
+    }
+
+    std::size_t count = 0;
+    while (count < kPollBatch and m_tap.next(m_message)) {
+        m_writer->append(detail::now_ns(), m_message.data(), m_message.size());
+        m_stats.bytes += m_message.size();
+        count++;
+    }
+    m_stats.messages += count;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_last_flush >= m_options.flush_interval) {
+        m_writer->flush();
+        m_last_flush = now;
+    }
+    return count;
+}
+
+void TapRecorder::close() {
+    if (m_writer) {
+        m_stats.segments = m_writer->segments();
+        const std::unique_ptr<detail::LogWriter> writer = std::move(m_writer);
+        writer->finish();
+    }
+}
+
+RecorderStats TapRecorder::stats() const {
+    RecorderStats stats = m_stats;
+    stats.missed = m_tap.missed();
+    if (m_writer) {
+        stats.segments = m_writer->segments();
+    }
+    return stats;
+}
+
+// Collect the segment files of a recording in order
+TapReader::TapReader(const std::string& directory) : m_index(0), m_file(nullptr) {
+    DIR* handle = opendir(directory.c_str());
+    if (handle == nullptr) {
+        throw std::runtime_error("Failed to open tap directory: " + directory);
+    }
+    while (const dirent* entry = readdir(handle)) {
+        const std::string file = entry->d_name;
+        if (file.size() == 10 and file.compare(6, 4, ".tap") == 0 and
+            file.find_first_not_of("0123456789") == 6) {
+            m_segments.push_back(directory + "/" + file);
+        }
+    }
+    closedir(handle);
+
+    if (m_segments.empty()) {
+        throw std::runtime_error("No tap recording in: " + directory);
+    }
+    std::sort(m_segments.begin(), m_segments.end());
+}
+
+TapReader::~TapReader() {
+    if (m_file != nullptr) {
+        std::fclose(m_file);
+    }
+}
+
+// Open the next segment. A segment cut short before its header was written holds nothing.
+bool TapReader::open_next() {
+    while (m_index < m_segments.size()) {
+        const std::string& path = m_segments[m_index++];
+        m_file = std::fopen(path.c_str(), "rb");
+        if (m_file == nullptr) {
+            throw std::runtime_error("Failed to open tap segment: " + path);
+        }
+
+        SegmentHeader header;
+        if (std::fread(&header, sizeof(header), 1, m_file) == 1) {
+            if (std::memcmp(header.magic, kSegmentMagic, sizeof(header.magic)) != 0) {
+                std::fclose(m_file);
+                m_file = nullptr;
+                throw std::runtime_error("Not a tap segment: " + path);
+            }
+            return true;
+        }
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+    return false;
+}
+
+bool TapReader::next(std::vector<std::byte>& message, std::uint64_t& stamp_ns) {
+    for (;;) {
+        if (m_file == nullptr and !open_next()) {
+            return false;
+        }
+
+        EntryHeader header;
+        if (std::fread(&header, sizeof(header), 1, m_file) == 1 and (header.flags & kEntryValid) != 0) {
+            message.resize(header.length);
+            const long padding = static_cast<long>(round_up(header.length, 8) - header.length);
+            if (std::fread(message.data(), 1, header.length, m_file) == header.length and
+                std::fseek(m_file, padding, SEEK_CUR) == 0) {
+                stamp_ns = header.stamp_ns;
+                return true;
+            }
+        }
+
+        // The end of the segment, or a last message cut short by a crash of the recorder
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+// Push a recording back into a queue at its recorded pace, scaled by speed
+ReplayStats replay(const std::string& directory, SMQueue& queue, double speed, const std::atomic<bool>* stop) {
+    TapReader reader(directory);
+    std::vector<std::byte> message;
+    std::uint64_t stamp = 0;
+    std::uint64_t first = 0;
+    ReplayStats stats;
+    const bool blocks = queue.overflow() == OverflowPolicy::Block;
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto stopped = [stop] { return stop != nullptr and stop->load(std::memory_order_relaxed); };
+    while (!stopped() and reader.next(message, stamp)) {
+        if (stats.messages == 0) {
+            first = stamp;
+        }
+        if (speed > 0) {
+            // Sleep in slices so a long pause in the recording does not hold up a stop
+            const auto due = start + std::chrono::nanoseconds(static_cast<std::int64_t>((stamp - first) / speed));
+            for (auto now = std::chrono::steady_clock::now(); now < due; now = std::chrono::steady_clock::now()) {
+                if (stopped()) {
+                    return stats;
+                }
+                std::this_thread::sleep_until(std::min(due, now + std::chrono::milliseconds(100)));
+            }
+        }
+
+        if (!queue.variable_size() and message.size() != queue.element_size()) {
+            throw std::runtime_error("Recorded message of " + std::to_string(message.size()) +
+                                     " bytes does not match the element size of queue: " + queue.name());
+        }
+        // Block queues wait for room, in slices for the same reason; the others report a drop instead
+        bool queued = queue.push_for(message.data(), message.size(), std::chrono::milliseconds(100));
+        while (!queued and blocks) {
+            if (stopped()) {
+                return stats;
+            }
+            queued = queue.push_for(message.data(), message.size(), std::chrono::milliseconds(100));
+        }
+        stats.messages++;
+        if (!queued) {
+            stats.dropped++;
+        }
+    }
+    return stats;
+}
+
+} // namespace shmem
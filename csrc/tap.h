@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>  // for std::atomic
+#include <chrono>  // for std::chrono::microseconds
+#include <cstddef> // for std::size_t
+#include <cstdint> // for std::uint64_t
+#include <cstdio>  // for std::FILE
+#include <memory>  // for std::unique_ptr
+#include <string>  // for std::string
+#include <vector>  // for std::vector
+
+#include "shmem.h"
+
+namespace shmem {
+
+namespace detail {
+class LogWriter; // tap.cpp
+} // namespace detail
+
+/*
+ * Watches the traffic of a queue without taking part in it. A Broadcast tap is an ordinary reader. On the
+ * other modes the tap keeps a cursor of its own and copies each message out of the ring, validating the
+ * copy against the producers' position the way Broadcast readers do, so consumers still receive every
+ * message and producers never wait for the tap. A tap that falls a whole ring behind skips what was
+ * overwritten and counts it in missed().
+ */
+class Tap {
+  public:
+    // Open the queue and start at its newest message
+    explicit Tap(const std::string& name);
+
+    // Copy the next message into message, resized to its length. Returns false if there is none yet.
+    bool next(std::vector<std::byte>& message);
+
+    // Messages overwritten before the tap could copy them. Variable-size rings cannot tell how many
+    // records were lost, so each gap counts as one.
+    std::uint64_t missed() const;
+
+    // The tap's own handle on the queue
+    const SMQueue& queue() const { return m_queue; }
+
+  private:
+    bool next_slot(std::vector<std::byte>& message);
+    bool next_record(std::vector<std::byte>& message);
+    bool next_mpmc(std::vector<std::byte>& message);
+    bool follow();
+
+    SMQueue m_queue;
+    std::uint64_t m_pos;    // Next position to copy (slot position, or record byte position)
+    std::uint64_t m_missed; // Not counting Broadcast overruns, which the queue counts itself
+};
+
+// Options accepted by TapRecorder
+struct RecorderOptions {
+    std::uint64_t segment_bytes = std::uint64_t(1) << 30; // Start a new segment file past this size
+    std::size_t buffer_bytes = std::size_t(8) << 20;      // Size of each of the two write buffers
+    bool direct = true; // Write with O_DIRECT where the filesystem supports it, bypassing the page cache
+    std::chrono::microseconds poll_interval{100};  // Sleep between polls of an idle queue
+    std::chrono::milliseconds flush_interval{500}; // Hand buffered messages to the disk at least this often
+};
+
+// What a TapRecorder has written so far
+struct RecorderStats {
+    std::uint64_t messages = 0; // Messages recorded
+    std::uint64_t bytes = 0;    // Payload bytes recorded
+    std::uint64_t missed = 0;   // Messages the tap could not copy in time (see Tap::missed)
+    std::uint64_t segments = 0; // Segment files started
+};
+
+/*
+ * Records the traffic of a queue into a directory of segment files (000000.tap, 000001.tap, ...). Each
+ * message is stored with the steady_clock time it was captured at. Messages are gathered in one buffer
+ * while a writer thread writes the other, in whole blocks, so the disk never holds up the tap.
+ */
+class TapRecorder {
+  public:
+    // directory is created if needed and must not hold a recording already
+    TapRecorder(const std::string& queue_name, const std::string& directory,
+                const RecorderOptions& options = RecorderOptions());
+    ~TapRecorder();
+
+    TapRecorder(const TapRecorder&) = delete;
+    TapRecorder& operator=(const TapRecorder&) = delete;
+
+    // Record until stop becomes true, then finish the log
+    void run(const std::atomic<bool>& stop);
+
+    // Record the messages available now without waiting. Returns the number recorded.
+    std::size_t poll();
+
+    // Write out everything recorded and close the log; the recorder cannot be used afterwards
+    void close();
+
+    RecorderStats stats() const;
+
+  private:
+    Tap m_tap;
+    RecorderOptions m_options;
+    std::unique_ptr<detail::LogWriter> m_writer;
+    std::vector<std::byte> m_message;
+    RecorderStats m_stats;
+    std::chrono::steady_clock::time_point m_last_flush;
+};
+
+// Reads back the messages of a recording, in order, across its segment files
+class TapReader {
+  public:
+    explicit TapReader(const std::string& directory);
+    ~TapReader();
+
+    TapReader(const TapReader&) = delete;
+    TapReader& operator=(const TapReader&) = delete;
+
+    // Read the next message and its capture time. Returns false at the end of the recording.
+    bool next(std::vector<std::byte>& message, std::uint64_t& stamp_ns);
+
+  private:
+    bool open_next();
+
+    std::vector<std::string> m_segments;
+    std::size_t m_index;
+    std::FILE* m_file;
+};
+
+// What a replay has pushed
+struct ReplayStats {
+    std::uint64_t messages = 0; // Messages of the recording offered to the queue
+    std::uint64_t dropped = 0;  // Pushes the queue reported a drop for (see SMQueue::push)
+};
+
+// Push every message of a recording into queue. speed scales the recorded pace (2 replays twice as fast);
+// 0 pushes as fast as the queue takes them. Block queues are waited on, so nothing is dropped; other queues
+// drop messages by their overflow policy when the consumers fall behind. Stops early once *stop becomes true.
+ReplayStats replay(const std::string& directory, SMQueue& queue, double speed = 1.0,
+                     const std::atomic<bool>* stop = nullptr);
+
+} // namespace shmem
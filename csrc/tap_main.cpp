@@ -0,0 +1,155 @@
+// shmem_tap: record the traffic of a queue to a directory of segment files without consuming it, and
+// push a recording back into a queue at its recorded pace or faster.
+
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "tap.h"
+
+namespace {
+
+std::atomic<bool> g_stop(false);
+
+void handle_signal(int) { g_stop.store(true); }
+
+void usage() {
+    std::cerr << "Usage: shmem_tap record QUEUE DIRECTORY [options]\n"
+                 "       shmem_tap replay DIRECTORY QUEUE [options]\n"
+                 "Record options:\n"
+                 "  --segment-bytes N   Start a new segment file past this size, e.g. 256M (default 1G)\n"
+                 "  --buffer-bytes N    Size of each of the two write buffers (default 8M)\n"
+                 "  --buffered          Write through the page cache instead of O_DIRECT\n"
+                 "  --duration SECONDS  Stop after this long (default: until interrupted)\n"
+                 "Replay options:\n"
+                 "  --speed X           Pace relative to the recording; 0 pushes flat out (default 1)\n";
+}
+
+// Parse a byte count with an optional K, M or G suffix
+std::uint64_t parse_bytes(const std::string& text) {
+    char* end = nullptr;
+    std::uint64_t value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        throw std::runtime_error("Invalid number: " + text);
+    }
+    switch (*end) {
+    case 'K':
+    case 'k':
+        value <<= 10;
+        break;
+    case 'M':
+    case 'm':
+        value <<= 20;
+        break;
+    case 'G':
+    case 'g':
+        value <<= 30;
+        break;
+    case '\0':
+        break;
+    default:
+        throw std::runtime_error("Invalid number: " + text);
+    }
+    return value;
+}
+
+int record(const std::string& queue, const std::string& directory, int argc, char* argv[]) {
+    shmem::RecorderOptions options;
+    double duration = 0;
+    for (int i = 0; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--buffered") {
+            options.direct = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + arg);
+        }
+        const std::string value = argv[++i];
+        if (arg == "--segment-bytes") {
+            options.segment_bytes = parse_bytes(value);
+        } else if (arg == "--buffer-bytes") {
+            options.buffer_bytes = static_cast<std::size_t>(parse_bytes(value));
+        } else if (arg == "--duration") {
+            duration = std::stod(value);
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+
+    shmem::TapRecorder recorder(queue, directory, options);
+    std::thread timer;
+    if (duration > 0) {
+        timer = std::thread([duration] {
+            const auto due = std::chrono::steady_clock::now() + std::chrono::duration<double>(duration);
+            while (!g_stop.load() and std::chrono::steady_clock::now() < due) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            g_stop.store(true);
+        });
+    }
+    recorder.run(g_stop);
+    if (timer.joinable()) {
+        timer.join();
+    }
+
+    const shmem::RecorderStats stats = recorder.stats();
+    std::cerr << "Recorded " << stats.messages << " messages (" << stats.bytes << " bytes) in " << stats.segments
+              << " segments; missed " << stats.missed << std::endl;
+    return 0;
+}
+
+int replay(const std::string& directory, const std::string& queue_name, int argc, char* argv[]) {
+    double speed = 1.0;
+    for (int i = 0; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + arg);
+        }
+        const std::string value = argv[++i];
+        if (arg == "--speed") {
+            speed = std::stod(value);
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+
+    shmem::SMQueue queue = shmem::SMQueue::open(queue_name);
+    const auto start = std::chrono::steady_clock::now();
+    const shmem::ReplayStats stats = shmem::replay(directory, queue, speed, &g_stop);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "Replayed " << stats.messages << " messages in " << elapsed.count() << " s; dropped "
+              << stats.dropped << std::endl;
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        usage();
+        return argc > 1 and (std::string(argv[1]) == "--help" or std::string(argv[1]) == "-h") ? 0 : 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    try {
+        const std::string command = argv[1];
+        if (command == "record") {
+            return record(argv[2], argv[3], argc - 4, argv + 4);
+        }
+        if (command == "replay") {
+            return replay(argv[2], argv[3], argc - 4, argv + 4);
+        }
+        usage();
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
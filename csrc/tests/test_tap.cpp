@@ -0,0 +1,150 @@
+// Tap tests: traffic recorded from a queue replays into another queue byte for byte and in order, and the
+// replay reports the messages the target queue dropped.
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tap.h"
+
+namespace {
+
+constexpr std::size_t kMessages = 100;
+constexpr std::size_t kMaxLength = 32;
+
+const std::string kSource = "/test_tap_source_" + std::to_string(getpid());
+const std::string kTarget = "/test_tap_target_" + std::to_string(getpid());
+const std::string kDirectory = "/tmp/test_tap_" + std::to_string(getpid());
+int g_failures = 0;
+
+#define CHECK(condition)                                                                                               \
+    do {                                                                                                               \
+        if (!(condition)) {                                                                                            \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                         \
+            g_failures++;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// Message i: variable-size queues get lengths from 1 to kMaxLength, fixed-size ones always kMaxLength
+std::vector<std::byte> message(std::size_t i, bool variable_size) {
+    std::vector<std::byte> bytes(variable_size ? 1 + i % kMaxLength : kMaxLength);
+    for (std::size_t k = 0; k < bytes.size(); ++k) {
+        bytes[k] = static_cast<std::byte>(i * 7 + k);
+    }
+    return bytes;
+}
+
+shmem::SMQueue make_queue(const std::string& name, std::size_t max_elements, bool variable_size,
+                          shmem::OverflowPolicy overflow) {
+    shmem::SMQueue::destroy(name);
+    shmem::QueueOptions options;
+    options.overflow = overflow;
+    options.variable_size = variable_size;
+    return shmem::SMQueue::create(name, max_elements, kMaxLength, options);
+}
+
+// Pop the next message of queue, resized to its length; empty if there is none
+std::vector<std::byte> pop(shmem::SMQueue& queue) {
+    std::vector<std::byte> bytes(kMaxLength);
+    std::size_t length = 0;
+    if (!queue.try_pop(bytes.data(), length)) {
+        return {};
+    }
+    bytes.resize(length);
+    return bytes;
+}
+
+// Record kMessages messages while a consumer takes each of them
+void record(bool variable_size) {
+    std::filesystem::remove_all(kDirectory);
+    shmem::SMQueue source = make_queue(kSource, 16, variable_size, shmem::OverflowPolicy::DropNewest);
+    shmem::TapRecorder recorder(kSource, kDirectory);
+    for (std::size_t i = 0; i < kMessages; ++i) {
+        const std::vector<std::byte> bytes = message(i, variable_size);
+        CHECK(source.push(bytes.data(), bytes.size()));
+        recorder.poll();
+        CHECK(pop(source) == bytes);
+    }
+    recorder.close();
+    CHECK(recorder.stats().messages == kMessages);
+    CHECK(recorder.stats().missed == 0);
+    source.close();
+    shmem::SMQueue::destroy(kSource);
+}
+
+// A queue with room for the whole recording receives all of it, unchanged and in order
+void test_round_trip(bool variable_size) {
+    record(variable_size);
+    shmem::SMQueue target = make_queue(kTarget, 2 * kMessages, variable_size, shmem::OverflowPolicy::DropNewest);
+    const shmem::ReplayStats stats = shmem::replay(kDirectory, target, 0);
+    CHECK(stats.messages == kMessages);
+    CHECK(stats.dropped == 0);
+    for (std::size_t i = 0; i < kMessages; ++i) {
+        CHECK(pop(target) == message(i, variable_size));
+    }
+    CHECK(pop(target).empty());
+    target.close();
+    shmem::SMQueue::destroy(kTarget);
+}
+
+// A full DropNewest queue refuses the rest of the recording, and the replay counts each refusal
+void test_drops_counted() {
+    record(false);
+    constexpr std::size_t kRoom = 8;
+    shmem::SMQueue target = make_queue(kTarget, kRoom, false, shmem::OverflowPolicy::DropNewest);
+    const shmem::ReplayStats stats = shmem::replay(kDirectory, target, 0);
+    CHECK(stats.messages == kMessages);
+    CHECK(stats.dropped == kMessages - kRoom);
+    for (std::size_t i = 0; i < kRoom; ++i) {
+        CHECK(pop(target) == message(i, false));
+    }
+    CHECK(pop(target).empty());
+    target.close();
+    shmem::SMQueue::destroy(kTarget);
+}
+
+// A Block queue holds the replay up until a consumer makes room, so nothing is dropped
+void test_block_waits() {
+    record(false);
+    shmem::SMQueue target = make_queue(kTarget, 4, false, shmem::OverflowPolicy::Block);
+    std::vector<std::vector<std::byte>> received;
+    std::thread consumer([&] {
+        shmem::SMQueue handle = shmem::SMQueue::open(kTarget);
+        std::vector<std::byte> bytes(kMaxLength);
+        while (received.size() < kMessages and handle.pop_for(bytes.data(), std::chrono::seconds(5))) {
+            received.push_back(bytes);
+        }
+    });
+    const shmem::ReplayStats stats = shmem::replay(kDirectory, target, 0);
+    consumer.join();
+    CHECK(stats.messages == kMessages);
+    CHECK(stats.dropped == 0);
+    CHECK(received.size() == kMessages);
+    for (std::size_t i = 0; i < received.size(); ++i) {
+        CHECK(received[i] == message(i, false));
+    }
+    target.close();
+    shmem::SMQueue::destroy(kTarget);
+}
+
+} // namespace
+
+int main() {
+    test_round_trip(false);
+    test_round_trip(true);
+    test_drops_counted();
+    test_block_waits();
+    std::filesystem::remove_all(kDirectory);
+
+    if (g_failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("All tap tests passed\n");
+    return 0;
+}
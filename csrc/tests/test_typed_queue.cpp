@@ -0,0 +1,164 @@
+// TypedQueue tests: the inline fast paths and the type-erased SMQueue calls share one queue, so values
+// pushed either way pop either way, and open() only accepts queues laid out for T and Capacity.
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "typed_queue.h"
+
+namespace {
+
+struct Point {
+    std::uint64_t sequence;
+    double x;
+    double y;
+};
+
+constexpr std::size_t kCapacity = 8;
+using PointQueue = shmem::TypedQueue<Point, kCapacity>;
+
+const std::string kName = "/test_typed_queue_" + std::to_string(getpid());
+int g_failures = 0;
+
+#define CHECK(condition)                                                                                               \
+    do {                                                                                                               \
+        if (!(condition)) {                                                                                            \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                         \
+            g_failures++;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+Point point(std::uint64_t sequence) { return Point{sequence, sequence * 0.5, sequence * -2.0}; }
+
+bool same(const Point& a, const Point& b) { return a.sequence == b.sequence and a.x == b.x and a.y == b.y; }
+
+bool push_plain(shmem::SMQueue& queue, const Point& value) {
+    return queue.try_push(reinterpret_cast<const std::byte*>(&value));
+}
+
+bool pop_plain(shmem::SMQueue& queue, Point& value) { return queue.try_pop(reinterpret_cast<std::byte*>(&value)); }
+
+// Values pushed by one handle pop from the other, over several laps of the ring and through full and
+// empty rings, where the typed calls leave the fast path
+void test_interop(shmem::QueueMode mode, bool typed_producer) {
+    shmem::SMQueue::destroy(kName);
+    shmem::QueueOptions options;
+    options.mode = mode;
+    options.overflow = shmem::OverflowPolicy::DropNewest;
+    PointQueue typed = PointQueue::create(kName, options);
+    shmem::SMQueue plain = shmem::SMQueue::open(kName);
+
+    const auto push = [&](const Point& value) {
+        return typed_producer ? typed.try_push(value) : push_plain(plain, value);
+    };
+    const auto pop = [&](Point& value) { return typed_producer ? pop_plain(plain, value) : typed.try_pop(value); };
+
+    std::uint64_t pushed = 0;
+    std::uint64_t popped = 0;
+    for (std::size_t lap = 0; lap < 5; ++lap) {
+        // Fill the ring, then take part of it, so that every lap starts at another slot
+        while (pushed - popped < 2 * kCapacity and push(point(pushed))) {
+            pushed++;
+        }
+        CHECK(pushed - popped == kCapacity);
+        if (typed_producer) {
+            CHECK(!typed.push(point(pushed)));
+        }
+
+        Point value{};
+        for (std::size_t i = 0; i < kCapacity / 2 + lap; ++i) {
+            CHECK(pop(value) and same(value, point(popped)));
+            popped++;
+        }
+    }
+
+    Point value{};
+    while (popped < pushed and pop(value)) {
+        CHECK(same(value, point(popped)));
+        popped++;
+    }
+    CHECK(popped == pushed);
+    CHECK(!pop(value));
+    if (!typed_producer) {
+        CHECK(!typed.pop_for(value, std::chrono::milliseconds(1)));
+    }
+
+    typed.close();
+    plain.close();
+    shmem::SMQueue::destroy(kName);
+}
+
+// A typed SPSC consumer that was idle while a plain handle consumed picks up where that one stopped
+void test_consumer_handoff() {
+    shmem::SMQueue::destroy(kName);
+    shmem::QueueOptions options;
+    options.mode = shmem::QueueMode::SPSC;
+    PointQueue typed = PointQueue::create(kName, options);
+    shmem::SMQueue plain = shmem::SMQueue::open(kName);
+
+    Point value{};
+    CHECK(typed.try_push(point(0)));
+    CHECK(typed.try_pop(value) and same(value, point(0)));
+
+    CHECK(typed.try_push(point(1)));
+    CHECK(typed.try_push(point(2)));
+    CHECK(pop_plain(plain, value) and same(value, point(1)));
+    CHECK(pop_plain(plain, value) and same(value, point(2)));
+    CHECK(!typed.try_pop(value));
+
+    CHECK(typed.try_push(point(3)));
+    CHECK(typed.try_pop(value) and same(value, point(3)));
+    CHECK(!pop_plain(plain, value));
+
+    typed.close();
+    plain.close();
+    shmem::SMQueue::destroy(kName);
+}
+
+// open() throws unless the queue holds kCapacity fixed-size elements of sizeof(Point) bytes
+void test_open_rejects_mismatch() {
+    const auto rejected = [](std::size_t max_elements, std::size_t element_size, bool variable_size) {
+        shmem::SMQueue::destroy(kName);
+        shmem::QueueOptions options;
+        options.mode = variable_size ? shmem::QueueMode::Locked : shmem::QueueMode::SPSC;
+        options.variable_size = variable_size;
+        shmem::SMQueue queue = shmem::SMQueue::create(kName, max_elements, element_size, options);
+        bool threw = false;
+        try {
+            PointQueue::open(kName);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        queue.close();
+        shmem::SMQueue::destroy(kName);
+        return threw;
+    };
+
+    CHECK(rejected(kCapacity * 2, sizeof(Point), false));
+    CHECK(rejected(kCapacity / 2, sizeof(Point), false));
+    CHECK(rejected(kCapacity, sizeof(Point) + 8, false));
+    CHECK(rejected(kCapacity, sizeof(Point), true));
+    CHECK(!rejected(kCapacity, sizeof(Point), false));
+}
+
+} // namespace
+
+int main() {
+    for (const shmem::QueueMode mode : {shmem::QueueMode::SPSC, shmem::QueueMode::MPMC, shmem::QueueMode::Locked}) {
+        test_interop(mode, true);
+        test_interop(mode, false);
+    }
+    test_consumer_handoff();
+    test_open_rejects_mismatch();
+
+    if (g_failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("All TypedQueue tests passed\n");
+    return 0;
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <atomic>      // for std::memory_order
+#include <chrono>      // for std::chrono::nanoseconds
+#include <cstddef>     // for std::size_t, std::byte
+#include <cstdint>     // for std::uint64_t
+#include <cstring>     // for memcpy
+#include <stdexcept>   // for std::runtime_error
+#include <string>      // for std::string
+#include <type_traits> // for std::is_trivially_copyable_v
+#include <utility>     // for std::move
+
+#include "shmem.h"
+
+namespace shmem {
+
+/*
+ * A fixed-size queue of T with Capacity slots, checked at compile time. The queue is an ordinary SMQueue
+ * (created with max_elements = Capacity and element_size = sizeof(T)), so type-erased handles and other
+ * languages can share it; open() checks the control block against T and Capacity.
+ *
+ * push and pop of SPSC and MPMC queues run inline: the slot address is a mask and a constant multiply
+ * away, and the handle is not re-validated on every access. Anything off the fast path (a full or empty
+ * ring, growth, Block waits, queues with stats or latency, Locked and Broadcast queues) goes through the
+ * SMQueue, so behaviour is the same either way.
+ */
+template <typename T, std::size_t Capacity> class TypedQueue {
+    static_assert(std::is_trivially_copyable_v<T>, "TypedQueue elements are copied as bytes");
+    static_assert(Capacity > 0 and (Capacity & (Capacity - 1)) == 0, "TypedQueue capacity must be a power of two");
+    static_assert(alignof(T) <= 64, "The data buffer is only aligned to a cache line");
+
+  public:
+    static constexpr std::size_t kCapacity = Capacity;
+    static constexpr std::uint64_t kMask = Capacity - 1;
+
+    // Create the queue. options.layout must be Packed so slots are sizeof(T) apart; variable_size is not
+    // available.
+    static TypedQueue create(const std::string& name, const QueueOptions& options = QueueOptions()) {
+        if (options.variable_size) {
+            throw std::runtime_error("TypedQueue cannot store variable-size records");
+        }
+        if (options.layout != SlotLayout::Packed) {
+            throw std::runtime_error("TypedQueue needs the Packed slot layout");
+        }
+        return TypedQueue(SMQueue::create(name, Capacity, sizeof(T), options));
+    }
+
+    // Open an existing queue, which must hold Capacity elements of sizeof(T) bytes in Packed slots
+    static TypedQueue open(const std::string& name, const OpenOptions& options = OpenOptions()) {
+        SMQueue queue = SMQueue::open(name, options);
+        const auto* cb = queue.get_control_block();
+        if (queue.variable_size()) {
+            throw std::runtime_error("Queue stores variable-size records: " + name);
+        }
+        if (cb->element_size != sizeof(T) or cb->slot_stride != sizeof(T)) {
+            throw std::runtime_error("Queue element size does not match the element type: " + name);
+        }
+        if (cb->max_elements != Capacity) {
+            throw std::runtime_error("Queue capacity does not match: " + name);
+        }
+        return TypedQueue(std::move(queue));
+    }
+
+    TypedQueue(TypedQueue&& other) noexcept : m_queue(std::move(other.m_queue)) {
+        sync();
+        other.m_fast = false;
+    }
+
+    TypedQueue& operator=(TypedQueue&& other) noexcept {
+        if (this != &other) {
+            m_queue = std::move(other.m_queue);
+            sync();
+            other.m_fast = false;
+        }
+        return *this;
+    }
+
+    // Push a value. Like SMQueue::push: on a full queue the overflow policy applies, and the result is
+    // false if a message was dropped.
+    bool push(const T& value) {
+        if (fast_push(value)) {
+            return true;
+        }
+        return slow([&] { return m_queue.push(bytes(value)); });
+    }
+
+    // Push a value only if there is room for it right now
+    bool try_push(const T& value) {
+        if (fast_push(value)) {
+            return true;
+        }
+        return slow([&] { return m_queue.try_push(bytes(value)); });
+    }
+
+    // Push a value, waiting at most timeout for room on Block queues
+    bool push_for(const T& value, std::chrono::nanoseconds timeout) {
+        if (fast_push(value)) {
+            return true;
+        }
+        return slow([&] { return m_queue.push_for(bytes(value), timeout); });
+    }
+
+    // Pop a value, waiting for one to arrive
+    bool pop(T& value) {
+        if (fast_pop(value)) {
+            return true;
+        }
+        return slow([&] { return m_queue.pop(bytes(value)); });
+    }
+
+    // Pop a value if one is ready (non-blocking)
+    bool try_pop(T& value) {
+        if (fast_pop(value)) {
+            return true;
+        }
+        return slow([&] { return m_queue.try_pop(bytes(value)); });
+    }
+
+    // Pop a value, waiting at most timeout for one to arrive
+    bool pop_for(T& value, std::chrono::nanoseconds timeout) {
+        if (fast_pop(value)) {
+            return true;
+        }
+        return slow([&] { return m_queue.pop_for(bytes(value), timeout); });
+    }
+
+    // Close the queue; the handle cannot be used afterwards
+    void close() {
+        m_queue.close();
+        m_fast = false;
+    }
+
+    // The underlying queue, for everything else (stats, notify_fd, grow, ...). Calls on it that move the
+    // handle to another generation are picked up by the next typed call.
+    SMQueue& queue() { return m_queue; }
+    const SMQueue& queue() const { return m_queue; }
+
+  private:
+    using ControlBlock = SMQueue::ControlBlock;
+    using SlotHeader = SMQueue::SlotHeader;
+
+    explicit TypedQueue(SMQueue&& queue) : m_queue(std::move(queue)) { sync(); }
+
+    static const std::byte* bytes(const T& value) { return reinterpret_cast<const std::byte*>(&value); }
+    static std::byte* bytes(T& value) { return reinterpret_cast<std::byte*>(&value); }
+
+    // Cache the layout of the ring the handle currently maps, and whether the inline paths may use it
+    void sync() {
+        m_cb = m_queue.get_control_block();
+        m_fast = false;
+        if (m_cb == nullptr) {
+            return;
+        }
+        m_slots = m_queue.get_slot(0);
+        m_data = m_queue.get_data_buffer();
+        m_block = m_cb->overflow == OverflowPolicy::Block;
+        // A generation grown to another size only takes type-erased calls, which reject the old size
+        m_fast = (m_cb->mode == QueueMode::SPSC or m_cb->mode == QueueMode::MPMC) and !m_cb->stats and
+                 m_cb->latency_offset == 0 and m_cb->max_elements == Capacity and m_cb->element_size == sizeof(T) and
+                 m_cb->slot_stride == sizeof(T);
+    }
+
+    // Run a type-erased call, then pick up the generation it may have moved the handle to
+    template <typename Fn> bool slow(Fn fn) {
+        const bool result = fn();
+        if (m_queue.get_control_block() != m_cb) {
+            sync();
+        }
+        return result;
+    }
+
+    std::byte* element(std::uint64_t pos) const { return m_data + (pos & kMask) * sizeof(T); }
+
+    // Publish without dropping anything, or return false and leave the rest to the SMQueue
+    bool fast_push(const T& value) {
+        if (!m_fast) {
+            return false;
+        }
+        if ((m_queue.m_roles & SMQueue::kRoleProducer) == 0) {
+            m_queue.mark_role(SMQueue::kRoleProducer);
+        }
+
+        if (m_cb->mode == QueueMode::SPSC) {
+            if (m_cb->sealed.load(std::memory_order_acquire) == SMQueue::kSealed) {
+                return false;
+            }
+            const std::uint64_t head = m_cb->head.load(std::memory_order_relaxed);
+            if (head - m_queue.m_cached_tail >= Capacity) {
+                m_queue.m_cached_tail = m_cb->tail.load(std::memory_order_acquire);
+                if (head - m_queue.m_cached_tail >= Capacity) {
+                    return false;
+                }
+            }
+            std::memcpy(element(head), &value, sizeof(T));
+            m_cb->head.store(head + 1, std::memory_order_release);
+        } else {
+            std::uint64_t pos = m_cb->head.load(std::memory_order_relaxed);
+            for (;;) {
+                if ((pos & SMQueue::kHeadSealed) != 0) {
+                    return false;
+                }
+                const std::uint64_t seq = m_slots[pos & kMask].seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::int64_t>(seq - pos);
+                if (diff == 0) {
+                    if (m_cb->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false; // Full: the overflow policy decides
+                } else {
+                    pos = m_cb->head.load(std::memory_order_relaxed);
+                }
+            }
+            std::memcpy(element(pos), &value, sizeof(T));
+            m_slots[pos & kMask].seq.store(pos + 1, std::memory_order_release);
+        }
+
+        m_queue.wake_consumers();
+        return true;
+    }
+
+    // Take the next value, or return false and leave an empty or sealed ring to the SMQueue
+    bool fast_pop(T& value) {
+        if (!m_fast) {
+            return false;
+        }
+        if ((m_queue.m_roles & SMQueue::kRoleConsumer) == 0) {
+            m_queue.mark_role(SMQueue::kRoleConsumer);
+        }
+
+        if (m_cb->mode == QueueMode::SPSC) {
+            const std::uint64_t read = m_cb->read.load(std::memory_order_relaxed);
+            // Outstanding borrows keep tail behind read; releasing around them is the SMQueue's job
+            if (m_cb->tail.load(std::memory_order_relaxed) != read) {
+                return false;
+            }
+            // The cached head falls behind read when another handle consumed since this one last looked
+            if (read >= m_queue.m_cached_head) {
+                m_queue.m_cached_head = m_cb->head.load(std::memory_order_acquire);
+                if (read == m_queue.m_cached_head) {
+                    return false;
+                }
+            }
+            std::memcpy(&value, element(read), sizeof(T));
+            m_cb->read.store(read + 1, std::memory_order_relaxed);
+            m_cb->tail.store(read + 1, std::memory_order_release);
+        } else {
+            std::uint64_t pos = m_cb->tail.load(std::memory_order_relaxed);
+            for (;;) {
+                const std::uint64_t seq = m_slots[pos & kMask].seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::int64_t>(seq - (pos + 1));
+                if (diff == 0) {
+                    if (m_cb->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false; // Empty, or the next message is still being written
+                } else {
+                    pos = m_cb->tail.load(std::memory_order_relaxed);
+                }
+            }
+            std::memcpy(&value, element(pos), sizeof(T));
+            m_slots[pos & kMask].seq.store(pos + Capacity, std::memory_order_release);
+        }
+
+        if (m_block) {
+            m_queue.wake_producers();
+        }
+        return true;
+    }
+
+    SMQueue m_queue;
+    ControlBlock* m_cb = nullptr;    // Control block of the mapped generation
+    SlotHeader* m_slots = nullptr;   // Its slot headers
+    std::byte* m_data = nullptr;     // Its data buffer
+    bool m_fast = false;             // Whether push and pop may take the inline paths
+    bool m_block = false;            // Whether the queue's overflow policy is Block
+};
+
+} // namespace shmem
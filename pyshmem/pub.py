@@ -12,7 +12,7 @@ from typing import Optional, Any
 import atexit
 
 # Import the SMQueue class from our package
-from shmem import SMQueue
+from shmem import SMQueue, ThreadPlacement
 
 # Constants
 QUEUE_NAME = "/my_queue_example_2"
@@ -49,6 +49,14 @@ def main() -> None:
         "--delay", "-d", type=float, default=0.1, 
         help="Delay between messages in seconds (default: 0.1)"
     )
+    parser.add_argument(
+        "--pin", nargs="?", type=int, const=-1, default=None, metavar="CPU",
+        help="Pin the publisher to a CPU (default: one near the queue's memory and the other pinned handles)"
+    )
+    parser.add_argument(
+        "--realtime", type=int, default=0, metavar="PRIORITY",
+        help="Run the publisher under SCHED_FIFO at this priority (needs CAP_SYS_NICE)"
+    )
     args = parser.parse_args()
 
     # Check for cleanup flag
@@ -71,6 +79,15 @@ def main() -> None:
         # Create queue with fixed-size messages
         queue = SMQueue.create(QUEUE_NAME, MAX_ELEMENTS, MESSAGE_SIZE)
 
+        # Keep the publisher on one CPU so the scheduler does not move it between messages
+        if args.pin is not None or args.realtime > 0:
+            placement = ThreadPlacement()
+            placement.pin = args.pin is not None
+            placement.cpu = args.pin if args.pin is not None else -1
+            placement.realtime = args.realtime > 0
+            placement.priority = max(args.realtime, 1)
+            print(f"Publisher placed on CPU {queue.place_thread(placement)}")
+
         counter = 0
         print("Publisher started. Press Ctrl+C to stop.")
         print(f"Message size: {MESSAGE_SIZE} bytes, Max elements: {MAX_ELEMENTS}")
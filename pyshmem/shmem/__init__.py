@@ -11,7 +11,70 @@ except ImportError:
             "Failed to import cyshmem module. Make sure it's compiled and in the Python path."
         )
 
+import asyncio
+from typing import Optional
+
 # Import the SMQueue class from the extension module
 SMQueue = cyshmem.SMQueue
+QueueMode = cyshmem.QueueMode
+QueueOptions = cyshmem.QueueOptions
+OpenOptions = cyshmem.OpenOptions
+OverflowPolicy = cyshmem.OverflowPolicy
+SyncPrimitives = cyshmem.SyncPrimitives
+SlotLayout = cyshmem.SlotLayout
+NumaPolicy = cyshmem.NumaPolicy
+QueueStats = cyshmem.QueueStats
+LatencyStats = cyshmem.LatencyStats
+Participant = cyshmem.Participant
+ThreadPlacement = cyshmem.ThreadPlacement
+Mailbox = cyshmem.Mailbox
+QueueSet = cyshmem.QueueSet
+wait_any = cyshmem.wait_any
+CopyPolicy = cyshmem.CopyPolicy
+CopyStrategy = cyshmem.CopyStrategy
+copy_into = cyshmem.copy_into
+stream_kernel = cyshmem.stream_kernel
+
+
+async def async_pop(queue: SMQueue, timeout: Optional[float] = None):
+    """
+    Pop a message without blocking the event loop.
+
+    Waits on queue.notify_fd() through the running loop, so no thread polls the queue. A handle supports
+    one pending async_pop at a time.
+
+    Args:
+        queue: The queue to pop from.
+        timeout: Seconds to wait for a message, or None to wait forever.
+
+    Returns:
+        The message as a numpy array, or None on timeout.
+    """
+    loop = asyncio.get_running_loop()
+    fd = queue.notify_fd()
+    deadline = None if timeout is None else loop.time() + timeout
+
+    while True:
+        # Clear before checking so a message published after the check leaves the descriptor readable
+        queue.clear_notify()
+        message = queue.try_pop_np()
+        if message is not None:
+            return message
+
+        remaining = None if deadline is None else deadline - loop.time()
+        if remaining is not None and remaining <= 0:
+            return None
+
+        readable = loop.create_future()
+        loop.add_reader(fd, lambda: readable.done() or readable.set_result(None))
+        try:
+            await asyncio.wait_for(readable, remaining)
+        except asyncio.TimeoutError:
+            pass
+        finally:
+            loop.remove_reader(fd)
 
-__all__ = ["SMQueue"] 
\ No newline at end of file
+__all__ = ["SMQueue", "QueueMode", "QueueOptions", "OpenOptions", "OverflowPolicy", "SyncPrimitives", "SlotLayout", "NumaPolicy", "Mailbox", "QueueSet", "wait_any",
+           "QueueStats", "LatencyStats", "Participant", "ThreadPlacement",
+           "CopyPolicy", "CopyStrategy", "copy_into", "stream_kernel",
+           "async_pop"] 
\ No newline at end of file
@@ -3,6 +3,7 @@
 Subscriber implementation for the shmem library using NumPy arrays.
 """
 
+import argparse
 import sys
 import time
 import numpy as np
@@ -11,7 +12,7 @@ from typing import Optional, Tuple, Any
 import re
 
 # Import the SMQueue class from our package
-from shmem import SMQueue
+from shmem import SMQueue, OpenOptions, ThreadPlacement
 
 # Constants
 QUEUE_NAME = "/my_queue_example_2"
@@ -57,9 +58,29 @@ def main() -> None:
     """Main function for the subscriber."""
     global running, queue
 
+    parser = argparse.ArgumentParser(
+        description="Shared memory subscriber using NumPy arrays"
+    )
+    parser.add_argument(
+        "--pin", nargs="?", type=int, const=-1, default=None, metavar="CPU",
+        help="Pin the subscriber to a CPU (default: one near the queue's memory and the other pinned handles)"
+    )
+    parser.add_argument(
+        "--realtime", type=int, default=0, metavar="PRIORITY",
+        help="Run the subscriber under SCHED_FIFO at this priority (needs CAP_SYS_NICE)"
+    )
+    args = parser.parse_args()
+
     try:
-        # Open existing queue
-        queue = SMQueue.open(QUEUE_NAME)
+        # Open existing queue, pinned next to the publisher if asked
+        options = OpenOptions()
+        placement = ThreadPlacement()
+        placement.pin = args.pin is not None
+        placement.cpu = args.pin if args.pin is not None else -1
+        placement.realtime = args.realtime > 0
+        placement.priority = max(args.realtime, 1)
+        options.placement = placement
+        queue = SMQueue.open(QUEUE_NAME, options)
         print("Subscriber started. Press Ctrl+C to stop.")
         print(
             f"Element size: {queue.element_size()} bytes, Max elements: {queue.max_elements()}"
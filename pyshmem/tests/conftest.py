@@ -0,0 +1,42 @@
+"""
+Fixtures and helpers shared by the shmem tests.
+"""
+
+import os
+from typing import Iterator, List
+
+import numpy as np
+import pytest
+
+from shmem import SMQueue
+
+
+def message(value: int) -> np.ndarray:
+    """A one-element uint64 message."""
+    return np.array([value], dtype=np.uint64)
+
+
+def value_of(array: np.ndarray) -> int:
+    """Value of a message returned by pop or borrow."""
+    return int(np.asarray(array).view(np.uint64)[0])
+
+
+def drain(queue: SMQueue) -> List[int]:
+    """Pop every message left in the queue."""
+    values = []
+    while True:
+        array = queue.try_pop_np()
+        if array is None:
+            return values
+        values.append(value_of(array))
+
+
+@pytest.fixture
+def queue_name(request: pytest.FixtureRequest) -> Iterator[str]:
+    """A queue name of the test's own module (e.g. /test_queue_<pid> for test_queue.py). The queue is
+    destroyed before and after the test, so every test starts without a leftover queue."""
+    module = request.module.__name__.rsplit(".", 1)[-1]
+    name = f"/{module}_{os.getpid()}"
+    SMQueue.destroy(name)
+    yield name
+    SMQueue.destroy(name)
@@ -15,7 +15,7 @@ from numpy.typing import NDArray
 import pytest
 
 # Import the SMQueue class from our package
-from shmem import SMQueue
+from shmem import SMQueue, CopyPolicy, CopyStrategy, copy_into, stream_kernel
 
 # Constants
 QUEUE_NAME = "/test_perf_queue"
@@ -73,6 +73,55 @@ def benchmark_raw_memcpy_bandwidth(buffer_size_bytes: int, iterations: int = 100
     return bandwidth_gb_per_sec
 
 
+def benchmark_copy_kernel_bandwidth(
+    strategy: CopyStrategy, buffer_size_bytes: int, iterations: int = 100
+) -> float:
+    """
+    Benchmarks one of the queue's copy kernels on the same buffers as benchmark_raw_memcpy_bandwidth.
+
+    Args:
+        strategy: The copy strategy a queue handle would use.
+        buffer_size_bytes: The size of the buffer to copy in bytes.
+        iterations: The number of times to perform the copy.
+
+    Returns:
+        The calculated bandwidth in GB/s, or 0.0 if calculation is not reliable.
+    """
+    source_buffer = np.ones(buffer_size_bytes, dtype=np.uint8)
+    dest_buffer = np.zeros(buffer_size_bytes, dtype=np.uint8)
+
+    # Warm-up copy, which also starts the worker threads of parallel copies
+    copy_into(dest_buffer, source_buffer, strategy)
+    assert np.array_equal(dest_buffer, source_buffer), f"{strategy.policy} copy corrupted the buffer"
+
+    start_time = time.perf_counter()
+    for _ in range(iterations):
+        copy_into(dest_buffer, source_buffer, strategy)
+    total_time_seconds = time.perf_counter() - start_time
+
+    if total_time_seconds <= 1e-9:
+        return 0.0
+    return (buffer_size_bytes * iterations) / (1024 * 1024 * 1024) / total_time_seconds
+
+
+def test_copy_kernels() -> None:
+    """Compare each copy kernel with raw memcpy bandwidth on MESSAGE_SIZE buffers."""
+    iterations = 100
+    raw_bandwidth_gbps = benchmark_raw_memcpy_bandwidth(MESSAGE_SIZE, iterations=iterations)
+
+    print(f"\n=== Copy Kernels ({MESSAGE_SIZE / (1024*1024):.0f}MB x {iterations} iterations) ===")
+    print(f"Raw memcpy: {raw_bandwidth_gbps:.3f} GB/s")
+    for policy in (CopyPolicy.Memcpy, CopyPolicy.Streaming, CopyPolicy.Parallel):
+        strategy = CopyStrategy()
+        strategy.policy = policy
+        bandwidth_gbps = benchmark_copy_kernel_bandwidth(strategy, MESSAGE_SIZE, iterations=iterations)
+        name = f"{policy.name} ({stream_kernel()})" if policy != CopyPolicy.Memcpy else policy.name
+        if raw_bandwidth_gbps > 0:
+            print(f"{name}: {bandwidth_gbps:.3f} GB/s ({bandwidth_gbps / raw_bandwidth_gbps * 100:.1f}% of raw memcpy)")
+        else:
+            print(f"{name}: {bandwidth_gbps:.3f} GB/s")
+
+
 def publisher_process(min_delay_ms: int = 1, max_delay_ms: int = 100) -> None:
     """
     Publisher process function.
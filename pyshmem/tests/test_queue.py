@@ -0,0 +1,413 @@
+#!/usr/bin/env python3
+"""
+Behaviour tests for the shmem queue modes.
+"""
+
+import threading
+import time
+from typing import List
+
+import numpy as np
+import pytest
+
+from shmem import OpenOptions, OverflowPolicy, QueueMode, QueueOptions, SMQueue
+
+from .conftest import drain, message, value_of
+
+MAX_ELEMENTS = 4
+
+# Modes whose consumers can borrow messages
+BORROW_MODES = [QueueMode.Locked, QueueMode.SPSC, QueueMode.MPMC]
+
+# Modes that store variable-size records
+VARIABLE_MODES = [QueueMode.Locked, QueueMode.SPSC]
+MAX_LENGTH = 32
+
+
+def fill(queue: SMQueue) -> int:
+    """Push messages until the queue refuses one; returns how many it took. The queue must not drop its
+    oldest message to make room."""
+    pushed = 0
+    while queue.push(message(100 + pushed)):
+        pushed += 1
+    return pushed
+
+
+def make_queue(name: str, mode: QueueMode, overflow: OverflowPolicy = OverflowPolicy.DropOldest,
+               max_elements: int = MAX_ELEMENTS, element_size: int = 8) -> SMQueue:
+    options = QueueOptions()
+    options.mode = mode
+    options.overflow = overflow
+    return SMQueue.create(name, max_elements, element_size, options)
+
+
+def payload(length: int, seed: int) -> np.ndarray:
+    """A message of length bytes whose contents depend on seed."""
+    return ((np.arange(length) + seed) % 256).astype(np.uint8)
+
+
+def make_variable_queue(name: str, mode: QueueMode) -> SMQueue:
+    options = QueueOptions()
+    options.mode = mode
+    options.overflow = OverflowPolicy.DropNewest
+    options.variable_size = True
+    return SMQueue.create(name, MAX_ELEMENTS, MAX_LENGTH, options)
+
+
+@pytest.mark.parametrize("mode", VARIABLE_MODES)
+def test_variable_lengths(queue_name: str, mode: QueueMode) -> None:
+    """Messages of a variable-size queue come back with the length they were pushed with."""
+    queue = make_variable_queue(queue_name, mode)
+    for seed, length in enumerate([1, 7, 8, MAX_LENGTH]):
+        assert queue.push(payload(length, seed))
+    with pytest.raises(RuntimeError):
+        queue.push(payload(MAX_LENGTH + 1, 0))
+
+    assert np.array_equal(queue.try_pop_np(), payload(1, 0))
+    borrowed = queue.borrow_np()
+    assert np.array_equal(borrowed, payload(7, 1))
+    del borrowed
+
+    buffer = np.zeros(MAX_LENGTH, dtype=np.uint8)
+    assert queue.try_pop_into_len(buffer) == 8
+    assert np.array_equal(buffer[:8], payload(8, 2))
+    assert np.array_equal(queue.pop_np(), payload(MAX_LENGTH, 3))
+    assert queue.try_pop_np() is None
+
+
+@pytest.mark.parametrize("mode", VARIABLE_MODES)
+def test_variable_ring_wraps(queue_name: str, mode: QueueMode) -> None:
+    """Records of mixed lengths survive many trips around the ring, padding records at the wrap point
+    included."""
+    queue = make_variable_queue(queue_name, mode)
+    lengths = [3, 20, MAX_LENGTH, 11, 17]
+    pushed = popped = 0
+    for _ in range(200):
+        while pushed - popped < 3:
+            assert queue.push(payload(lengths[pushed % len(lengths)], pushed))
+            pushed += 1
+
+        # Alternate between zero-copy views and copies
+        array = queue.borrow_np() if popped % 3 == 0 else queue.try_pop_np()
+        assert np.array_equal(array, payload(lengths[popped % len(lengths)], popped))
+        del array
+        popped += 1
+
+
+@pytest.mark.parametrize("mode", VARIABLE_MODES)
+def test_variable_capacity_at_any_offset(queue_name: str, mode: QueueMode) -> None:
+    """max_elements messages of the maximum length fit wherever the ring currently wraps."""
+    queue = make_variable_queue(queue_name, mode)
+    for shift in range(12):
+        # Move the write position on by a record of another size
+        assert queue.push(payload(1 + shift, shift))
+        assert queue.try_pop_np() is not None
+
+        for seed in range(MAX_ELEMENTS):
+            assert queue.push(payload(MAX_LENGTH, seed))
+        for seed in range(MAX_ELEMENTS):
+            assert np.array_equal(queue.try_pop_np(), payload(MAX_LENGTH, seed))
+        assert queue.try_pop_np() is None
+
+
+@pytest.mark.parametrize("mode", VARIABLE_MODES)
+def test_variable_pop_batch_lengths(queue_name: str, mode: QueueMode) -> None:
+    """pop_batch_np on a variable-size queue returns the rows together with each message's length."""
+    queue = make_variable_queue(queue_name, mode)
+    lengths = [5, MAX_LENGTH, 1]
+    for seed, length in enumerate(lengths):
+        assert queue.push(payload(length, seed))
+
+    rows, popped = queue.pop_batch_np(1000)
+    assert rows.shape == (len(lengths), MAX_LENGTH)
+    assert list(popped) == lengths
+    for seed, length in enumerate(lengths):
+        assert np.array_equal(rows[seed, :length], payload(length, seed))
+
+    rows, popped = queue.pop_batch_np(8, block=False)
+    assert rows.shape == (0, MAX_LENGTH) and len(popped) == 0
+    with pytest.raises(RuntimeError):
+        queue.pop_batch_np(2**62)
+
+
+@pytest.mark.parametrize("mode", BORROW_MODES)
+def test_borrows_released_out_of_order(queue_name: str, mode: QueueMode) -> None:
+    """Several messages can be borrowed at once; slots return to producers oldest first."""
+    queue = make_queue(queue_name, mode, OverflowPolicy.DropNewest)
+    for i in range(MAX_ELEMENTS):
+        assert queue.push(message(i))
+
+    first, second, third = queue.borrow_np(), queue.borrow_np(), queue.borrow_np()
+    assert [value_of(first), value_of(second), value_of(third)] == [0, 1, 2]
+
+    # Releasing the newest borrow frees nothing while older ones are still out
+    del third
+    assert fill(queue) == 0
+
+    # Releasing the oldest hands its slot back
+    del first
+    assert fill(queue) == 1
+
+    # Releasing the one in between hands back its slot and the one released earlier
+    del second
+    assert fill(queue) == 2
+
+    assert drain(queue) == [3, 100, 100, 101]
+
+
+@pytest.mark.parametrize("mode", BORROW_MODES)
+@pytest.mark.parametrize("overflow", [OverflowPolicy.DropOldest, OverflowPolicy.DropNewest, OverflowPolicy.Block])
+def test_push_refused_over_borrowed_slot(queue_name: str, mode: QueueMode, overflow: OverflowPolicy) -> None:
+    """A borrowed slot is never overwritten, whatever the overflow policy."""
+    queue = make_queue(queue_name, mode, overflow)
+    for i in range(MAX_ELEMENTS):
+        assert queue.push(message(i))
+
+    pinned = queue.borrow_np()
+    assert value_of(pinned) == 0
+    if overflow == OverflowPolicy.Block:
+        assert not queue.push_for(message(99), 0.05)
+    else:
+        assert not queue.push(message(99))
+    assert not queue.try_push(message(99))
+    assert value_of(pinned) == 0
+
+    assert drain(queue) == [1, 2, 3]
+    del pinned
+    assert queue.push(message(4))
+    assert drain(queue) == [4]
+
+
+@pytest.mark.parametrize("mode", BORROW_MODES)
+def test_drop_oldest(queue_name: str, mode: QueueMode) -> None:
+    """DropOldest discards the oldest message; SPSC producers cannot, and drop the newest instead."""
+    queue = make_queue(queue_name, mode, OverflowPolicy.DropOldest)
+    for i in range(MAX_ELEMENTS):
+        assert queue.push(message(i))
+    assert not queue.push(message(MAX_ELEMENTS))
+
+    expected = list(range(MAX_ELEMENTS)) if mode == QueueMode.SPSC else list(range(1, MAX_ELEMENTS + 1))
+    assert drain(queue) == expected
+
+
+@pytest.mark.parametrize("mode", BORROW_MODES)
+def test_drop_newest(queue_name: str, mode: QueueMode) -> None:
+    """DropNewest leaves a full queue untouched."""
+    queue = make_queue(queue_name, mode, OverflowPolicy.DropNewest)
+    for i in range(MAX_ELEMENTS):
+        assert queue.push(message(i))
+    assert not queue.push(message(MAX_ELEMENTS))
+    assert drain(queue) == list(range(MAX_ELEMENTS))
+
+
+def test_spsc_consumer_handoff(queue_name: str) -> None:
+    """An SPSC consumer handle that was idle while another handle consumed picks up where that one stopped."""
+    first = make_queue(queue_name, QueueMode.SPSC)
+    second = SMQueue.open(queue_name)
+    assert first.push(message(0))
+    assert value_of(first.try_pop_np()) == 0
+
+    for i in range(1, 3):
+        assert first.push(message(i))
+    assert drain(second) == [1, 2]
+    assert first.try_pop_np() is None
+
+    assert first.push(message(3))
+    assert drain(first) == [3]
+
+
+def test_spsc_batch_consumer_handoff(queue_name: str) -> None:
+    """Batch pops and borrows of an SPSC handle that was idle while another handle consumed see only new
+    messages."""
+    first = make_queue(queue_name, QueueMode.SPSC)
+    second = SMQueue.open(queue_name)
+    assert first.push(message(0))
+    assert len(first.pop_batch_np(MAX_ELEMENTS, block=False)) == 1
+
+    for i in range(1, 3):
+        assert first.push(message(i))
+    assert drain(second) == [1, 2]
+    assert len(first.pop_batch_np(MAX_ELEMENTS, block=False)) == 0
+    assert first.borrow_batch_np(MAX_ELEMENTS) is None
+
+    assert first.push(message(3))
+    rows = first.borrow_batch_np(MAX_ELEMENTS)
+    assert [int(v) for v in np.asarray(rows).view(np.uint64).ravel()] == [3]
+
+
+@pytest.mark.parametrize("mode", BORROW_MODES)
+def test_block(queue_name: str, mode: QueueMode) -> None:
+    """Block never drops: push_for times out, and push waits until a consumer makes room."""
+    queue = make_queue(queue_name, mode, OverflowPolicy.Block)
+    for i in range(MAX_ELEMENTS):
+        assert queue.push(message(i))
+
+    start = time.perf_counter()
+    assert not queue.push_for(message(99), 0.05)
+    assert time.perf_counter() - start >= 0.04
+    assert not queue.try_push(message(99))
+
+    consumer = SMQueue.open(queue_name)
+    popped: List[int] = []
+
+    def pop_later() -> None:
+        time.sleep(0.1)
+        popped.append(value_of(consumer.pop_for_np(1.0)))
+
+    thread = threading.Thread(target=pop_later)
+    thread.start()
+    assert queue.push(message(MAX_ELEMENTS))
+    thread.join()
+
+    assert popped == [0]
+    assert drain(consumer) == list(range(1, MAX_ELEMENTS + 1))
+
+
+def test_mpmc_order_under_concurrency(queue_name: str) -> None:
+    """Every message arrives exactly once, and each consumer sees each producer's messages in order."""
+    producers, consumers, count = 2, 2, 5000
+    queue = make_queue(queue_name, QueueMode.MPMC, OverflowPolicy.DropNewest, max_elements=64, element_size=16)
+    received: List[List[np.ndarray]] = [[] for _ in range(consumers)]
+    done = threading.Event()
+
+    def produce(producer: int) -> None:
+        handle = SMQueue.open(queue_name)
+        for sequence in range(count):
+            # A full queue refuses the message: offer it again until a consumer makes room
+            while not handle.push(np.array([producer, sequence], dtype=np.uint64)):
+                pass
+
+    def consume(consumer: int) -> None:
+        handle = SMQueue.open(queue_name)
+        while True:
+            array = handle.try_pop_np()
+            if array is not None:
+                received[consumer].append(np.asarray(array).view(np.uint64).copy())
+            elif done.is_set():
+                return
+
+    consumer_threads = [threading.Thread(target=consume, args=(c,)) for c in range(consumers)]
+    producer_threads = [threading.Thread(target=produce, args=(p,)) for p in range(producers)]
+    for thread in consumer_threads + producer_threads:
+        thread.start()
+    for thread in producer_threads:
+        thread.join()
+    done.set()
+    for thread in consumer_threads:
+        thread.join()
+
+    seen = {producer: [] for producer in range(producers)}
+    for messages in received:
+        last = {producer: -1 for producer in range(producers)}
+        for producer, sequence in (map(int, m) for m in messages):
+            assert sequence > last[producer], f"producer {producer}: {sequence} after {last[producer]}"
+            last[producer] = sequence
+            seen[producer].append(sequence)
+
+    for producer in range(producers):
+        assert sorted(seen[producer]) == list(range(count))
+    assert queue.try_pop_np() is None
+
+
+def test_broadcast_every_reader_sees_every_message(queue_name: str) -> None:
+    """Each reader gets every message pushed after it opened; the writer cannot pop, nor readers borrow."""
+    writer = make_queue(queue_name, QueueMode.Broadcast, max_elements=8)
+    assert writer.push(message(100))
+    first, second = SMQueue.open(queue_name), SMQueue.open(queue_name)
+    for i in range(5):
+        assert writer.push(message(i))
+    assert drain(first) == list(range(5))
+    assert drain(second) == list(range(5))
+
+    late = SMQueue.open(queue_name)
+    assert writer.push(message(5))
+    assert drain(late) == [5]
+    assert drain(first) == [5]
+    assert drain(second) == [5]
+    assert first.overruns() == 0
+
+    with pytest.raises(RuntimeError):
+        writer.try_pop_np()
+    with pytest.raises(RuntimeError):
+        first.borrow_np()
+
+
+def test_broadcast_lapped_reader_counts_overruns(queue_name: str) -> None:
+    """A reader lapped by the writer skips to the oldest message left in the ring and counts the rest."""
+    writer = make_queue(queue_name, QueueMode.Broadcast, max_elements=8)
+    reader = SMQueue.open(queue_name)
+    for i in range(20):
+        assert writer.push(message(i))
+
+    assert drain(reader) == list(range(12, 20))
+    assert reader.overruns() == 12
+
+
+def test_broadcast_rewind(queue_name: str) -> None:
+    """Readers opened with rewind start at the oldest message still in the ring instead of the newest."""
+    writer = make_queue(queue_name, QueueMode.Broadcast)
+    early = SMQueue.open(queue_name)
+    rewind = OpenOptions()
+    rewind.rewind = True
+
+    for i in range(2):
+        assert writer.push(message(i))
+    rewound = SMQueue.open(queue_name, rewind)
+    assert drain(rewound) == [0, 1]
+
+    # Once the ring has wrapped, a rewound reader starts at the oldest message the ring still holds
+    for i in range(2, 6):
+        assert writer.push(message(i))
+    late = SMQueue.open(queue_name)
+    wrapped = SMQueue.open(queue_name, rewind)
+    assert drain(late) == []
+    assert drain(wrapped) == [2, 3, 4, 5]
+    assert wrapped.overruns() == 0
+    assert drain(rewound) == [2, 3, 4, 5]
+
+    assert writer.push(message(6))
+    assert drain(late) == [6]
+    assert drain(early) == [3, 4, 5, 6]
+    assert early.overruns() == 3
+
+
+@pytest.mark.parametrize("mode", BORROW_MODES)
+def test_grow_twice_under_load(queue_name: str, mode: QueueMode) -> None:
+    """A ring grown twice while a consumer pops loses and reorders nothing, and the call in which the
+    consumer moves to a larger element size returns without a message."""
+    count = 6000
+    first_grow, second_grow = count // 3, 2 * count // 3
+    producer = make_queue(queue_name, mode, OverflowPolicy.DropNewest, max_elements=16)
+    received: List[np.ndarray] = []
+    empty_at: List[int] = []
+    generations: List[int] = []
+
+    def consume() -> None:
+        handle = SMQueue.open(queue_name)
+        deadline = time.monotonic() + 60
+        while len(received) < count and time.monotonic() < deadline:
+            array = handle.pop_for_np(1.0)
+            if array is None:
+                empty_at.append(len(received))
+            else:
+                received.append(np.asarray(array).copy())
+        generations.append(handle.generation())
+
+    consumer = threading.Thread(target=consume)
+    consumer.start()
+    for sequence in range(count):
+        if sequence == first_grow:
+            producer.grow(64, 8)
+        elif sequence == second_grow:
+            producer.grow(256, 16)
+        payload = np.zeros(producer.element_size(), dtype=np.uint8)
+        payload[:8] = message(sequence).view(np.uint8)
+        # A full queue refuses the message: offer it again until the consumer makes room
+        while not producer.push(payload):
+            pass
+    consumer.join()
+
+    assert generations == [2] and producer.generation() == 2
+    assert [value_of(array) for array in received] == list(range(count))
+    assert [array.nbytes for array in received] == [8] * second_grow + [16] * (count - second_grow)
+    assert second_grow in empty_at
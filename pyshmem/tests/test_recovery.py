@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""
+Crash-recovery tests: a child process is killed while using the queue, and a recovering open repairs it.
+"""
+
+import os
+import signal
+from typing import Callable
+
+import pytest
+
+from shmem import OpenOptions, QueueMode, QueueOptions, SMQueue
+
+from .conftest import drain, message
+
+MAX_ELEMENTS = 4
+
+
+def die_in_child(queue_name: str, action: Callable[[SMQueue], None]) -> None:
+    """Fork a child that opens the queue, runs action on it and is killed with SIGKILL while it still holds
+    whatever action took."""
+    pid = os.fork()
+    if pid == 0:
+        try:
+            queue = SMQueue.open(queue_name)
+            action(queue)
+            os.kill(os.getpid(), signal.SIGKILL)
+        finally:
+            os._exit(1)
+
+    _, status = os.waitpid(pid, 0)
+    assert os.WIFSIGNALED(status) and os.WTERMSIG(status) == signal.SIGKILL
+
+
+def reopen(queue_name: str) -> SMQueue:
+    options = OpenOptions()
+    options.recover = True
+    return SMQueue.open(queue_name, options)
+
+
+@pytest.mark.parametrize("mode", [QueueMode.Locked, QueueMode.SPSC, QueueMode.MPMC])
+def test_borrows_of_dead_consumer_requeued(queue_name: str, mode: QueueMode) -> None:
+    """Messages a killed consumer had borrowed are delivered again, and their slots are usable."""
+    options = QueueOptions()
+    options.mode = mode
+    queue = SMQueue.create(queue_name, MAX_ELEMENTS, 8, options)
+    for i in range(3):
+        assert queue.push(message(i))
+
+    def borrow_two(child: SMQueue) -> None:
+        assert child.borrow_np() is not None
+        assert child.borrow_np() is not None
+
+    die_in_child(queue_name, borrow_two)
+
+    # MPMC rings are only rebuilt once no other handle is open; the others only need no live consumer
+    if mode == QueueMode.MPMC:
+        queue.close()
+    recovered = reopen(queue_name)
+    assert drain(recovered) == [0, 1, 2]
+
+    for i in range(MAX_ELEMENTS):
+        assert recovered.push(message(10 + i))
+    assert drain(recovered) == [10, 11, 12, 13]
+
+
+def test_robust_mutex_of_dead_producer_usable(queue_name: str) -> None:
+    """A producer killed between reserve and publish leaves the mutex held; the queue stays usable."""
+    options = QueueOptions()
+    options.mode = QueueMode.Locked
+    options.robust = True
+    queue = SMQueue.create(queue_name, MAX_ELEMENTS, 8, options)
+    for i in range(3):
+        assert queue.push(message(i))
+
+    # On Locked queues the mutex stays held from reserve until publish
+    die_in_child(queue_name, lambda child: child.reserve_np())
+
+    # The unpublished reservation is dropped, and both handles can take the mutex again
+    recovered = reopen(queue_name)
+    assert drain(recovered) == [0, 1, 2]
+    assert recovered.push(message(7))
+    assert queue.push(message(8))
+    assert drain(recovered) == [7, 8]
+    assert drain(queue) == []